@@ -0,0 +1,179 @@
+/*!
+ \file lj/Arena.cpp
+ \brief LJ arena allocator implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lj/Arena.h"
+#include "lj/Wiper.h"
+#include <algorithm>
+
+namespace
+{
+    //! The arena used by acquire() on the current thread, if any.
+    thread_local lj::Arena* t_arena = nullptr;
+
+    // Every acquire() allocation is prefixed with the arena it came from.
+    // nullptr marks heap memory.
+    const size_t k_header = lj::Arena::k_alignment;
+
+    static_assert(sizeof(lj::Arena*) <= k_header,
+            "Arena header is too small.");
+
+    inline size_t round_up(size_t sz)
+    {
+        return (sz + lj::Arena::k_alignment - 1) & ~(lj::Arena::k_alignment - 1);
+    }
+}; // namespace (anonymous)
+
+namespace lj
+{
+    Arena::Scope::Scope(Arena& arena) : previous_(t_arena)
+    {
+        t_arena = &arena;
+    }
+
+    Arena::Scope::Scope(Arena* arena) : previous_(t_arena)
+    {
+        t_arena = arena;
+    }
+
+    Arena::Scope::~Scope()
+    {
+        t_arena = previous_;
+    }
+
+    Arena::Arena(size_t block_size) :
+            block_size_(block_size),
+            size_(0),
+            blocks_()
+    {
+    }
+
+    Arena::~Arena()
+    {
+        release();
+        for (auto& block : blocks_)
+        {
+            delete[] block.data;
+        }
+    }
+
+    void* Arena::allocate(size_t sz)
+    {
+        sz = round_up(sz ? sz : 1);
+        if (blocks_.empty() || blocks_.back().size - blocks_.back().used < sz)
+        {
+            Block block;
+            block.size = std::max(sz, block_size_);
+            block.data = new uint8_t[block.size];
+            block.used = 0;
+            blocks_.push_back(block);
+        }
+
+        Block& block = blocks_.back();
+        void* ptr = block.data + block.used;
+        block.used += sz;
+        size_ += sz;
+        return ptr;
+    }
+
+    void Arena::release()
+    {
+        for (auto& block : blocks_)
+        {
+            lj::Wiper<uint8_t[]>::wipe(block.data, block.used);
+            block.used = 0;
+        }
+        while (blocks_.size() > 1)
+        {
+            delete[] blocks_.back().data;
+            blocks_.pop_back();
+        }
+        size_ = 0;
+    }
+
+    size_t Arena::size() const
+    {
+        return size_;
+    }
+
+    size_t Arena::capacity() const
+    {
+        size_t total = 0;
+        for (auto& block : blocks_)
+        {
+            total += block.size;
+        }
+        return total;
+    }
+
+    Arena* Arena::current()
+    {
+        return t_arena;
+    }
+
+    void* Arena::acquire(size_t sz)
+    {
+        uint8_t* ptr;
+        if (t_arena)
+        {
+            ptr = static_cast<uint8_t*>(t_arena->allocate(sz + k_header));
+        }
+        else
+        {
+            ptr = static_cast<uint8_t*>(::operator new(sz + k_header));
+        }
+        *reinterpret_cast<Arena**>(ptr) = t_arena;
+        return ptr + k_header;
+    }
+
+    void Arena::dispose(void* ptr)
+    {
+        if (!ptr)
+        {
+            return;
+        }
+        uint8_t* base = static_cast<uint8_t*>(ptr) - k_header;
+        if (!*reinterpret_cast<Arena**>(base))
+        {
+            ::operator delete(base);
+        }
+    }
+
+    Arena* Arena::owner(const void* ptr)
+    {
+        const uint8_t* base = static_cast<const uint8_t*>(ptr) - k_header;
+        return *reinterpret_cast<Arena* const*>(base);
+    }
+}; // namespace lj
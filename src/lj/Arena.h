@@ -0,0 +1,260 @@
+#pragma once
+/*!
+ \file lj/Arena.h
+ \brief LJ arena allocator header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace lj
+{
+    /*!
+     \brief Monotonic memory arena.
+
+     Memory is handed out from large blocks by bumping an offset, so a
+     tree of small objects costs a handful of block allocations instead of
+     one allocation per object. Individual allocations are never returned
+     to the arena; everything is released at once by release() or the
+     destructor. Released memory is overwritten with zeros before it is
+     reused or returned to the system, matching the lj::Wiper guarantee.
+
+     Objects allocated through acquire() while an Arena::Scope is active
+     on the current thread are placed in that arena. Those objects must
+     not outlive the arena.
+     \since 1.0
+     */
+    class Arena
+    {
+    public:
+        //! Default size of each block.
+        static const size_t k_default_block_size = 64 * 1024;
+
+        //! Alignment of every allocation.
+        static const size_t k_alignment = alignof(void*);
+
+        /*!
+         \brief Scoped activation of an arena.
+
+         While the scope exists, acquire() on the current thread allocates
+         from the arena. Scopes nest; the previous arena is restored when
+         the scope is destroyed.
+         */
+        class Scope
+        {
+        public:
+            //! Make \c arena the current arena for this thread.
+            explicit Scope(Arena& arena);
+
+            //! Make \c arena the current arena, or use the heap if nullptr.
+            explicit Scope(Arena* arena);
+            Scope(const Scope& o) = delete;
+            Scope(Scope&& o) = delete;
+            Scope& operator=(const Scope& rhs) = delete;
+            Scope& operator=(Scope&& rhs) = delete;
+
+            //! Restore the previous arena.
+            ~Scope();
+        private:
+            Arena* previous_;
+        }; // class lj::Arena::Scope
+
+        //! Create a new arena.
+        /*!
+         No memory is allocated until the first allocation.
+         \param block_size The size of each block.
+         */
+        explicit Arena(size_t block_size = k_default_block_size);
+        Arena(const Arena& o) = delete;
+        Arena(Arena&& o) = delete;
+        Arena& operator=(const Arena& rhs) = delete;
+        Arena& operator=(Arena&& rhs) = delete;
+
+        //! Destructor.
+        /*!
+         Wipes and frees every block.
+         */
+        ~Arena();
+
+        //! Allocate memory from the arena.
+        /*!
+         Requests larger than the block size get a block of their own.
+         \param sz The number of bytes.
+         \return Pointer aligned to k_alignment.
+         */
+        void* allocate(size_t sz);
+
+        //! Release everything allocated from the arena.
+        /*!
+         Used memory is wiped. The first block is kept for reuse and the
+         rest are freed.
+         */
+        void release();
+
+        //! Get the number of bytes handed out since the last release.
+        size_t size() const;
+
+        //! Get the number of bytes held in blocks.
+        size_t capacity() const;
+
+        //! Get the current arena for this thread.
+        /*!
+         \return The arena, or nullptr if no scope is active.
+         */
+        static Arena* current();
+
+        //! Allocate from the current arena, or the heap if there is none.
+        /*!
+         The allocation records where it came from, so dispose() can be
+         called on it whether or not a scope is active.
+         \param sz The number of bytes.
+         \return Pointer aligned to k_alignment.
+         */
+        static void* acquire(size_t sz);
+
+        //! Return memory obtained from acquire().
+        /*!
+         Heap memory is freed. Arena memory stays in use until its arena
+         is released.
+         \param ptr The pointer returned by acquire(). May be nullptr.
+         */
+        static void dispose(void* ptr);
+
+        //! Get the arena that memory from acquire() came from.
+        /*!
+         \param ptr The pointer returned by acquire().
+         \return The arena, or nullptr for heap memory.
+         */
+        static Arena* owner(const void* ptr);
+    private:
+        struct Block
+        {
+            uint8_t* data;
+            size_t size;
+            size_t used;
+        };
+
+        size_t block_size_;
+        size_t size_;
+        std::vector<Block> blocks_;
+    }; // class lj::Arena
+
+    /*!
+     \brief Standard allocator backed by Arena::acquire().
+
+     Containers using this allocator place their storage in the current
+     arena when one is active, and on the heap otherwise.
+     \tparam T The allocated type.
+     \since 1.0
+     */
+    template<typename T>
+    class Arena_allocator
+    {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        //! Rebind helper for allocator compatibility.
+        template<typename U>
+        struct rebind
+        {
+            typedef Arena_allocator<U> other;
+        };
+
+        //! Default constructor.
+        Arena_allocator() = default;
+
+        //! Converting constructor.
+        template<typename U>
+        Arena_allocator(const Arena_allocator<U>& o)
+        {
+        }
+
+        //! Allocate storage for \c n objects.
+        T* allocate(size_t n)
+        {
+            static_assert(alignof(T) <= Arena::k_alignment,
+                    "Type alignment exceeds the arena alignment.");
+            return static_cast<T*>(Arena::acquire(n * sizeof(T)));
+        }
+
+        //! Release storage from allocate().
+        void deallocate(T* ptr, size_t n)
+        {
+            Arena::dispose(ptr);
+        }
+
+        //! Construct an object in allocated storage.
+        template<typename U, typename... Args>
+        void construct(U* ptr, Args&&... args)
+        {
+            ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+        }
+
+        //! Destroy an object in allocated storage.
+        template<typename U>
+        void destroy(U* ptr)
+        {
+            ptr->~U();
+        }
+
+        //! Get the largest supported allocation.
+        size_t max_size() const
+        {
+            return static_cast<size_t>(-1) / sizeof(T);
+        }
+    }; // class lj::Arena_allocator
+
+    //! All arena allocators are interchangeable.
+    template<typename T, typename U>
+    inline bool operator==(const Arena_allocator<T>&, const Arena_allocator<U>&)
+    {
+        return true;
+    }
+
+    //! All arena allocators are interchangeable.
+    template<typename T, typename U>
+    inline bool operator!=(const Arena_allocator<T>&, const Arena_allocator<U>&)
+    {
+        return false;
+    }
+}; // namespace lj
@@ -0,0 +1,180 @@
+/*!
+ \file lj/Blake2b.cpp
+ \brief LJ BLAKE2b content hash implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lj/Base64.h"
+
+#include "lj/Blake2b.h"
+#include "lj/Exception.h"
+
+#include <cstring>
+
+namespace
+{
+    const uint64_t k_iv[8] = {
+        0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL,
+        0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+        0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL,
+        0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL};
+
+    const uint8_t k_sigma[12][16] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+        {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+        {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+        {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+        {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+        {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+        {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+        {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+        {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+    inline uint64_t rotr(uint64_t x, int n)
+    {
+        return (x >> n) | (x << (64 - n));
+    }
+
+    // Words are little endian regardless of the host.
+    inline uint64_t load64(const uint8_t* ptr)
+    {
+        uint64_t w = 0;
+        for (int h = 7; h >= 0; --h)
+        {
+            w = (w << 8) | ptr[h];
+        }
+        return w;
+    }
+
+    inline void mix(uint64_t* v, int a, int b, int c, int d, uint64_t x, uint64_t y)
+    {
+        v[a] = v[a] + v[b] + x;
+        v[d] = rotr(v[d] ^ v[a], 32);
+        v[c] = v[c] + v[d];
+        v[b] = rotr(v[b] ^ v[c], 24);
+        v[a] = v[a] + v[b] + y;
+        v[d] = rotr(v[d] ^ v[a], 16);
+        v[c] = v[c] + v[d];
+        v[b] = rotr(v[b] ^ v[c], 63);
+    }
+}; // namespace (anonymous)
+
+namespace lj
+{
+    Blake2b::Blake2b(size_t digest_size) : buffer_size_(0), digest_size_(digest_size)
+    {
+        if (0 == digest_size || k_max_digest_size < digest_size)
+        {
+            throw LJ__Exception("Invalid BLAKE2b digest size.");
+        }
+        memcpy(h_, k_iv, sizeof(h_));
+        h_[0] ^= 0x01010000ULL ^ digest_size;
+        t_[0] = 0;
+        t_[1] = 0;
+    }
+
+    void Blake2b::update(const void* data, size_t sz)
+    {
+        const uint8_t* ptr = static_cast<const uint8_t*>(data);
+        while (sz)
+        {
+            // The last block is held back, because it is compressed
+            // differently by finish().
+            if (k_block_size == buffer_size_)
+            {
+                t_[0] += k_block_size;
+                t_[1] += (t_[0] < k_block_size) ? 1 : 0;
+                compress(buffer_, false);
+                buffer_size_ = 0;
+            }
+
+            size_t count = k_block_size - buffer_size_;
+            count = (count < sz) ? count : sz;
+            memcpy(buffer_ + buffer_size_, ptr, count);
+            buffer_size_ += count;
+            ptr += count;
+            sz -= count;
+        }
+    }
+
+    void Blake2b::finish(uint8_t* out)
+    {
+        t_[0] += buffer_size_;
+        t_[1] += (t_[0] < buffer_size_) ? 1 : 0;
+        memset(buffer_ + buffer_size_, 0, k_block_size - buffer_size_);
+        compress(buffer_, true);
+
+        for (size_t h = 0; h < digest_size_; ++h)
+        {
+            out[h] = static_cast<uint8_t>(h_[h / 8] >> (8 * (h % 8)));
+        }
+    }
+
+    void Blake2b::compress(const uint8_t* block, bool last)
+    {
+        uint64_t m[16];
+        for (int h = 0; h < 16; ++h)
+        {
+            m[h] = load64(block + h * 8);
+        }
+
+        uint64_t v[16];
+        memcpy(v, h_, sizeof(h_));
+        memcpy(v + 8, k_iv, sizeof(k_iv));
+        v[12] ^= t_[0];
+        v[13] ^= t_[1];
+        if (last)
+        {
+            v[14] = ~v[14];
+        }
+
+        for (int round = 0; round < 12; ++round)
+        {
+            const uint8_t* s = k_sigma[round];
+            mix(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            mix(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            mix(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            mix(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            mix(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            mix(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            mix(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+
+        for (int h = 0; h < 8; ++h)
+        {
+            h_[h] ^= v[h] ^ v[h + 8];
+        }
+    }
+}; // namespace lj
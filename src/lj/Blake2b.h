@@ -0,0 +1,92 @@
+#pragma once
+/*!
+ \file lj/Blake2b.h
+ \brief LJ BLAKE2b content hash header.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lj
+{
+    /*!
+     \brief Streaming BLAKE2b hash.
+
+     Implements BLAKE2b as described in RFC 7693, without a key. Data is
+     added with update() in any number of pieces, and finish() writes the
+     digest. The digest is the same however the data was split.
+     \since 1.0
+     */
+    class Blake2b
+    {
+    public:
+        static const size_t k_block_size = 128; //!< Bytes compressed at a time.
+        static const size_t k_max_digest_size = 64; //!< Largest digest size.
+
+        /*!
+         \brief Start a new hash.
+         \param digest_size Number of digest bytes, from 1 to 64.
+         \throws lj::Exception If the digest size is out of range.
+         */
+        explicit Blake2b(size_t digest_size = 32);
+
+        //! Get the number of bytes written by finish().
+        inline size_t digest_size() const
+        {
+            return digest_size_;
+        }
+
+        /*!
+         \brief Add data to the hash.
+         \param data The bytes to add.
+         \param sz The number of bytes.
+         */
+        void update(const void* data, size_t sz);
+
+        /*!
+         \brief Finish the hash.
+
+         No more data can be added afterwards.
+         \param out Location for digest_size() bytes.
+         */
+        void finish(uint8_t* out);
+    private:
+        void compress(const uint8_t* block, bool last);
+
+        uint64_t h_[8];
+        uint64_t t_[2];
+        uint8_t buffer_[k_block_size];
+        size_t buffer_size_;
+        size_t digest_size_;
+    }; // class lj::Blake2b
+}; // namespace lj
@@ -35,13 +35,24 @@
 
 #include "lj/Bson.h"
 #include "lj/Base64.h"
+#include "lj/Blake2b.h"
+#include "lj/Bson_decoder.h"
+#include "lj/Bson_writer.h"
+#include "lj/Executor.h"
 #include "lj/Log.h"
+#include "lj/Streambuf_buffer.h"
 #include "lj/Streambuf_mutex.h"
 #include "lj/Wiper.h"
 
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <functional>
 #include <istream>
 #include <fstream>
 #include <iostream>
@@ -49,6 +60,8 @@
 #include <mutex>
 #include <sstream>
 #include <stack>
+#include <thread>
+#include <unordered_map>
 
 namespace lj
 {
@@ -56,6 +69,198 @@ namespace lj
     {
         namespace
         {
+            //! Allocate a value buffer through the arena.
+            inline uint8_t* new_data(size_t sz)
+            {
+                return static_cast<uint8_t*>(lj::Arena::acquire(sz));
+            }
+
+            //! Allocate a child container through the arena.
+            template<typename T>
+            inline T* new_container()
+            {
+                return new (lj::Arena::acquire(sizeof(T))) T();
+            }
+
+            //! Release a child container from new_container().
+            template<typename T>
+            inline void delete_container(T* ptr)
+            {
+                ptr->~T();
+                lj::Arena::dispose(ptr);
+            }
+
+            //! Test if a child container can be shared by a new copy.
+            /*!
+             Heap containers can always be shared. Arena containers are
+             only shared within their own arena, so a copy never depends on
+             an arena that might be released first.
+             */
+            inline bool can_share(const void* ptr)
+            {
+                lj::Arena* owner = lj::Arena::owner(ptr);
+                return !owner || lj::Arena::current() == owner;
+            }
+
+            //! Precomputed keys for the first array indexes.
+            struct Index_key_table
+            {
+                static const size_t k_size = 1000;
+
+                Index_key_table()
+                {
+                    for (size_t indx = 0; indx < k_size; ++indx)
+                    {
+                        const int sz = snprintf(keys[indx], sizeof(keys[indx]), "%zu", indx);
+                        sizes[indx] = static_cast<uint8_t>(sz);
+                    }
+                }
+
+                char keys[k_size][4];
+                uint8_t sizes[k_size];
+            };
+
+            inline const Index_key_table& index_keys()
+            {
+                static const Index_key_table table;
+                return table;
+            }
+
+            //! Get the number of characters in an array index key.
+            inline size_t index_key_size(size_t indx)
+            {
+                if (Index_key_table::k_size > indx)
+                {
+                    return index_keys().sizes[indx];
+                }
+                size_t sz = 1;
+                while (indx >= 10)
+                {
+                    indx /= 10;
+                    ++sz;
+                }
+                return sz;
+            }
+
+            //! Write an array index key, including the null terminator.
+            inline size_t write_index_key(uint8_t* ptr, size_t indx)
+            {
+                if (Index_key_table::k_size > indx)
+                {
+                    const Index_key_table& table = index_keys();
+                    const size_t sz = table.sizes[indx];
+                    memcpy(ptr, table.keys[indx], sz + 1);
+                    return sz + 1;
+                }
+                size_t sz = index_key_size(indx);
+                ptr[sz] = 0;
+                size_t pos = sz;
+                do
+                {
+                    ptr[--pos] = '0' + (indx % 10);
+                    indx /= 10;
+                } while (indx);
+                return sz + 1;
+            }
+
+            //! Binary documents are written as regular documents.
+            inline Type element_type(Type t)
+            {
+                return (Type::k_binary_document == t) ? Type::k_document : t;
+            }
+
+            //! The type a value is written as in the canonical encoding.
+            inline Type canonical_type(Type t)
+            {
+                switch (t)
+                {
+                    case Type::k_int32:
+                        return Type::k_int64;
+                    case Type::k_binary_document:
+                        return Type::k_document;
+                    default:
+                        return t;
+                }
+            }
+
+            void canonical_value(const Node& n, std::string& out);
+
+            //! Write one canonical element, header included.
+            inline void canonical_element(const char* key, size_t key_size,
+                    const Node& n, std::string& out)
+            {
+                out.push_back(static_cast<char>(canonical_type(n.type())));
+                out.append(key, key_size + 1);
+                canonical_value(n, out);
+            }
+
+            //! Write the length of a nested value started at \c start.
+            inline void canonical_close(size_t start, std::string& out)
+            {
+                out.push_back('\0');
+                const uint32_t sz = static_cast<uint32_t>(out.size() - start);
+                memcpy(&out[start], &sz, 4);
+            }
+
+            //! Write a value in the canonical encoding.
+            void canonical_value(const Node& n, std::string& out)
+            {
+                const size_t start = out.size();
+                switch (n.type())
+                {
+                    case Type::k_int32:
+                    case Type::k_int64:
+                    {
+                        const int64_t val = as_int64(n);
+                        out.append(reinterpret_cast<const char*>(&val), 8);
+                        break;
+                    }
+                    case Type::k_double:
+                    {
+                        double val;
+                        memcpy(&val, n.to_value(), 8);
+                        uint64_t bits = 0x7FF8000000000000ULL;
+                        if (val == val)
+                        {
+                            val = (0.0 == val) ? 0.0 : val;
+                            memcpy(&bits, &val, 8);
+                        }
+                        out.append(reinterpret_cast<const char*>(&bits), 8);
+                        break;
+                    }
+                    case Type::k_binary_document:
+                        canonical_value(Node(Type::k_document, n.to_value()), out);
+                        break;
+                    case Type::k_document:
+                        out.append(4, '\0');
+                        for (auto iter = n.begin(); n.end() != iter; ++iter)
+                        {
+                            canonical_element(iter.key().c_str(), iter.key().size(), *iter, out);
+                        }
+                        canonical_close(start, out);
+                        break;
+                    case Type::k_array:
+                    {
+                        out.append(4, '\0');
+                        size_t indx = 0;
+                        uint8_t key[24];
+                        for (auto iter = n.to_vector().begin(); n.to_vector().end() != iter; ++iter)
+                        {
+                            const size_t key_size = write_index_key(key, indx++) - 1;
+                            canonical_element(reinterpret_cast<const char*>(key), key_size, **iter, out);
+                        }
+                        canonical_close(start, out);
+                        break;
+                    }
+                    default:
+                        if (n.to_value())
+                        {
+                            out.append(reinterpret_cast<const char*>(n.to_value()), n.size());
+                        }
+                        break;
+                }
+            }
+
             //! escape a string.
             std::string escape(const std::string& val)
             {
@@ -72,59 +277,80 @@ namespace lj
                 return r;
             }
 
-            //! sub document parsing helper method.
-            void subdocument(Type parent_t, Node& node, const uint8_t* value)
+            //! Bson bytes shared by a document read from bson and the
+            //! nested documents parsed from it.
+            struct Shared_bytes
+            {
+                Shared_bytes() : data(nullptr), size(0), refs(1)
+                {
+                }
+
+                uint8_t* data;
+                size_t size;
+                std::atomic<uint32_t> refs;
+            };
+
+            //! Drop a reference to shared bytes. The last one wipes them.
+            inline void release_bytes(Shared_bytes* bytes)
+            {
+                if (1 == bytes->refs.fetch_sub(1, std::memory_order_acq_rel))
+                {
+                    lj::Wiper<uint8_t[]>::wipe(bytes->data, bytes->size);
+                    lj::Arena::dispose(bytes->data);
+                    delete_container(bytes);
+                }
+            }
+
+            //! Walk the values of a bson document or array.
+            /*!
+             \c fn is called with the name, type and value bytes of each
+             element.
+             */
+            template<typename F>
+            void each_value(const uint8_t* value, F fn)
             {
                 // calculate the end address, and position pointer after size.
                 const uint8_t *ptr = value;
-                long sz = 0;
+                int32_t sz = 0;
                 memcpy(&sz, ptr, 4);
                 const uint8_t *end = ptr + sz - 1;
                 ptr += 4;
 
-                // if the size is 5, then this is the smallest sub document possible
-                // and we don't need to process anything.
-                if (sz == 5)
-                {
-                    return;
-                }
-
                 // loop while the pointer is before the end.
                 while (ptr < end)
                 {
                     // read the field type and advance the pointer.
-                    uint8_t t;
-                    memcpy(&t, ptr++, 1);
+                    const Type t = static_cast<Type>(*ptr++);
 
                     // Read the field name. BSON spec says field names are null
-                    // terminated c-strings, so we let the std::string library
-                    // find the hard work
-                    std::string name(reinterpret_cast<const char*>(ptr));
-                    ptr += name.size() + 1;
-
-                    // Read the field value. this will create a child node.
-                    // The node constructor does all the byte parsing based on
-                    // the provided type.
-                    Node* new_child = new Node(static_cast<Type>(t), ptr);
-
-                    // Attaching the child node to the parent Node is different
-                    // depending on the type of the parent node.
-                    if (Type::k_document == parent_t)
-                    {
-                        node.set_child(escape_path(name), new_child);
-                    }
-                    else if(Type::k_array == parent_t)
-                    {
-                        node.push_child("", new_child);
-                    }
+                    // terminated c-strings.
+                    const char* name = reinterpret_cast<const char*>(ptr);
+                    ptr += strlen(name) + 1;
 
-                    // Move the pointer to the end of the parsed binary data.
-                    // will put us at the start of the next field or the end of
-                    // the document.
-                    ptr += new_child->size();
+                    fn(name, t, ptr);
+
+                    // Move the pointer to the start of the next field or
+                    // the end of the document.
+                    ptr += type_value_size(t, ptr);
                 }
             }
 
+            //! Walk the elements of a bson document or array.
+            /*!
+             \c fn is called with the name and a new child node for each
+             element, and takes ownership of the node.
+             */
+            template<typename F>
+            void each_element(const uint8_t* value, F fn)
+            {
+                // The node constructor does all the byte parsing based on
+                // the provided type. Nested documents keep their bytes
+                // until they are used.
+                each_value(value, [&fn](const char* name, Type t, const uint8_t* ptr) {
+                    fn(name, new Node(t, ptr));
+                });
+            }
+
             const std::string k_bson_type_string_string("string");
             const std::string k_bson_type_string_int32("int32");
             const std::string k_bson_type_string_double("double");
@@ -136,6 +362,16 @@ namespace lj
             const std::string k_bson_type_string_binary_document("binary-document");
             const std::string k_bson_type_string_binary("binary");
             const std::string k_bson_type_string_array("array");
+            const std::string k_bson_type_string_object_id("object-id");
+            const std::string k_bson_type_string_datetime("datetime");
+            const std::string k_bson_type_string_regex("regex");
+            const std::string k_bson_type_string_db_pointer("db-pointer");
+            const std::string k_bson_type_string_javascript("javascript");
+            const std::string k_bson_type_string_symbol("symbol");
+            const std::string k_bson_type_string_javascript_scope("javascript-scope");
+            const std::string k_bson_type_string_decimal128("decimal128");
+            const std::string k_bson_type_string_minkey("minkey");
+            const std::string k_bson_type_string_maxkey("maxkey");
             const std::string k_bson_type_string_unknown("unknown");
 
             const std::string k_bson_binary_type_string_generic("generic");
@@ -175,6 +411,26 @@ namespace lj
                     return k_bson_type_string_binary_document;
                 case Type::k_array:
                     return k_bson_type_string_array;
+                case Type::k_object_id:
+                    return k_bson_type_string_object_id;
+                case Type::k_datetime:
+                    return k_bson_type_string_datetime;
+                case Type::k_regex:
+                    return k_bson_type_string_regex;
+                case Type::k_db_pointer:
+                    return k_bson_type_string_db_pointer;
+                case Type::k_javascript:
+                    return k_bson_type_string_javascript;
+                case Type::k_symbol:
+                    return k_bson_type_string_symbol;
+                case Type::k_javascript_scope:
+                    return k_bson_type_string_javascript_scope;
+                case Type::k_decimal128:
+                    return k_bson_type_string_decimal128;
+                case Type::k_minkey:
+                    return k_bson_type_string_minkey;
+                case Type::k_maxkey:
+                    return k_bson_type_string_maxkey;
                 default:
                     break;
             }
@@ -205,6 +461,45 @@ namespace lj
             return k_bson_type_string_unknown;
         }
 
+        size_t type_value_size(const Type t, const uint8_t* v)
+        {
+            if (type_is_fixed_size(t))
+            {
+                return type_min_size(t);
+            }
+
+            int32_t sz = 0;
+            switch (t)
+            {
+                case Type::k_string:
+                case Type::k_javascript:
+                case Type::k_symbol:
+                    memcpy(&sz, v, 4);
+                    return sz + 4;
+                case Type::k_binary:
+                    memcpy(&sz, v, 4);
+                    return sz + 5;
+                case Type::k_db_pointer:
+                    memcpy(&sz, v, 4);
+                    return sz + 4 + 12;
+                case Type::k_regex:
+                {
+                    // Pattern and options are both null terminated.
+                    const size_t pattern = strlen(reinterpret_cast<const char*>(v)) + 1;
+                    return pattern + strlen(reinterpret_cast<const char*>(v + pattern)) + 1;
+                }
+                case Type::k_document:
+                case Type::k_array:
+                case Type::k_binary_document:
+                case Type::k_javascript_scope:
+                    memcpy(&sz, v, 4);
+                    return sz;
+                default:
+                    break;
+            }
+            throw Bson_type_exception("Unable to determine the size of the value.", t);
+        }
+
         //=====================================================================
         // Bson path exception.
         //=====================================================================
@@ -236,176 +531,657 @@ namespace lj
 
 
         //=====================================================================
-        // Node
+        // Path
         //=====================================================================
 
-        Node::Node() : type_(Type::k_document)
+        Path::Path(const std::string& p) : Path(p.c_str())
         {
-            value_.map_ = new std::map<std::string, Node*>();
         }
 
-        Node::Node(const Type t, const uint8_t* v) : type_(Type::k_null)
+        Path::Path(const char* p) : parts_()
         {
-            value_.data_ = nullptr;
-            set_value(t, v);
+            std::string current;
+            for (; *p; ++p)
+            {
+                if (*p == '/')
+                {
+                    if (0 < current.size())
+                    {
+                        parts_.push_back(current);
+                        current.erase();
+                    }
+                }
+                else if (*p == '\\' && *(p + 1))
+                {
+                    current.push_back(*(++p));
+                }
+                else
+                {
+                    current.push_back(*p);
+                }
+            }
+            if (0 < current.size())
+            {
+                parts_.push_back(current);
+            }
         }
 
-        Node::Node(const Node &o) : type_(Type::k_null)
+        Path& Path::push_back(const std::string& element)
         {
-            value_.data_ = nullptr;
-            copy_from(o);
+            parts_.push_back(element);
+            return *this;
         }
 
-        Node::Node(Node&& o) : type_(o.type_),
-                value_(o.value_)
+        void Path::pop_back()
         {
-            o.value_.data_ = nullptr;
-            o.type_ = Type::k_null;
+            parts_.pop_back();
         }
 
-        Node::~Node()
+        void Path::clear()
         {
-            destroy(true);
+            parts_.clear();
         }
 
-        void Node::set_value(const Type t, const uint8_t* v)
+        std::string Path::str() const
         {
-            // We have to clear out all of the current value before we can set
-            // new values.  we take extra caution to avoid
-            // issues with passing values into the same object:
-            // e.g. a.set_value(a.type(), a.to_value()).
-            uint8_t* old_data = nullptr;
-            size_t old_size = 0;
-            if (!type_is_nested(type()))
+            std::string result;
+            for (auto iter = parts_.begin(); parts_.end() != iter; ++iter)
             {
-                // We capture this pointer because destroy will lose it
-                // and we need to free it later.
-                old_size = size();
-                old_data = value_.data_;
-                destroy(false);
+                if (parts_.begin() != iter)
+                {
+                    result.push_back('/');
+                }
+                result.append(escape_path(*iter));
             }
-            else
+            return result;
+        }
+
+        //=====================================================================
+        // Node::Children
+        //=====================================================================
+
+        // Document children. Entries are kept sorted by key in one
+        // contiguous array, which keeps the typical small record in a
+        // single allocation. Above k_index_threshold a hash index of array
+        // positions is built so key lookups stay constant time. From then
+        // on new keys are appended and the array is sorted once before it
+        // is next read, so building a large document out of order never
+        // shifts the array. The children may be shared by several copies
+        // of a document, counted by refs.
+        //
+        // Children read from bson keep a copy of the bytes and are only
+        // parsed on first use, so nested documents that are never visited
+        // cost a copy instead of a parse. Nested documents reference the
+        // same copy. The bytes are also reused to serialize the document
+        // until it is modified.
+        class Node::Children
+        {
+        public:
+            typedef std::vector<Entry, lj::Arena_allocator<Entry> > Entries;
+            typedef std::unordered_map<std::string,
+                    size_t,
+                    std::hash<std::string>,
+                    std::equal_to<std::string>,
+                    lj::Arena_allocator<std::pair<const std::string, size_t> > > Index;
+
+            static const size_t k_index_threshold = 32;
+
+            Children() : refs(1), entries_(), index_(nullptr),
+                    bytes_(nullptr), raw_(nullptr), sorted_(true), state_(k_ready)
             {
-                destroy(true);
             }
+            Children(const Children& o) = delete;
+            Children(Children&& o) = delete;
+            Children& operator=(const Children& rhs) = delete;
+            Children& operator=(Children&& rhs) = delete;
 
-            // process the void pointer provided based on the provided type.
-            type_ = t;
-            if (v || type_ == Type::k_null)
+            std::atomic<uint32_t> refs;
+
+            // The child nodes are owned and released by the Node. Any
+            // children parsed from the raw bytes are included.
+            ~Children()
             {
-                long long sz = 0;
-                switch (type_)
+                if (index_)
                 {
-                    case Type::k_string:
-                        memcpy(&sz, v, 4);
-                        value_.data_ = new uint8_t[sz + 4];
-                        memcpy(value_.data_, v, sz + 4);
-                        break;
-                    case Type::k_binary:
-                        memcpy(&sz, v, 4);
-                        value_.data_ = new uint8_t[sz + 5];
-                        memcpy(value_.data_, v, sz + 5);
-                        break;
-                    case Type::k_int32:
-                        value_.data_ = new uint8_t[4];
-                        memcpy(value_.data_, v, 4);
-                        break;
-                    case Type::k_double:
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        value_.data_ = new uint8_t[8];
-                        memcpy(value_.data_, v, 8);
-                        break;
-                    case Type::k_boolean:
-                        value_.data_ = new uint8_t[1];
-                        memcpy(value_.data_, v, 1);
-                        break;
-                    case Type::k_null:
-                        value_.data_ = NULL;
-                        break;
-                    case Type::k_document:
-                        value_.map_ = new std::map<std::string, Node*>();
-                        subdocument(type_, *this, v);
-                        break;
-                    case Type::k_array:
-                        value_.vector_ = new std::vector<Node*>();
-                        subdocument(type_, *this, v);
-                        break;
-                    case Type::k_binary_document:
-                        memcpy(&sz, v, 4);
-                        value_.data_ = new uint8_t[sz];
-                        memcpy(value_.data_, v, sz);
-                        break;
-                    default:
-                        break;
+                    delete_container(index_);
                 }
+                drop_raw();
             }
-            else if (type_is_nested(type_))
+
+            // Keep a copy of a bson document to parse later.
+            void assign(const uint8_t* v)
             {
-                // we were not passed a value, so create some empty data structures.
-                if (Type::k_document == type_)
-                {
-                    value_.map_ = new std::map<std::string, Node*>();
-                }
-                else if (Type::k_array == type_)
-                {
-                    value_.vector_ = new std::vector<Node*>();
-                }
+                Shared_bytes* bytes = new_container<Shared_bytes>();
+                bytes->size = type_value_size(Type::k_document, v);
+                bytes->data = new_data(bytes->size);
+                memcpy(bytes->data, v, bytes->size);
+                bytes_ = bytes;
+                raw_ = bytes->data;
+                state_.store(k_pending, std::memory_order_release);
             }
-            else
+
+            // Parse a document later from bytes held by the document it
+            // is nested in.
+            void share(Shared_bytes* bytes, const uint8_t* v)
             {
-                throw Bson_type_exception("NULL pointer passed to non-structural node type.", t);
+                bytes->refs.fetch_add(1, std::memory_order_relaxed);
+                bytes_ = bytes;
+                raw_ = v;
+                state_.store(k_pending, std::memory_order_release);
             }
 
-            // Clean up any old memory.
-            if (old_data)
+            // The bson bytes of an unmodified document, or null.
+            inline const uint8_t* raw() const
             {
-                memset(old_data, 0, old_size);
-                delete[] old_data;
+                return raw_;
             }
-        }
-
-        void Node::nullify()
-        {
-            destroy(true);
-        }
 
-        Node& Node::copy_from(const Node& o)
-        {
-            if (Type::k_document == o.type())
+            // Forget the bson bytes once the document is modified. The
+            // children must be parsed first. The bytes themselves go with
+            // the last document that uses them.
+            void drop_raw()
             {
-                std::map<std::string, Node*>* tmp = new std::map<std::string, Node*>();
-                for (auto iter = o.to_map().begin(); o.to_map().end() != iter; ++iter)
+                if (bytes_)
                 {
-                    Node *ptr = new Node(*(iter->second));
-                    tmp->insert(std::pair<std::string, Node*>(iter->first, ptr));
+                    release_bytes(bytes_);
+                    bytes_ = nullptr;
+                    raw_ = nullptr;
                 }
-                destroy(true);
-                type_ = o.type();
-                value_.map_ = tmp;
             }
-            else if (Type::k_array == o.type())
+
+            // Parse the children from the bson bytes if that has not
+            // happened yet, and sort appended entries when the caller reads
+            // them in order. Const readers may share these children across
+            // threads, so only one of them does the work and the rest wait.
+            void expand(bool order = false) const
             {
-                std::vector<Node*>* tmp = new std::vector<Node*>();
-                for (auto iter = o.to_vector().begin(); o.to_vector().end() != iter; ++iter)
+                uint8_t expected = state_.load(std::memory_order_acquire);
+                while (true)
                 {
-                    Node *ptr = new Node(*(*iter));
-                    tmp->push_back(ptr);
+                    if (k_ready == expected || (k_unsorted == expected && !order))
+                    {
+                        return;
+                    }
+                    if (k_parsing == expected)
+                    {
+                        std::this_thread::yield();
+                        expected = state_.load(std::memory_order_acquire);
+                    }
+                    else if (state_.compare_exchange_weak(expected, k_parsing, std::memory_order_acquire))
+                    {
+                        break;
+                    }
                 }
-                destroy(true);
-                type_ = o.type();
-                value_.vector_ = tmp;
+
+                Children* self = const_cast<Children*>(this);
+                if (k_unsorted == expected)
+                {
+                    self->sort();
+                    state_.store(k_ready, std::memory_order_release);
+                    return;
+                }
+
+                // Parsing does not change the document, only how it is held.
+                // The children belong with the container: in its arena
+                // when that arena is active on this thread, otherwise on
+                // the heap. Arenas are not thread safe, so a reader on
+                // another thread never allocates from one.
+                //
+                // Nested documents point into the same bytes instead of
+                // copying their part, so walking down a deep document is
+                // linear. They only share when the bytes live where the
+                // children are allocated, so a child never outlives them.
+                lj::Arena* owner = lj::Arena::owner(this);
+                lj::Arena::Scope scope(lj::Arena::current() == owner ? owner : nullptr);
+                Shared_bytes* bytes = (lj::Arena::owner(bytes_) == lj::Arena::current()) ?
+                        bytes_ :
+                        nullptr;
+                try
+                {
+                    each_value(raw_, [self, bytes](const char* name, Type t, const uint8_t* ptr) {
+                        self->insert(name, make_child(bytes, t, ptr));
+                    });
+                }
+                catch (...)
+                {
+                    self->clear();
+                    state_.store(k_pending, std::memory_order_release);
+                    throw;
+                }
+                if (order)
+                {
+                    self->sort();
+                }
+                state_.store(sorted_ ? k_ready : k_unsorted, std::memory_order_release);
             }
-            else
+
+            inline size_t size() const
             {
-                set_value(o.type(), o.to_value());
+                return entries_.size();
             }
-            return *this;
-        }
 
-        Node& Node::operator=(Node&& o)
-        {
-            if (&o != this)
+            inline const Entry* begin() const
+            {
+                expand(true);
+                return entries_.data();
+            }
+
+            inline const Entry* end() const
+            {
+                return entries_.data() + entries_.size();
+            }
+
+            inline void reserve(size_t sz)
+            {
+                entries_.reserve(sz);
+            }
+
+            Node* find(const std::string& key) const
+            {
+                if (index_)
+                {
+                    auto iter = index_->find(key);
+                    return (index_->end() == iter) ? nullptr : entries_[iter->second].node;
+                }
+                auto iter = lower_bound(key);
+                return (entries_.end() != iter && iter->key == key) ? iter->node : nullptr;
+            }
+
+            // Add or replace a child. The replaced child is returned so the
+            // caller can release it.
+            Node* insert(const std::string& key, Node* node)
+            {
+                if (index_)
+                {
+                    auto iter = index_->find(key);
+                    if (index_->end() != iter)
+                    {
+                        Node* old = entries_[iter->second].node;
+                        entries_[iter->second].node = node;
+                        return old;
+                    }
+                    if (!(entries_.back().key < key))
+                    {
+                        mark_unsorted();
+                    }
+                    entries_.push_back(Entry{key, node});
+                    index_->insert(std::make_pair(key, entries_.size() - 1));
+                    return nullptr;
+                }
+
+                Node* old = nullptr;
+                if (entries_.empty() || entries_.back().key < key)
+                {
+                    // Keys usually arrive in order when parsing.
+                    entries_.push_back(Entry{key, node});
+                }
+                else
+                {
+                    auto iter = lower_bound(key);
+                    if (entries_.end() != iter && iter->key == key)
+                    {
+                        old = iter->node;
+                        iter->node = node;
+                    }
+                    else
+                    {
+                        entries_.insert(iter, Entry{key, node});
+                    }
+                }
+
+                if (entries_.size() > k_index_threshold)
+                {
+                    index_ = new_container<Index>();
+                    index_->reserve(entries_.size() * 2);
+                    for (size_t h = 0; h < entries_.size(); ++h)
+                    {
+                        index_->insert(std::make_pair(entries_[h].key, h));
+                    }
+                }
+                return old;
+            }
+
+            // Remove a child. The removed child is returned so the caller
+            // can release it.
+            Node* erase(const std::string& key)
+            {
+                if (index_)
+                {
+                    // The last entry fills the gap instead of shifting the
+                    // rest down.
+                    auto iter = index_->find(key);
+                    if (index_->end() == iter)
+                    {
+                        return nullptr;
+                    }
+                    size_t pos = iter->second;
+                    index_->erase(iter);
+                    Node* old = entries_[pos].node;
+                    if (pos + 1 != entries_.size())
+                    {
+                        entries_[pos] = std::move(entries_.back());
+                        (*index_)[entries_[pos].key] = pos;
+                        mark_unsorted();
+                    }
+                    entries_.pop_back();
+                    return old;
+                }
+
+                auto iter = lower_bound(key);
+                if (entries_.end() == iter || iter->key != key)
+                {
+                    return nullptr;
+                }
+                Node* old = iter->node;
+                entries_.erase(iter);
+                return old;
+            }
+        private:
+            enum State : uint8_t
+            {
+                k_ready,
+                k_pending,
+                k_parsing,
+                k_unsorted
+            };
+
+            // Note that the entries must be sorted before the next read.
+            // While parsing, expand() leaves the state unsorted when done.
+            void mark_unsorted()
+            {
+                sorted_ = false;
+                uint8_t expected = k_ready;
+                state_.compare_exchange_strong(expected, k_unsorted, std::memory_order_relaxed);
+            }
+
+            // Restore the key order of appended entries.
+            void sort()
+            {
+                if (sorted_)
+                {
+                    return;
+                }
+                std::sort(entries_.begin(), entries_.end(),
+                        [](const Entry& a, const Entry& b) { return a.key < b.key; });
+                for (size_t h = 0; h < entries_.size(); ++h)
+                {
+                    (*index_)[entries_[h].key] = h;
+                }
+                sorted_ = true;
+            }
+
+            // Create a child from bson, sharing the bytes of nested
+            // documents when bytes is not null.
+            static Node* make_child(Shared_bytes* bytes, Type t, const uint8_t* ptr)
+            {
+                if (!bytes || !type_is_nested(t))
+                {
+                    return new Node(t, ptr);
+                }
+
+                std::unique_ptr<Node> child(new Node(t, nullptr));
+                if (Type::k_document == t)
+                {
+                    child->value_.map_->share(bytes, ptr);
+                }
+                else
+                {
+                    Array& items = child->value_.vector_->items;
+                    each_value(ptr, [bytes, &items](const char*, Type item_type, const uint8_t* item) {
+                        std::unique_ptr<Node> node(make_child(bytes, item_type, item));
+                        items.push_back(node.get());
+                        node.release();
+                    });
+                }
+                return child.release();
+            }
+
+            // Release the children after a failed parse.
+            void clear()
+            {
+                for (auto& entry : entries_)
+                {
+                    delete entry.node;
+                }
+                entries_.clear();
+                if (index_)
+                {
+                    delete_container(index_);
+                    index_ = nullptr;
+                }
+                sorted_ = true;
+            }
+
+            Entries::iterator lower_bound(const std::string& key)
+            {
+                return std::lower_bound(entries_.begin(), entries_.end(), key,
+                        [](const Entry& entry, const std::string& k) { return entry.key < k; });
+            }
+
+            Entries::const_iterator lower_bound(const std::string& key) const
+            {
+                return std::lower_bound(entries_.begin(), entries_.end(), key,
+                        [](const Entry& entry, const std::string& k) { return entry.key < k; });
+            }
+
+            Entries entries_;
+            Index* index_;
+            Shared_bytes* bytes_;
+            const uint8_t* raw_;
+            bool sorted_;
+            mutable std::atomic<uint8_t> state_;
+        }; // class lj::bson::Node::Children
+
+        //=====================================================================
+        // Node
+        //=====================================================================
+
+        Node::Node() : type_(Type::k_document)
+        {
+            value_.map_ = new_container<Children>();
+        }
+
+        Node::Node(const Type t, const uint8_t* v) : type_(Type::k_null)
+        {
+            value_.data_ = nullptr;
+            set_value(t, v);
+        }
+
+        Node::Node(const Node &o) : type_(Type::k_null)
+        {
+            value_.data_ = nullptr;
+            copy_from(o);
+        }
+
+        Node::Node(Node&& o) : type_(o.type_),
+                value_(o.value_)
+        {
+            o.value_.data_ = nullptr;
+            o.type_ = Type::k_null;
+        }
+
+        Node::~Node()
+        {
+            destroy(true);
+        }
+
+        void* Node::operator new(size_t sz)
+        {
+            return lj::Arena::acquire(sz);
+        }
+
+        void Node::operator delete(void* ptr)
+        {
+            lj::Arena::dispose(ptr);
+        }
+
+        const Node::Children& Node::children() const
+        {
+            if (Type::k_document != type())
+            {
+                throw Bson_type_exception("Unable to represent object as a document.", type());
+            }
+            value_.map_->expand();
+            return *(value_.map_);
+        }
+
+        Node::Iterator Node::begin() const
+        {
+            return Iterator(children().begin());
+        }
+
+        Node::Iterator Node::end() const
+        {
+            return Iterator(children().end());
+        }
+
+        size_t Node::count() const
+        {
+            return children().size();
+        }
+
+        void Node::set_value(const Type t, const uint8_t* v)
+        {
+            // We have to clear out all of the current value before we can set
+            // new values.  we take extra caution to avoid
+            // issues with passing values into the same object:
+            // e.g. a.set_value(a.type(), a.to_value()).
+            // The new value is checked first so a bad value leaves this
+            // node unchanged.
+            size_t sz = 0;
+            if (type_is_value(t) && !(type_is_fixed_size(t) && 0 == type_min_size(t)))
+            {
+                if (!v)
+                {
+                    throw Bson_type_exception("NULL pointer passed to non-structural node type.", t);
+                }
+                sz = type_value_size(t, v);
+            }
+
+            uint8_t* old_data = nullptr;
+            size_t old_size = 0;
+            if (!type_is_nested(type()))
+            {
+                // We capture this pointer because destroy will lose it
+                // and we need to free it later.
+                old_size = size();
+                old_data = value_.data_;
+                destroy(false);
+            }
+            else
+            {
+                destroy(true);
+            }
+
+            // process the void pointer provided based on the provided type.
+            type_ = t;
+            if (Type::k_document == type_)
+            {
+                value_.map_ = new_container<Children>();
+                if (v)
+                {
+                    value_.map_->assign(v);
+                }
+            }
+            else if (Type::k_array == type_)
+            {
+                value_.vector_ = new_container<Shared_array>();
+                if (v)
+                {
+                    Array& items = value_.vector_->items;
+                    each_element(v, [&items](const char*, Node* child) {
+                        items.push_back(child);
+                    });
+                }
+            }
+            else if (0 == sz)
+            {
+                // Null and the min and max keys have no value bytes.
+                value_.data_ = nullptr;
+            }
+            else
+            {
+                value_.data_ = new_data(sz);
+                memcpy(value_.data_, v, sz);
+            }
+
+            // Clean up any old memory.
+            if (old_data)
+            {
+                memset(old_data, 0, old_size);
+                lj::Arena::dispose(old_data);
+            }
+        }
+
+        void Node::nullify()
+        {
+            destroy(true);
+        }
+
+        Node& Node::copy_from(const Node& o)
+        {
+            if (type_is_nested(o.type()) && can_share(o.value_.data_))
+            {
+                // Take the reference before destroying, in case o is one
+                // of our own children.
+                const Type t = o.type_;
+                auto v = o.value_;
+                if (Type::k_document == t)
+                {
+                    v.map_->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    v.vector_->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+                destroy(true);
+                type_ = t;
+                value_ = v;
+            }
+            else if (Type::k_document == o.type() && o.value_.map_->raw())
+            {
+                // Unmodified documents are copied as bytes.
+                Children* tmp = new_container<Children>();
+                tmp->assign(o.value_.map_->raw());
+                destroy(true);
+                type_ = o.type();
+                value_.map_ = tmp;
+            }
+            else if (Type::k_document == o.type())
+            {
+                Children* tmp = new_container<Children>();
+                tmp->reserve(o.count());
+                for (auto iter = o.begin(); o.end() != iter; ++iter)
+                {
+                    tmp->insert(iter.key(), new Node(*iter));
+                }
+                destroy(true);
+                type_ = o.type();
+                value_.map_ = tmp;
+            }
+            else if (Type::k_array == o.type())
+            {
+                Shared_array* tmp = new_container<Shared_array>();
+                tmp->items.reserve(o.to_vector().size());
+                for (auto iter = o.to_vector().begin(); o.to_vector().end() != iter; ++iter)
+                {
+                    Node *ptr = new Node(*(*iter));
+                    tmp->items.push_back(ptr);
+                }
+                destroy(true);
+                type_ = o.type();
+                value_.vector_ = tmp;
+            }
+            else
+            {
+                set_value(o.type(), o.to_value());
+            }
+            return *this;
+        }
+
+        Node& Node::operator=(Node&& o)
+        {
+            if (&o != this)
             {
                 destroy(true);
                 type_ = o.type_;
@@ -418,23 +1194,35 @@ namespace lj
 
         Node* Node::find_or_create_child_documents(const std::list<std::string>& input_list)
         {
-            std::list<std::string> parts(input_list);
+            Path p;
+            for (auto iter = input_list.begin(); input_list.end() != iter; ++iter)
+            {
+                p.push_back(*iter);
+            }
+            return find_or_create(p, p.size());
+        }
 
+        // private, navigates through the first count elements of the path,
+        // creating documents that do not exist.
+        Node* Node::find_or_create(const Path& p, size_t count)
+        {
             // set the root, and loop until all path parts are complete.
             // verifying that each node is a document is handled by the
-            // to_map() method.
+            // children() method.
             Node *n = this;
-            while (0 < parts.size())
+            n->detach();
+            for (size_t h = 0; h < count; ++h)
             {
+                const std::string& part = p[h];
                 if (Type::k_array == n->type())
                 {
                     // Check that the position is valid.
                     // Doesn't make sense to pad the vector with empty document
                     // objects, so we don't do that here.
-                    int pos = atoi(parts.front().c_str());
+                    int pos = atoi(part.c_str());
                     if(pos < 0 || static_cast<size_t>(pos) >= n->to_vector().size())
                     {
-                        throw Bson_path_exception(std::string("Invalid array index ") + parts.front(), parts.front());
+                        throw Bson_path_exception(std::string("Invalid array index ") + part, part);
                     }
 
                     // one level deeper.
@@ -443,79 +1231,49 @@ namespace lj
                 else
                 {
                     // Search for the child by name.
-                    auto iter = n->to_map().find(parts.front());
-                    if (n->to_map().end() == iter)
+                    Node* child = n->children().find(part);
+                    if (!child)
                     {
                         // Child not found, so create it.
-                        Node* tmp = new Node();
-                        n->set_child(parts.front(), tmp);
-                        n = tmp;
-                    }
-                    else
-                    {
-                        // one level deeper.
-                        n = iter->second;
+                        child = new Node();
+                        n->value_.map_->insert(part, child);
                     }
+
+                    // one level deeper.
+                    n = child;
                 }
-                parts.pop_front();
+                n->detach();
             }
             return n;
         }
 
-        namespace {
-            void split_path(const std::string& path, std::list<std::string>& parts)
-            {
-                const char* tmp = path.c_str();
-                std::string current;
-                for (;*tmp; ++tmp)
-                {
-                    if (*tmp == '/')
-                    {
-                        if (0 < current.size())
-                        {
-                            parts.push_back(current);
-                            current.erase();
-                        }
-                    }
-                    else if (*tmp == '\\' && *(tmp + 1))
-                    {
-                        current.push_back(*(++tmp));
-                    }
-                    else
-                    {
-                        current.push_back(*tmp);
-                    }
-                }
-                if (0 < current.size())
-                {
-                    parts.push_back(current);
-                }
-            }
-        };
-
         Node* Node::path(const std::string& p)
         {
-            std::list<std::string> parts;
-            split_path(p, parts);
-            return find_or_create_child_documents(parts);
+            return path(Path(p));
         }
 
         const Node* Node::path(const std::string& p) const
         {
-            // split path up for looping.
-            std::list<std::string> parts;
-            split_path(p, parts);
+            return path(Path(p));
+        }
+
+        Node* Node::path(const Path& p)
+        {
+            return find_or_create(p, p.size());
+        }
 
+        const Node* Node::path(const Path& p) const
+        {
             // set the root, and loop until all path parts are complete.
             // verifying that each node is a document is handled by the
-            // to_map() method.
+            // children() method.
             const Node *n = this;
-            while (0 < parts.size())
+            for (auto part = p.begin(); p.end() != part; ++part)
             {
                 if (Type::k_array == n->type())
                 {
                     // Check that the position is valid.
-                    int pos = atoi(parts.front().c_str());
+                    int pos = atoi(part->c_str());
                     if (pos < 0 || static_cast<size_t>(pos) >= n->to_vector().size())
                     {
                         return nullptr;
@@ -527,70 +1285,66 @@ namespace lj
                 else
                 {
                     // Search for the child by name.
-                    auto iter = n->to_map().find(parts.front());
-                    if (n->to_map().end() == iter)
+                    n = n->children().find(*part);
+                    if (!n)
                     {
                         // Child not found, and everything is const, so return null.
                         return nullptr;
                     }
-
-                    // One level deeper.
-                    n = iter->second;
                 }
-                parts.pop_front();
             }
             return n;
         }
 
         void Node::set_child(const std::string& p, Node* c)
         {
-            // split path up for navigation.
-            std::list<std::string> parts;
-            split_path(p, parts);
+            set_child(Path(p), c);
+        }
 
+        void Node::set_child(const Path& p, Node* c)
+        {
             // Check that we got a valid child name.
-            if (parts.size() < 1)
+            if (p.empty())
             {
-                throw Bson_path_exception("Cannot set a child without a child name.", p);
+                throw Bson_path_exception("Cannot set a child without a child name.", p.str());
             }
 
-            // This gets the new child's name from the parts.s
-            std::string child_name = parts.back();
-            parts.pop_back();
-
-            // navigate the structure.
-            Node *n = find_or_create_child_documents(parts);
+            // The last element is the new child's name. navigate the
+            // structure for the rest.
+            const std::string& child_name = p.back();
+            Node *n = find_or_create(p, p.size() - 1);
 
-            // Cannot use to_map below because I need a non-const iterator.
-            // checking that the found node is a document.
+            // Cannot use children() below because I need a non-const
+            // container. checking that the found node is a document.
             if (Type::k_document != n->type())
             {
                 throw Bson_type_exception("Cannot add a child to a non-document type.", n->type());
             }
 
-            // remove any existing value to keep memory sane.
-            auto iter = n->value_.map_->find(child_name);
-            if (n->value_.map_->end() != iter)
+            // replace or remove any existing value to keep memory sane.
+            Node* old;
+            if (c)
             {
-                if (iter->second == c)
+                if (n->value_.map_->find(child_name) == c)
                 {
                     //already here, do nothing.
                     return;
                 }
-                delete iter->second;
-                n->value_.map_->erase(iter);
+                old = n->value_.map_->insert(child_name, c);
             }
-
-            // At this point we have the target node, we have made sure no
-            // existing child exists with the same name, and we need to add
-            // the new child onto the node.
-            if (c)
+            else
             {
-                n->value_.map_->insert(std::pair<std::string, Node*>(child_name, c));
+                old = n->value_.map_->erase(child_name);
             }
+            delete old;
         }
 
         void Node::push_child(const std::string& p, Node* c)
+        {
+            push_child(Path(p), c);
+        }
+
+        void Node::push_child(const Path& p, Node* c)
         {
             // Null check.
             if (!c)
@@ -598,12 +1352,8 @@ namespace lj
                 throw Bson_type_exception("Cannot push null as a child.", type());
             }
 
-            // split path up for navigation.
-            std::list<std::string> parts;
-            split_path(p, parts);
-
             // Navigate to the target node.
-            Node* n = find_or_create_child_documents(parts);
+            Node* n = find_or_create(p, p.size());
 
             // Make sure the target node is the correct type.
             if (Type::k_array != n->type())
@@ -612,167 +1362,597 @@ namespace lj
             }
 
             // push the value to the end.
-            n->value_.vector_->push_back(c);
+            n->value_.vector_->items.push_back(c);
         }
 
         size_t Node::size() const
         {
             long sz = 0;
-            int indx = 0;
+            size_t indx = 0;
             switch (type())
             {
-                case Type::k_string:
-                    memcpy(&sz, value_.data_, 4);
-                    sz += 4;
-                    break;
-                case Type::k_binary:
-                    memcpy(&sz, value_.data_, 4);
+                case Type::k_array:
                     sz += 5;
+                    for (auto iter = to_vector().begin(); to_vector().end() != iter; ++iter)
+                    {
+                        sz += index_key_size(indx++) + (*iter)->size() + 2;
+                    }
                     break;
-                case Type::k_int32:
-                    sz = 4;
-                    break;
-                case Type::k_double:
-                case Type::k_int64:
-                case Type::k_timestamp:
-                    sz = 8;
-                    break;
-                case Type::k_boolean:
-                    sz = 1;
+                case Type::k_document:
+                    if (value_.map_->raw())
+                    {
+                        return type_value_size(type(), value_.map_->raw());
+                    }
+                    sz += 5;
+                    for (auto iter = begin(); end() != iter; ++iter)
+                    {
+                        sz += iter->size() + iter.key().size() + 2;
+                    }
                     break;
-                case Type::k_null:
-                    sz = 0;
+                default:
+                    sz = type_value_size(type(), value_.data_);
                     break;
-                case Type::k_array:
-                    sz += 5;
-                    for (auto iter = to_vector().begin(); to_vector().end() != iter; ++iter)
+            }
+            return sz;
+        }
+
+        uint8_t* Node::to_canonical_binary(size_t* sz_ptr) const
+        {
+            std::string buffer;
+            buffer.reserve(size());
+            canonical_value(*this, buffer);
+
+            uint8_t* ptr = new uint8_t[buffer.size()];
+            memcpy(ptr, buffer.data(), buffer.size());
+            if (sz_ptr)
+            {
+                *sz_ptr = buffer.size();
+            }
+            lj::Wiper<char[]>::wipe(&buffer[0], buffer.size());
+            return ptr;
+        }
+
+        // private, used by to_binary() to copy bytes into a preallocated
+        // array. Nested lengths are written after their children, so the
+        // tree is only walked once.
+        size_t Node::copy_to_bson(uint8_t* ptr) const
+        {
+            uint8_t* start = ptr;
+            if (Type::k_document == type() && value_.map_->raw())
+            {
+                // Unmodified documents are copied as they were read.
+                size_t sz = type_value_size(type(), value_.map_->raw());
+                memcpy(ptr, value_.map_->raw(), sz);
+                return sz;
+            }
+            else if (Type::k_document == type())
+            {
+                ptr += 4;
+                for (auto iter = begin(); end() != iter; ++iter)
+                {
+                    *ptr++ = static_cast<uint8_t>(element_type(iter->type()));
+                    memcpy(ptr, iter.key().c_str(), iter.key().size() + 1);
+                    ptr += iter.key().size() + 1;
+                    ptr += iter->copy_to_bson(ptr);
+                }
+                *ptr++ = 0;
+            }
+            else if (Type::k_array == type())
+            {
+                size_t indx = 0;
+                ptr += 4;
+                for (auto iter = to_vector().begin(); to_vector().end() != iter; ++iter)
+                {
+                    *ptr++ = static_cast<uint8_t>(element_type((*iter)->type()));
+                    ptr += write_index_key(ptr, indx++);
+                    ptr += (*iter)->copy_to_bson(ptr);
+                }
+                *ptr++ = 0;
+            }
+            else
+            {
+                // Value sizes are read from the value itself.
+                size_t sz = size();
+                memcpy(ptr, value_.data_, sz);
+                return sz;
+            }
+
+            uint32_t sz = static_cast<uint32_t>(ptr - start);
+            memcpy(start, &sz, 4);
+            return sz;
+        }
+
+        // private, used to free the current resources in a standard way.
+        void Node::destroy(bool should_delete_value)
+        {
+            if (type_is_value(type()) && should_delete_value)
+            {
+                if (value_.data_)
+                {
+                    // The data section is overwritten for security reasons.
+                    size_t sz = size();
+                    lj::Wiper<uint8_t[]>::wipe(value_.data_, sz);
+                    lj::Arena::dispose(value_.data_);
+                }
+            }
+            else if (type_is_nested(type()))
+            {
+                release_children();
+            }
+            type_ = Type::k_null;
+            value_.data_ = NULL;
+        }
+
+        // private, gives this node its own children before it is
+        // modified. The children are copied, which shares their own
+        // children in turn, so only one level is duplicated. Documents
+        // read from bson are parsed and stop using their bytes.
+        void Node::detach()
+        {
+            if (Type::k_document == type())
+            {
+                value_.map_->expand();
+            }
+
+            if (Type::k_document == type() &&
+                    1 < value_.map_->refs.load(std::memory_order_acquire))
+            {
+                Children* tmp = new_container<Children>();
+                tmp->reserve(value_.map_->size());
+                for (auto iter = value_.map_->begin(); value_.map_->end() != iter; ++iter)
+                {
+                    tmp->insert(iter->key, new Node(*(iter->node)));
+                }
+                release_children();
+                value_.map_ = tmp;
+            }
+            else if (Type::k_array == type() &&
+                    1 < value_.vector_->refs.load(std::memory_order_acquire))
+            {
+                Shared_array* tmp = new_container<Shared_array>();
+                tmp->items.reserve(value_.vector_->items.size());
+                for (auto iter = value_.vector_->items.begin(); value_.vector_->items.end() != iter; ++iter)
+                {
+                    tmp->items.push_back(new Node(*(*iter)));
+                }
+                release_children();
+                value_.vector_ = tmp;
+            }
+            else if (Type::k_document == type())
+            {
+                value_.map_->drop_raw();
+            }
+        }
+
+        // private, drops this node's reference to its children. The last
+        // reference deletes them.
+        void Node::release_children()
+        {
+            if (Type::k_document == type())
+            {
+                if (1 == value_.map_->refs.fetch_sub(1, std::memory_order_acq_rel))
+                {
+                    for (auto iter = value_.map_->begin(); value_.map_->end() != iter; ++iter)
                     {
-                        // Yes, this is ugly, but it avoids string building for
-                        // smaller arrays.
-                        int key_size = 1;
-                        if (indx < 10 && indx > -1)
-                        {
-                            key_size = 1;
-                        }
-                        else if (indx < 100 && indx > 9)
+                        delete iter->node;
+                    }
+                    delete_container(value_.map_);
+                }
+            }
+            else if (Type::k_array == type())
+            {
+                if (1 == value_.vector_->refs.fetch_sub(1, std::memory_order_acq_rel))
+                {
+                    for (auto iter = value_.vector_->items.begin(); value_.vector_->items.end() != iter; ++iter)
+                    {
+                        delete *iter;
+                    }
+                    delete_container(value_.vector_);
+                }
+            }
+        }
+
+        //=====================================================================
+        // Node::Parallel_writer
+        //=====================================================================
+
+        // Serializes a tree, splitting the children of large containers
+        // across the workers of an executor. plan() sizes the tree and
+        // records where each child of a large container starts, then
+        // fill() writes those children by chunk. The calling thread takes
+        // chunks as well, so it never waits on work that has not started.
+        class Node::Parallel_writer
+        {
+        public:
+            //! Containers with fewer children are written by one thread.
+            static const size_t k_min_children = 4096;
+
+            //! Number of children in each chunk of work.
+            static const size_t k_chunk_children = 1024;
+
+            explicit Parallel_writer(lj::Executor& executor) : executor_(executor), layouts_()
+            {
+            }
+
+            // Get the size of n, recording the layout of large containers.
+            size_t plan(const Node& n)
+            {
+                if (is_leaf(n))
+                {
+                    return n.size();
+                }
+
+                const size_t count = child_count(n);
+                if (count < k_min_children || 2 > executor_.workers())
+                {
+                    size_t sz = 5;
+                    for (size_t h = 0; h < count; ++h)
+                    {
+                        sz += key_size(n, h) + 2 + plan(child(n, h));
+                    }
+                    return sz;
+                }
+
+                // Each child's size goes in the slot after it, then the
+                // running sum turns the sizes into start offsets.
+                std::vector<size_t> offsets(count + 1);
+                offsets[0] = 4;
+                run(count, [&n, &offsets](size_t begin, size_t end) {
+                    for (size_t h = begin; h < end; ++h)
+                    {
+                        offsets[h + 1] = key_size(n, h) + 2 + child(n, h).size();
+                    }
+                });
+                for (size_t h = 0; h < count; ++h)
+                {
+                    offsets[h + 1] += offsets[h];
+                }
+                const size_t sz = offsets[count] + 1;
+                layouts_[&n] = std::move(offsets);
+                return sz;
+            }
+
+            // Write n to ptr, returning the bytes written.
+            size_t fill(const Node& n, uint8_t* ptr)
+            {
+                if (is_leaf(n))
+                {
+                    return n.copy_to_bson(ptr);
+                }
+
+                const size_t count = child_count(n);
+                auto layout = layouts_.find(&n);
+                if (layouts_.end() == layout)
+                {
+                    uint8_t* start = ptr;
+                    ptr += 4;
+                    for (size_t h = 0; h < count; ++h)
+                    {
+                        ptr += write_header(n, h, ptr);
+                        ptr += fill(child(n, h), ptr);
+                    }
+                    *ptr++ = 0;
+                    const uint32_t sz = static_cast<uint32_t>(ptr - start);
+                    memcpy(start, &sz, 4);
+                    return sz;
+                }
+
+                const std::vector<size_t>& offsets = layout->second;
+                run(count, [&n, &offsets, ptr](size_t begin, size_t end) {
+                    for (size_t h = begin; h < end; ++h)
+                    {
+                        uint8_t* pos = ptr + offsets[h];
+                        pos += write_header(n, h, pos);
+                        child(n, h).copy_to_bson(pos);
+                    }
+                });
+                ptr[offsets[count]] = 0;
+                const uint32_t sz = static_cast<uint32_t>(offsets[count] + 1);
+                memcpy(ptr, &sz, 4);
+                return sz;
+            }
+        private:
+            // Completion state shared with the helper tasks, which may
+            // start after the work is done.
+            struct Batch
+            {
+                Batch() : next(0), done(0), mutex(), cv(), error()
+                {
+                }
+
+                std::atomic<size_t> next;
+                size_t done;
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::exception_ptr error;
+            };
+
+            // Values and unmodified documents are copied as they are.
+            static bool is_leaf(const Node& n)
+            {
+                return !type_is_nested(n.type()) ||
+                        (Type::k_document == n.type() && n.value_.map_->raw());
+            }
+
+            static size_t child_count(const Node& n)
+            {
+                return (Type::k_document == n.type()) ? n.count() : n.to_vector().size();
+            }
+
+            static const Node& child(const Node& n, size_t indx)
+            {
+                return (Type::k_document == n.type()) ?
+                        *(n.children().begin()[indx].node) :
+                        *(n.to_vector()[indx]);
+            }
+
+            static size_t key_size(const Node& n, size_t indx)
+            {
+                return (Type::k_document == n.type()) ?
+                        n.children().begin()[indx].key.size() :
+                        index_key_size(indx);
+            }
+
+            // Write the element type and key of a child.
+            static size_t write_header(const Node& n, size_t indx, uint8_t* ptr)
+            {
+                *ptr = static_cast<uint8_t>(element_type(child(n, indx).type()));
+                if (Type::k_document == n.type())
+                {
+                    const std::string& key = n.children().begin()[indx].key;
+                    memcpy(ptr + 1, key.c_str(), key.size() + 1);
+                    return key.size() + 2;
+                }
+                return write_index_key(ptr + 1, indx) + 1;
+            }
+
+            // Call fn for each chunk of [0, count), spread over the
+            // executor and the calling thread.
+            template<typename F>
+            void run(size_t count, F fn)
+            {
+                const size_t chunks = (count + k_chunk_children - 1) / k_chunk_children;
+                std::shared_ptr<Batch> batch(std::make_shared<Batch>());
+
+                // fn is only used while chunks remain, and the caller
+                // waits for every chunk, so the reference stays valid.
+                std::function<void()> work = [batch, chunks, count, &fn]() {
+                    for (size_t c = batch->next.fetch_add(1); c < chunks; c = batch->next.fetch_add(1))
+                    {
+                        try
                         {
-                            key_size = 2;
+                            fn(c * k_chunk_children, std::min(count, (c + 1) * k_chunk_children));
                         }
-                        else if (indx < 1000 && indx > 99)
+                        catch (...)
                         {
-                            key_size = 3;
+                            std::lock_guard<std::mutex> lock(batch->mutex);
+                            batch->error = std::current_exception();
                         }
-                        else
+                        std::lock_guard<std::mutex> lock(batch->mutex);
+                        if (++batch->done == chunks)
                         {
-                            std::ostringstream oss;
-                            oss << indx++;
-                            key_size = oss.str().size();
+                            batch->cv.notify_all();
                         }
-                        sz += key_size + (*iter)->size() + 2;
                     }
-                    break;
-                case Type::k_document:
-                    sz += 5;
-                    for (auto iter = to_map().begin(); to_map().end() != iter; ++iter)
+                };
+
+                const size_t helpers = std::min(chunks, executor_.workers()) - 1;
+                try
+                {
+                    for (size_t h = 0; h < helpers; ++h)
                     {
-                        sz += iter->second->size() + iter->first.size() + 2;
+                        executor_.submit(work);
                     }
-                    break;
-                case Type::k_binary_document:
-                    memcpy(&sz, value_.data_, 4);
-                    break;
-                default:
-                    break;
+                }
+                catch (lj::Exception& ex)
+                {
+                    // A stopped executor leaves the work to this thread.
+                }
+                work();
+
+                std::unique_lock<std::mutex> lock(batch->mutex);
+                batch->cv.wait(lock, [&batch, chunks]() { return chunks == batch->done; });
+                if (batch->error)
+                {
+                    std::rethrow_exception(batch->error);
+                }
+            }
+
+            lj::Executor& executor_;
+            std::unordered_map<const Node*, std::vector<size_t> > layouts_;
+        }; // class lj::bson::Node::Parallel_writer
+
+        uint8_t* Node::to_binary(size_t* sz_ptr, lj::Executor& executor) const
+        {
+            Parallel_writer writer(executor);
+            const size_t sz = writer.plan(*this);
+            uint8_t* ptr = new uint8_t[sz];
+            writer.fill(*this, ptr);
+
+            // if sz_ptr is not null, store the data size.
+            if (sz_ptr)
+            {
+                *sz_ptr = sz;
+            }
+            return ptr;
+        }
+
+        //=====================================================================
+        // View
+        //=====================================================================
+
+        View::View() :
+                type_(Type::k_null),
+                data_(nullptr),
+                owner_()
+        {
+        }
+
+        View::View(const uint8_t* doc) :
+                type_(Type::k_document),
+                data_(doc),
+                owner_()
+        {
+        }
+
+        View::View(const Type t, const uint8_t* v) :
+                type_(t),
+                data_(v),
+                owner_()
+        {
+        }
+
+        View::View(const std::shared_ptr<const uint8_t>& doc) :
+                type_(Type::k_document),
+                data_(doc.get()),
+                owner_(doc)
+        {
+        }
+
+        size_t View::size() const
+        {
+            return data_ ? type_value_size(type_, data_) : 0;
+        }
+
+        const uint8_t* View::to_value() const
+        {
+            if (type_is_nested(type()))
+            {
+                throw Bson_type_exception("Unable to represent object as a data pointer.", type());
+            }
+            return data_;
+        }
+
+        View View::path(const std::string& p) const
+        {
+            return path(Path(p));
+        }
+
+        View View::nav(const std::string& p) const
+        {
+            View v(path(p));
+            if (!v)
+            {
+                throw Bson_path_exception("Path not found.", p);
             }
-            return sz;
+            return v;
         }
 
-        // private, used by to_binary() to copy bytes into a preallocated
-        // array.
-        size_t Node::copy_to_bson(uint8_t* ptr) const
+        View View::path(const Path& p) const
         {
-            size_t sz = size();
-            if (Type::k_document == type() || Type::k_binary_document == type())
+            View v(*this);
+            for (auto iter = p.begin(); p.end() != iter && v; ++iter)
             {
-                memcpy(ptr, &sz, 4);
-                ptr += 4;
-                for (auto iter = to_map().begin(); to_map().end() != iter; ++iter)
-                {
-                    Type t = iter->second->type();
-                    if (Type::k_binary_document == t)
-                    {
-                        t = Type::k_document;
-                    }
-                    memcpy(ptr++, &t, 1);
-                    memcpy(ptr, iter->first.c_str(), iter->first.size() + 1);
-                    ptr += iter->first.size() + 1;
-                    ptr += iter->second->copy_to_bson(ptr);
-                }
-                *ptr = 0;
+                v = v.child(*iter);
             }
-            else if (Type::k_array == type())
+            return v;
+        }
+
+        View View::nav(const Path& p) const
+        {
+            View v(path(p));
+            if (!v)
             {
-                int indx = 0;
-                memcpy(ptr, &sz, 4);
-                ptr += 4;
-                for (auto iter = to_vector().begin(); to_vector().end() != iter; ++iter)
-                {
-                    Type t = (*iter)->type();
-                    if (Type::k_binary_document == t)
-                    {
-                        t = Type::k_document;
-                    }
-                    memcpy(ptr++, &t, 1);
+                throw Bson_path_exception("Path not found.", p.str());
+            }
+            return v;
+        }
 
-                    std::ostringstream oss;
-                    oss << indx++;
-                    std::string key_name = oss.str();
-                    memcpy(ptr, key_name.c_str(), key_name.size() + 1);
-                    ptr += key_name.size() + 1;
-                    ptr += (*iter)->copy_to_bson(ptr);
-                }
-                *ptr = 0;
+        View::Iterator View::begin() const
+        {
+            if (!data_ || !(type_is_nested(type_) || Type::k_binary_document == type_))
+            {
+                throw Bson_type_exception("Unable to iterate a value.", type_);
             }
-            else
+            return Iterator(data_ + 4, owner_);
+        }
+
+        View::Iterator View::end() const
+        {
+            if (!data_ || !(type_is_nested(type_) || Type::k_binary_document == type_))
             {
-                memcpy(ptr, value_.data_, sz);
+                return Iterator(nullptr, owner_);
             }
-            return sz;
+            return Iterator(data_ + size() - 1, owner_);
         }
 
-        // private, used to free the current resources in a standard way.
-        void Node::destroy(bool should_delete_value)
+        Node View::to_node() const
         {
-            if (type_is_value(type()) && should_delete_value)
+            if (!data_)
             {
-                if (value_.data_)
-                {
-                    // The data section is overwritten for security reasons.
-                    size_t sz = size();
-                    lj::Wiper<uint8_t[]>::wipe(value_.data_, sz);
-                    delete[] value_.data_;
-                }
+                return Node(Type::k_null, nullptr);
             }
-            else if (Type::k_document == type())
+            else if (Type::k_binary_document == type_)
             {
-                for (auto iter = value_.map_->begin(); value_.map_->end() != iter; ++iter)
+                return Node(Type::k_document, data_);
+            }
+            return Node(type_, data_);
+        }
+
+        View View::child(const std::string& name) const
+        {
+            if (Type::k_array == type_)
+            {
+                // Array keys are positions, so count instead of comparing.
+                // Anything that is not a plain decimal index is not found.
+                if (name.empty() || !isdigit(static_cast<unsigned char>(name[0])))
+                {
+                    return View();
+                }
+                char* stop = nullptr;
+                unsigned long pos = strtoul(name.c_str(), &stop, 10);
+                if ('\0' != *stop)
+                {
+                    return View();
+                }
+                for (auto iter = begin(); end() != iter; ++iter, --pos)
                 {
-                    delete iter->second;
+                    if (0 == pos)
+                    {
+                        return iter.value();
+                    }
                 }
-                delete value_.map_;
             }
-            else if (Type::k_array == type())
+            else
             {
-                for (auto iter = value_.vector_->begin(); value_.vector_->end() != iter; ++iter)
+                for (auto iter = begin(); end() != iter; ++iter)
                 {
-                    delete *iter;
+                    if (0 == name.compare(iter.key()))
+                    {
+                        return iter.value();
+                    }
                 }
-                delete value_.vector_;
             }
-            type_ = Type::k_null;
-            value_.data_ = NULL;
+            return View();
+        }
+
+        View::Iterator::Iterator(const uint8_t* ptr,
+                const std::shared_ptr<const uint8_t>& owner) :
+                ptr_(ptr),
+                owner_(owner)
+        {
+        }
+
+        View View::Iterator::value() const
+        {
+            Type t = static_cast<Type>(*ptr_);
+            const uint8_t* v = ptr_ + 1 + strlen(key()) + 1;
+            View result(t, v);
+            result.owner_ = owner_;
+            return result;
+        }
+
+        View::Iterator& View::Iterator::operator++()
+        {
+            Type t = static_cast<Type>(*ptr_);
+            const uint8_t* v = ptr_ + 1 + strlen(key()) + 1;
+            ptr_ = v + type_value_size(t, v);
+            return *this;
         }
 
+        //=====================================================================
+        // Free functions
+        //=====================================================================
 
         std::string escape_path(const std::string& input)
         {
@@ -851,290 +2031,617 @@ namespace lj
             return new Node(Type::k_array, NULL);
         }
 
-        std::string as_debug_string(const Node& b, int lvl)
+        Node* new_datetime(const int64_t ms)
         {
-            Binary_type binary_type = Binary_type::k_bin_generic;
-            long long l = 0;
-            double d = 0.0;
-            std::ostringstream buf;
+            return new Node(Type::k_datetime, reinterpret_cast<const uint8_t*> (&ms));
+        }
 
-            if (type_is_nested(b.type()))
+        Node* new_timestamp(const uint64_t val)
+        {
+            return new Node(Type::k_timestamp, reinterpret_cast<const uint8_t*> (&val));
+        }
+
+        Node* new_object_id(const uint8_t* oid)
+        {
+            return new Node(Type::k_object_id, oid);
+        }
+
+        Node* new_regex(const std::string& pattern, const std::string& options)
+        {
+            std::string tmp(pattern);
+            tmp.push_back('\0');
+            tmp.append(options);
+            tmp.push_back('\0');
+            return new Node(Type::k_regex, reinterpret_cast<const uint8_t*> (tmp.data()));
+        }
+
+        Node* new_javascript(const std::string& code)
+        {
+            Node* new_bson = new_string(code);
+            new_bson->set_value(Type::k_javascript, new_bson->to_value());
+            return new_bson;
+        }
+
+        Node* new_decimal128(const uint8_t* val)
+        {
+            return new Node(Type::k_decimal128, val);
+        }
+
+        Node* new_minkey()
+        {
+            return new Node(Type::k_minkey, NULL);
+        }
+
+        Node* new_maxkey()
+        {
+            return new Node(Type::k_maxkey, NULL);
+        }
+
+        namespace
+        {
+            // Format milliseconds since the epoch as ISO 8601 in UTC.
+            std::string datetime_string(int64_t ms)
             {
-                // This node can have children, indentation level matters.
-                std::string indent;
-                for (int h = 0; h < lvl; ++h)
+                int64_t secs = ms / 1000;
+                int64_t millis = ms % 1000;
+                if (0 > millis)
                 {
-                    indent.append("  ");
+                    millis += 1000;
+                    --secs;
                 }
+                const time_t t = static_cast<time_t>(secs);
+                struct tm parts;
+                gmtime_r(&t, &parts);
+                char buf[40];
+                const size_t sz = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &parts);
+                snprintf(buf + sz, sizeof(buf) - sz, ".%03dZ", static_cast<int>(millis));
+                return std::string(buf);
+            }
 
-                // Caching node size because it can be complicated to compute.
-                size_t node_size = b.size();
-                if (node_size == 5)
+            std::string hex_string(const uint8_t* v, size_t sz)
+            {
+                static const char k_digits[] = "0123456789abcdef";
+                std::string result;
+                result.reserve(sz * 2);
+                for (const uint8_t* end = v + sz; end != v; ++v)
                 {
-                    return "{(size-4)0(null-1)0}";
+                    result.push_back(k_digits[*v >> 4]);
+                    result.push_back(k_digits[*v & 0x0F]);
                 }
-                buf << "{(size-4)" << node_size << "\n";
+                return result;
+            }
 
-                // The output function is essentially the same for documents
-                // and arrays. We create a nested anonymous function for use
-                // in the loops below. Except for the capture of the
-                // buf object, this is identical to a function in an anonymous
-                // namespace.
-                auto output_function = [&buf, &indent, &lvl](const std::string& key, const Node* n) {
-                    buf << indent;
-                    buf << "(type-1)" << type_string(n->type()) << "";
-                    buf << "\"(key-" << key.size() + 1 << ")" << escape(key) << "\":";
-                    if (type_is_quotable(n->type()))
-                    {
-                        buf << "\"";
-                    }
-                    buf << as_debug_string(*n, lvl + 1);
-                    if (type_is_quotable(n->type()))
+            // Format a decimal128 value (binary integer decimal encoding)
+            // with the bson spec rules for choosing scientific notation.
+            std::string decimal128_string(const uint8_t* v)
+            {
+                uint64_t low, high;
+                memcpy(&low, v, 8);
+                memcpy(&high, v + 8, 8);
+                const bool negative = (high >> 63);
+                std::string result(negative ? "-" : "");
+
+                if (0x1F == ((high >> 58) & 0x1F))
+                {
+                    return "NaN";
+                }
+                else if (0x1E == ((high >> 58) & 0x1F))
+                {
+                    return result + "Infinity";
+                }
+
+                int exponent;
+                uint32_t coefficient[4] = {0, 0, 0, 0};
+                if (3 == ((high >> 61) & 3))
+                {
+                    // The coefficient would be larger than 34 digits; the
+                    // spec treats this as zero.
+                    exponent = static_cast<int>((high >> 47) & 0x3FFF) - 6176;
+                }
+                else
+                {
+                    exponent = static_cast<int>((high >> 49) & 0x3FFF) - 6176;
+                    coefficient[0] = static_cast<uint32_t>((high >> 32) & 0x1FFFF);
+                    coefficient[1] = static_cast<uint32_t>(high);
+                    coefficient[2] = static_cast<uint32_t>(low >> 32);
+                    coefficient[3] = static_cast<uint32_t>(low);
+                }
+
+                // Peel off decimal digits, least significant first.
+                std::string digits;
+                do
+                {
+                    uint64_t rem = 0;
+                    for (int indx = 0; 4 > indx; ++indx)
                     {
-                        buf << "\"";
+                        const uint64_t cur = (rem << 32) | coefficient[indx];
+                        coefficient[indx] = static_cast<uint32_t>(cur / 10);
+                        rem = cur % 10;
                     }
-                    buf << ",\n";
-                };
+                    digits.push_back(static_cast<char>('0' + rem));
+                } while (coefficient[0] || coefficient[1] || coefficient[2] || coefficient[3]);
+                std::reverse(digits.begin(), digits.end());
 
-                // Handle Documents and Arrays differently.
-                if (Type::k_document == b.type())
+                const int count = static_cast<int>(digits.size());
+                const int adjusted = exponent + count - 1;
+                if (0 < exponent || -6 > adjusted)
                 {
-                    for (auto iter = b.to_map().begin(); b.to_map().end() != iter; ++iter)
+                    result.push_back(digits[0]);
+                    if (1 < count)
                     {
-                        output_function(iter->first, iter->second);
+                        result.push_back('.');
+                        result.append(digits, 1, std::string::npos);
                     }
-                }
-                else
-                {
-                    int indx = 0;
-                    for (auto iter = b.to_vector().begin(); b.to_vector().end() != iter; ++iter)
+                    result.push_back('E');
+                    if (0 <= adjusted)
                     {
-                        std::ostringstream oss;
-                        oss << indx++;
-                        output_function(oss.str(), *iter);
+                        result.push_back('+');
                     }
+                    result.append(std::to_string(adjusted));
                 }
-
-                //Close the document properly.
-                std::string ret_val = buf.str().erase(buf.str().size() - 2).append("\n");
-                if (indent.size() >= 2)
+                else if (0 == exponent)
                 {
-                    ret_val.append(indent.erase(indent.size() - 2));
+                    result.append(digits);
                 }
-                return ret_val.append("(null-1)0}");            }
-            else
+                else if (count > -exponent)
+                {
+                    result.append(digits, 0, count + exponent);
+                    result.push_back('.');
+                    result.append(digits, count + exponent, std::string::npos);
+                }
+                else
+                {
+                    result.append("0.");
+                    result.append(-exponent - count, '0');
+                    result.append(digits);
+                }
+                return result;
+            }
+
+            double decimal128_double(const uint8_t* v)
+            {
+                return strtod(decimal128_string(v).c_str(), nullptr);
+            }
+
+            std::string value_as_string(const Type t, const uint8_t* v)
             {
-                const uint8_t* v = b.to_value();
-                switch (b.type())
+                Binary_type binary_type = Binary_type::k_bin_generic;
+                long long l = 0;
+                double d = 0.0;
+                std::ostringstream buf;
+                switch (t)
                 {
+                    case Type::k_null:
+                        return "null";
                     case Type::k_string:
                         memcpy(&l, v, 4);
-                        buf << "(size-4)" << l << "(value-" << l << ")" << reinterpret_cast<const char*>(v + 4);
-                        return buf.str();
+                        return std::string(reinterpret_cast<const char*>(v + 4));
                     case Type::k_binary:
                         memcpy(&l, v, 4);
                         memcpy(&binary_type, v + 4, 1);
-                        buf << "(size-4)" << l;
-                        buf << "(bin-type-1)" << binary_type_string(binary_type);
-                        buf << "(value-" << l << ")";
                         if (Binary_type::k_bin_uuid == binary_type && l == 16)
                         {
-                            buf << Uuid(v + 5).str();
+                            return Uuid(v + 5).str();
                         }
                         else
                         {
-                            buf << lj::base64_encode(v + 5, l);
+                            return lj::base64_encode(v + 5, l);
                         }
-                        return buf.str();
                     case Type::k_int32:
                         memcpy(&l, v, 4);
-                        buf << "(value-4)" << l;
+                        buf << l;
                         return buf.str();
                     case Type::k_double:
                         memcpy(&d, v, 8);
-                        buf << "(value-8)" << d;
+                        buf << d;
                         return buf.str();
                     case Type::k_int64:
                     case Type::k_timestamp:
                         memcpy(&l, v, 8);
-                        buf << "(value-8)" << l;
+                        buf << l;
                         return buf.str();
                     case Type::k_boolean:
                         memcpy(&l, v, 1);
-                        buf << "(value-1)" << ((bool)l);
-                        return buf.str();
-                    case Type::k_null:
-                        buf << "(value-0)";
+                        buf << ((bool)l);
                         return buf.str();
                     case Type::k_binary_document:
-                        return as_debug_string(Node(Type::k_document, v));
+                        return as_string(Node(Type::k_document, v));
+                    case Type::k_javascript:
+                    case Type::k_symbol:
+                        return std::string(reinterpret_cast<const char*>(v + 4));
+                    case Type::k_javascript_scope:
+                        return std::string(reinterpret_cast<const char*>(v + 8));
+                    case Type::k_datetime:
+                        memcpy(&l, v, 8);
+                        return datetime_string(l);
+                    case Type::k_object_id:
+                        return hex_string(v, 12);
+                    case Type::k_regex:
+                    {
+                        const char* pattern = reinterpret_cast<const char*>(v);
+                        const char* options = pattern + strlen(pattern) + 1;
+                        return std::string("/") + pattern + "/" + options;
+                    }
+                    case Type::k_db_pointer:
+                        memcpy(&l, v, 4);
+                        return std::string(reinterpret_cast<const char*>(v + 4)) +
+                                "/" + hex_string(v + 4 + l, 12);
+                    case Type::k_decimal128:
+                        return decimal128_string(v);
+                    case Type::k_minkey:
+                    case Type::k_maxkey:
+                        return type_string(t);
                     default:
                         break;
                 }
+                return std::string();
             }
-            return std::string();
-        }
-
-        std::string as_string(const Node& b)
-        {
-            Binary_type binary_type = Binary_type::k_bin_generic;
-            long long l = 0;
-            double d = 0.0;
-            std::ostringstream buf;
 
-            if (type_is_nested(b.type()))
+            int32_t value_as_int32(const Type t, const uint8_t* v)
             {
-                // Caching node size because it can be complicated to compute.
-                size_t node_size = b.size();
-
-                // Quickly abort for empty documents and arrays.
-                if (node_size == 5)
+                long l = 0;
+                double d = 0.0;
+                if (type_is_value(t))
                 {
-                    return (Type::k_array == b.type() ? "[]" : "{}");
+                    switch (t)
+                    {
+                        case Type::k_string:
+                            return atoi(reinterpret_cast<const char*>(v + 4));
+                        case Type::k_int32:
+                            memcpy(&l, v, 4);
+                            return (int)l;
+                        case Type::k_double:
+                            memcpy(&d, v, 8);
+                            return (int)d;
+                        case Type::k_int64:
+                        case Type::k_timestamp:
+                        case Type::k_datetime:
+                            memcpy(&l, v, 8);
+                            return (int)l;
+                        case Type::k_boolean:
+                            memcpy(&l, v, 1);
+                            return (int)l;
+                        case Type::k_decimal128:
+                            return (int)decimal128_double(v);
+                        default:
+                            break;
+                    }
                 }
+                return 0;
+            }
 
-                buf << (Type::k_array == b.type() ? "[" : "{");
-
-                // The output function is essentially the same for documents
-                // and arrays. We create a nested anonymous function for use
-                // in the loops below. Except for the capture of the
-                // buf object, this is identical to a function in an anonymous
-                // namespace.
-                auto output_function = [&buf](const std::string& key, const Node* n) {
-                    buf << "\"" << escape(key) << "\":";
-                    if (type_is_quotable(n->type()))
+            int64_t value_as_int64(const Type t, const uint8_t* v)
+            {
+                int64_t l = 0;
+                double d = 0.0;
+                if (type_is_value(t))
+                {
+                    switch (t)
                     {
-                        buf << "\"";
+                        case Type::k_string:
+                            return atol(reinterpret_cast<const char*>(v + 4));
+                        case Type::k_int32:
+                            memcpy(&l, v, 4);
+                            return l;
+                        case Type::k_double:
+                            memcpy(&d, v, 8);
+                            return (long long)d;
+                        case Type::k_int64:
+                        case Type::k_timestamp:
+                        case Type::k_datetime:
+                            memcpy(&l, v, 8);
+                            return l;
+                        case Type::k_boolean:
+                            memcpy(&l, v, 1);
+                            return l;
+                        case Type::k_decimal128:
+                            return (int64_t)decimal128_double(v);
+                        default:
+                            break;
                     }
-                    buf << as_string(*n);
-                    if (type_is_quotable(n->type()))
+                }
+                return 0;
+            }
+
+            uint64_t value_as_uint64(const Type t, const uint8_t* v)
+            {
+                uint64_t l = 0;
+                double d = 0.0;
+                if (type_is_value(t))
+                {
+                    switch (t)
                     {
-                        buf << "\"";
+                        case Type::k_string:
+                            return static_cast<uint64_t>(atol(reinterpret_cast<const char*>(v + 4)));
+                        case Type::k_int32:
+                            memcpy(&l, v, 4);
+                            return l;
+                        case Type::k_double:
+                            memcpy(&d, v, 8);
+                            return (long long)d;
+                        case Type::k_int64:
+                        case Type::k_timestamp:
+                        case Type::k_datetime:
+                            memcpy(&l, v, 8);
+                            return l;
+                        case Type::k_boolean:
+                            memcpy(&l, v, 1);
+                            return l;
+                        case Type::k_decimal128:
+                            return (uint64_t)decimal128_double(v);
+                        default:
+                            break;
                     }
-                    buf << ", ";
-                };
+                }
+                return 0;
+            }
 
-                // Handle Documents and Arrays differently.
-                if (Type::k_document == b.type())
+            bool value_as_boolean(const Type t, const uint8_t* v)
+            {
+                long l = 0;
+                double d = 0.0;
+                if (type_is_value(t))
                 {
-                    for (auto iter = b.to_map().begin(); b.to_map().end() != iter; ++iter)
+                    const char* s;
+                    switch (t)
                     {
-                        output_function(iter->first, iter->second);
+                        case Type::k_string:
+                            s = reinterpret_cast<const char*>(v + 4);
+                            if (!v)
+                            {
+                                return false;
+                            }
+                            if (!s[0])
+                            {
+                                return false;
+                            }
+                            if (s[0] == '0' && !s[1])
+                            {
+                                return false;
+                            }
+                            if (s[0] == '1' && !s[1])
+                            {
+                                return true;
+                            }
+                            if (strlen(s) == 4 &&
+                                toupper(s[0]) == 'T' &&
+                                toupper(s[1]) == 'R' &&
+                                toupper(s[2]) == 'U' &&
+                                toupper(s[3]) == 'E')
+                            {
+                                return true;
+                            }
+                            break;
+                        case Type::k_int32:
+                            memcpy(&l, v, 4);
+                            return l;
+                        case Type::k_double:
+                            memcpy(&d, v, 8);
+                            return (long)d;
+                        case Type::k_int64:
+                        case Type::k_timestamp:
+                        case Type::k_datetime:
+                            memcpy(&l, v, 8);
+                            return l;
+                        case Type::k_boolean:
+                            memcpy(&l, v, 1);
+                            return l;
+                        case Type::k_decimal128:
+                            return 0.0 != decimal128_double(v);
+                        default:
+                            break;
                     }
                 }
-                else
+                return false;
+            }
+
+            double value_as_double(const Type t, const uint8_t* v)
+            {
+                long l = 0;
+                double d = 0.0;
+                if (type_is_value(t))
                 {
-                    int indx = 0;
-                    for (auto iter = b.to_vector().begin(); b.to_vector().end() != iter; ++iter)
+                    switch (t)
                     {
-                        std::ostringstream oss;
-                        oss << indx++;
-                        output_function(oss.str(), *iter);
+                        case Type::k_string:
+                            return atof(reinterpret_cast<const char*>(v + 4));
+                        case Type::k_int32:
+                            memcpy(&l, v, 4);
+                            return (double)l;
+                        case Type::k_double:
+                            memcpy(&d, v, 8);
+                            return d;
+                        case Type::k_int64:
+                        case Type::k_timestamp:
+                        case Type::k_datetime:
+                            memcpy(&l, v, 8);
+                            return (double)l;
+                        case Type::k_boolean:
+                            memcpy(&l, v, 1);
+                            return (double)l;
+                        case Type::k_decimal128:
+                            return decimal128_double(v);
+                        default:
+                            break;
                     }
                 }
-
-                //Close the document properly.
-                return buf.str().erase(buf.str().size() - 2).append((Type::k_array == b.type() ? "]" : "}"));
+                return 0.0;
             }
-            else
+        }; // namespace lj::bson::(anonymous)
+
+        namespace
+        {
+            void write_debug(std::ostream& buf, const Node& b, int lvl)
             {
-                const uint8_t* v = b.to_value();
-                switch (b.type())
+                Binary_type binary_type = Binary_type::k_bin_generic;
+                long long l = 0;
+                double d = 0.0;
+
+                if (type_is_nested(b.type()))
                 {
-                    case Type::k_null:
-                        return "null";
-                    case Type::k_string:
-                        memcpy(&l, v, 4);
-                        return std::string(reinterpret_cast<const char*>(v + 4));
-                    case Type::k_binary:
-                        memcpy(&l, v, 4);
-                        memcpy(&binary_type, v + 4, 1);
-                        if (Binary_type::k_bin_uuid == binary_type && l == 16)
+                    // This node can have children, indentation level matters.
+                    const std::string indent(lvl * 2, ' ');
+
+                    // Caching node size because it can be complicated to compute.
+                    size_t node_size = b.size();
+                    if (node_size == 5)
+                    {
+                        buf << "{(size-4)0(null-1)0}";
+                        return;
+                    }
+                    buf << "{(size-4)" << node_size;
+
+                    // The output function is essentially the same for documents
+                    // and arrays. Each child writes its own separator, so
+                    // nothing has to be trimmed off the end.
+                    auto output_function = [&buf, &indent, &lvl](const std::string& key, const Node* n, bool first) {
+                        buf << (first ? "\n" : ",\n") << indent;
+                        buf << "(type-1)" << type_string(n->type()) << "";
+                        buf << "\"(key-" << key.size() + 1 << ")" << escape(key) << "\":";
+                        if (type_is_quotable(n->type()))
                         {
-                            return Uuid(v + 5).str();
+                            buf << "\"";
                         }
-                        else
+                        write_debug(buf, *n, lvl + 1);
+                        if (type_is_quotable(n->type()))
+                        {
+                            buf << "\"";
+                        }
+                    };
+
+                    // Handle Documents and Arrays differently.
+                    if (Type::k_document == b.type())
+                    {
+                        bool first = true;
+                        for (auto iter = b.begin(); b.end() != iter; ++iter)
+                        {
+                            output_function(iter.key(), &(*iter), first);
+                            first = false;
+                        }
+                    }
+                    else
+                    {
+                        int indx = 0;
+                        for (auto iter = b.to_vector().begin(); b.to_vector().end() != iter; ++iter)
                         {
-                            return lj::base64_encode(v + 5, l);
+                            output_function(std::to_string(indx), *iter, 0 == indx);
+                            ++indx;
                         }
-                    case Type::k_int32:
-                        memcpy(&l, v, 4);
-                        buf << l;
-                        return buf.str();
-                    case Type::k_double:
-                        memcpy(&d, v, 8);
-                        buf << d;
-                        return buf.str();
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        memcpy(&l, v, 8);
-                        buf << l;
-                        return buf.str();
-                    case Type::k_boolean:
-                        memcpy(&l, v, 1);
-                        buf << ((bool)l);
-                        return buf.str();
-                    case Type::k_binary_document:
-                        return as_string(Node(Type::k_document, v));
-                    default:
-                        break;
+                    }
+
+                    //Close the document properly.
+                    buf << "\n" << indent.substr(std::min<size_t>(2, indent.size())) << "(null-1)0}";
+                }
+                else
+                {
+                    const uint8_t* v = b.to_value();
+                    switch (b.type())
+                    {
+                        case Type::k_string:
+                            memcpy(&l, v, 4);
+                            buf << "(size-4)" << l << "(value-" << l << ")" << reinterpret_cast<const char*>(v + 4);
+                            break;
+                        case Type::k_binary:
+                            memcpy(&l, v, 4);
+                            memcpy(&binary_type, v + 4, 1);
+                            buf << "(size-4)" << l;
+                            buf << "(bin-type-1)" << binary_type_string(binary_type);
+                            buf << "(value-" << l << ")";
+                            if (Binary_type::k_bin_uuid == binary_type && l == 16)
+                            {
+                                buf << Uuid(v + 5).str();
+                            }
+                            else
+                            {
+                                buf << lj::base64_encode(v + 5, l);
+                            }
+                            break;
+                        case Type::k_int32:
+                            memcpy(&l, v, 4);
+                            buf << "(value-4)" << l;
+                            break;
+                        case Type::k_double:
+                            memcpy(&d, v, 8);
+                            buf << "(value-8)" << d;
+                            break;
+                        case Type::k_int64:
+                        case Type::k_timestamp:
+                        case Type::k_datetime:
+                            memcpy(&l, v, 8);
+                            buf << "(value-8)" << l;
+                            break;
+                        case Type::k_boolean:
+                            memcpy(&l, v, 1);
+                            buf << "(value-1)" << ((bool)l);
+                            break;
+                        case Type::k_null:
+                            buf << "(value-0)";
+                            break;
+                        case Type::k_binary_document:
+                            write_debug(buf, Node(Type::k_document, v), 1);
+                            break;
+                        case Type::k_minkey:
+                        case Type::k_maxkey:
+                            buf << "(value-0)";
+                            break;
+                        default:
+                            // Everything else uses its string form.
+                            buf << "(value-" << b.size() << ")" << value_as_string(b.type(), v);
+                            break;
+                    }
                 }
             }
-            return std::string();
+        }; // namespace lj::bson::(anonymous)
+
+        std::string as_debug_string(const Node& b, int lvl)
+        {
+            std::ostringstream buf;
+            write_debug(buf, b, lvl);
+            return buf.str();
         }
 
-        std::string as_json_string(const Node& b, int lvl)
+        std::string as_string(const Node& b)
         {
             std::ostringstream buf;
 
-            // Calculate the indent level.
-            std::string indent;
-            for (int h = 0; h < lvl; ++h)
-            {
-                indent.append("  ");
-            }
-            
             if (type_is_nested(b.type()))
             {
                 // Caching node size because it can be complicated to compute.
                 size_t node_size = b.size();
+
+                // Quickly abort for empty documents and arrays.
                 if (node_size == 5)
                 {
-                    return (Type::k_array == b.type() ? "[]" : "{}");;
+                    return (Type::k_array == b.type() ? "[]" : "{}");
                 }
 
-                buf << (Type::k_array == b.type() ? "[" : "{") << "\n";
+                buf << (Type::k_array == b.type() ? "[" : "{");
 
                 // The output function is essentially the same for documents
                 // and arrays. We create a nested anonymous function for use
                 // in the loops below. Except for the capture of the
                 // buf object, this is identical to a function in an anonymous
                 // namespace.
-                auto output_function = [&b, &buf, &indent, &lvl](const std::string& key, const Node* n) {
-                    buf << indent;
-                    if (Type::k_document == b.type())
-                    {
-                        buf << "\"" << escape(key) << "\":";
-                    }
-                    if (!type_is_native(n->type()) && !type_is_pretty_nested(n->type()))
+                auto output_function = [&buf](const std::string& key, const Node* n) {
+                    buf << "\"" << escape(key) << "\":";
+                    if (type_is_quotable(n->type()))
                     {
                         buf << "\"";
-                        buf << escape(as_json_string(*n, lvl + 1));
-                        buf << "\"";
                     }
-                    else
+                    buf << as_string(*n);
+                    if (type_is_quotable(n->type()))
                     {
-                        buf << as_json_string(*n, lvl + 1);
+                        buf << "\"";
                     }
-                    buf << ",\n";
+                    buf << ", ";
                 };
 
                 // Handle Documents and Arrays differently.
                 if (Type::k_document == b.type())
                 {
-                    for (auto iter = b.to_map().begin(); b.to_map().end() != iter; ++iter)
+                    for (auto iter = b.begin(); b.end() != iter; ++iter)
                     {
-                        output_function(iter->first, iter->second);
+                        output_function(iter.key(), &(*iter));
                     }
                 }
                 else
@@ -1149,227 +2656,49 @@ namespace lj
                 }
 
                 //Close the document properly.
-                std::string ret_val = buf.str().erase(buf.str().size() - 2).append("\n");
-                if (indent.size() >= 2)
-                {
-                    ret_val.append(indent.erase(indent.size() - 2));
-                }
-                return ret_val.append((Type::k_array == b.type() ? "]" : "}"));
+                return buf.str().erase(buf.str().size() - 2).append((Type::k_array == b.type() ? "]" : "}"));
             }
             else
             {
-                const uint8_t* v = b.to_value();
-                Binary_type bin_type;
-                uint32_t bin_size;
-                Node tmp;
-
-                switch (b.type())
-                {
-                    case Type::k_binary_document:
-                        return as_json_string(Node(Type::k_document, v), lvl);
-                    case Type::k_binary:
-                        v = as_binary(b, &bin_type, &bin_size);
-                        if (Binary_type::k_bin_uuid == bin_type)
-                        {
-                            tmp.set_child("__bson_type", new_string("UUID"));
-                            tmp.set_child("__bson_value", new_string(static_cast<std::string>(as_uuid(b))));
-                            tmp.set_child("__bson_note", new_int64(static_cast<int64_t>(static_cast<uint64_t>(as_uuid(b)))));
-                            return as_json_string(tmp, lvl);
-                        }
-                        else
-                        {
-                            tmp.set_child("__bson_type", new_string("BINARY"));
-                            tmp.set_child("__bson_value", new_string(as_string(b)));
-                            tmp.set_child("__bson_note", new_int32(static_cast<int32_t>(bin_type)));
-                            return as_json_string(tmp, lvl);
-                        }
-                        // intentionally fall through.
-                    default:
-                        return as_string(b);
-                }
+                return value_as_string(b.type(), b.to_value());
             }
-            return std::string();
+        }
+
+        std::string as_json_string(const Node& b, int lvl)
+        {
+            std::string result;
+            Json_writer(result).write(b, lvl);
+            return result;
         }
 
         int32_t as_int32(const Node& b)
         {
-            long l = 0;
-            double d = 0.0;
-            if (type_is_value(b.type()))
-            {
-                const uint8_t* v = b.to_value();
-                switch (b.type())
-                {
-                    case Type::k_string:
-                        return atoi(reinterpret_cast<const char*>(v + 4));
-                    case Type::k_int32:
-                        memcpy(&l, v, 4);
-                        return (int)l;
-                    case Type::k_double:
-                        memcpy(&d, v, 8);
-                        return (int)d;
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        memcpy(&l, v, 8);
-                        return (int)l;
-                    case Type::k_boolean:
-                        memcpy(&l, v, 1);
-                        return (int)l;
-                    default:
-                        break;
-                }
-            }
-            return 0;
+            return value_as_int32(b.type(),
+                    type_is_value(b.type()) ? b.to_value() : nullptr);
         }
 
         int64_t as_int64(const Node& b)
         {
-            int64_t l = 0;
-            double d = 0.0;
-            if (type_is_value(b.type()))
-            {
-                const uint8_t* v = b.to_value();
-                switch (b.type())
-                {
-                    case Type::k_string:
-                        return atol(reinterpret_cast<const char*>(v + 4));
-                    case Type::k_int32:
-                        memcpy(&l, v, 4);
-                        return l;
-                    case Type::k_double:
-                        memcpy(&d, v, 8);
-                        return (long long)d;
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        memcpy(&l, v, 8);
-                        return l;
-                    case Type::k_boolean:
-                        memcpy(&l, v, 1);
-                        return l;
-                    default:
-                        break;
-                }
-            }
-            return 0;
+            return value_as_int64(b.type(),
+                    type_is_value(b.type()) ? b.to_value() : nullptr);
         }
 
         uint64_t as_uint64(const Node& b)
         {
-            uint64_t l = 0;
-            double d = 0.0;
-            if (type_is_value(b.type()))
-            {
-                const uint8_t* v = b.to_value();
-                switch (b.type())
-                {
-                    case Type::k_string:
-                        return static_cast<uint64_t>(atol(reinterpret_cast<const char*>(v + 4)));
-                    case Type::k_int32:
-                        memcpy(&l, v, 4);
-                        return l;
-                    case Type::k_double:
-                        memcpy(&d, v, 8);
-                        return (long long)d;
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        memcpy(&l, v, 8);
-                        return l;
-                    case Type::k_boolean:
-                        memcpy(&l, v, 1);
-                        return l;
-                    default:
-                        break;
-                }
-            }
-            return 0;
+            return value_as_uint64(b.type(),
+                    type_is_value(b.type()) ? b.to_value() : nullptr);
         }
 
         bool as_boolean(const Node& b)
         {
-            long l = 0;
-            double d = 0.0;
-            if (type_is_value(b.type()))
-            {
-                const uint8_t* v = b.to_value();
-                const char* s;
-                switch (b.type())
-                {
-                    case Type::k_string:
-                        s = reinterpret_cast<const char*>(v + 4);
-                        if (!v)
-                        {
-                            return false;
-                        }
-                        if (!s[0])
-                        {
-                            return false;
-                        }
-                        if (s[0] == '0' && !s[1])
-                        {
-                            return false;
-                        }
-                        if (s[0] == '1' && !s[1])
-                        {
-                            return true;
-                        }
-                        if (strlen(s) == 4 &&
-                            toupper(s[0]) == 'T' &&
-                            toupper(s[1]) == 'R' &&
-                            toupper(s[2]) == 'U' &&
-                            toupper(s[3]) == 'E')
-                        {
-                            return true;
-                        }
-                        break;
-                    case Type::k_int32:
-                        memcpy(&l, v, 4);
-                        return l;
-                    case Type::k_double:
-                        memcpy(&d, v, 8);
-                        return (long)d;
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        memcpy(&l, v, 8);
-                        return l;
-                    case Type::k_boolean:
-                        memcpy(&l, v, 1);
-                        return l;
-                    default:
-                        break;
-                }
-            }
-            return false;
+            return value_as_boolean(b.type(),
+                    type_is_value(b.type()) ? b.to_value() : nullptr);
         }
 
         double as_double(const Node& b)
         {
-            long l = 0;
-            double d = 0.0;
-            if (type_is_value(b.type()))
-            {
-                const uint8_t* v = b.to_value();
-                switch (b.type())
-                {
-                    case Type::k_string:
-                        return atof(reinterpret_cast<const char*>(v + 4));
-                    case Type::k_int32:
-                        memcpy(&l, v, 4);
-                        return (double)l;
-                    case Type::k_double:
-                        memcpy(&d, v, 8);
-                        return d;
-                    case Type::k_int64:
-                    case Type::k_timestamp:
-                        memcpy(&l, v, 8);
-                        return (double)l;
-                    case Type::k_boolean:
-                        memcpy(&l, v, 1);
-                        return (double)l;
-                    default:
-                        break;
-                }
-            }
-            return 0.0;
+            return value_as_double(b.type(),
+                    type_is_value(b.type()) ? b.to_value() : nullptr);
         }
 
         const uint8_t* as_binary(const Node& b, Binary_type* t, uint32_t* sz)
@@ -1399,6 +2728,77 @@ namespace lj
             return Uuid::k_nil;
         }
 
+        std::string as_string(const View& b)
+        {
+            if (type_is_nested(b.type()))
+            {
+                return as_string(b.to_node());
+            }
+            return value_as_string(b.type(), b.data());
+        }
+
+        std::string as_json_string(const View& b, int lvl)
+        {
+            return as_json_string(b.to_node(), lvl);
+        }
+
+        int32_t as_int32(const View& b)
+        {
+            return value_as_int32(b.type(),
+                    type_is_value(b.type()) ? b.data() : nullptr);
+        }
+
+        int64_t as_int64(const View& b)
+        {
+            return value_as_int64(b.type(),
+                    type_is_value(b.type()) ? b.data() : nullptr);
+        }
+
+        uint64_t as_uint64(const View& b)
+        {
+            return value_as_uint64(b.type(),
+                    type_is_value(b.type()) ? b.data() : nullptr);
+        }
+
+        bool as_boolean(const View& b)
+        {
+            return value_as_boolean(b.type(),
+                    type_is_value(b.type()) ? b.data() : nullptr);
+        }
+
+        double as_double(const View& b)
+        {
+            return value_as_double(b.type(),
+                    type_is_value(b.type()) ? b.data() : nullptr);
+        }
+
+        const uint8_t* as_binary(const View& b, Binary_type* t, uint32_t* sz)
+        {
+            if (Type::k_binary != b.type())
+            {
+                throw Bson_type_exception("Attempt to get non-binary view as binary.", b.type());
+            }
+            const uint8_t* v = b.data();
+            memcpy(sz, v, 4);
+            memcpy(t, v + 4, 1);
+            return v + 5;
+        }
+
+        Uuid as_uuid(const View& b)
+        {
+            Binary_type t = Binary_type::k_bin_generic;
+            uint32_t sz;
+            if (b && Type::k_null != b.type())
+            {
+                const uint8_t* ptr = as_binary(b, &t, &sz);
+                if (Binary_type::k_bin_uuid == t && 16 == sz)
+                {
+                    return Uuid(ptr);
+                }
+            }
+            return Uuid::k_nil;
+        }
+
         void increment(Node& b, int amount)
         {
             const int64_t v = as_int64(b) + amount;
@@ -1410,11 +2810,12 @@ namespace lj
         {
             if (Type::k_document == changes.type())
             {
-                for (auto iter = changes.to_map().begin();
-                        changes.to_map().end() != iter;
-                        ++iter)
+                Path key;
+                for (auto iter = changes.begin(); changes.end() != iter; ++iter)
                 {
-                    combine(target.nav(iter->first), *(iter->second));
+                    key.clear();
+                    key.push_back(iter.key());
+                    combine(target.nav(key), *iter);
                 }
             }
             else
@@ -1422,10 +2823,31 @@ namespace lj
                 target = changes;
             }
         }
+
+        void content_hash(const Node& n, uint8_t* out)
+        {
+            std::string buffer;
+            buffer.reserve(n.size() + 1);
+            buffer.push_back(static_cast<char>(canonical_type(n.type())));
+            canonical_value(n, buffer);
+
+            lj::Blake2b hasher(k_content_hash_size);
+            hasher.update(buffer.data(), buffer.size());
+            hasher.finish(out);
+            lj::Wiper<char[]>::wipe(&buffer[0], buffer.size());
+        }
     }; // namespace lj::bson
 }; // namespace lj
 
 std::istream& operator>>(std::istream& is, lj::bson::Node& val)
+{
+    lj::bson::View view;
+    is >> view;
+    val.set_value(lj::bson::Type::k_document, view.data());
+    return is;
+}
+
+std::istream& operator>>(std::istream& is, lj::bson::View& val)
 {
     // Wrap the lock in a unique_ptr to make sure it gets cleaned up in the
     // stack unwind.
@@ -1448,42 +2870,92 @@ std::istream& operator>>(std::istream& is, lj::bson::Node& val)
         lj::log::format<lj::Debug>("Reading BSON node from non-locking streambuf.")
                 << lj::log::end;
     }
-    
-    int read_bytes = 0;
-    char len[4];
-    while (read_bytes < 4 && is.good())
-    {
-        is.read(len + read_bytes, 4 - read_bytes);
-        read_bytes += is.gcount();
-    }
 
-    if (!is.good())
-    {
-        throw LJ__Exception("Unable to read the length from the input stream.");
-    }
+    // Validate the frame as it arrives, so an oversized or malformed
+    // document is rejected before it is buffered.
+    lj::bson::Decoder decoder;
 
-    int32_t document_length = *reinterpret_cast<uint32_t*>(len);
-    char* document_buffer = new char[document_length];
-    memcpy(document_buffer, len, 4);
-    while (read_bytes < document_length && is.good())
+    // When the whole document is already buffered, view it in place.
+    lj::Streambuf_buffer* in_place = dynamic_cast<lj::Streambuf_buffer*>(is.rdbuf());
+    if (in_place)
     {
-        is.read(document_buffer + read_bytes, document_length - read_bytes);
-        read_bytes += is.gcount();
+        const size_t document_length = decoder.scan(
+                reinterpret_cast<const uint8_t*>(in_place->input_data()),
+                in_place->input_size());
+        if (0 < document_length)
+        {
+            val = lj::bson::View(reinterpret_cast<const uint8_t*>(in_place->input_data()));
+            in_place->consume_input(document_length);
+            return is;
+        }
+        decoder.reset();
     }
 
-    if (!is.good())
+    // Grow the buffer as the bytes arrive instead of trusting the claimed
+    // length up front.
+    const size_t k_read_chunk = 64 * 1024;
+    std::shared_ptr<std::vector<uint8_t> > document_buffer(
+            new std::vector<uint8_t>());
+    std::vector<uint8_t>& bytes = *document_buffer;
+    size_t document_length = 0;
+    while (0 == document_length)
     {
-        throw LJ__Exception("Unable to read document from the input stream.");
+        const size_t wanted = (0 == decoder.frame_size()) ?
+                4 - bytes.size() :
+                std::min(k_read_chunk, decoder.frame_size() - bytes.size());
+        const size_t offset = bytes.size();
+        bytes.resize(offset + wanted);
+        is.read(reinterpret_cast<char*>(bytes.data() + offset), wanted);
+        bytes.resize(offset + is.gcount());
+
+        if (!is.good())
+        {
+            if (bytes.size() < 4)
+            {
+                throw LJ__Exception("Unable to read the length from the input stream.");
+            }
+            throw LJ__Exception("Unable to read document from the input stream.");
+        }
+        document_length = decoder.scan(bytes.data(), bytes.size());
     }
 
-    val.set_value(lj::bson::Type::k_document,
-            reinterpret_cast<uint8_t*>(document_buffer));
-
-    delete[] document_buffer;
+    val = lj::bson::View(std::shared_ptr<const uint8_t>(document_buffer,
+            document_buffer->data()));
 
     return is;
 }
 
+namespace
+{
+    // Write bson bytes, holding the stream's mutex if it has one.
+    void write_bson(std::ostream& os, const char* data, size_t sz)
+    {
+        // Wrap the lock in a unique_ptr to make sure it gets cleaned up in the
+        // stack unwind.
+        std::unique_ptr<std::unique_lock<std::mutex> > io_lock;
+
+        // Try to extract the mutex from this stream.
+        lj::Streambuf_mutex<std::remove_reference<decltype(os)>::type::char_type>* buffer =
+                dynamic_cast<lj::Streambuf_mutex<std::remove_reference<decltype(os)>::type::char_type>*>(os.rdbuf());
+        if (buffer)
+        {
+            // Create a new lock on the mutex. 
+            io_lock.reset(new std::unique_lock<std::mutex>(buffer->mutex()));
+
+            lj::log::format<lj::Debug>("Locking %p for writing BSON node.")
+                    << buffer
+                    << lj::log::end;
+        }
+        else
+        {
+            lj::log::format<lj::Debug>("Writing BSON node to non-locking streambuf.")
+                    << lj::log::end;
+        }
+
+        os.write(data, sz);
+    }
+}; // namespace (anonymous)
+
 std::ostream& operator<<(std::ostream& os, const lj::bson::Node& val)
 {
     // unmarshalling the object could be time consuming, so do it outside the
@@ -1491,30 +2963,12 @@ std::ostream& operator<<(std::ostream& os, const lj::bson::Node& val)
     size_t sz;
     std::unique_ptr<char[], lj::Wiper<char[]>> data(reinterpret_cast<char*>(val.to_binary(&sz)));
     data.get_deleter().set_count(sz);
+    write_bson(os, data.get(), sz);
+    return os;
+}
 
-    // Wrap the lock in a unique_ptr to make sure it gets cleaned up in the
-    // stack unwind.
-    std::unique_ptr<std::unique_lock<std::mutex> > io_lock;
-    
-    // Try to extract the mutex from this stream.
-    lj::Streambuf_mutex<std::remove_reference<decltype(os)>::type::char_type>* buffer =
-            dynamic_cast<lj::Streambuf_mutex<std::remove_reference<decltype(os)>::type::char_type>*>(os.rdbuf());
-    if (buffer)
-    {
-        // Create a new lock on the mutex. 
-        io_lock.reset(new std::unique_lock<std::mutex>(buffer->mutex()));
-        
-        lj::log::format<lj::Debug>("Locking %p for writing BSON node.")
-                << buffer
-                << lj::log::end;
-    }
-    else
-    {
-        lj::log::format<lj::Debug>("Writing BSON node to non-locking streambuf.")
-                << lj::log::end;
-    }
-    
-    os.write(data.get(), sz);
-
+std::ostream& operator<<(std::ostream& os, const lj::bson::View& val)
+{
+    write_bson(os, reinterpret_cast<const char*>(val.data()), val.size());
     return os;
 }
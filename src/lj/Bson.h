@@ -33,17 +33,22 @@
  POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "lj/Arena.h"
 #include "lj/Exception.h"
 #include "lj/Uuid.h"
 
+#include <atomic>
 #include <cstdint>
 #include <list>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace lj
 {
+    class Executor;
+
     namespace bson
     {
         /*!
@@ -59,13 +64,19 @@ namespace lj
             k_array = 0x04, //!< Node contains a nested array value.
             k_binary = 0x05, //!< Node contains a binary value.
             k_binary_document = 0x06, //!< Node contains a document that has not been parsed (Raw bytes).
+            k_object_id = 0x07, //!< Node contains a 12 byte object id.
             k_boolean = 0x08, //!< Node contains a boolean value.
-            k_datetime = 0x09, //!< Node contains a date/time value.
+            k_datetime = 0x09, //!< Node contains milliseconds since the unix epoch.
             k_null = 0x0A, //!< Node contains a null value.
+            k_regex = 0x0B, //!< Node contains a regular expression and its options.
+            k_db_pointer = 0x0C, //!< Node contains a deprecated db pointer value.
             k_javascript = 0x0D, //!< Node contains a javascript value.
+            k_symbol = 0x0E, //!< Node contains a deprecated symbol value.
+            k_javascript_scope = 0x0F, //!< Node contains javascript with a scope document.
             k_int32 = 0x10, //!< Node contains a int32 number value.
             k_timestamp = 0x11, //!< Node contains a timestamp value.
             k_int64 = 0x12, //!< Node contains a int64 number value.
+            k_decimal128 = 0x13, //!< Node contains a 128-bit decimal value.
             k_minkey = 0xFF, //!< Node contains a reserved BSON spec value.
             k_maxkey = 0x7F //!< Node contains a reserved BSON spec value.
         };
@@ -97,27 +108,80 @@ namespace lj
             switch (t)
             {
                 case Type::k_null:
+                case Type::k_minkey:
+                case Type::k_maxkey:
                     return 0;
                 case Type::k_boolean:
                     return 1;
+                case Type::k_regex:
+                    return 2;
                 case Type::k_int32:
                     return 4;
                 case Type::k_string:
+                case Type::k_javascript:
+                case Type::k_symbol:
                 case Type::k_binary:
                 case Type::k_binary_document:
                 case Type::k_document:
                 case Type::k_array:
                     return 5;
                 case Type::k_timestamp:
+                case Type::k_datetime:
                 case Type::k_int64:
                 case Type::k_double:
                     return 8;
+                case Type::k_object_id:
+                    return 12;
+                case Type::k_javascript_scope:
+                    return 14;
+                case Type::k_decimal128:
+                    return 16;
+                case Type::k_db_pointer:
+                    return 17;
                 default:
                     break;
             }
             return 5;
         }
 
+        /*!
+         \brief Test if a type always uses the same number of bytes.
+
+         The size of a fixed size value is type_min_size().
+         \since 1.0
+         */
+        inline bool type_is_fixed_size(const Type t)
+        {
+            switch (t)
+            {
+                case Type::k_null:
+                case Type::k_minkey:
+                case Type::k_maxkey:
+                case Type::k_boolean:
+                case Type::k_int32:
+                case Type::k_timestamp:
+                case Type::k_datetime:
+                case Type::k_int64:
+                case Type::k_double:
+                case Type::k_object_id:
+                case Type::k_decimal128:
+                    return true;
+                default:
+                    break;
+            }
+            return false;
+        }
+
+        /*!
+         \brief Get the number of bytes used by a value.
+         \param t The type of the value.
+         \param v The value bytes. Only read for variable sized types.
+         \return The number of value bytes.
+         \throws lj::bson::Bson_type_exception if \c t is not a bson type.
+         \since 1.0
+         */
+        size_t type_value_size(const Type t, const uint8_t* v);
+
         //! Test if a type is a nested type (Array, or document).
         inline bool type_is_nested(const Type t)
         {
@@ -145,10 +209,20 @@ namespace lj
             return !type_is_nested(t);
         }
 
-        //! Test if a type is quotablable (string types).
+        //! Test if a type is quotablable (types shown as strings).
         inline bool type_is_quotable(const Type t)
         {
-            return (t == Type::k_string);
+            return (t == Type::k_string ||
+                    t == Type::k_javascript ||
+                    t == Type::k_symbol ||
+                    t == Type::k_javascript_scope ||
+                    t == Type::k_datetime ||
+                    t == Type::k_object_id ||
+                    t == Type::k_regex ||
+                    t == Type::k_db_pointer ||
+                    t == Type::k_decimal128 ||
+                    t == Type::k_minkey ||
+                    t == Type::k_maxkey);
         }
 
         //! Test if a type is a numerical type (integers and floats).
@@ -157,7 +231,8 @@ namespace lj
             return (t == Type::k_int32 ||
                     t == Type::k_int64 ||
                     t == Type::k_timestamp ||
-                    t == Type::k_double);
+                    t == Type::k_double ||
+                    t == Type::k_decimal128);
         }
 
         //! Test if a type is a native c++ type (integers, floats, booleans, null).
@@ -265,15 +340,157 @@ namespace lj
             Binary_type binary_type_;
         };
 
+        /*!
+         \brief Pre-parsed bson path.
+         \since 1.0
+
+         A path split into its elements once, so repeated lookups with the
+         same path do not parse the string again. Build paths used in hot
+         code once and reuse them, for example as namespace scope
+         constants.
+
+         Path strings follow the same rules as Node::path(const std::string&):
+         elements are separated by forward slashes, empty elements are
+         ignored, and a backslash escapes the next character.
+         */
+        class Path
+        {
+        public:
+            //! Iterator over the path elements.
+            typedef std::vector<std::string>::const_iterator const_iterator;
+
+            //! Create an empty path, referring to the root node.
+            Path() = default;
+
+            /*!
+             \brief Parse a path string.
+             \param p The path string.
+             */
+            explicit Path(const std::string& p);
+
+            /*!
+             \brief Parse a path string.
+             \param p The path string.
+             */
+            explicit Path(const char* p);
+
+            //! Copy constructor.
+            Path(const Path& o) = default;
+
+            //! Move constructor.
+            Path(Path&& o) = default;
+
+            //! Destructor.
+            ~Path() = default;
+
+            //! Copy assignment operator.
+            Path& operator=(const Path& o) = default;
+
+            //! Move assignment operator.
+            Path& operator=(Path&& o) = default;
+
+            /*!
+             \brief Append an element.
+
+             The element is used as is; slashes and backslashes are not
+             interpreted.
+             \param element The element to append.
+             \return This path.
+             */
+            Path& push_back(const std::string& element);
+
+            //! Remove the last element.
+            void pop_back();
+
+            //! Remove every element.
+            void clear();
+
+            //! Get the number of elements.
+            inline size_t size() const
+            {
+                return parts_.size();
+            }
+
+            //! Test if the path refers to the root node.
+            inline bool empty() const
+            {
+                return parts_.empty();
+            }
+
+            //! Get an element by position.
+            inline const std::string& operator[](size_t indx) const
+            {
+                return parts_[indx];
+            }
+
+            //! Get the last element.
+            inline const std::string& back() const
+            {
+                return parts_.back();
+            }
+
+            //! Get an iterator to the first element.
+            inline const_iterator begin() const
+            {
+                return parts_.begin();
+            }
+
+            //! Get an iterator past the last element.
+            inline const_iterator end() const
+            {
+                return parts_.end();
+            }
+
+            //! Get the escaped path string.
+            std::string str() const;
+        private:
+            std::vector<std::string> parts_;
+        }; // class lj::bson::Path
+
         /*!
          \brief Bson value.
          \since 1.0
 
          Represets a Bson value, including documents and arrays.
+
+         Nodes, their child containers and their value buffers are
+         allocated through lj::Arena::acquire(). Trees built while an
+         lj::Arena::Scope is active live in that arena and must be
+         destroyed before it is released.
+
+         Copying a document or array shares its children with the
+         original instead of duplicating them. The first modification
+         through either copy gives the nodes from the root down to the
+         modified node their own children; the rest of the tree stays
+         shared. Navigating with a non-const method counts as a
+         modification. Children in an arena are only shared by copies
+         made in the same arena; a tree changed while a scope was active
+         belongs to that arena, and so do the copies sharing it.
+
+         A pointer or reference to a child that was obtained before
+         the tree was copied must not be used to modify it afterwards.
+         Navigate from the root again instead.
+
+         Documents created from bson bytes keep a copy of the bytes and
+         parse their children on first access, so nested documents that
+         are never visited are never parsed. Nested documents point into
+         that same copy. Until a document is modified, to_binary() copies
+         its bytes instead of walking it.
          */
         class Node
         {
         public:
+            class Iterator;
+
+            //! Child storage for Type::k_array nodes.
+            typedef std::vector<Node*, lj::Arena_allocator<Node*> > Array;
+
+            //! Allocate a node from the current arena or the heap.
+            static void* operator new(size_t sz);
+
+            //! Release a node allocated by operator new.
+            static void operator delete(void* ptr);
+
             /*!
              \brief Create a new document Node.
 
@@ -383,6 +600,24 @@ namespace lj
              */
             const Node* path(const std::string& p) const;
 
+            /*!
+             \brief Get a pointer to a specific Node object in the document.
+
+             Pre-parsed version of \c #path(const std::string&).
+             \param p The path to follow.
+             \return Pointer to the found or created object.
+             */
+            Node* path(const Path& p);
+
+            /*!
+             \brief Get a pointer to a specific Node object in the document.
+
+             Pre-parsed version of \c #path(const std::string&)const.
+             \param p The path to follow.
+             \return Pointer to the found object or \c nullptr
+             */
+            const Node* path(const Path& p) const;
+
             /*!
              \brief Get a specific Node object at a path.
 
@@ -416,6 +651,23 @@ namespace lj
                 return *ptr;
             }
 
+            //! Pre-parsed version of \c #nav(const std::string&).
+            inline Node& nav(const Path& p)
+            {
+                return *path(p);
+            }
+
+            //! Pre-parsed version of \c #nav(const std::string&)const.
+            inline const Node& nav(const Path& p) const
+            {
+                const Node* ptr = path(p);
+                if (!ptr)
+                {
+                    throw Bson_path_exception("Path not found.", p.str());
+                }
+                return *ptr;
+            }
+
             /*!
              \brief Get a specific Node object at a path.
 
@@ -444,6 +696,18 @@ namespace lj
                 return nav(p);
             }
 
+            //! Pre-parsed version of \c #operator[](const std::string&).
+            inline Node& operator[](const Path& p)
+            {
+                return nav(p);
+            }
+
+            //! Pre-parsed version of \c #operator[](const std::string&)const.
+            inline const Node& operator[](const Path& p) const
+            {
+                return nav(p);
+            }
+
             /*!
              \brief Set a child at a specific path.
 
@@ -459,6 +723,9 @@ namespace lj
              */
             void set_child(const std::string& path, Node* child);
 
+            //! Pre-parsed version of \c #set_child(const std::string&, Node*).
+            void set_child(const Path& path, Node* child);
+
             /*!
              \brief Push a child at a specific path.
 
@@ -475,6 +742,9 @@ namespace lj
              */
             void push_child(const std::string& path, Node* child);
 
+            //! Pre-parsed version of \c #push_child(const std::string&, Node*).
+            void push_child(const Path& path, Node* child);
+
             /*!
              \brief Push a child onto this Node object.
              \param o other object to copy from.
@@ -501,19 +771,30 @@ namespace lj
             }
 
             /*!
-             \brief Get the map backing document nodes.
-             \return A map of children.
+             \brief Get an iterator to the first child of a document.
+
+             Children are visited in key order.
+             \return The iterator.
+             \throws lj::bson::Bson_type_exception When called on
+             non-document nodes.
+             */
+            Iterator begin() const;
+
+            /*!
+             \brief Get an iterator past the last child of a document.
+             \return The iterator.
              \throws lj::bson::Bson_type_exception When called on
              non-document nodes.
              */
-            inline const std::map<std::string, Node*>& to_map() const
-            {
-                if (Type::k_document != type())
-                {
-                    throw Bson_type_exception("Unable to represent object as a map.", type());
-                }
-                return *(value_.map_);
-            }
+            Iterator end() const;
+
+            /*!
+             \brief Get the number of children in a document.
+             \return The number of children.
+             \throws lj::bson::Bson_type_exception When called on
+             non-document nodes.
+             */
+            size_t count() const;
 
             /*!
              \brief Get the vector backing array type.
@@ -521,13 +802,13 @@ namespace lj
              \throws lj::bson::Bson_type_exception When called on
              non-array types.
              */
-            inline const std::vector<Node*>& to_vector() const
+            inline const Array& to_vector() const
             {
                 if (Type::k_array != type())
                 {
                     throw Bson_type_exception("Unable to represent object as a vector.", type());
                 }
-                return *(value_.vector_);
+                return value_.vector_->items;
             }
 
             /*!
@@ -551,7 +832,8 @@ namespace lj
              \c delete[].
 
              The array length can be obtained by calling \c size(), but it is
-             recommended that you use the size pointer to get the size.
+             recommended that you use the size pointer to get the size. The
+             tree is traversed once to size the buffer and once to fill it.
              \param sz_ptr [out] Location to store the size of the data.
              \return A byte array contain the bson document.
              */
@@ -569,6 +851,41 @@ namespace lj
                 return ptr;
             }
 
+            /*!
+             \brief get the value of the document node as a bson string,
+             using several threads for large documents and arrays.
+
+             The children of documents and arrays with thousands of
+             children are sized and written in chunks on the workers of
+             \c executor, with the calling thread taking chunks too. It is
+             safe to call from one of the executor's own workers. Smaller
+             trees are written as by \c to_binary(size_t*)const.
+
+             Pointer is allocated with \c new[] and must be released with
+             \c delete[]. The tree must not be modified until this returns.
+             \param sz_ptr [out] Location to store the size of the data.
+             \param executor The executor to spread the work over.
+             \return A byte array contain the bson document.
+             */
+            uint8_t* to_binary(size_t* sz_ptr, lj::Executor& executor) const;
+
+            /*!
+             \brief Get the value of the node in the canonical encoding.
+
+             Equal values always have the same canonical encoding. Document
+             fields are written in key order, int32 values are written as
+             int64, binary documents as documents, and doubles with a
+             single zero and a single NaN. Field order in the source bytes
+             does not matter.
+
+             Pointer is allocated with \c new[] and must be released with
+             \c delete[].
+             \param sz_ptr [out] Location to store the size of the data.
+             \return A byte array containing the canonical value.
+             \sa lj::bson::content_hash(const Node&, uint8_t*)
+             */
+            uint8_t* to_canonical_binary(size_t* sz_ptr) const;
+
             //! Get the type of the document node.
             inline Type type() const
             {
@@ -581,28 +898,336 @@ namespace lj
                 return (this->path(path) != NULL);
             }
 
+            //! Pre-parsed version of \c #exists(const std::string&)const.
+            bool exists(const Path& path) const
+            {
+                return (this->path(path) != NULL);
+            }
+
             /*! Get the size of the node.
 
-             This requires traversing the entire node tree and can
-             be expensive on larger documents.
+             This traverses the node tree once and is linear in the
+             number of nodes. Unmodified documents read from bson are
+             sized from their bytes.
              */
             size_t size() const;
 
         private:
+            // Document children are kept in a flat array sorted by key.
+            // Larger documents also get a hash index for lookups.
+            struct Entry
+            {
+                std::string key;
+                Node* node;
+            };
+            class Children;
+            class Parallel_writer;
+
+            // Array children, shared between copies until one of them is
+            // modified.
+            struct Shared_array
+            {
+                Shared_array() : items(), refs(1)
+                {
+                }
+
+                Array items;
+                std::atomic<uint32_t> refs;
+            };
+
             Type type_;
 
             union
             {
                 uint8_t* data_;
-                std::vector<Node*>* vector_;
-                std::map<std::string, Node*>* map_;
+                Shared_array* vector_;
+                Children* map_;
             } value_;
 
+            const Children& children() const;
+
+            void detach();
+
+            void release_children();
+
             size_t copy_to_bson(uint8_t *) const;
 
+            Node* find_or_create(const Path& p, size_t count);
+
             void destroy(bool);
         }; // class lj::bson::Node
 
+        /*!
+         \brief Iterator over the children of a document node.
+         \since 1.0
+
+         Iterators are invalidated when the document is modified.
+         */
+        class Node::Iterator
+        {
+        public:
+            //! Get the key of the current child.
+            inline const std::string& key() const
+            {
+                return ptr_->key;
+            }
+
+            //! Get the current child.
+            inline const Node& value() const
+            {
+                return *(ptr_->node);
+            }
+
+            //! Get the current child.
+            inline const Node& operator*() const
+            {
+                return value();
+            }
+
+            //! Get the current child.
+            inline const Node* operator->() const
+            {
+                return ptr_->node;
+            }
+
+            //! Advance to the next child.
+            inline Iterator& operator++()
+            {
+                ++ptr_;
+                return *this;
+            }
+
+            //! Compare iterator positions.
+            inline bool operator==(const Iterator& o) const
+            {
+                return ptr_ == o.ptr_;
+            }
+
+            //! Compare iterator positions.
+            inline bool operator!=(const Iterator& o) const
+            {
+                return ptr_ != o.ptr_;
+            }
+        private:
+            friend class Node;
+            explicit Iterator(const Entry* ptr) : ptr_(ptr)
+            {
+            }
+
+            const Entry* ptr_;
+        }; // class lj::bson::Node::Iterator
+
+        /*!
+         \brief Read-only view of a bson value.
+         \since 1.0
+
+         A view reads bson bytes in place, such as a mapped storage segment
+         or a connection read buffer. Navigating and iterating a view never
+         allocates; a Node is only needed when the data must be modified,
+         and can be created with #to_node().
+
+         A view created from a raw pointer does not own the bytes and is
+         only valid as long as they are. A view created from a shared
+         buffer keeps the buffer alive, as do all views derived from it.
+         */
+        class View
+        {
+        public:
+            class Iterator;
+
+            //! Create a view that refers to nothing.
+            View();
+
+            /*!
+             \brief Create a view of a bson document.
+             \param doc The document bytes, starting with the length.
+             */
+            explicit View(const uint8_t* doc);
+
+            /*!
+             \brief Create a view of a bson value.
+             \param t The type of the value.
+             \param v The value bytes.
+             */
+            View(const Type t, const uint8_t* v);
+
+            /*!
+             \brief Create a view that shares ownership of a document buffer.
+             \param doc The document bytes, starting with the length.
+             */
+            explicit View(const std::shared_ptr<const uint8_t>& doc);
+
+            //! Default copy constructor.
+            View(const View& o) = default;
+
+            //! Default move constructor.
+            View(View&& o) = default;
+
+            //! Default copy assignment operator.
+            View& operator=(const View& o) = default;
+
+            //! Default move assignment operator.
+            View& operator=(View&& o) = default;
+
+            //! Destructor.
+            ~View() = default;
+
+            //! Test if the view refers to a value.
+            inline explicit operator bool() const
+            {
+                return nullptr != data_;
+            }
+
+            //! Get the type of the viewed value.
+            inline Type type() const
+            {
+                return type_;
+            }
+
+            //! Get the raw bytes of the viewed value.
+            inline const uint8_t* data() const
+            {
+                return data_;
+            }
+
+            //! Get the number of bytes in the viewed value.
+            size_t size() const;
+
+            /*!
+             \brief Get the value bytes.
+             \return The value bytes.
+             \throws lj::bson::Bson_type_exception for document and array types.
+             */
+            const uint8_t* to_value() const;
+
+            /*!
+             \brief Get the view of a specific path.
+
+             Paths follow the same rules as Node::path(const std::string&)const.
+             \param p The path to follow.
+             \return The view at that path, or an empty view.
+             */
+            View path(const std::string& p) const;
+
+            /*!
+             \brief Get the view of a specific path.
+             \param p The path to follow.
+             \return The view at that path.
+             \throws lj::bson::Bson_path_exception if the path is not found.
+             */
+            View nav(const std::string& p) const;
+
+            //! Pre-parsed version of \c #path(const std::string&)const.
+            View path(const Path& p) const;
+
+            //! Pre-parsed version of \c #nav(const std::string&)const.
+            View nav(const Path& p) const;
+
+            /*!
+             \brief Get the view of a specific path.
+
+             Syntatical sugar for \c nav(p).
+             \param p The path to follow.
+             \return The view at that path.
+             */
+            inline View operator[](const std::string& p) const
+            {
+                return nav(p);
+            }
+
+            //! Pre-parsed version of \c #operator[](const std::string&)const.
+            inline View operator[](const Path& p) const
+            {
+                return nav(p);
+            }
+
+            //! Test if a path exists.
+            inline bool exists(const std::string& p) const
+            {
+                return static_cast<bool>(path(p));
+            }
+
+            //! Test if a pre-parsed path exists.
+            inline bool exists(const Path& p) const
+            {
+                return static_cast<bool>(path(p));
+            }
+
+            /*!
+             \brief Get an iterator to the first field.
+             \throws lj::bson::Bson_type_exception for value types.
+             */
+            Iterator begin() const;
+
+            //! Get an iterator past the last field.
+            Iterator end() const;
+
+            /*!
+             \brief Create a mutable copy of the viewed value.
+             \return The new node.
+             */
+            Node to_node() const;
+
+        private:
+            View child(const std::string& name) const;
+
+            Type type_;
+            const uint8_t* data_;
+            std::shared_ptr<const uint8_t> owner_;
+        }; // class lj::bson::View
+
+        /*!
+         \brief Iterator over the fields of a document or array view.
+         \since 1.0
+         */
+        class View::Iterator
+        {
+        public:
+            //! Default copy constructor.
+            Iterator(const Iterator& o) = default;
+
+            //! Default copy assignment operator.
+            Iterator& operator=(const Iterator& o) = default;
+
+            //! Get the field name.
+            inline const char* key() const
+            {
+                return reinterpret_cast<const char*>(ptr_ + 1);
+            }
+
+            //! Get the field value.
+            View value() const;
+
+            //! Get the field value.
+            inline View operator*() const
+            {
+                return value();
+            }
+
+            //! Move to the next field.
+            Iterator& operator++();
+
+            //! Compare iterator positions.
+            inline bool operator==(const Iterator& o) const
+            {
+                return ptr_ == o.ptr_;
+            }
+
+            //! Compare iterator positions.
+            inline bool operator!=(const Iterator& o) const
+            {
+                return ptr_ != o.ptr_;
+            }
+
+        private:
+            friend class View;
+            Iterator(const uint8_t* ptr,
+                    const std::shared_ptr<const uint8_t>& owner);
+
+            const uint8_t* ptr_;
+            std::shared_ptr<const uint8_t> owner_;
+        }; // class lj::bson::View::Iterator
+
         /*!
          \brief Escape slashes for bson keys.
          \param input The string to escape.
@@ -695,6 +1320,78 @@ namespace lj
          */
         Node* new_array();
 
+        /*!
+         \brief Create a new date/time object.
+
+         Pointer should be released with delete.
+         \param ms Milliseconds since the unix epoch, in UTC.
+         \return a new Node object.
+         */
+        Node* new_datetime(const int64_t ms);
+
+        /*!
+         \brief Create a new timestamp object.
+
+         Pointer should be released with delete.
+         \param val The timestamp value.
+         \return a new Node object.
+         */
+        Node* new_timestamp(const uint64_t val);
+
+        /*!
+         \brief Create a new object id object.
+
+         Pointer should be released with delete.
+         \param oid The 12 object id bytes.
+         \return a new Node object.
+         */
+        Node* new_object_id(const uint8_t* oid);
+
+        /*!
+         \brief Create a new regular expression object.
+
+         Pointer should be released with delete.
+         \param pattern The expression.
+         \param options The option letters, such as "i" or "mx".
+         \return a new Node object.
+         */
+        Node* new_regex(const std::string& pattern, const std::string& options);
+
+        /*!
+         \brief Create a new javascript object.
+
+         Pointer should be released with delete.
+         \param code The javascript source.
+         \return a new Node object.
+         */
+        Node* new_javascript(const std::string& code);
+
+        /*!
+         \brief Create a new 128-bit decimal object.
+
+         Pointer should be released with delete.
+         \param val The 16 bytes of the IEEE 754 decimal, in the binary
+         integer encoding used by bson.
+         \return a new Node object.
+         */
+        Node* new_decimal128(const uint8_t* val);
+
+        /*!
+         \brief Create a new min key object.
+
+         Pointer should be released with delete.
+         \return a new Node object.
+         */
+        Node* new_minkey();
+
+        /*!
+         \brief Create a new max key object.
+
+         Pointer should be released with delete.
+         \return a new Node object.
+         */
+        Node* new_maxkey();
+
         /*!
          \brief Create a new node from a json string.
 
@@ -709,6 +1406,22 @@ namespace lj
          */
         Node* parse_json(const std::string& val);
 
+        /*!
+         \brief Create a new node from a json buffer.
+
+         The buffer is expected to hold a well-formed json document
+         that will be parsed into a bson document node. The buffer does
+         not need to be null terminated.
+
+         Pointer should be released with delete.
+         \param data The json text.
+         \param sz The number of bytes in \c data.
+         \return A new Node object.
+         \exception lj::Exception Upon encountering unparsable data in the
+         buffer.
+         */
+        Node* parse_json(const char* data, size_t sz);
+
         /*!
          \brief Create a new node from a json std::istream.
 
@@ -742,7 +1455,9 @@ namespace lj
          \brief Get the value of a Bson object as a c++ string.
 
          Value types are output in their string representation.  Document and
-         array types are output in a JSON looking format.
+         array types are output in a JSON looking format. Date/times are
+         output in ISO 8601 format in UTC, object ids in hex, regular
+         expressions as /pattern/options and decimals in decimal notation.
          \param b The Node object.
          \return A string describing how this Node object should look in JSON.
          */
@@ -847,6 +1562,62 @@ namespace lj
          */
         Uuid as_uuid(const Node& b);
 
+        /*!
+         \brief Get the value of a bson view as a c++ string.
+         \sa as_string(const Node&)
+         */
+        std::string as_string(const View& b);
+
+        /*!
+         \brief Get the value of a bson view as a json string with indenting.
+         \sa as_json_string(const Node&, int)
+         */
+        std::string as_json_string(const View& b, int lvl = 1);
+
+        /*!
+         \brief Get the value of a bson view as an 32-bit wide integer.
+         \sa as_int32(const Node&)
+         */
+        int32_t as_int32(const View& b);
+
+        /*!
+         \brief Get the value of a bson view as an 64-bit wide integer.
+         \sa as_int64(const Node&)
+         */
+        int64_t as_int64(const View& b);
+
+        /*!
+         \brief Get the value of a bson view as an unsigned 64-bit wide integer.
+         \sa as_uint64(const Node&)
+         */
+        uint64_t as_uint64(const View& b);
+
+        /*!
+         \brief Get the value of a bson view as a boolean.
+         \sa as_boolean(const Node&)
+         */
+        bool as_boolean(const View& b);
+
+        /*!
+         \brief Get the value of a bson view as a double.
+         \sa as_double(const Node&)
+         */
+        double as_double(const View& b);
+
+        /*!
+         \brief Get the value of a bson view as a pointer.
+
+         The pointer refers to the viewed bytes.
+         \sa as_binary(const Node&, Binary_type*, uint32_t*)
+         */
+        const uint8_t* as_binary(const View& b, Binary_type* t, uint32_t* sz);
+
+        /*!
+         \brief Get the value of a bson view as a lj::Uuid.
+         \sa as_uuid(const Node&)
+         */
+        Uuid as_uuid(const View& b);
+
         /*!
          \brief Increment the value of a bson object.
 
@@ -866,6 +1637,58 @@ namespace lj
          \param changes [in] The paths and data to add to \c target.
          */
         void combine(Node& target, const Node& changes);
+
+        /*!
+         \brief Create a patch that turns one node into another.
+
+         The patch is a document of operations keyed by escaped path
+         strings, so only the changed parts of \c b are copied:
+         - \c set: a document of paths and the values to store there.
+         - \c unset: an array of paths to remove.
+         - \c push: a document of paths and arrays of items to append.
+         - \c inc: a document of paths and the 64-bit amount to add.
+
+         Integers that changed are recorded as increments and arrays
+         that only grew are recorded as pushes. An empty path refers to
+         the node itself. An empty patch means the nodes are equal.
+         \param a [in] The original node.
+         \param b [in] The changed node.
+         \return A new patch document. The caller owns the result.
+         \sa apply(Node&, const Node&)
+         */
+        Node* diff(const Node& a, const Node& b);
+
+        /*!
+         \brief Apply a patch created by diff() to a node.
+
+         Operations are applied in the order unset, set, push and inc.
+         Missing parents of set paths are created as documents, and
+         missing push targets are created as arrays. Increments keep the
+         width of an existing 32-bit integer.
+         \param target [in,out] The node to modify.
+         \param patch [in] The patch to apply.
+         \throws lj::bson::Bson_path_exception if the patch refers to a
+         path that cannot be created.
+         \throws lj::bson::Bson_type_exception if the patch is malformed.
+         \sa diff(const Node&, const Node&)
+         */
+        void apply(Node& target, const Node& patch);
+
+        //! Number of bytes in a content hash.
+        const size_t k_content_hash_size = 32;
+
+        /*!
+         \brief Hash the content of a node.
+
+         The hash is a 256 bit BLAKE2b digest of the node's type and its
+         canonical encoding, so equal values hash the same however they
+         were built. It is suitable for deduplication, replica comparison
+         and entity tags.
+         \param n [in] The node to hash.
+         \param out [out] Location for k_content_hash_size bytes.
+         \sa Node::to_canonical_binary(size_t*)const
+         */
+        void content_hash(const Node& n, uint8_t* out);
     }; // namespace lj::bson
 }; // namespace lj
 
@@ -880,6 +1703,20 @@ namespace lj
  */
 std::istream& operator>>(std::istream& is, lj::bson::Node& val);
 
+/*!
+ \brief Extract data with format.
+
+ Extract an lj::bson::View object from the datastream. When the stream
+ reads from a lj::Streambuf_buffer holding the whole document, the view
+ refers to the buffered bytes and is only valid until the buffer is
+ compacted. Otherwise the document is copied into a buffer owned by the
+ view.
+ \param is The input stream to read from.
+ \param val The View to store the data in.
+ \return The input stream passed as \c is.
+ */
+std::istream& operator>>(std::istream& is, lj::bson::View& val);
+
 /*!
  \brief Insert data with format.
 
@@ -890,3 +1727,13 @@ std::istream& operator>>(std::istream& is, lj::bson::Node& val);
  \return The output stream passed as \c os.
  */
 std::ostream& operator<<(std::ostream& os, const lj::bson::Node& val);
+
+/*!
+ \brief Insert data with format.
+
+ Insert the bytes of an lj::bson::View to the datastream.
+ \param os The output stream to write to.
+ \param val The View to write.
+ \return The output stream passed as \c os.
+ */
+std::ostream& operator<<(std::ostream& os, const lj::bson::View& val);
@@ -0,0 +1,299 @@
+/*!
+ \file lj/Bson_decoder.cpp
+ \brief LJ Bson frame decoder implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lj/Bson_decoder.h"
+#include "lj/Bson.h"
+#include "lj/Exception.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    int32_t read_int32(const uint8_t* ptr)
+    {
+        int32_t v;
+        memcpy(&v, ptr, 4);
+        return v;
+    }
+
+    // Get the number of bytes needed to find the size of a value, or zero
+    // if the type is not accepted on the wire.
+    size_t header_size(lj::bson::Type t)
+    {
+        switch (t)
+        {
+            case lj::bson::Type::k_null:
+            case lj::bson::Type::k_minkey:
+            case lj::bson::Type::k_maxkey:
+            case lj::bson::Type::k_regex:
+                return 0;
+            case lj::bson::Type::k_boolean:
+                return 1;
+            case lj::bson::Type::k_int32:
+            case lj::bson::Type::k_double:
+            case lj::bson::Type::k_int64:
+            case lj::bson::Type::k_timestamp:
+            case lj::bson::Type::k_datetime:
+            case lj::bson::Type::k_string:
+            case lj::bson::Type::k_javascript:
+            case lj::bson::Type::k_symbol:
+            case lj::bson::Type::k_db_pointer:
+            case lj::bson::Type::k_binary:
+            case lj::bson::Type::k_document:
+            case lj::bson::Type::k_array:
+            case lj::bson::Type::k_javascript_scope:
+                return 4;
+            case lj::bson::Type::k_object_id:
+                return 12;
+            case lj::bson::Type::k_decimal128:
+                return 16;
+            default:
+                throw LJ__Exception("Unsupported element type in bson frame.");
+        }
+    }
+}; // namespace (anonymous)
+
+namespace lj
+{
+    namespace bson
+    {
+        Decoder::Decoder(size_t max_frame_size) :
+                max_frame_size_(max_frame_size),
+                frame_size_(0),
+                pos_(0),
+                ends_()
+        {
+        }
+
+        size_t Decoder::scan(const uint8_t* data, size_t sz)
+        {
+            if (0 == frame_size_)
+            {
+                if (sz < 4)
+                {
+                    return 0;
+                }
+                int32_t length = read_int32(data);
+                if (length < 5)
+                {
+                    throw LJ__Exception("Invalid document length in bson frame.");
+                }
+                if (static_cast<size_t>(length) > max_frame_size_)
+                {
+                    throw LJ__Exception("Bson frame exceeds the maximum frame size.");
+                }
+                frame_size_ = length;
+                pos_ = 4;
+                ends_.clear();
+                ends_.push_back(frame_size_);
+            }
+
+            // Nothing past the frame belongs to this document.
+            sz = std::min(sz, frame_size_);
+
+            while (!ends_.empty())
+            {
+                const size_t end = ends_.back();
+
+                // Every document ends with a null byte.
+                if (pos_ + 1 == end)
+                {
+                    if (sz < end)
+                    {
+                        return 0;
+                    }
+                    if (0 != data[pos_])
+                    {
+                        throw LJ__Exception("Missing document terminator in bson frame.");
+                    }
+                    pos_ = end;
+                    ends_.pop_back();
+                    continue;
+                }
+
+                // Type, key and the bytes that hold the value size.
+                if (sz <= pos_)
+                {
+                    return 0;
+                }
+                const Type t = static_cast<Type>(data[pos_]);
+                const size_t needed = header_size(t);
+                const size_t key_start = pos_ + 1;
+                const size_t limit = std::min(sz, end - 1);
+                const void* nul = (key_start < limit) ?
+                        memchr(data + key_start, 0, limit - key_start) :
+                        nullptr;
+                if (!nul)
+                {
+                    if (sz < end - 1)
+                    {
+                        return 0;
+                    }
+                    throw LJ__Exception("Unterminated element name in bson frame.");
+                }
+                const size_t value = static_cast<const uint8_t*>(nul) - data + 1;
+                if (value + needed > end - 1)
+                {
+                    throw LJ__Exception("Element overruns its document in bson frame.");
+                }
+                if (sz < value + needed)
+                {
+                    return 0;
+                }
+
+                size_t value_size = needed;
+                switch (t)
+                {
+                    case Type::k_double:
+                    case Type::k_int64:
+                    case Type::k_timestamp:
+                    case Type::k_datetime:
+                        value_size = 8;
+                        break;
+                    case Type::k_string:
+                    case Type::k_javascript:
+                    case Type::k_symbol:
+                    case Type::k_db_pointer:
+                    {
+                        int32_t length = read_int32(data + value);
+                        if (length < 1)
+                        {
+                            throw LJ__Exception("Invalid string length in bson frame.");
+                        }
+                        value_size = 4 + static_cast<size_t>(length);
+                        if (Type::k_db_pointer == t)
+                        {
+                            value_size += 12;
+                        }
+                        break;
+                    }
+                    case Type::k_regex:
+                    {
+                        // Pattern and options, both null terminated.
+                        const uint8_t* limit_ptr = data + std::min(sz, end - 1);
+                        const uint8_t* pattern = static_cast<const uint8_t*>(
+                                memchr(data + value, 0, limit_ptr - (data + value)));
+                        const uint8_t* options = pattern ?
+                                static_cast<const uint8_t*>(memchr(pattern + 1, 0, limit_ptr - (pattern + 1))) :
+                                nullptr;
+                        if (!options)
+                        {
+                            if (sz < end - 1)
+                            {
+                                return 0;
+                            }
+                            throw LJ__Exception("Unterminated regular expression in bson frame.");
+                        }
+                        value_size = options + 1 - (data + value);
+                        break;
+                    }
+                    case Type::k_javascript_scope:
+                    {
+                        int32_t length = read_int32(data + value);
+                        if (length < 14)
+                        {
+                            throw LJ__Exception("Invalid javascript scope length in bson frame.");
+                        }
+                        value_size = length;
+                        break;
+                    }
+                    case Type::k_binary:
+                    {
+                        int32_t length = read_int32(data + value);
+                        if (length < 0)
+                        {
+                            throw LJ__Exception("Invalid binary length in bson frame.");
+                        }
+                        value_size = 5 + static_cast<size_t>(length);
+                        break;
+                    }
+                    case Type::k_document:
+                    case Type::k_array:
+                    {
+                        int32_t length = read_int32(data + value);
+                        if (length < 5)
+                        {
+                            throw LJ__Exception("Invalid document length in bson frame.");
+                        }
+                        value_size = length;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                if (value_size > end - 1 - value)
+                {
+                    throw LJ__Exception("Element overruns its document in bson frame.");
+                }
+
+                if (Type::k_document == t || Type::k_array == t)
+                {
+                    // Descend; the children are checked as they arrive.
+                    ends_.push_back(value + value_size);
+                    pos_ = value + 4;
+                    continue;
+                }
+
+                if (sz < value + value_size)
+                {
+                    return 0;
+                }
+                if ((Type::k_string == t || Type::k_javascript == t || Type::k_symbol == t) &&
+                        0 != data[value + value_size - 1])
+                {
+                    throw LJ__Exception("Unterminated string in bson frame.");
+                }
+                pos_ = value + value_size;
+            }
+            return frame_size_;
+        }
+
+        void Decoder::reset()
+        {
+            frame_size_ = 0;
+            pos_ = 0;
+            ends_.clear();
+        }
+
+        void Decoder::track(size_t pos, size_t frame_size)
+        {
+            frame_size_ = frame_size;
+            pos_ = pos;
+            ends_.clear();
+        }
+    }; // namespace lj::bson
+}; // namespace lj
@@ -0,0 +1,137 @@
+#pragma once
+/*!
+ \file lj/Bson_decoder.h
+ \brief LJ Bson frame decoder header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lj
+{
+    namespace bson
+    {
+        /*!
+         \brief Incremental decoder for bson document frames.
+
+         Examines a bson document as its bytes arrive and reports when a
+         complete, well formed document is buffered. Work done on earlier
+         calls is not repeated, so a large document arriving in many reads
+         is examined once.
+
+         The decoder only reads the caller's buffer; it never allocates
+         for the document itself. The length claimed by a frame is checked
+         against the maximum frame size as soon as it arrives, so a peer
+         cannot make the reader wait on or buffer an oversized document.
+
+         Every element is checked against the bounds of its enclosing
+         document, so a frame accepted by the decoder can be parsed into a
+         lj::bson::Node or read through a lj::bson::View safely.
+         \since 1.0
+         */
+        class Decoder
+        {
+        public:
+            //! Default maximum frame size.
+            static const size_t k_default_max_frame_size = 16 * 1024 * 1024;
+
+            /*!
+             \brief Create a new decoder.
+             \param max_frame_size The largest document accepted.
+             */
+            explicit Decoder(size_t max_frame_size = k_default_max_frame_size);
+            Decoder(const Decoder& o) = default;
+            Decoder(Decoder&& o) = default;
+            Decoder& operator=(const Decoder& rhs) = default;
+            Decoder& operator=(Decoder&& rhs) = default;
+            ~Decoder() = default;
+
+            /*!
+             \brief Examine buffered input.
+
+             \c data must point at the start of the same frame on every call
+             until reset() is called. It may move between calls, for example
+             when the buffer is compacted, and \c sz may only grow.
+             \param data The buffered input, starting at the frame.
+             \param sz The number of buffered bytes.
+             \return The frame size once the whole document is buffered, or
+             zero if more input is needed.
+             \throws lj::Exception if the frame is oversized or malformed.
+             */
+            size_t scan(const uint8_t* data, size_t sz);
+
+            /*!
+             \brief Forget the current frame.
+
+             Call after the frame has been consumed, before scanning the next
+             one.
+             */
+            void reset();
+
+            /*!
+             \brief Record progress on input that is not a bson frame.
+
+             Stages that frame their own input keep their scan state here,
+             so it is forgotten by reset() along with the rest of the frame.
+             \param pos The number of bytes examined so far.
+             \param frame_size The length of the frame once known, or zero.
+             */
+            void track(size_t pos, size_t frame_size);
+
+            //! Get the number of bytes of the current frame examined so far.
+            inline size_t position() const
+            {
+                return pos_;
+            }
+
+            //! Get the largest document accepted.
+            inline size_t max_frame_size() const
+            {
+                return max_frame_size_;
+            }
+
+            //! Get the length claimed by the current frame, or zero if unknown.
+            inline size_t frame_size() const
+            {
+                return frame_size_;
+            }
+        private:
+            size_t max_frame_size_;
+            size_t frame_size_;
+            size_t pos_;
+            std::vector<size_t> ends_;
+        }; // class lj::bson::Decoder
+    }; // namespace lj::bson
+}; // namespace lj
@@ -0,0 +1,270 @@
+/*!
+ \file lj/Bson_index.cpp
+ \brief LJ Bson value hashing implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lj/Bson_index.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+    // Streaming 64 bit hash. Input is consumed a word at a time and the
+    // state is finished with the splitmix64 mixer.
+    class Hasher
+    {
+    public:
+        Hasher() : state_(0x9E3779B97F4A7C15ULL)
+        {
+        }
+
+        void add(const void* ptr, size_t sz)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(ptr);
+            mix(sz);
+            for (; sz >= 8; sz -= 8, bytes += 8)
+            {
+                uint64_t word;
+                memcpy(&word, bytes, 8);
+                mix(word);
+            }
+            if (sz)
+            {
+                uint64_t word = 0;
+                memcpy(&word, bytes, sz);
+                mix(word);
+            }
+        }
+
+        inline void add(lj::bson::Type t)
+        {
+            mix(static_cast<uint64_t>(t));
+        }
+
+        uint64_t finish() const
+        {
+            uint64_t h = state_;
+            h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+            return h ^ (h >> 31);
+        }
+    private:
+        inline void mix(uint64_t word)
+        {
+            state_ ^= word * 0x87C37B91114253D5ULL;
+            state_ = ((state_ << 31) | (state_ >> 33)) * 0x4CF5AD432745937FULL;
+        }
+
+        uint64_t state_;
+    };
+
+    // The type a value is compared as.
+    lj::bson::Type canonical_type(lj::bson::Type t)
+    {
+        switch (t)
+        {
+            case lj::bson::Type::k_int32:
+                return lj::bson::Type::k_int64;
+            case lj::bson::Type::k_binary_document:
+                return lj::bson::Type::k_document;
+            default:
+                return t;
+        }
+    }
+
+    // Doubles compare by value: both zeros are one value, and so are
+    // all NaNs.
+    double canonical_double(const lj::bson::Node& n)
+    {
+        double val;
+        memcpy(&val, n.to_value(), 8);
+        if (std::isnan(val))
+        {
+            return NAN;
+        }
+        return (0.0 == val) ? 0.0 : val;
+    }
+
+    void hash_into(Hasher& hasher, const lj::bson::Node& n);
+
+    void hash_document(Hasher& hasher, const lj::bson::Node& n)
+    {
+        for (auto iter = n.begin(); n.end() != iter; ++iter)
+        {
+            hasher.add(iter.key().data(), iter.key().size());
+            hash_into(hasher, *iter);
+        }
+    }
+
+    void hash_into(Hasher& hasher, const lj::bson::Node& n)
+    {
+        const lj::bson::Type t = canonical_type(n.type());
+        hasher.add(t);
+        switch (n.type())
+        {
+            case lj::bson::Type::k_int32:
+            case lj::bson::Type::k_int64:
+            {
+                const int64_t val = lj::bson::as_int64(n);
+                hasher.add(&val, 8);
+                break;
+            }
+            case lj::bson::Type::k_double:
+            {
+                const double val = canonical_double(n);
+                hasher.add(&val, 8);
+                break;
+            }
+            case lj::bson::Type::k_document:
+                hash_document(hasher, n);
+                break;
+            case lj::bson::Type::k_binary_document:
+                hash_document(hasher, lj::bson::Node(lj::bson::Type::k_document, n.to_value()));
+                break;
+            case lj::bson::Type::k_array:
+                for (auto child : n.to_vector())
+                {
+                    hash_into(hasher, *child);
+                }
+                break;
+            default:
+                if (n.to_value())
+                {
+                    hasher.add(n.to_value(), n.size());
+                }
+                break;
+        }
+
+        // Close nested values, so [[1], 2] and [[1, 2]] differ.
+        if (lj::bson::Type::k_document == t || lj::bson::Type::k_array == t)
+        {
+            hasher.add(lj::bson::Type::k_null);
+        }
+    }
+
+    bool equal_documents(const lj::bson::Node& a, const lj::bson::Node& b)
+    {
+        if (a.count() != b.count())
+        {
+            return false;
+        }
+        for (auto ia = a.begin(), ib = b.begin(); a.end() != ia; ++ia, ++ib)
+        {
+            if (ia.key() != ib.key() || !lj::bson::equal_value(*ia, *ib))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Parse a binary document, or return the node itself.
+    const lj::bson::Node& as_document(const lj::bson::Node& n,
+            std::unique_ptr<lj::bson::Node>& holder)
+    {
+        if (lj::bson::Type::k_binary_document == n.type())
+        {
+            holder.reset(new lj::bson::Node(lj::bson::Type::k_document, n.to_value()));
+            return *holder;
+        }
+        return n;
+    }
+}; // namespace (anonymous)
+
+namespace lj
+{
+    namespace bson
+    {
+        uint64_t hash_value(const Node& n)
+        {
+            Hasher hasher;
+            hash_into(hasher, n);
+            return hasher.finish();
+        }
+
+        bool equal_value(const Node& a, const Node& b)
+        {
+            const Type t = canonical_type(a.type());
+            if (t != canonical_type(b.type()))
+            {
+                return false;
+            }
+
+            switch (t)
+            {
+                case Type::k_int64:
+                    return as_int64(a) == as_int64(b);
+                case Type::k_double:
+                {
+                    const double va = canonical_double(a);
+                    const double vb = canonical_double(b);
+                    return va == vb || (std::isnan(va) && std::isnan(vb));
+                }
+                case Type::k_document:
+                {
+                    std::unique_ptr<Node> ha;
+                    std::unique_ptr<Node> hb;
+                    return equal_documents(as_document(a, ha), as_document(b, hb));
+                }
+                case Type::k_array:
+                {
+                    const Node::Array& va = a.to_vector();
+                    const Node::Array& vb = b.to_vector();
+                    if (va.size() != vb.size())
+                    {
+                        return false;
+                    }
+                    for (size_t h = 0; h < va.size(); ++h)
+                    {
+                        if (!equal_value(*va[h], *vb[h]))
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+                default:
+                {
+                    if (!a.to_value() || !b.to_value())
+                    {
+                        return a.to_value() == b.to_value();
+                    }
+                    const size_t sz = a.size();
+                    return sz == b.size() && 0 == memcmp(a.to_value(), b.to_value(), sz);
+                }
+            }
+        }
+    }; // namespace lj::bson
+}; // namespace lj
@@ -0,0 +1,355 @@
+#pragma once
+/*!
+ \file lj/Bson_index.h
+ \brief LJ Bson value hashing and hash index header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lj/Bson.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace lj
+{
+    namespace bson
+    {
+        /*!
+         \brief Hash a bson value.
+
+         The hash is canonical: values that compare equal with
+         equal_value() hash the same. Int32 and int64 values are hashed
+         as int64, binary documents as documents, and document children
+         in key order. Other types hash their type and value bytes.
+         \param n The value to hash.
+         \return A 64 bit hash of the value.
+         \since 1.0
+         \sa equal_value(const Node&, const Node&)
+         */
+        uint64_t hash_value(const Node& n);
+
+        /*!
+         \brief Compare two bson values.
+
+         Values are equal when their types match, after treating int32
+         and int64 as one type and binary documents as documents, and
+         their contents match. Doubles compare by value, so 0.0 equals
+         -0.0 and NaN equals NaN.
+         \param a The first value.
+         \param b The second value.
+         \return True if the values are equal.
+         \since 1.0
+         \sa hash_value(const Node&)
+         */
+        bool equal_value(const Node& a, const Node& b);
+
+        //! Hash functor for bson values in standard containers.
+        struct Node_hash
+        {
+            size_t operator()(const Node& n) const
+            {
+                return static_cast<size_t>(hash_value(n));
+            }
+        };
+
+        //! Equality functor for bson values in standard containers.
+        struct Node_equal
+        {
+            bool operator()(const Node& a, const Node& b) const
+            {
+                return equal_value(a, b);
+            }
+        };
+
+        /*!
+         \brief Hash index from bson values to values of type V.
+
+         Entries are kept in one open addressing table with linear
+         probing. Each slot holds the key hash next to the key, so a
+         probe only reads a key when the hashes match. Erased entries
+         are removed by shifting their followers back, so lookups never
+         pass over deleted slots.
+
+         Keys are copies of the Node passed to insert(). Any value can
+         be a key, so an index over a document field is built by
+         inserting the node found at that field's path.
+
+         \code
+         lj::bson::Hash_index<lj::bson::Node*> by_login;
+         by_login.insert(record->nav("login"), record);
+         lj::bson::Node** found = by_login.find(request["login"]);
+         \endcode
+         \tparam V The mapped type. It must be default constructible.
+         \since 1.0
+         */
+        template<typename V>
+        class Hash_index
+        {
+        public:
+            //! Create an empty index.
+            Hash_index() : slots_(), size_(0)
+            {
+            }
+
+            Hash_index(const Hash_index& o) = delete;
+
+            //! Move the entries from another index.
+            Hash_index(Hash_index&& o) : slots_(std::move(o.slots_)), size_(o.size_)
+            {
+                o.slots_.clear();
+                o.size_ = 0;
+            }
+
+            Hash_index& operator=(const Hash_index& rhs) = delete;
+
+            //! Replace the entries with those of another index.
+            Hash_index& operator=(Hash_index&& rhs)
+            {
+                if (&rhs != this)
+                {
+                    clear();
+                    slots_.swap(rhs.slots_);
+                    std::swap(size_, rhs.size_);
+                }
+                return *this;
+            }
+
+            //! Destructor.
+            ~Hash_index()
+            {
+                clear();
+            }
+
+            //! Get the number of entries.
+            inline size_t size() const
+            {
+                return size_;
+            }
+
+            //! Test if the index has no entries.
+            inline bool empty() const
+            {
+                return 0 == size_;
+            }
+
+            /*!
+             \brief Find the value for a key.
+             \param key The key to look for.
+             \return A pointer to the value, or null if the key is not in
+             the index. The pointer is valid until the index is modified.
+             */
+            V* find(const Node& key)
+            {
+                size_t pos;
+                return locate(key, hash_value(key), &pos) ? &slots_[pos].value : nullptr;
+            }
+
+            //! Const version of \c #find(const Node&).
+            const V* find(const Node& key) const
+            {
+                size_t pos;
+                return locate(key, hash_value(key), &pos) ? &slots_[pos].value : nullptr;
+            }
+
+            /*!
+             \brief Add or replace the value for a key.
+             \param key The key. A copy is stored in the index.
+             \param value The value.
+             \return True if the key was added, false if it was already
+             in the index and its value was replaced.
+             */
+            bool insert(const Node& key, const V& value)
+            {
+                const uint64_t h = hash_value(key);
+                size_t pos;
+                if (locate(key, h, &pos))
+                {
+                    slots_[pos].value = value;
+                    return false;
+                }
+
+                if ((size_ + 1) * 4 > slots_.size() * 3)
+                {
+                    rehash(slots_.empty() ? k_min_capacity : slots_.size() * 2);
+                    locate(key, h, &pos);
+                }
+                slots_[pos].hash = h;
+                slots_[pos].key = new Node(key);
+                slots_[pos].value = value;
+                ++size_;
+                return true;
+            }
+
+            /*!
+             \brief Remove a key.
+             \param key The key to remove.
+             \return True if the key was in the index.
+             */
+            bool erase(const Node& key)
+            {
+                size_t pos;
+                if (!locate(key, hash_value(key), &pos))
+                {
+                    return false;
+                }
+                delete slots_[pos].key;
+
+                // Shift back each following entry that would no longer
+                // be found from its home slot.
+                const size_t mask = slots_.size() - 1;
+                for (size_t next = (pos + 1) & mask; slots_[next].key; next = (next + 1) & mask)
+                {
+                    const size_t home = slots_[next].hash & mask;
+                    if (((next - home) & mask) >= ((next - pos) & mask))
+                    {
+                        slots_[pos] = std::move(slots_[next]);
+                        pos = next;
+                    }
+                }
+                slots_[pos] = Slot();
+                --size_;
+                return true;
+            }
+
+            //! Remove all entries.
+            void clear()
+            {
+                for (auto& slot : slots_)
+                {
+                    delete slot.key;
+                }
+                slots_.clear();
+                size_ = 0;
+            }
+
+            /*!
+             \brief Size the table for a number of entries.
+             \param count The expected number of entries.
+             */
+            void reserve(size_t count)
+            {
+                size_t capacity = k_min_capacity;
+                while (capacity * 3 < count * 4)
+                {
+                    capacity *= 2;
+                }
+                if (capacity > slots_.size())
+                {
+                    rehash(capacity);
+                }
+            }
+
+            /*!
+             \brief Visit every entry.
+
+             Entries are visited in table order, which is not stable
+             across modifications.
+             \param fn Called with the key and value of each entry.
+             */
+            template<typename F>
+            void each(F fn) const
+            {
+                for (const auto& slot : slots_)
+                {
+                    if (slot.key)
+                    {
+                        fn(*slot.key, slot.value);
+                    }
+                }
+            }
+        private:
+            struct Slot
+            {
+                Slot() : hash(0), key(nullptr), value()
+                {
+                }
+
+                uint64_t hash;
+                Node* key;
+                V value;
+            };
+
+            static const size_t k_min_capacity = 16;
+
+            // Find the slot holding key, or the empty slot where it would
+            // be added.
+            bool locate(const Node& key, uint64_t h, size_t* pos) const
+            {
+                if (slots_.empty())
+                {
+                    return false;
+                }
+                const size_t mask = slots_.size() - 1;
+                for (size_t indx = h & mask; ; indx = (indx + 1) & mask)
+                {
+                    const Slot& slot = slots_[indx];
+                    if (!slot.key)
+                    {
+                        *pos = indx;
+                        return false;
+                    }
+                    if (slot.hash == h && equal_value(*slot.key, key))
+                    {
+                        *pos = indx;
+                        return true;
+                    }
+                }
+            }
+
+            // Move every entry into a table with the given capacity, which
+            // must be a power of two.
+            void rehash(size_t capacity)
+            {
+                std::vector<Slot> old(capacity);
+                old.swap(slots_);
+                const size_t mask = capacity - 1;
+                for (auto& slot : old)
+                {
+                    if (slot.key)
+                    {
+                        size_t indx = slot.hash & mask;
+                        while (slots_[indx].key)
+                        {
+                            indx = (indx + 1) & mask;
+                        }
+                        slots_[indx] = std::move(slot);
+                    }
+                }
+            }
+
+            std::vector<Slot> slots_;
+            size_t size_;
+        }; // class lj::bson::Hash_index
+    }; // namespace lj::bson
+}; // namespace lj
@@ -36,13 +36,26 @@
 #include "lj/Bson.h"
 #include "lj/Base64.h"
 #include "lj/Exception.h"
-#include <cassert>
+#include <algorithm>
 #include <cstddef>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <sstream>
-#include <stack>
+#include <vector>
+
+// Strings and white space are scanned a block at a time when the target
+// supports it. AVX2 is only used when the build enables it (-mavx2), SSE2
+// is part of every x86_64 target, and everything else uses the scalar loops.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LJ__JSON_BLOCK_SIZE 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LJ__JSON_BLOCK_SIZE 16
+#endif
 
 namespace
 {
@@ -83,553 +96,556 @@ namespace
         unsigned int line_;
     };
 
-    class Parser_state
+#if defined(LJ__JSON_BLOCK_SIZE)
+#if LJ__JSON_BLOCK_SIZE == 32
+    typedef __m256i Block;
+
+    inline Block load_block(const char* p)
     {
-    public:
-        Parser_state(std::istream& input) :
-                state_(State::k_pre),
-                stream_(input),
-                stream_buffer_(),
-                node_(NULL),
-                parents_(),
-                col_(1),
-                line_(1)
-        {
-        }
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    }
 
-        ~Parser_state()
-        {
-        }
+    inline Block splat(const char c)
+    {
+        return _mm256_set1_epi8(c);
+    }
 
-        lj::bson::Node* run()
-        {
-            do
-            {
-                if (State::k_pre == state())
-                {
-                    extract_value();
-                }
-                else if (State::k_post == state())
-                {
-                    extract_separator();
-                }
-                else
-                {
-                    extract_key();
-                }
-            } while(next());
-            assert(NULL != node_);
-            return node_;
-        }
-    private:
-        enum class State
-        {
-            k_pre,
-            k_post,
-            k_key
-        };
+    // One bit per byte of the block that equals the matching byte of c.
+    inline uint32_t matches(const Block& b, const Block& c)
+    {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, c)));
+    }
 
-        State state_;
-        std::istream& stream_;
-        std::deque<int> stream_buffer_;
-        lj::bson::Node* node_;
-        std::stack<lj::bson::Node*> parents_;
-        unsigned int col_;
-        unsigned int line_;
+    const uint32_t k_all_matched = 0xFFFFFFFF;
+#else
+    typedef __m128i Block;
 
-        // Hidden because it is just the terminating function for a
-        // variadic template
-        inline bool is(const char c)
+    inline Block load_block(const char* p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+
+    inline Block splat(const char c)
+    {
+        return _mm_set1_epi8(c);
+    }
+
+    // One bit per byte of the block that equals the matching byte of c.
+    inline uint32_t matches(const Block& b, const Block& c)
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(b, c)));
+    }
+
+    const uint32_t k_all_matched = 0xFFFF;
+#endif
+#endif
+
+    inline bool is_space(const char c)
+    {
+        return ' ' == c || '\n' == c || '\r' == c || '\t' == c;
+    }
+
+    // Find the first a or b in [p, end). Returns end if there is neither.
+    const char* find_either(const char* p,
+            const char* end,
+            const char a,
+            const char b)
+    {
+#if defined(LJ__JSON_BLOCK_SIZE)
+        const Block block_a = splat(a);
+        const Block block_b = splat(b);
+        while (end - p >= LJ__JSON_BLOCK_SIZE)
         {
-            return false;
+            const Block block = load_block(p);
+            const uint32_t found = matches(block, block_a) | matches(block, block_b);
+            if (found)
+            {
+                return p + __builtin_ctz(found);
+            }
+            p += LJ__JSON_BLOCK_SIZE;
         }
-
-        State state()
+#endif
+        while (p < end && a != *p && b != *p)
         {
-            return state_;
+            ++p;
         }
+        return p;
+    }
 
-        inline void node_reset()
+    // Find the first character in [p, end) that is not white space.
+    const char* skip_space(const char* p, const char* end)
+    {
+        // Most gaps are a single character or none, so only switch to
+        // blocks for longer runs like indentation.
+        if (end == p || !is_space(*p))
         {
-            node_ = NULL;
+            return p;
         }
-
-        inline lj::bson::Node& node()
+#if defined(LJ__JSON_BLOCK_SIZE)
+        const Block space = splat(' ');
+        const Block newline = splat('\n');
+        const Block carriage_return = splat('\r');
+        const Block tab = splat('\t');
+        while (end - p >= LJ__JSON_BLOCK_SIZE)
         {
-            if (!node_)
+            const Block block = load_block(p);
+            const uint32_t white = matches(block, space) |
+                    matches(block, newline) |
+                    matches(block, carriage_return) |
+                    matches(block, tab);
+            if (k_all_matched != white)
             {
-                node_ = new lj::bson::Node();
+                return p + __builtin_ctz(~white);
             }
-            return *node_;
+            p += LJ__JSON_BLOCK_SIZE;
         }
-
-        inline lj::bson::Node& parent()
+#endif
+        while (p < end && is_space(*p))
         {
-            return *(parents_.top());
+            ++p;
         }
+        return p;
+    }
 
-        inline void push_array()
-        {
-            node().set_value(lj::bson::Type::k_array, NULL);
-            parents_.push(node_);
-            node_reset();
-        }
-
-        inline void push_document()
+    class Parser_state
+    {
+    public:
+        Parser_state(const char* data, size_t sz) :
+                begin_(data),
+                end_(data + sz),
+                pos_(data),
+                parents_(),
+                key_(),
+                scratch_()
         {
-            node().set_value(lj::bson::Type::k_document, NULL);
-            parents_.push(node_);
-            node_reset();
         }
 
-        void pop()
+        ~Parser_state()
         {
-            assert(0 < parents_.size());
-            if (lj::bson::Type::k_array == parents_.top()->type() &&
-                    nullptr != node_)
-            {
-                *(parents_.top()) << node_;
-            }
-            node_ = parents_.top();
-            parents_.pop();
-            translate_binary();
-            state_ = State::k_post;
         }
 
-        inline bool is_valid(ptrdiff_t dist = 0)
+        lj::bson::Node* run()
         {
-            while(stream_buffer_.size() < (dist + 1) && stream_.good())
+            std::unique_ptr<lj::bson::Node> root;
+            State state = State::k_value;
+            while (true)
             {
-                int c = stream_.get();
-                if (stream_.good())
+                pos_ = skip_space(pos_, end_);
+                if (State::k_value == state)
                 {
-                    stream_buffer_.push_back(c);
+                    if (end_ == pos_)
+                    {
+                        fail(pos_, "Unexpected end of input.");
+                    }
+
+                    // Empty array, or a trailing comma.
+                    if (']' == *pos_ && in_array())
+                    {
+                        ++pos_;
+                        pop();
+                        state = State::k_post;
+                        continue;
+                    }
+
+                    const char* start = pos_;
+                    std::unique_ptr<lj::bson::Node> n(extract_value());
+                    lj::bson::Node* container = nullptr;
+                    if (lj::bson::Type::k_document == n->type() ||
+                            lj::bson::Type::k_array == n->type())
+                    {
+                        container = n.get();
+                    }
+
+                    if (parents_.empty())
+                    {
+                        root = std::move(n);
+                    }
+                    else if (in_array())
+                    {
+                        parents_.back()->push_child(k_no_path, n.get());
+                        n.release();
+                    }
+                    else
+                    {
+                        parents_.back()->set_child(key_, n.get());
+                        n.release();
+                    }
+
+                    if (container)
+                    {
+                        parents_.push_back(container);
+                        state = ('{' == *start) ? State::k_key : State::k_value;
+                    }
+                    else
+                    {
+                        state = State::k_post;
+                    }
                 }
-            }
-            return stream_buffer_.size() >= (dist + 1);
-        }
+                else if (State::k_post == state)
+                {
+                    if (parents_.empty())
+                    {
+                        if (end_ != pos_)
+                        {
+                            fail(pos_, "Unexpected character.");
+                        }
+                        return root.release();
+                    }
+                    if (end_ == pos_)
+                    {
+                        fail(pos_, "Unexpected end of input.");
+                    }
 
-        inline const char at(ptrdiff_t dist = 0)
-        {
-            if (!is_valid(dist))
-            {
-                throw Parser_exception("Unexpected end of input.",
-                        col_,
-                        line_);
-            }
-            return static_cast<char>(stream_buffer_.at(dist));
-        }
-        bool next(ptrdiff_t dist = 1)
-        {
-            if (is_valid(dist))
-            {
-                for (int h = 0; h < dist; ++h)
+                    const char c = *pos_;
+                    if (',' == c)
+                    {
+                        ++pos_;
+                        state = in_array() ? State::k_value : State::k_key;
+                    }
+                    else if ((']' == c && in_array()) ||
+                            ('}' == c && !in_array()))
+                    {
+                        ++pos_;
+                        pop();
+                    }
+                    else
+                    {
+                        fail(pos_, "Unexpected character.");
+                    }
+                }
+                else
                 {
-                    if (is(at(), '\n'))
+                    if (end_ == pos_)
+                    {
+                        fail(pos_, "Unexpected end of input.");
+                    }
+
+                    const char c = *pos_;
+                    if ('}' == c)
+                    {
+                        // Empty document, or a trailing comma.
+                        ++pos_;
+                        pop();
+                        state = State::k_post;
+                    }
+                    else if ('\'' == c || '\"' == c)
                     {
-                        line_++;
-                        col_ = 1;
+                        key_.clear();
+                        extract_string(key_);
+                        pos_ = skip_space(pos_, end_);
+                        if (end_ == pos_)
+                        {
+                            fail(pos_, "Unexpected end of input.");
+                        }
+                        if (':' != *pos_)
+                        {
+                            fail(pos_, "Unexpected character.");
+                        }
+                        ++pos_;
+                        state = State::k_value;
                     }
                     else
                     {
-                        col_++;
+                        fail(pos_, "Unexpected character.");
                     }
-                    stream_buffer_.pop_front();
                 }
-                return true;
             }
-            return false;
         }
-        template <class C0, class ...Args>
-        bool is(const char c, const C0& test, const Args& ...args)
+    private:
+        enum class State
         {
-            return (c == test ? true : is(c, args...));
-        }
+            k_value,
+            k_post,
+            k_key
+        };
+
+        static const lj::bson::Path k_no_path;
 
-        inline void extract_null()
+        const char* begin_;
+        const char* end_;
+        const char* pos_;
+        std::vector<lj::bson::Node*> parents_;
+        std::string key_;
+        std::string scratch_;
+
+        // Report an error at p. The line and column are only worked out
+        // when something goes wrong.
+        void fail(const char* p, const std::string& msg) const
         {
-            if (is(at(0), 'N', 'n') &&
-                is(at(1), 'U', 'u') &&
-                is(at(2), 'L', 'l') &&
-                is(at(3), 'L', 'l'))
-            {
-                std::unique_ptr<lj::bson::Node> n(lj::bson::new_null());
-                node().copy_from(*n);
-            }
-            else
+            unsigned int line = 1;
+            const char* line_start = begin_;
+            for (const char* c = begin_; c < p; ++c)
             {
-                throw Parser_exception("Unexpected value.",
-                        col_,
-                        line_);
+                if ('\n' == *c)
+                {
+                    ++line;
+                    line_start = c + 1;
+                }
             }
-            next(3);
-            state_ = State::k_post;
+            throw Parser_exception(msg, p - line_start + 1, line);
         }
-        inline void extract_true()
+
+        inline bool in_array() const
         {
-            if (is(at(0), 'T', 't') &&
-                is(at(1), 'R', 'r') &&
-                is(at(2), 'U', 'u') &&
-                is(at(3), 'E', 'e'))
-            {
-                std::unique_ptr<lj::bson::Node> n(lj::bson::new_boolean(true));
-                node().copy_from(*n);
-            }
-            else
-            {
-                throw Parser_exception("Unexpected value.",
-                        col_,
-                        line_);
-            }
-            next(3);
-            state_ = State::k_post;
+            return !parents_.empty() &&
+                    lj::bson::Type::k_array == parents_.back()->type();
         }
-        inline void extract_false()
+
+        void pop()
         {
-            if (is(at(0), 'F', 'f') &&
-                is(at(1), 'A', 'a') &&
-                is(at(2), 'L', 'l') &&
-                is(at(3), 'S', 's') &&
-                is(at(4), 'E', 'e'))
-            {
-                std::unique_ptr<lj::bson::Node> n(lj::bson::new_boolean(false));
-                node().copy_from(*n);
-            }
-            else
-            {
-                throw Parser_exception("Unexpected value.",
-                        col_,
-                        line_);
-            }
-            next(4);
-            state_ = State::k_post;
+            lj::bson::Node* n = parents_.back();
+            parents_.pop_back();
+            translate_binary(*n);
         }
-        void extract_string()
+
+        // Match a keyword, ignoring case.
+        void extract_keyword(const char* word)
         {
-            char quote_character = at();
-            std::string buffer;
-            while(next())
+            const char* start = pos_;
+            for (; '\0' != *word; ++word, ++pos_)
             {
-                // Not in the while statement because next modifies
-                // what at() reads from.
-                if (at() == quote_character)
+                if (end_ == pos_)
                 {
-                    break;
+                    fail(pos_, "Unexpected end of input.");
                 }
-
-                if ('\\' == at())
+                if ((*pos_ | 0x20) != *word)
                 {
-                    switch (at(1))
-                    {
-                        case '\"':
-                            buffer.push_back('\"');
-                            break;
-                        case '\\':
-                            buffer.push_back('\\');
-                            break;
-                        case '/':
-                            buffer.push_back('/');
-                            break;
-                        case 'b':
-                            buffer.push_back('\b');
-                            break;
-                        case 'f':
-                            buffer.push_back('\f');
-                            break;
-                        case 'n':
-                            buffer.push_back('\n');
-                            break;
-                        case 'r':
-                            buffer.push_back('\r');
-                            break;
-                        case 't':
-                            buffer.push_back('\t');
-                            break;
-                        default:
-                            buffer.push_back(at(1));
-                            break;
-                    }
-                    next();
-                }
-                else
-                {
-                    buffer.push_back(at());
+                    fail(start, "Unexpected value.");
                 }
             }
-
-            std::unique_ptr<lj::bson::Node> n(lj::bson::new_string(buffer));
-            node().copy_from(*n);
-            state_ = State::k_post;
         }
 
-        void extract_number()
+        // Append the unescaped contents of the string at pos_ to out.
+        void extract_string(std::string& out)
         {
-            std::string buffer;
-            buffer.push_back(at());
-
-            bool decimal = false;
-            if (is(at(), '.'))
+            const char quote_character = *pos_++;
+            while (true)
             {
-                decimal = true;
-            }
-
-            do
-            {
-                switch (at(1))
+                const char* found = find_either(pos_, end_, quote_character, '\\');
+                if (end_ == found)
                 {
-                    case '.':
-                        if (decimal)
-                        {
-                            throw Parser_exception("Expected a digit.",
-                                    col_,
-                                    line_);
-                        }
-                        decimal = true;
-                        // fall through.
-                    case '1':
-                    case '2':
-                    case '3':
-                    case '4':
-                    case '5':
-                    case '6':
-                    case '7':
-                    case '8':
-                    case '9':
-                    case '0':
-                        buffer.push_back(at(1));
-                        break;
-                    default:
-                        if (decimal)
-                        {
-                            throw Parser_exception("Decimal not yet supported.",
-                                    col_,
-                                    line_);
-                        }
-                        else
-                        {
-                            std::unique_ptr<lj::bson::Node> n(lj::bson::new_int64(atol(buffer.c_str())));
-                            node().copy_from(*n);
-                        }
-                        state_ = State::k_post;
-                        return;
+                    fail(end_, "Unexpected end of input.");
+                }
+                out.append(pos_, found);
+                pos_ = found + 1;
+                if (quote_character == *found)
+                {
+                    return;
                 }
-            } while(next());
-        }
 
-        void extract_value()
-        {
-            while (State::k_pre == state_)
-            {
-                switch (at())
+                if (end_ == pos_)
                 {
-                    case ' ':
-                    case '\n':
-                    case '\r':
-                    case '\t':
-                        // throw away white space before a value.
-                        if (!next())
-                        {
-                            return;
-                        }
-                        break;
-                    case '\'':
-                    case '\"':
-                        // Hit a quote, so treat as a string.
-                        extract_string();
-                        break;
-                    case 'T':
-                    case 't':
-                        // true keyword?
-                        extract_true();
+                    fail(pos_, "Unexpected end of input.");
+                }
+                switch (*pos_)
+                {
+                    case 'b':
+                        out.push_back('\b');
                         break;
-                    case 'F':
                     case 'f':
-                        // false keyword?
-                        extract_false();
+                        out.push_back('\f');
                         break;
-                    case 'N':
                     case 'n':
-                        // null keyword?
-                        extract_null();
-                        break;
-                    case '-':
-                    case '1':
-                    case '2':
-                    case '3':
-                    case '4':
-                    case '5':
-                    case '6':
-                    case '7':
-                    case '8':
-                    case '9':
-                    case '0':
-                    case '.':
-                        //Number.
-                        extract_number();
+                        out.push_back('\n');
                         break;
-                    case '[':
-                        // An Array. Nesting
-                        push_array();
-                        if (!next())
-                        {
-                            return;
-                        }
+                    case 'r':
+                        out.push_back('\r');
                         break;
-                    case '{':
-                        // A Document. Nesting
-                        push_document();
-                        state_ = State::k_key;
-                        return; // return, not break.
-                    case ']':
-                        // must be empty
-                        pop();
+                    case 't':
+                        out.push_back('\t');
                         break;
                     default:
-                        throw Parser_exception("Unexpected character.",
-                                col_,
-                                line_);
+                        // Covers quotes, slashes and back slashes.
+                        out.push_back(*pos_);
                         break;
                 }
-            } // while (State::k_pre == state_)
+                ++pos_;
+            }
         }
 
-        void extract_separator()
+        lj::bson::Node* extract_number()
         {
-            while (State::k_post == state_)
+            const char* start = pos_;
+            bool decimal = ('.' == *pos_);
+            for (++pos_; end_ != pos_; ++pos_)
             {
-                switch (at())
+                if ('.' == *pos_)
                 {
-                    case ' ':
-                    case '\n':
-                    case '\r':
-                    case '\t':
-                        // throw away white space
-                        if (!next())
-                        {
-                            return;
-                        }
-                        break;
-                    case '}':
-                    case ']':
-                        pop();
-                        if (!next())
-                        {
-                            return;
-                        }
-                        break;
-                    case ',':
-                        if (lj::bson::Type::k_document == parent().type())
-                        {
-                            node_reset();
-                            state_ = State::k_key;
-                        }
-                        else
-                        {
-                            parent() << node_;
-                            node_reset();
-                            state_ = State::k_pre;
-                        }
-                        return; // return, not break;
-                    default:
-                        throw Parser_exception("Unexpected character.",
-                                col_,
-                                line_);
-                        break;
+                    if (decimal)
+                    {
+                        fail(pos_, "Expected a digit.");
+                    }
+                    decimal = true;
                 }
-            } // while (State::k_post == state_)
+                else if (*pos_ < '0' || '9' < *pos_)
+                {
+                    break;
+                }
+            }
+
+            if (decimal)
+            {
+                fail(start, "Decimal not yet supported.");
+            }
+            const std::string digits(start, pos_);
+            return lj::bson::new_int64(atol(digits.c_str()));
         }
 
-        void extract_key()
+        // Create the node for the value at pos_. Documents and arrays are
+        // returned empty, and filled in by run().
+        lj::bson::Node* extract_value()
         {
-            bool post_key = false;
-            while (State::k_key == state_)
+            switch (*pos_)
             {
-                switch (at())
+                case '\'':
+                case '\"':
                 {
-                    case ' ':
-                    case '\n':
-                    case '\r':
-                    case '\t':
-                        // throw away white space
-                        if (!next())
-                        {
-                            return;
-                        }
-                        break;
-                    case '\'':
-                    case '\"':
-                        if (post_key)
-                        {
-                            throw Parser_exception("Unexpected character.",
-                                    col_,
-                                    line_);
-                        }
-                        extract_string();
-                        parent().set_child(lj::bson::as_string(node()), node_);
-                        node().nullify();
-                        post_key = true;
-                        state_ = State::k_key;
-                        if (!next())
-                        {
-                            return;
-                        }
-                        break;
-                    case ':':
-                        state_ = State::k_pre;
-                        return;
-                    case '}':
-                        // must be empty
-                        pop();
-                        break;
-                    default:
-                        throw Parser_exception("Unexpected character.",
-                                col_,
-                                line_);
-                        break;
+                    // Build the bson string in place: length, bytes, null.
+                    scratch_.assign(4, '\0');
+                    extract_string(scratch_);
+                    scratch_.push_back('\0');
+                    const int32_t sz = scratch_.size() - 4;
+                    memcpy(&scratch_[0], &sz, 4);
+                    return new lj::bson::Node(lj::bson::Type::k_string,
+                            reinterpret_cast<const uint8_t*>(scratch_.data()));
                 }
-            } // while (State::k_key == state_)
+                case 'T':
+                case 't':
+                    extract_keyword("true");
+                    return lj::bson::new_boolean(true);
+                case 'F':
+                case 'f':
+                    extract_keyword("false");
+                    return lj::bson::new_boolean(false);
+                case 'N':
+                case 'n':
+                    extract_keyword("null");
+                    return lj::bson::new_null();
+                case '-':
+                case '1':
+                case '2':
+                case '3':
+                case '4':
+                case '5':
+                case '6':
+                case '7':
+                case '8':
+                case '9':
+                case '0':
+                case '.':
+                    return extract_number();
+                case '[':
+                    ++pos_;
+                    return lj::bson::new_array();
+                case '{':
+                    ++pos_;
+                    return new lj::bson::Node();
+                default:
+                    fail(pos_, "Unexpected character.");
+                    return nullptr;
+            }
         }
 
-        void translate_binary()
+        void translate_binary(lj::bson::Node& n)
         {
-            assert(nullptr != node_);
-            if (lj::bson::Type::k_document == node().type() && node().exists("__bson_type"))
+            if (lj::bson::Type::k_document == n.type() && n.exists("__bson_type"))
             {
-                lj::bson::Node& type_node = node().nav("__bson_type");
+                lj::bson::Node& type_node = n.nav("__bson_type");
                 std::string type_string(lj::bson::as_string(type_node));
 
                 if (type_string.compare("UUID") == 0)
                 {
-                    std::string value_string(lj::bson::as_string(node().nav("__bson_value")));
+                    std::string value_string(lj::bson::as_string(n.nav("__bson_value")));
                     lj::Uuid value_uuid(value_string);
                     std::unique_ptr<lj::bson::Node> value(lj::bson::new_uuid(value_uuid));
-                    (*node_) = std::move(*value);
+                    n = std::move(*value);
                 }
                 else if (type_string.compare("BINARY") == 0)
                 {
-                    std::string value_string(lj::bson::as_string(node().nav("__bson_value")));
-                    lj::bson::Binary_type binary_type = static_cast<lj::bson::Binary_type>(lj::bson::as_int32(node().nav("__bson_note")));
+                    std::string value_string(lj::bson::as_string(n.nav("__bson_value")));
+                    lj::bson::Binary_type binary_type = static_cast<lj::bson::Binary_type>(lj::bson::as_int32(n.nav("__bson_note")));
                     size_t sz;
                     uint8_t* data = lj::base64_decode(value_string, &sz);
-                    assert(nullptr != data);
                     std::unique_ptr<lj::bson::Node> value(lj::bson::new_binary(data, sz, binary_type));
                     delete[] data;
-                    (*node_) = std::move(*value);
+                    n = std::move(*value);
+                }
+                else if (type_string.compare("DATETIME") == 0)
+                {
+                    std::unique_ptr<lj::bson::Node> value(lj::bson::new_datetime(lj::bson::as_int64(n.nav("__bson_value"))));
+                    n = std::move(*value);
+                }
+                else
+                {
+                    translate_raw(n, type_string);
                 }
             }
         }
+
+        // Types written by Json_writer as their base64 encoded value bytes.
+        void translate_raw(lj::bson::Node& n, const std::string& type_string)
+        {
+            static const struct
+            {
+                const char* name;
+                lj::bson::Type type;
+            } k_raw_types[] = {
+                {"OBJECT_ID", lj::bson::Type::k_object_id},
+                {"REGEX", lj::bson::Type::k_regex},
+                {"DB_POINTER", lj::bson::Type::k_db_pointer},
+                {"JAVASCRIPT", lj::bson::Type::k_javascript},
+                {"SYMBOL", lj::bson::Type::k_symbol},
+                {"JAVASCRIPT_SCOPE", lj::bson::Type::k_javascript_scope},
+                {"DECIMAL128", lj::bson::Type::k_decimal128},
+                {"MINKEY", lj::bson::Type::k_minkey},
+                {"MAXKEY", lj::bson::Type::k_maxkey}
+            };
+
+            for (const auto& raw : k_raw_types)
+            {
+                if (type_string.compare(raw.name) != 0)
+                {
+                    continue;
+                }
+
+                std::string value_string(lj::bson::as_string(n.nav("__bson_value")));
+                size_t sz = 0;
+                std::unique_ptr<uint8_t[]> data(value_string.empty() ?
+                        nullptr :
+                        lj::base64_decode(value_string, &sz));
+
+                // Values that do not fit their type are left as documents.
+                if (sz < lj::bson::type_min_size(raw.type) ||
+                        (lj::bson::Type::k_regex == raw.type &&
+                        std::count(data.get(), data.get() + sz, 0) < 2) ||
+                        (0 < sz && lj::bson::type_value_size(raw.type, data.get()) != sz))
+                {
+                    return;
+                }
+                n.set_value(raw.type, data.get());
+                return;
+            }
+        }
     };
+
+    const lj::bson::Path Parser_state::k_no_path;
 };
 
-lj::bson::Node* lj::bson::parse_json(const std::string& val)
+lj::bson::Node* lj::bson::parse_json(const char* data, size_t sz)
 {
-    std::stringstream wrapper(val);
-    Parser_state state(wrapper);
+    Parser_state state(data, sz);
     return state.run();
 }
 
+lj::bson::Node* lj::bson::parse_json(const std::string& val)
+{
+    return parse_json(val.data(), val.size());
+}
+
 lj::bson::Node* lj::bson::parse_json(std::istream& in_stream)
 {
-    Parser_state state(in_stream);
-    return state.run();
+    // The parser works on whole buffers, so collect the input first.
+    const std::string buffer((std::istreambuf_iterator<char>(in_stream)),
+            std::istreambuf_iterator<char>());
+    return parse_json(buffer);
 }
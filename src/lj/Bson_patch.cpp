@@ -0,0 +1,318 @@
+/*!
+ \file lj/Bson_patch.cpp
+ \brief LJ Bson diff and patch implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lj/Bson.h"
+
+#include <cstring>
+
+namespace
+{
+    const lj::bson::Path k_op_set("set");
+    const lj::bson::Path k_op_unset("unset");
+    const lj::bson::Path k_op_push("push");
+    const lj::bson::Path k_op_inc("inc");
+
+    // Test if two nodes hold the same data. Containers shared between
+    // copies are recognized by their first child.
+    bool same(const lj::bson::Node& a, const lj::bson::Node& b)
+    {
+        if (a.type() != b.type())
+        {
+            return false;
+        }
+
+        if (lj::bson::Type::k_document == a.type())
+        {
+            if (a.count() != b.count())
+            {
+                return false;
+            }
+            auto ia = a.begin();
+            auto ib = b.begin();
+            if (a.end() != ia && &(*ia) == &(*ib))
+            {
+                return true;
+            }
+            for (; a.end() != ia; ++ia, ++ib)
+            {
+                if (ia.key() != ib.key() || !same(*ia, *ib))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        else if (lj::bson::Type::k_array == a.type())
+        {
+            const lj::bson::Node::Array& va = a.to_vector();
+            const lj::bson::Node::Array& vb = b.to_vector();
+            if (&va == &vb)
+            {
+                return true;
+            }
+            if (va.size() != vb.size())
+            {
+                return false;
+            }
+            for (size_t indx = 0; va.size() > indx; ++indx)
+            {
+                if (!same(*va[indx], *vb[indx]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const size_t sz = a.size();
+        return sz == b.size() &&
+                (0 == sz || 0 == memcmp(a.to_value(), b.to_value(), sz));
+    }
+
+    // Add an operation for path to the patch. The escaped path is used
+    // as a single key so it does not create nested documents.
+    void add_op(lj::bson::Node& patch,
+            const lj::bson::Path& op,
+            const lj::bson::Path& path,
+            lj::bson::Node* value)
+    {
+        lj::bson::Path key(op);
+        key.push_back(path.str());
+        patch.set_child(key, value);
+    }
+
+    // Add an unset operation for path to the patch.
+    void add_unset(lj::bson::Node& patch, const lj::bson::Path& path)
+    {
+        if (!patch.exists(k_op_unset))
+        {
+            patch.set_child(k_op_unset, lj::bson::new_array());
+        }
+        patch.push_child(k_op_unset, lj::bson::new_string(path.str()));
+    }
+
+    void diff_into(lj::bson::Node& patch,
+            lj::bson::Path& path,
+            const lj::bson::Node& a,
+            const lj::bson::Node& b)
+    {
+        if (same(a, b))
+        {
+            return;
+        }
+
+        if (a.type() != b.type())
+        {
+            add_op(patch, k_op_set, path, new lj::bson::Node(b));
+        }
+        else if (lj::bson::Type::k_document == a.type())
+        {
+            // Both child lists are sorted by key, so one merge pass finds
+            // the removed, added and common keys.
+            auto ia = a.begin();
+            auto ib = b.begin();
+            while (a.end() != ia || b.end() != ib)
+            {
+                const int cmp = (a.end() == ia) ? 1 :
+                        (b.end() == ib) ? -1 :
+                        ia.key().compare(ib.key());
+                if (0 > cmp)
+                {
+                    path.push_back(ia.key());
+                    add_unset(patch, path);
+                    path.pop_back();
+                    ++ia;
+                }
+                else if (0 < cmp)
+                {
+                    path.push_back(ib.key());
+                    add_op(patch, k_op_set, path, new lj::bson::Node(*ib));
+                    path.pop_back();
+                    ++ib;
+                }
+                else
+                {
+                    path.push_back(ia.key());
+                    diff_into(patch, path, *ia, *ib);
+                    path.pop_back();
+                    ++ia;
+                    ++ib;
+                }
+            }
+        }
+        else if (lj::bson::Type::k_array == a.type())
+        {
+            const lj::bson::Node::Array& va = a.to_vector();
+            const lj::bson::Node::Array& vb = b.to_vector();
+            size_t common = 0;
+            while (va.size() > common && vb.size() > common &&
+                    same(*va[common], *vb[common]))
+            {
+                ++common;
+            }
+
+            if (va.size() == common)
+            {
+                // Appended items.
+                lj::bson::Node* items = lj::bson::new_array();
+                for (size_t indx = common; vb.size() > indx; ++indx)
+                {
+                    items->push_child("", new lj::bson::Node(*vb[indx]));
+                }
+                add_op(patch, k_op_push, path, items);
+            }
+            else if (va.size() == vb.size())
+            {
+                // Items changed in place.
+                for (size_t indx = common; vb.size() > indx; ++indx)
+                {
+                    path.push_back(std::to_string(indx));
+                    diff_into(patch, path, *va[indx], *vb[indx]);
+                    path.pop_back();
+                }
+            }
+            else
+            {
+                add_op(patch, k_op_set, path, new lj::bson::Node(b));
+            }
+        }
+        else if (lj::bson::Type::k_int32 == a.type() ||
+                lj::bson::Type::k_int64 == a.type())
+        {
+            add_op(patch, k_op_inc, path,
+                    lj::bson::new_int64(lj::bson::as_int64(b) - lj::bson::as_int64(a)));
+        }
+        else
+        {
+            add_op(patch, k_op_set, path, new lj::bson::Node(b));
+        }
+    }
+
+    // Patch keys are escaped paths; an empty key refers to the target.
+    lj::bson::Node& patch_target(lj::bson::Node& target, const std::string& key)
+    {
+        return key.empty() ? target : target.nav(lj::bson::Path(key));
+    }
+}; // namespace (anonymous)
+
+namespace lj
+{
+    namespace bson
+    {
+        Node* diff(const Node& a, const Node& b)
+        {
+            Node* patch = new Node();
+            Path path;
+            diff_into(*patch, path, a, b);
+            return patch;
+        }
+
+        void apply(Node& target, const Node& patch)
+        {
+            if (patch.exists(k_op_unset))
+            {
+                for (const Node* item : patch[k_op_unset].to_vector())
+                {
+                    const Path path(as_string(*item));
+                    if (path.empty())
+                    {
+                        throw Bson_path_exception("Cannot unset the patch target.", path.str());
+                    }
+                    if (target.exists(path))
+                    {
+                        target.set_child(path, nullptr);
+                    }
+                }
+            }
+
+            if (patch.exists(k_op_set))
+            {
+                const Node& ops = patch[k_op_set];
+                for (auto iter = ops.begin(); ops.end() != iter; ++iter)
+                {
+                    const Path path(iter.key());
+                    if (path.empty() || target.exists(path))
+                    {
+                        patch_target(target, iter.key()) = *iter;
+                    }
+                    else
+                    {
+                        target.set_child(path, new Node(*iter));
+                    }
+                }
+            }
+
+            if (patch.exists(k_op_push))
+            {
+                const Node& ops = patch[k_op_push];
+                for (auto iter = ops.begin(); ops.end() != iter; ++iter)
+                {
+                    const Path path(iter.key());
+                    if (!path.empty() && !target.exists(path))
+                    {
+                        target.set_child(path, new_array());
+                    }
+                    Node& items = patch_target(target, iter.key());
+                    for (const Node* item : iter->to_vector())
+                    {
+                        items.push_child("", new Node(*item));
+                    }
+                }
+            }
+
+            if (patch.exists(k_op_inc))
+            {
+                const Node& ops = patch[k_op_inc];
+                for (auto iter = ops.begin(); ops.end() != iter; ++iter)
+                {
+                    Node& n = patch_target(target, iter.key());
+                    const int64_t v = as_int64(n) + as_int64(*iter);
+                    if (Type::k_int32 == n.type())
+                    {
+                        const int32_t narrow = static_cast<int32_t>(v);
+                        n.set_value(Type::k_int32,
+                                reinterpret_cast<const uint8_t*>(&narrow));
+                    }
+                    else
+                    {
+                        n.set_value(Type::k_int64,
+                                reinterpret_cast<const uint8_t*>(&v));
+                    }
+                }
+            }
+        }
+    }; // namespace lj::bson
+}; // namespace lj
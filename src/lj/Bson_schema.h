@@ -0,0 +1,457 @@
+#pragma once
+/*!
+ \file lj/Bson_schema.h
+ \brief LJ Bson record schema header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lj/Bson.h"
+#include "lj/Uuid.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace lj
+{
+    namespace bson
+    {
+        //! Throw a Bson_type_exception if a field is not of the expected type.
+        inline void expect_type(const View& v, const Type t)
+        {
+            if (t != v.type())
+            {
+                throw Bson_type_exception("Unexpected field type.", v.type());
+            }
+        }
+
+        /*!
+         \brief Conversion between a C++ type and a bson field value.
+
+         Each specialization provides:
+         - \c type(val): the bson type written for \c val.
+         - \c decode(view, val): read \c val from a field, throwing
+           lj::bson::Bson_type_exception if the field has the wrong type.
+         - \c encode(val, out): append the value bytes of \c val to \c out.
+
+         Specialize this template to use other types in a Schema.
+         \tparam T The C++ type.
+         \since 1.0
+         */
+        template<typename T>
+        struct Codec;
+
+        //! Codec for string fields.
+        template<>
+        struct Codec<std::string>
+        {
+            static Type type(const std::string& val)
+            {
+                return Type::k_string;
+            }
+
+            static void decode(const View& v, std::string& val)
+            {
+                expect_type(v, Type::k_string);
+                int32_t sz;
+                memcpy(&sz, v.data(), 4);
+                val.assign(reinterpret_cast<const char*>(v.data() + 4), sz - 1);
+            }
+
+            static void encode(const std::string& val, std::string& out)
+            {
+                const int32_t sz = val.size() + 1;
+                out.append(reinterpret_cast<const char*>(&sz), 4);
+                out.append(val.c_str(), sz);
+            }
+        };
+
+        //! Codec for 32-bit integer fields.
+        template<>
+        struct Codec<int32_t>
+        {
+            static Type type(const int32_t val)
+            {
+                return Type::k_int32;
+            }
+
+            static void decode(const View& v, int32_t& val)
+            {
+                expect_type(v, Type::k_int32);
+                memcpy(&val, v.data(), 4);
+            }
+
+            static void encode(const int32_t val, std::string& out)
+            {
+                out.append(reinterpret_cast<const char*>(&val), 4);
+            }
+        };
+
+        /*!
+         \brief Codec for 64-bit integer fields.
+
+         32-bit values are widened, since json input always produces
+         64-bit integers and older documents may hold either.
+         */
+        template<>
+        struct Codec<int64_t>
+        {
+            static Type type(const int64_t val)
+            {
+                return Type::k_int64;
+            }
+
+            static void decode(const View& v, int64_t& val)
+            {
+                if (Type::k_int32 == v.type())
+                {
+                    int32_t narrow;
+                    memcpy(&narrow, v.data(), 4);
+                    val = narrow;
+                    return;
+                }
+                expect_type(v, Type::k_int64);
+                memcpy(&val, v.data(), 8);
+            }
+
+            static void encode(const int64_t val, std::string& out)
+            {
+                out.append(reinterpret_cast<const char*>(&val), 8);
+            }
+        };
+
+        //! Codec for unsigned 64-bit integer fields, stored as Type::k_int64.
+        template<>
+        struct Codec<uint64_t>
+        {
+            static Type type(const uint64_t val)
+            {
+                return Type::k_int64;
+            }
+
+            static void decode(const View& v, uint64_t& val)
+            {
+                expect_type(v, Type::k_int64);
+                memcpy(&val, v.data(), 8);
+            }
+
+            static void encode(const uint64_t val, std::string& out)
+            {
+                out.append(reinterpret_cast<const char*>(&val), 8);
+            }
+        };
+
+        //! Codec for boolean fields.
+        template<>
+        struct Codec<bool>
+        {
+            static Type type(const bool val)
+            {
+                return Type::k_boolean;
+            }
+
+            static void decode(const View& v, bool& val)
+            {
+                expect_type(v, Type::k_boolean);
+                val = (0 != *v.data());
+            }
+
+            static void encode(const bool val, std::string& out)
+            {
+                out.push_back(val ? 1 : 0);
+            }
+        };
+
+        //! Codec for double fields.
+        template<>
+        struct Codec<double>
+        {
+            static Type type(const double val)
+            {
+                return Type::k_double;
+            }
+
+            static void decode(const View& v, double& val)
+            {
+                expect_type(v, Type::k_double);
+                memcpy(&val, v.data(), 8);
+            }
+
+            static void encode(const double val, std::string& out)
+            {
+                out.append(reinterpret_cast<const char*>(&val), 8);
+            }
+        };
+
+        //! Codec for lj::Uuid fields, stored as uuid binary values.
+        template<>
+        struct Codec<lj::Uuid>
+        {
+            static Type type(const lj::Uuid& val)
+            {
+                return Type::k_binary;
+            }
+
+            static void decode(const View& v, lj::Uuid& val)
+            {
+                expect_type(v, Type::k_binary);
+                uint32_t sz;
+                memcpy(&sz, v.data(), 4);
+                if (16 != sz || Binary_type::k_bin_uuid != static_cast<Binary_type>(v.data()[4]))
+                {
+                    throw Bson_type_exception("Unexpected binary field type.",
+                            v.type(), static_cast<Binary_type>(v.data()[4]));
+                }
+                val = lj::Uuid(v.data() + 5);
+            }
+
+            static void encode(const lj::Uuid& val, std::string& out)
+            {
+                size_t sz;
+                const uint8_t* d = val.data(&sz);
+                const uint32_t sz32 = sz;
+                out.append(reinterpret_cast<const char*>(&sz32), 4);
+                out.push_back(static_cast<char>(Binary_type::k_bin_uuid));
+                out.append(reinterpret_cast<const char*>(d), sz);
+            }
+        };
+
+        /*!
+         \brief Codec for fields of any type.
+
+         The view refers to the decoded bytes, so it is only valid as
+         long as they are. An empty view is written as null.
+         */
+        template<>
+        struct Codec<View>
+        {
+            static Type type(const View& val)
+            {
+                if (!val)
+                {
+                    return Type::k_null;
+                }
+                return Type::k_binary_document == val.type() ?
+                        Type::k_document : val.type();
+            }
+
+            static void decode(const View& v, View& val)
+            {
+                val = v;
+            }
+
+            static void encode(const View& val, std::string& out)
+            {
+                if (val)
+                {
+                    out.append(reinterpret_cast<const char*>(val.data()), val.size());
+                }
+            }
+        };
+
+        /*!
+         \brief Binding of a record member to a schema field.
+         \tparam Record The record type.
+         \tparam T The member type. Codec<T> must be defined.
+         \tparam Member The member pointer.
+         \since 1.0
+         */
+        template<typename Record, typename T, T Record::*Member>
+        struct Field
+        {
+            //! Read the member from a field value.
+            static void decode(const View& v, Record& r)
+            {
+                Codec<T>::decode(v, r.*Member);
+            }
+
+            //! Append the member as a bson element.
+            static void encode(const Record& r,
+                    const std::string& name,
+                    std::string& out)
+            {
+                out.push_back(static_cast<char>(Codec<T>::type(r.*Member)));
+                out.append(name.c_str(), name.size() + 1);
+                Codec<T>::encode(r.*Member, out);
+            }
+        };
+
+        /*!
+         \brief Fixed set of fields mapped onto a plain struct.
+
+         A schema is declared once, usually as a namespace scope
+         constant, and converts between raw bson documents and records
+         without building Node trees:
+         \code
+         struct Login
+         {
+             std::string method;
+             lj::bson::View data;
+         };
+
+         const lj::bson::Schema<Login,
+                 lj::bson::Field<Login, std::string, &Login::method>,
+                 lj::bson::Field<Login, lj::bson::View, &Login::data> >
+                 k_login_schema("method", "data");
+         \endcode
+
+         Decoding walks the document once. Each key is compared with the
+         field after the last one matched first, so documents written in
+         schema order match every key on the first compare. Unknown keys
+         are skipped and missing fields keep their value in the record.
+         A field of the wrong type fails immediately. Nested documents
+         can be read as a View field and decoded with another schema.
+         \tparam Record The record type.
+         \tparam Fields One Field for each member to map.
+         \since 1.0
+         */
+        template<typename Record, typename... Fields>
+        class Schema
+        {
+        public:
+            //! Number of fields in the schema.
+            static const size_t k_size = sizeof...(Fields);
+
+            /*!
+             \brief Create a schema.
+             \param names The field names, in the same order as \c Fields.
+             */
+            template<typename... Names>
+            explicit Schema(Names... names) : names_{{std::string(names)...}}
+            {
+                static_assert(sizeof...(Names) == sizeof...(Fields),
+                        "A schema needs one name for each field.");
+            }
+
+            /*!
+             \brief Read a record from a document.
+             \param doc The document to read.
+             \param r [out] The record to fill.
+             \throws lj::bson::Bson_type_exception if \c doc is not a
+             document or a field has the wrong type.
+             */
+            void decode(const View& doc, Record& r) const
+            {
+                typedef void (*Decoder)(const View&, Record&);
+                static const Decoder k_decoders[] = {&Fields::decode...};
+
+                if (Type::k_document != doc.type() &&
+                        Type::k_binary_document != doc.type())
+                {
+                    throw Bson_type_exception("Unable to decode a non-document type.", doc.type());
+                }
+
+                size_t next = 0;
+                for (auto iter = doc.begin(); doc.end() != iter; ++iter)
+                {
+                    const size_t indx = find(iter.key(), next);
+                    if (k_size != indx)
+                    {
+                        k_decoders[indx](iter.value(), r);
+                        next = indx + 1;
+                    }
+                }
+            }
+
+            /*!
+             \brief Read a record from a document.
+             \param doc The document to read.
+             \return The record. Missing fields are value initialized.
+             \sa decode(const View&, Record&) const
+             */
+            Record decode(const View& doc) const
+            {
+                Record r = Record();
+                decode(doc, r);
+                return r;
+            }
+
+            /*!
+             \brief Write a record as a document.
+
+             Fields are written in schema order.
+             \param r The record to write.
+             \param out [out] The string to append the document bytes to.
+             */
+            void encode(const Record& r, std::string& out) const
+            {
+                typedef void (*Encoder)(const Record&, const std::string&, std::string&);
+                static const Encoder k_encoders[] = {&Fields::encode...};
+
+                const size_t start = out.size();
+                out.append(4, '\0');
+                for (size_t indx = 0; k_size > indx; ++indx)
+                {
+                    k_encoders[indx](r, names_[indx], out);
+                }
+                out.push_back('\0');
+                const int32_t sz = out.size() - start;
+                memcpy(&out[start], &sz, 4);
+            }
+
+            /*!
+             \brief Write a record as a document node.
+             \param r The record to write.
+             \return The document.
+             */
+            Node to_node(const Record& r) const
+            {
+                std::string bytes;
+                encode(r, bytes);
+                return Node(Type::k_document,
+                        reinterpret_cast<const uint8_t*>(bytes.data()));
+            }
+
+        private:
+            // Find the field for a key, starting with the expected one.
+            size_t find(const char* key, size_t next) const
+            {
+                for (size_t count = 0; k_size > count; ++count, ++next)
+                {
+                    if (k_size == next)
+                    {
+                        next = 0;
+                    }
+                    if (0 == strcmp(key, names_[next].c_str()))
+                    {
+                        return next;
+                    }
+                }
+                return k_size;
+            }
+
+            std::array<std::string, sizeof...(Fields)> names_;
+        }; // class lj::bson::Schema
+    }; // namespace lj::bson
+}; // namespace lj
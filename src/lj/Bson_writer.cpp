@@ -0,0 +1,393 @@
+/*!
+ \file lj/Bson_writer.cpp
+ \brief LJ Bson json writer implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lj/Bson_writer.h"
+#include "lj/Base64.h"
+#include "lj/Bson.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace lj
+{
+    namespace bson
+    {
+        Json_writer::Json_writer(std::string& out, Format format) :
+                buffer_(),
+                out_(out),
+                os_(nullptr),
+                format_(format)
+        {
+        }
+
+        Json_writer::Json_writer(std::ostream& os, Format format) :
+                buffer_(),
+                out_(buffer_),
+                os_(&os),
+                format_(format)
+        {
+            buffer_.reserve(k_flush_size + 64);
+        }
+
+        Json_writer::~Json_writer()
+        {
+            flush();
+        }
+
+        void Json_writer::write(const Node& b, int lvl)
+        {
+            const uint8_t* v = nullptr;
+            int32_t i32 = 0;
+            int64_t i64 = 0;
+            double d = 0.0;
+            switch (b.type())
+            {
+                case Type::k_document:
+                case Type::k_array:
+                    write_nested(b, lvl);
+                    break;
+                case Type::k_binary_document:
+                    write(Node(Type::k_document, b.to_value()), lvl);
+                    break;
+                case Type::k_binary:
+                    write_binary(b, lvl);
+                    break;
+                case Type::k_string:
+                    // Top level strings are written bare, like as_string().
+                    v = b.to_value();
+                    memcpy(&i32, v, 4);
+                    put(reinterpret_cast<const char*>(v + 4), i32 - 1);
+                    break;
+                case Type::k_null:
+                    put("null", 4);
+                    break;
+                case Type::k_boolean:
+                    put(*b.to_value() ? '1' : '0');
+                    break;
+                case Type::k_int32:
+                    memcpy(&i32, b.to_value(), 4);
+                    put_int(i32);
+                    break;
+                case Type::k_int64:
+                case Type::k_timestamp:
+                    memcpy(&i64, b.to_value(), 8);
+                    put_int(i64);
+                    break;
+                case Type::k_double:
+                    memcpy(&d, b.to_value(), 8);
+                    put_double(d);
+                    break;
+                default:
+                    write_typed(b, lvl);
+                    break;
+            }
+        }
+
+        void Json_writer::flush()
+        {
+            if (os_ && !buffer_.empty())
+            {
+                os_->write(buffer_.data(), buffer_.size());
+                buffer_.clear();
+            }
+        }
+
+        inline void Json_writer::put(const char* p, size_t sz)
+        {
+            out_.append(p, sz);
+        }
+
+        inline void Json_writer::put(const char c)
+        {
+            out_.push_back(c);
+        }
+
+        void Json_writer::put_escaped(const char* p, size_t sz)
+        {
+            // Copy the runs between characters that need escaping in one
+            // go. Most strings have none, and are a single append.
+            const char* end = p + sz;
+            const char* run = p;
+            for (; end != p; ++p)
+            {
+                if ('\\' == *p || '"' == *p)
+                {
+                    put(run, p - run);
+                    put('\\');
+                    run = p;
+                }
+            }
+            put(run, end - run);
+        }
+
+        void Json_writer::put_indent(int lvl)
+        {
+            if (0 < lvl)
+            {
+                out_.append(lvl * 2, ' ');
+            }
+        }
+
+        void Json_writer::put_int(int64_t v)
+        {
+            char buf[24];
+            char* p = buf + sizeof(buf);
+            uint64_t u = (0 > v) ? 0 - static_cast<uint64_t>(v) : v;
+            do
+            {
+                *--p = '0' + (u % 10);
+                u /= 10;
+            } while (u);
+            if (0 > v)
+            {
+                *--p = '-';
+            }
+            put(p, buf + sizeof(buf) - p);
+        }
+
+        void Json_writer::put_double(double v)
+        {
+            // Same digits as the default std::ostream formatting.
+            char buf[32];
+            const int sz = snprintf(buf, sizeof(buf), "%g", v);
+            put(buf, sz);
+        }
+
+        void Json_writer::put_separator(bool first, int lvl)
+        {
+            // Every element starts here, so this is where stream output
+            // is handed off.
+            if (os_ && out_.size() >= k_flush_size)
+            {
+                flush();
+            }
+            if (!first)
+            {
+                put(',');
+            }
+            if (Format::k_pretty == format_)
+            {
+                put('\n');
+                put_indent(lvl);
+            }
+        }
+
+        void Json_writer::put_key(const std::string& key)
+        {
+            put('"');
+            put_escaped(key.data(), key.size());
+            put("\":", 2);
+        }
+
+        void Json_writer::write_child(const Node& b, int lvl)
+        {
+            if (Type::k_string == b.type())
+            {
+                const uint8_t* v = b.to_value();
+                int32_t sz;
+                memcpy(&sz, v, 4);
+                put('"');
+                put_escaped(reinterpret_cast<const char*>(v + 4), sz - 1);
+                put('"');
+            }
+            else
+            {
+                write(b, lvl);
+            }
+        }
+
+        void Json_writer::write_nested(const Node& b, int lvl)
+        {
+            const bool array = (Type::k_array == b.type());
+            if (array ? b.to_vector().empty() : 0 == b.count())
+            {
+                put(array ? "[]" : "{}", 2);
+                return;
+            }
+
+            bool first = true;
+            if (array)
+            {
+                put('[');
+                for (const Node* n : b.to_vector())
+                {
+                    put_separator(first, lvl);
+                    write_child(*n, lvl + 1);
+                    first = false;
+                }
+            }
+            else
+            {
+                put('{');
+                for (auto iter = b.begin(); b.end() != iter; ++iter)
+                {
+                    put_separator(first, lvl);
+                    put_key(iter.key());
+                    write_child(*iter, lvl + 1);
+                    first = false;
+                }
+            }
+
+            if (Format::k_pretty == format_)
+            {
+                put('\n');
+                put_indent(lvl - 1);
+            }
+            put(array ? ']' : '}');
+        }
+
+        void Json_writer::write_binary(const Node& b, int lvl)
+        {
+            // Binary values are written as a document that parse_json()
+            // turns back into binary.
+            Binary_type bin_type;
+            uint32_t bin_size;
+            const uint8_t* v = as_binary(b, &bin_type, &bin_size);
+            const bool uuid = (Binary_type::k_bin_uuid == bin_type);
+            const std::string value(uuid ?
+                    static_cast<std::string>(as_uuid(b)) :
+                    lj::base64_encode(v, bin_size));
+
+            put('{');
+            put_separator(true, lvl);
+            put_key("__bson_note");
+            if (uuid)
+            {
+                put_int(static_cast<int64_t>(static_cast<uint64_t>(as_uuid(b))));
+            }
+            else
+            {
+                put_int(static_cast<int32_t>(bin_type));
+            }
+            put_separator(false, lvl);
+            put_key("__bson_type");
+            if (uuid)
+            {
+                put("\"UUID\"", 6);
+            }
+            else
+            {
+                put("\"BINARY\"", 8);
+            }
+            put_separator(false, lvl);
+            put_key("__bson_value");
+            put('"');
+            put_escaped(value.data(), value.size());
+            put('"');
+            if (Format::k_pretty == format_)
+            {
+                put('\n');
+                put_indent(lvl - 1);
+            }
+            put('}');
+        }
+
+        void Json_writer::write_typed(const Node& b, int lvl)
+        {
+            // The note is the readable form of the value. The value holds
+            // the raw value bytes, except for date/times which hold the
+            // milliseconds since the epoch.
+            const char* name;
+            switch (b.type())
+            {
+                case Type::k_datetime:
+                    name = "DATETIME";
+                    break;
+                case Type::k_object_id:
+                    name = "OBJECT_ID";
+                    break;
+                case Type::k_regex:
+                    name = "REGEX";
+                    break;
+                case Type::k_db_pointer:
+                    name = "DB_POINTER";
+                    break;
+                case Type::k_javascript:
+                    name = "JAVASCRIPT";
+                    break;
+                case Type::k_symbol:
+                    name = "SYMBOL";
+                    break;
+                case Type::k_javascript_scope:
+                    name = "JAVASCRIPT_SCOPE";
+                    break;
+                case Type::k_decimal128:
+                    name = "DECIMAL128";
+                    break;
+                case Type::k_minkey:
+                    name = "MINKEY";
+                    break;
+                case Type::k_maxkey:
+                    name = "MAXKEY";
+                    break;
+                default:
+                    return;
+            }
+
+            const std::string note(as_string(b));
+            put('{');
+            put_separator(true, lvl);
+            put_key("__bson_note");
+            put('"');
+            put_escaped(note.data(), note.size());
+            put('"');
+            put_separator(false, lvl);
+            put_key("__bson_type");
+            put('"');
+            put(name, strlen(name));
+            put('"');
+            put_separator(false, lvl);
+            put_key("__bson_value");
+            if (Type::k_datetime == b.type())
+            {
+                put_int(as_int64(b));
+            }
+            else
+            {
+                const size_t sz = b.size();
+                const std::string value(sz ? lj::base64_encode(b.to_value(), sz) : std::string());
+                put('"');
+                put_escaped(value.data(), value.size());
+                put('"');
+            }
+            if (Format::k_pretty == format_)
+            {
+                put('\n');
+                put_indent(lvl - 1);
+            }
+            put('}');
+        }
+    }; // namespace lj::bson
+}; // namespace lj
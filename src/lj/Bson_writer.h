@@ -0,0 +1,127 @@
+#pragma once
+/*!
+ \file lj/Bson_writer.h
+ \brief LJ Bson json writer header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace lj
+{
+    namespace bson
+    {
+        class Node;
+
+        /*!
+         \brief Streaming json writer for bson nodes.
+
+         Writes a Node tree as json straight into an output buffer, or into
+         a std::ostream through a fixed size buffer, without building a
+         string for every level of the tree.
+
+         Pretty output matches lj::bson::as_json_string(), and can be read
+         back with lj::bson::parse_json(). Compact output is the same json
+         without the new lines and indentation. Types without a json
+         equivalent, such as binary values and date/times, are written as
+         a document with \c __bson_type and \c __bson_value keys that
+         parse_json() turns back into the original type.
+         \since 1.0
+         */
+        class Json_writer
+        {
+        public:
+            //! Output formats.
+            enum class Format
+            {
+                k_compact, //!< Everything on one line.
+                k_pretty //!< Nested values on their own indented lines.
+            };
+
+            //! Number of buffered bytes that triggers a stream write.
+            static const size_t k_flush_size = 16 * 1024;
+
+            /*!
+             \brief Create a writer that appends to a string.
+             \param out The string to append to.
+             \param format The output format.
+             */
+            explicit Json_writer(std::string& out,
+                    Format format = Format::k_pretty);
+
+            /*!
+             \brief Create a writer that writes to a stream.
+
+             Output is buffered until the buffer reaches k_flush_size, or
+             flush() is called, or the writer is destroyed.
+             \param os The stream to write to.
+             \param format The output format.
+             */
+            explicit Json_writer(std::ostream& os,
+                    Format format = Format::k_pretty);
+            Json_writer(const Json_writer& o) = delete;
+            Json_writer& operator=(const Json_writer& rhs) = delete;
+            ~Json_writer();
+
+            /*!
+             \brief Write a node.
+             \param b The node to write.
+             \param lvl The indentation level of the node's children.
+             */
+            void write(const Node& b, int lvl = 1);
+
+            //! Write any buffered output to the stream.
+            void flush();
+        private:
+            std::string buffer_;
+            std::string& out_;
+            std::ostream* os_;
+            Format format_;
+
+            void put(const char* p, size_t sz);
+            void put(const char c);
+            void put_escaped(const char* p, size_t sz);
+            void put_indent(int lvl);
+            void put_int(int64_t v);
+            void put_double(double v);
+            void put_separator(bool first, int lvl);
+            void put_key(const std::string& key);
+            void write_child(const Node& b, int lvl);
+            void write_nested(const Node& b, int lvl);
+            void write_binary(const Node& b, int lvl);
+            void write_typed(const Node& b, int lvl);
+        }; // class lj::bson::Json_writer
+    }; // namespace lj::bson
+}; // namespace lj
@@ -52,6 +52,14 @@ extern "C"
 namespace lj
 {
     const size_t Document::k_key_size = AES_MAX_KEY_SIZE;
+    const lj::bson::Path Document::k_path_data(".");
+    const lj::bson::Path Document::k_path_parent("_/parent");
+    const lj::bson::Path Document::k_path_vclock("_/vclock");
+    const lj::bson::Path Document::k_path_suppressed("_/flag/suppressed");
+    const lj::bson::Path Document::k_path_key("_/key");
+    const lj::bson::Path Document::k_path_id("_/id");
+    const lj::bson::Path Document::k_path_version("version");
+    const lj::bson::Path Document::k_path_siblings("_/siblings");
 
     Document::Document() : doc_(NULL), dirty_(true)
     {
@@ -71,7 +79,7 @@ namespace lj
         else
         {
             seed();
-            doc_->set_child(".", doc);
+            doc_->set_child(k_path_data, doc);
         }
     }
 
@@ -83,6 +91,44 @@ namespace lj
         }
     }
 
+    Document::Order Document::compare(const lj::bson::Node& left,
+            const lj::bson::Node& right)
+    {
+        bool less = false;
+        bool greater = false;
+        for (auto iter = left.begin(); left.end() != iter; ++iter)
+        {
+            const lj::bson::Node* other = right.path(iter.key());
+            int64_t l = lj::bson::as_int64(*iter);
+            int64_t r = other ? lj::bson::as_int64(*other) : 0;
+            less = less || l < r;
+            greater = greater || l > r;
+        }
+
+        // Entries only found on the right are compared against zero.
+        for (auto iter = right.begin(); right.end() != iter; ++iter)
+        {
+            if (!left.exists(iter.key()) && 0 < lj::bson::as_int64(*iter))
+            {
+                less = true;
+            }
+        }
+
+        if (less && greater)
+        {
+            return Order::k_concurrent;
+        }
+        else if (less)
+        {
+            return Order::k_before;
+        }
+        else if (greater)
+        {
+            return Order::k_after;
+        }
+        return Order::k_equal;
+    }
+
     void Document::wash()
     {
         dirty_ = false;
@@ -96,13 +142,13 @@ namespace lj
 
         // parent relationships are updated in the taint method.
         taint(server);
-        doc_->set_child("_/key", lj::bson::new_uint64(k));
-        doc_->set_child("_/id", lj::bson::new_uuid(lj::Uuid(k)));
+        doc_->set_child(k_path_key, lj::bson::new_uint64(k));
+        doc_->set_child(k_path_id, lj::bson::new_uuid(lj::Uuid(k)));
 
         // We only reset the vclock if key has actually changed.
         if (k != old_key)
         {
-            doc_->set_child("_/vclock", new lj::bson::Node());
+            doc_->set_child(k_path_vclock, new lj::bson::Node());
         }
     }
 
@@ -121,9 +167,9 @@ namespace lj
 
     namespace
     {
-        const std::string k_crypt_vector("_/encrypted/vector");
-        const std::string k_crypt_auth("_/encrypted/auth");
-        const std::string k_crypt_data("#");
+        const lj::bson::Path k_crypt_vector("_/encrypted/vector");
+        const lj::bson::Path k_crypt_auth("_/encrypted/auth");
+        const lj::bson::Path k_crypt_data("#");
     }; // namespace (anonymous)
 
     void Document::encrypt(const lj::Uuid& server,
@@ -144,7 +190,7 @@ namespace lj
         if (paths.empty())
         {
             // An empty paths list means we should encrypt everything.
-            source.reset(doc_->nav(".").to_binary(&source_size));
+            source.reset(doc_->nav(k_path_data).to_binary(&source_size));
         }
         else
         {
@@ -158,8 +204,8 @@ namespace lj
                     ++iter)
             {
                 lj::bson::Node* ptr =
-                        new lj::bson::Node(doc_->nav(".").nav(*iter));
-                tmp.nav(".").set_child(*iter, ptr);
+                        new lj::bson::Node(doc_->nav(k_path_data).nav(*iter));
+                tmp.nav(k_path_data).set_child(*iter, ptr);
             }
             source.reset(tmp.to_binary(&source_size));
         }
@@ -222,7 +268,7 @@ namespace lj
         // Remove the paths that were just encrypted.
         if (paths.empty())
         {
-            doc_->set_child(".", nullptr);
+            doc_->set_child(k_path_data, nullptr);
         }
         else
         {
@@ -230,7 +276,7 @@ namespace lj
                     paths.end() != iter;
                     ++iter)
             {
-                doc_->nav(".").set_child(*iter, nullptr);
+                doc_->nav(k_path_data).set_child(*iter, nullptr);
             }
         }
     }
@@ -321,7 +367,7 @@ namespace lj
 
         // try to combine the documents.  This may throw an exception if things are
         // messed up.
-        lj::bson::combine(doc_->nav("."), changes.nav("."));
+        lj::bson::combine(doc_->nav(k_path_data), changes.nav(k_path_data));
 
         // Remove the encrypted data from the document.
         doc_->nav(k_crypt_vector).set_child(key_name, nullptr);
@@ -333,7 +379,33 @@ namespace lj
             const bool s)
     {
         taint(server);
-        doc_->set_child("_/flag/suppressed", lj::bson::new_boolean(s));
+        doc_->set_child(k_path_suppressed, lj::bson::new_boolean(s));
+    }
+
+    void Document::resolve(const lj::Uuid& server)
+    {
+        taint(server);
+        if (!doc_->exists(k_path_siblings))
+        {
+            return;
+        }
+
+        // Take the highest count of every server.
+        lj::bson::Node& clock = doc_->nav(k_path_vclock);
+        for (const lj::bson::Node* sibling : doc_->nav(k_path_siblings).to_vector())
+        {
+            const lj::bson::Node& other = sibling->nav(k_path_vclock);
+            for (auto iter = other.begin(); other.end() != iter; ++iter)
+            {
+                if (!clock.exists(iter.key()) ||
+                        lj::bson::as_int64(clock.nav(iter.key())) < lj::bson::as_int64(*iter))
+                {
+                    clock.set_child(iter.key(),
+                            lj::bson::new_int64(lj::bson::as_int64(*iter)));
+                }
+            }
+        }
+        doc_->set_child(k_path_siblings, nullptr);
     }
 
     void Document::set(const lj::Uuid& server,
@@ -341,7 +413,7 @@ namespace lj
             lj::bson::Node* value)
     {
         taint(server);
-        doc_->nav(".").set_child(path, value);
+        doc_->nav(k_path_data).set_child(path, value);
     }
 
     void Document::push(const lj::Uuid& server,
@@ -349,7 +421,7 @@ namespace lj
             lj::bson::Node* value)
     {
         taint(server);
-        doc_->nav(".").push_child(path, value);
+        doc_->nav(k_path_data).push_child(path, value);
     }
 
     void Document::increment(const lj::Uuid& server,
@@ -357,7 +429,7 @@ namespace lj
             int amount)
     {
         taint(server);
-        lj::bson::increment(doc_->nav(".").nav(path), amount);
+        lj::bson::increment(doc_->nav(k_path_data).nav(path), amount);
     }
 
     void Document::seed()
@@ -369,13 +441,13 @@ namespace lj
         doc_ = new lj::bson::Node();
         dirty_ = true;
 
-        doc_->set_child("_/parent", lj::bson::new_null());
-        doc_->set_child("_/vclock", new lj::bson::Node());
-        doc_->set_child("_/flag/suppressed", lj::bson::new_boolean(false));
-        doc_->set_child("_/key", lj::bson::new_null());
-        doc_->set_child("_/id", lj::bson::new_null());
-        doc_->set_child("version", lj::bson::new_int32(100));
-        doc_->set_child(".", new lj::bson::Node());
+        doc_->set_child(k_path_parent, lj::bson::new_null());
+        doc_->set_child(k_path_vclock, new lj::bson::Node());
+        doc_->set_child(k_path_suppressed, lj::bson::new_boolean(false));
+        doc_->set_child(k_path_key, lj::bson::new_null());
+        doc_->set_child(k_path_id, lj::bson::new_null());
+        doc_->set_child(k_path_version, lj::bson::new_int32(100));
+        doc_->set_child(k_path_data, new lj::bson::Node());
     }
 
     void Document::taint(const lj::Uuid& server)
@@ -386,11 +458,11 @@ namespace lj
             dirty_ = true;
 
             // Create new revision ID.
-            doc_->set_child("_/parent", new lj::bson::Node(doc_->nav("_/id")));
-            doc_->set_child("_/id", lj::bson::new_uuid(lj::Uuid(key())));
+            doc_->set_child(k_path_parent, new lj::bson::Node(doc_->nav(k_path_id)));
+            doc_->set_child(k_path_id, lj::bson::new_uuid(lj::Uuid(key())));
 
             // Update the vclock
-            lj::bson::increment(doc_->nav("_/vclock").nav(server), 1);
+            lj::bson::increment(doc_->nav(k_path_vclock).nav(server), 1);
         }
     }
 }
@@ -86,6 +86,14 @@ namespace lj
      modified state. Modifications to a document must be done through the
      document interface.
 
+     \par Vector clocks
+     Every modification increments the entry for the modifying server in
+     the "_/vclock" element. Two versions of a document are causally
+     ordered when one clock is at least the other in every entry, and
+     concurrent otherwise. Concurrent versions are kept side by side, one
+     as the document and the others under the "_/siblings" element, until
+     \c lj::Document::resolve() is called.
+
      Copying documents is not allowed.
      \since 1.0
      \sa lj::bson::Node
@@ -94,7 +102,24 @@ namespace lj
     class Document
     {
     public:
+        //! Causal order of two vector clocks.
+        enum class Order
+        {
+            k_before, //!< The left clock happened before the right clock.
+            k_equal, //!< The clocks are identical.
+            k_after, //!< The left clock happened after the right clock.
+            k_concurrent //!< Neither clock happened before the other.
+        };
+
         static const size_t k_key_size; //!< Number of bytes required for the encryption key.
+        static const lj::bson::Path k_path_data; //!< Path to the data element.
+        static const lj::bson::Path k_path_parent; //!< Path to the parent identifier.
+        static const lj::bson::Path k_path_vclock; //!< Path to the vector clock.
+        static const lj::bson::Path k_path_suppressed; //!< Path to the suppressed flag.
+        static const lj::bson::Path k_path_key; //!< Path to the document key.
+        static const lj::bson::Path k_path_id; //!< Path to the document identifier.
+        static const lj::bson::Path k_path_version; //!< Path to the document version.
+        static const lj::bson::Path k_path_siblings; //!< Path to the concurrent versions.
 
         // grant the unit test function access.
         friend void ::testEncrypt_friendly();
@@ -132,7 +157,7 @@ namespace lj
          */
         inline lj::Uuid parent() const
         {
-            return lj::bson::as_uuid(doc_->nav("_/parent"));
+            return lj::bson::as_uuid(doc_->nav(k_path_parent));
         }
 
         /*!
@@ -141,7 +166,38 @@ namespace lj
          */
         inline const lj::bson::Node& vclock() const
         {
-            return doc_->nav("_/vclock");
+            return doc_->nav(k_path_vclock);
+        }
+
+        /*!
+         \brief Compare two vector clocks.
+
+         Missing entries count as zero.
+         \param left The left clock.
+         \param right The right clock.
+         \return The order of \c left relative to \c right.
+         */
+        static Order compare(const lj::bson::Node& left,
+                const lj::bson::Node& right);
+
+        /*!
+         \brief Compare the vector clock of this document with another.
+         \param o The other document.
+         \return The order of this document relative to \c o.
+         */
+        inline Order compare(const lj::Document& o) const
+        {
+            return compare(vclock(), o.vclock());
+        }
+
+        /*!
+         \brief Test for concurrent versions.
+         \return True if the "_/siblings" element holds any versions.
+         */
+        inline bool conflicted() const
+        {
+            return doc_->exists(k_path_siblings) &&
+                    !doc_->nav(k_path_siblings).to_vector().empty();
         }
 
         /*!
@@ -150,7 +206,7 @@ namespace lj
          */
         inline int32_t version() const
         {
-            return lj::bson::as_int32(doc_->nav("version"));
+            return lj::bson::as_int32(doc_->nav(k_path_version));
         }
 
         /*!
@@ -159,7 +215,7 @@ namespace lj
          */
         inline uint64_t key() const
         {
-            return lj::bson::as_uint64(doc_->nav("_/key"));
+            return lj::bson::as_uint64(doc_->nav(k_path_key));
         }
 
         /*!
@@ -168,7 +224,7 @@ namespace lj
          */
         inline lj::Uuid id() const
         {
-            return lj::bson::as_uuid(doc_->nav("_/id"));
+            return lj::bson::as_uuid(doc_->nav(k_path_id));
         }
 
         /*!
@@ -177,7 +233,7 @@ namespace lj
          */
         inline bool suppress() const
         {
-            return lj::bson::as_boolean(doc_->nav("_/flag/suppressed"));
+            return lj::bson::as_boolean(doc_->nav(k_path_suppressed));
         }
 
         /*!
@@ -189,13 +245,22 @@ namespace lj
             return dirty_;
         }
 
+        /*!
+         \brief Get the complete document, including the metadata.
+         \return The root node.
+         */
+        inline const lj::bson::Node& root() const
+        {
+            return *doc_;
+        }
+
         /*!
          \brief Get the data document.
          \return The data node.
          */
         inline const lj::bson::Node& get() const
         {
-            return doc_->nav(".");
+            return doc_->nav(k_path_data);
         }
 
         /*!
@@ -205,7 +270,20 @@ namespace lj
          */
         inline const lj::bson::Node& get(const std::string& path) const
         {
-            return doc_->nav(".").nav(path);
+            return doc_->nav(k_path_data).nav(path);
+        }
+
+        /*!
+         \brief Hash the data document.
+
+         Only the "." element is hashed, so documents holding the same
+         data have the same hash whatever their metadata or field order.
+         \param out Location for lj::bson::k_content_hash_size bytes.
+         \sa lj::bson::content_hash(const lj::bson::Node&, uint8_t*)
+         */
+        inline void content_hash(uint8_t* out) const
+        {
+            lj::bson::content_hash(get(), out);
         }
 
         /*!
@@ -285,6 +363,16 @@ namespace lj
         void suppress(const lj::Uuid& server,
                 const bool s);
 
+        /*!
+         \brief Resolve the concurrent versions of the document.
+
+         The current data is kept, the siblings are removed, and the vector
+         clock is merged with theirs so the result replaces every one of
+         them wherever it is replicated.
+         \param server The server resolving the conflict.
+         */
+        void resolve(const lj::Uuid& server);
+
         /*! 
          \brief Change a value in the document.
          \param server The server setting the value.
@@ -0,0 +1,261 @@
+/*!
+ \file lj/Executor.cpp
+ \brief LJ work-stealing executor implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lj/Executor.h"
+#include "lj/Log.h"
+#include <algorithm>
+#include <future>
+#include <thread>
+
+namespace
+{
+    //! The executor that owns the current thread, if any.
+    thread_local const lj::Executor* t_executor = nullptr;
+
+    //! The worker index of the current thread.
+    thread_local size_t t_worker = 0;
+}; // namespace (anonymous)
+
+namespace lj
+{
+    //! Worker thread and its task deque.
+    class Executor::Worker : public lj::Work
+    {
+    public:
+        Worker(Executor& executor, size_t indx) :
+                executor_(executor),
+                indx_(indx),
+                mutex_(),
+                tasks_()
+        {
+        }
+        Worker(const Worker& o) = delete;
+        Worker(Worker&& o) = delete;
+        Worker& operator=(const Worker& rhs) = delete;
+        Worker& operator=(Worker&& rhs) = delete;
+        virtual ~Worker() = default;
+
+        virtual void run() override
+        {
+            t_executor = &executor_;
+            t_worker = indx_;
+
+            Task task;
+            while (executor_.next_task(indx_, task))
+            {
+                log::attempt<Error>(task);
+                task = nullptr;
+            }
+        }
+
+        virtual void cleanup() override
+        {
+        }
+
+        //! Push onto the owner end of the deque.
+        void push(Task&& task)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+
+        //! Pop from the owner end of the deque.
+        bool pop(Task& task)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (tasks_.empty())
+            {
+                return false;
+            }
+            task = std::move(tasks_.back());
+            tasks_.pop_back();
+            return true;
+        }
+
+        //! Steal from the opposite end of the deque.
+        bool steal(Task& task)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (tasks_.empty())
+            {
+                return false;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            return true;
+        }
+    private:
+        Executor& executor_;
+        size_t indx_;
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+    }; // class lj::Executor::Worker
+
+    Executor::Executor(size_t workers) :
+            running_(true),
+            pending_(0),
+            mutex_(),
+            cv_(),
+            injection_(),
+            workers_(),
+            threads_()
+    {
+        if (0 == workers)
+        {
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (size_t h = 0; h < workers; ++h)
+        {
+            workers_.emplace_back(new Worker(*this, h));
+        }
+        for (std::unique_ptr<Worker>& w : workers_)
+        {
+            threads_.emplace_back(new lj::Thread());
+            threads_.back()->run(w.get());
+        }
+    }
+
+    Executor::~Executor()
+    {
+        shutdown();
+    }
+
+    void Executor::submit(Task task)
+    {
+        // The pending count is raised before the task becomes visible, so
+        // it never drops below the number of tasks waiting in the queues.
+        if (is_worker())
+        {
+            // Keep the work local to this core.
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++pending_;
+            }
+            workers_[t_worker]->push(std::move(task));
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_.load())
+            {
+                throw LJ__Exception("Executor is shut down.");
+            }
+            ++pending_;
+            injection_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+    void Executor::execute(Task task)
+    {
+        if (is_worker())
+        {
+            task();
+            return;
+        }
+
+        std::packaged_task<void()> wrapped(task);
+        std::future<void> result(wrapped.get_future());
+        submit([&wrapped]() { wrapped(); });
+        result.get();
+    }
+
+    void Executor::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_.store(false);
+        }
+        cv_.notify_all();
+
+        for (std::unique_ptr<lj::Thread>& t : threads_)
+        {
+            t->join();
+        }
+        threads_.clear();
+    }
+
+    size_t Executor::workers() const
+    {
+        return workers_.size();
+    }
+
+    bool Executor::next_task(size_t indx, Task& task)
+    {
+        while (true)
+        {
+            if (workers_[indx]->pop(task) || steal_task(indx, task))
+            {
+                --pending_;
+                return true;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!injection_.empty())
+            {
+                task = std::move(injection_.front());
+                injection_.pop_front();
+                --pending_;
+                return true;
+            }
+            if (!running_.load() && 0 == pending_.load())
+            {
+                return false;
+            }
+            cv_.wait(lock, [this]() {
+                return 0 < pending_.load() || !running_.load();
+            });
+        }
+    }
+
+    bool Executor::steal_task(size_t indx, Task& task)
+    {
+        for (size_t h = 1; h < workers_.size(); ++h)
+        {
+            if (workers_[(indx + h) % workers_.size()]->steal(task))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Executor::is_worker() const
+    {
+        return this == t_executor;
+    }
+}; // namespace lj
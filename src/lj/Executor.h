@@ -0,0 +1,126 @@
+#pragma once
+/*!
+ \file lj/Executor.h
+ \brief LJ work-stealing executor header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lj/Thread.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lj
+{
+    /*!
+     \brief Bounded pool of worker threads with work-stealing deques.
+
+     Every worker owns a deque of tasks. Tasks submitted from a worker
+     thread are pushed onto that worker's deque, and the worker pops from
+     the back of its own deque so related work stays on the same core.
+     Tasks submitted from any other thread go through a shared injection
+     queue. Idle workers first check the injection queue, then steal from
+     the front of the other workers' deques.
+
+     The number of workers is fixed for the life of the executor, so the
+     amount of concurrent CPU work is bounded no matter how many threads
+     submit tasks.
+     \since 1.0
+     */
+    class Executor
+    {
+    public:
+        //! Unit of work executed by a worker.
+        typedef std::function<void()> Task;
+
+        //! Create a new executor and start the workers.
+        /*!
+         \param workers The number of worker threads. Zero uses one worker
+         per core.
+         */
+        explicit Executor(size_t workers = 0);
+        Executor(const Executor& o) = delete;
+        Executor(Executor&& o) = delete;
+        Executor& operator=(const Executor& rhs) = delete;
+        Executor& operator=(Executor&& rhs) = delete;
+
+        //! Destructor.
+        /*!
+         Calls shutdown(), waiting for the queued tasks to finish.
+         */
+        ~Executor();
+
+        //! Queue a task for execution.
+        /*!
+         Exceptions thrown by the task are logged and discarded.
+         \param task The task to execute.
+         \throws lj::Exception if the executor has been shut down.
+         */
+        void submit(Task task);
+
+        //! Execute a task and wait for it to finish.
+        /*!
+         When called from one of this executor's workers, the task is run
+         inline instead of queued. Waiting on a queued task from a worker
+         could otherwise exhaust the pool.
+         \param task The task to execute.
+         \throws Any exception thrown by the task.
+         */
+        void execute(Task task);
+
+        //! Stop accepting tasks, finish the queued ones, and join the workers.
+        void shutdown();
+
+        //! Get the number of workers.
+        size_t workers() const;
+    private:
+        class Worker;
+        friend class Worker;
+
+        bool next_task(size_t indx, Task& task);
+        bool steal_task(size_t indx, Task& task);
+        bool is_worker() const;
+
+        std::atomic<bool> running_;
+        std::atomic<size_t> pending_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Task> injection_;
+        std::vector<std::unique_ptr<Worker> > workers_;
+        std::vector<std::unique_ptr<lj::Thread> > threads_;
+    }; // class lj::Executor
+}; // namespace lj
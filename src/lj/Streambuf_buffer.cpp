@@ -0,0 +1,160 @@
+/*!
+ \file lj/Streambuf_buffer.cpp
+ \brief LJ memory buffer stream buffer implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lj/Streambuf_buffer.h"
+#include <cstring>
+
+namespace lj
+{
+    Streambuf_buffer::Streambuf_buffer(size_t reserve) : std::streambuf(),
+            in_(reserve),
+            in_end_(0),
+            out_(),
+            out_begin_(0)
+    {
+        out_.reserve(reserve);
+        reset_get_area(0, 0);
+        setp(NULL, NULL);
+    }
+
+    Streambuf_buffer::~Streambuf_buffer()
+    {
+    }
+
+    char* Streambuf_buffer::prepare_input(size_t sz)
+    {
+        if (in_.size() - in_end_ < sz)
+        {
+            // Growing the vector moves the data, so remember where the
+            // reader was.
+            size_t offset = gptr() - eback();
+            in_.resize(in_end_ + sz);
+            reset_get_area(offset, in_end_);
+        }
+        return in_.data() + in_end_;
+    }
+
+    void Streambuf_buffer::commit_input(size_t sz)
+    {
+        size_t offset = gptr() - eback();
+        in_end_ += sz;
+        reset_get_area(offset, in_end_);
+    }
+
+    void Streambuf_buffer::append_input(const char* data, size_t sz)
+    {
+        memcpy(prepare_input(sz), data, sz);
+        commit_input(sz);
+    }
+
+    const char* Streambuf_buffer::input_data() const
+    {
+        return gptr();
+    }
+
+    size_t Streambuf_buffer::input_size() const
+    {
+        return egptr() - gptr();
+    }
+
+    void Streambuf_buffer::consume_input(size_t sz)
+    {
+        gbump(static_cast<int>(sz));
+    }
+
+    void Streambuf_buffer::compact_input()
+    {
+        size_t remaining = input_size();
+        if (remaining > 0 && gptr() != eback())
+        {
+            memmove(in_.data(), gptr(), remaining);
+        }
+        in_end_ = remaining;
+        reset_get_area(0, in_end_);
+    }
+
+    const char* Streambuf_buffer::output_data() const
+    {
+        return out_.data() + out_begin_;
+    }
+
+    size_t Streambuf_buffer::output_size() const
+    {
+        return out_.size() - out_begin_;
+    }
+
+    void Streambuf_buffer::consume_output(size_t sz)
+    {
+        out_begin_ += sz;
+        if (out_begin_ >= out_.size())
+        {
+            // Everything was written, keep the allocation around.
+            out_.clear();
+            out_begin_ = 0;
+        }
+    }
+
+    int Streambuf_buffer::underflow()
+    {
+        if (gptr() < egptr())
+        {
+            return traits_type::to_int_type(*gptr());
+        }
+        return traits_type::eof();
+    }
+
+    int Streambuf_buffer::overflow(int c)
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            out_.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize Streambuf_buffer::xsputn(const char* s,
+            std::streamsize n)
+    {
+        out_.insert(out_.end(), s, s + n);
+        return n;
+    }
+
+    void Streambuf_buffer::reset_get_area(size_t offset, size_t end)
+    {
+        char* base = in_.data();
+        setg(base, base + offset, base + end);
+    }
+}; // namespace lj
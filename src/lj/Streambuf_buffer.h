@@ -0,0 +1,167 @@
+#pragma once
+/*!
+ \file lj/Streambuf_buffer.h
+ \brief LJ memory buffer stream buffer header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace lj
+{
+    /*!
+     \brief Memory backed streambuf for non-blocking IO.
+
+     Bytes are fed into the input buffer by the owner (usually after a
+     non-blocking read from a socket), and the bytes written to the stream
+     are collected in the output buffer until the owner drains them. The
+     streambuf never blocks. Reading past the buffered input returns
+     end-of-file, so callers are expected to check that enough input is
+     buffered before parsing from the stream.
+     \since 1.0
+     */
+    class Streambuf_buffer : public std::streambuf
+    {
+    public:
+        //! Create a new buffer streambuf.
+        /*!
+         \param reserve Number of bytes to initially reserve in each buffer.
+         */
+        explicit Streambuf_buffer(size_t reserve = 8192);
+        Streambuf_buffer(const Streambuf_buffer& o) = delete;
+        Streambuf_buffer(Streambuf_buffer&& o) = delete;
+        Streambuf_buffer& operator=(const Streambuf_buffer& rhs) = delete;
+        Streambuf_buffer& operator=(Streambuf_buffer&& rhs) = delete;
+
+        //! Destructor.
+        virtual ~Streambuf_buffer();
+
+        /*!
+         \brief Reserve space at the end of the input buffer.
+
+         The returned pointer is valid until the next call to a non-const
+         method. Use \c commit_input() to mark the bytes as readable.
+         \param sz The number of bytes to reserve.
+         \return Pointer to the reserved space.
+         */
+        char* prepare_input(size_t sz);
+
+        /*!
+         \brief Make bytes written to the prepared space readable.
+         \param sz The number of bytes written to the prepared space.
+         */
+        void commit_input(size_t sz);
+
+        /*!
+         \brief Copy bytes into the input buffer.
+         \param data The bytes to copy.
+         \param sz The number of bytes to copy.
+         */
+        void append_input(const char* data, size_t sz);
+
+        /*!
+         \brief Unread input bytes.
+         \return Pointer to the first unread byte.
+         */
+        const char* input_data() const;
+
+        /*!
+         \brief Number of unread input bytes.
+         \return The number of bytes.
+         */
+        size_t input_size() const;
+
+        /*!
+         \brief Mark input bytes as read without copying them out.
+
+         Used by readers that work directly on \c input_data().
+         \param sz The number of bytes read. Must not exceed \c input_size().
+         */
+        void consume_input(size_t sz);
+
+        /*!
+         \brief Discard the consumed input bytes.
+
+         Moves the unread bytes to the front of the input buffer. The
+         allocation is retained for the next read.
+         */
+        void compact_input();
+
+        /*!
+         \brief Bytes waiting to be written.
+         \return Pointer to the first unwritten byte.
+         */
+        const char* output_data() const;
+
+        /*!
+         \brief Number of bytes waiting to be written.
+         \return The number of bytes.
+         */
+        size_t output_size() const;
+
+        /*!
+         \brief Mark output bytes as written.
+         \param sz The number of bytes written.
+         */
+        void consume_output(size_t sz);
+    protected:
+        /*!
+         \brief std::streambuf override.
+         \return character read or EOF.
+         */
+        virtual int underflow() override;
+
+        /*!
+         \brief std::streambuf override.
+         \return character written or EOF.
+         */
+        virtual int overflow(int c = EOF) override;
+
+        /*!
+         \brief std::streambuf override.
+         \return The number of characters written.
+         */
+        virtual std::streamsize xsputn(const char* s,
+                std::streamsize n) override;
+    private:
+        void reset_get_area(size_t offset, size_t end);
+
+        std::vector<char> in_;
+        size_t in_end_;
+        std::vector<char> out_;
+        size_t out_begin_;
+    }; // class lj::Streambuf_buffer
+}; // namespace lj
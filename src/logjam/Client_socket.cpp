@@ -42,6 +42,8 @@
 #include "lj/Exception.h"
 #include "lj/Log.h"
 #include "lj/Streambuf_bsd.h"
+#include <memory>
+#include <sstream>
 
 namespace
 {
@@ -69,6 +71,53 @@ namespace
         logjam::Tls_session<credT>* session_;
         lj::Streambuf_bsd<logjam::Tls_session<credT>>* buffer_;
     };
+
+    class iostream_plain : public std::iostream
+    {
+    public:
+        iostream_plain(logjam::Network_socket&& conn,
+                lj::Streambuf_bsd<lj::medium::Socket>* buf) :
+                std::iostream(buf),
+                connection_(std::move(conn)),
+                buffer_(buf)
+        {
+        }
+        virtual ~iostream_plain()
+        {
+            delete buffer_;
+        }
+    private:
+        logjam::Network_socket connection_;
+        lj::Streambuf_bsd<lj::medium::Socket>* buffer_;
+    };
+
+    logjam::Network_socket connect_to(const std::string& target_host)
+    {
+        logjam::Network_address_info info(target_host,
+                0,
+                AF_UNSPEC,
+                SOCK_STREAM,
+                0);
+
+        logjam::Network_socket connection;
+        while (info.next() && !connection.is_open())
+        {
+            try
+            {
+                connection = logjam::socket_for_target(info.current());
+            }
+            catch (const lj::Exception& ex)
+            {
+                lj::log::format<lj::Critical>("%s").end(ex);
+            }
+        }
+
+        if (!connection.is_open())
+        {
+            throw LJ__Exception("Unable to connect to host.");
+        }
+        return connection;
+    }
 }; // namespace (anonymous)
 
 namespace logjam
@@ -105,29 +154,7 @@ namespace logjam
 
             session->set_cipher_priority("NORMAL:+ANON-ECDH:+ANON-DH");
             
-            logjam::Network_address_info info(target_host,
-                    0,
-                    AF_UNSPEC,
-                    SOCK_STREAM,
-                    0);
-
-            logjam::Network_socket connection;
-            while (info.next() && !connection.is_open())
-            {
-                try
-                {
-                    connection = logjam::socket_for_target(info.current());
-                }
-                catch (lj::Exception ex)
-                {
-                    lj::log::format<lj::Critical>("%s").end(ex);
-                }
-            }
-
-            if (!connection.is_open())
-            {
-                throw LJ__Exception("Unable to connect to host.");
-            }
+            logjam::Network_socket connection(connect_to(target_host));
             
             lj::log::out<lj::Info>("Connection established. Requesting TLS.");
             
@@ -197,5 +224,28 @@ namespace logjam
             
             return sec_io;
         }
+
+        std::iostream* create_plain_connection(const std::string& target_host,
+                const std::string& target_mode,
+                lj::bson::Node& response)
+        {
+            logjam::Network_socket connection(connect_to(target_host));
+            lj::Streambuf_bsd<lj::medium::Socket>* buffer =
+                    new lj::Streambuf_bsd<lj::medium::Socket>(new lj::medium::Socket(connection.socket()), 8192, 8192);
+            std::unique_ptr<iostream_plain> io(new iostream_plain(std::move(connection),
+                    buffer));
+
+            (*io) << target_mode << "\n";
+            io->flush();
+            (*io) >> response;
+            if (!is_success(response))
+            {
+                std::ostringstream oss;
+                oss << "Could not switch to mode " << target_mode << ": "
+                        << message(response);
+                throw LJ__Exception(oss.str());
+            }
+            return io.release();
+        }
     }; // namespace logjam::client
 }; // namespace logjam
@@ -61,6 +61,23 @@ namespace logjam
          */
         std::iostream* create_connection(const std::string& target_host,
                 const std::string& target_mode);
+
+        //! Create a connection object without TLS.
+        /*!
+         Connects the same way as create_connection(), but engages the mode
+         directly instead of negotiating TLS first. Nothing sent over the
+         connection is encrypted, so it must not carry secrets. Used by
+         servers to reach their cluster peers until the server side
+         supports \c +tls.
+         \param target_host The \c "hostname@port" of the system to connect to.
+         \param target_mode The mode to engage once connected (bson, peer, etc.)
+         \param response Set to the server's reply to the mode.
+         \throws lj::Exception if the connection could not be established or
+         the mode was refused.
+         */
+        std::iostream* create_plain_connection(const std::string& target_host,
+                const std::string& target_mode,
+                lj::bson::Node& response);
         
     };
 };
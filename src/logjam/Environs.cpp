@@ -34,15 +34,20 @@
  */
 
 #include "logjam/Environs.h"
+#include "lj/Exception.h"
+
+#include <algorithm>
 
 namespace logjam
 {
     Environs::Environs(lj::bson::Node&& cfg,
             User_repository* ur,
-            Authentication_repository* ar) :
+            Authentication_repository* ar,
+            storage::Storage* st) :
             config_(std::move(cfg)),
             user_repository_(ur),
-            authentication_repository_(ar)
+            authentication_repository_(ar),
+            storage_(st)
     {
     }
 
@@ -61,11 +66,26 @@ namespace logjam
         return *authentication_repository_;
     }
 
+    storage::Storage& Environs::storage()
+    {
+        if (!storage_)
+        {
+            throw LJ__Exception("Storage is not configured.");
+        }
+        return *storage_;
+    }
+
+    bool Environs::has_storage() const
+    {
+        return nullptr != storage_;
+    }
+
     Context::Context(std::shared_ptr<Environs>& environs) :
             data_(),
             node_(),
             user_(User::k_unknown),
-            environs_(environs)
+            environs_(environs),
+            lsn_(0)
     {
     }
 
@@ -114,4 +134,14 @@ namespace logjam
         return *environs_;
     }
 
+    uint64_t Context::lsn() const
+    {
+        return lsn_;
+    }
+
+    void Context::lsn(uint64_t l)
+    {
+        lsn_ = std::max(lsn_, l);
+    }
+
 }; // namespace logjam
@@ -39,6 +39,11 @@
 
 namespace logjam
 {
+    namespace storage
+    {
+        class Storage;
+    }; // namespace logjam::storage
+
     /*!
      \brief Object representing the global pool context.
      \since 1.0
@@ -51,10 +56,14 @@ namespace logjam
          All Pools are required to have some form of configuration
 
          \param config The configuration for the server.
+         \param ur The user repository.
+         \param ar The authentication repository.
+         \param st The document storage, or nullptr if storage is disabled.
          */
         Environs(lj::bson::Node&& cfg,
                 User_repository* ur,
-                Authentication_repository* ar);
+                Authentication_repository* ar,
+                storage::Storage* st = nullptr);
 
         //! Deleted copy constructor.
         Environs(const Environs& orig) = delete;
@@ -80,10 +89,20 @@ namespace logjam
         //! Get the reference to the authentication repository.
         virtual Authentication_repository& authentication_repository();
 
+        /*!
+         \brief Get the reference to the document storage.
+         \throws lj::Exception If storage is not configured.
+         */
+        virtual storage::Storage& storage();
+
+        //! Test if document storage is configured.
+        virtual bool has_storage() const;
+
     private:
         lj::bson::Node config_;
         User_repository* user_repository_;
         Authentication_repository* authentication_repository_;
+        storage::Storage* storage_;
     }; // class lj::Environs
 
     /*!
@@ -171,10 +190,25 @@ namespace logjam
 
         //! Get the parent environs.
         virtual const logjam::Environs& environs() const;
+
+        /*!
+         \brief Get the highest log sequence number written for the context.
+
+         Responses must not be acknowledged until this sequence number
+         is durable.
+         */
+        virtual uint64_t lsn() const;
+
+        /*!
+         \brief Record a log sequence number written for the context.
+         \param l The log sequence number. Lower values are ignored.
+         */
+        virtual void lsn(uint64_t l);
     private:
         std::shared_ptr<Additional_data> data_;
         lj::bson::Node node_;
         logjam::User user_;
         std::shared_ptr<logjam::Environs> environs_;
+        uint64_t lsn_;
     }; // class logjam::Context
 }; // namespace logjam
@@ -88,6 +88,14 @@ namespace logjam
         }
     }
     
+    int Network_socket::release()
+    {
+        int sockfd = fd_;
+        is_open_ = false;
+        fd_ = -1;
+        return sockfd;
+    }
+
     int Network_socket::socket() const
     {
         return fd_;
@@ -127,4 +135,43 @@ namespace logjam
 
         return Network_socket(sockfd);
     }
+
+    Network_socket socket_for_listening(const struct addrinfo& target,
+            int backlog)
+    {
+        // Now create my socket descriptor for listening.
+        int sockfd = ::socket(target.ai_family,
+                target.ai_socktype,
+                target.ai_protocol);
+        if (0 > sockfd)
+        {
+            // Did not get a socket descriptor.
+            throw LJ__Exception(strerror(errno));
+        }
+
+        // The socket object closes the descriptor if binding fails.
+        Network_socket listener(sockfd);
+
+        // Allow restarts while old connections are in TIME_WAIT.
+        int reuse = 1;
+        ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        int rc = ::bind(sockfd,
+                target.ai_addr,
+                target.ai_addrlen);
+        if (0 > rc)
+        {
+            // did not bind the listener to a port.
+            throw LJ__Exception(strerror(errno));
+        }
+
+        rc = ::listen(sockfd, backlog);
+        if (0 > rc)
+        {
+            // did not start listening.
+            throw LJ__Exception(strerror(errno));
+        }
+
+        return listener;
+    }
 }; // namespace logjam
@@ -98,6 +98,12 @@ namespace logjam
          No action is performed if the socket is not open.
          */
         void close();
+        //! Give up ownership of the socket.
+        /*!
+         The socket is left open, and this object no longer closes it.
+         \return the socket descriptor.
+         */
+        int release();
         
         //! Get the socket file descriptor.
         /*!
@@ -128,4 +134,14 @@ namespace logjam
      \throws lj::Exception if the connection could not be established.
      */
     Network_socket socket_for_target(const struct addrinfo& target);
+
+    //! Listen on a local address.
+    /*!
+     \param target The local address to bind.
+     \param backlog The maximum length of the pending connection queue.
+     \return An open socket, ready to accept connections.
+     \throws lj::Exception if the socket could not be bound.
+     */
+    Network_socket socket_for_listening(const struct addrinfo& target,
+            int backlog);
 }; // namespace logjam
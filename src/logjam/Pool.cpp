@@ -34,6 +34,10 @@
  */
 
 #include "logjam/Pool.h"
+#include "logjam/storage/Storage.h"
+#include "lj/Bson_decoder.h"
+#include "lj/Log.h"
+#include <algorithm>
 
 namespace logjam
 {
@@ -42,8 +46,35 @@ namespace logjam
         //// Area
 
         Area::Area(Environs&& env) :
-                environs_(new Environs(std::move(env)))
+                environs_(new Environs(std::move(env))),
+                executor_(),
+                max_frame_size_(lj::bson::Decoder::k_default_max_frame_size)
         {
+            int64_t workers = 0;
+            if (environs_->config().exists("server/workers"))
+            {
+                workers = lj::bson::as_int64(
+                        environs_->config()["server/workers"]);
+            }
+            executor_.reset(new lj::Executor(std::max<int64_t>(0, workers)));
+
+            if (environs_->config().exists("server/max_frame_size"))
+            {
+                // Documents are also read through the stream operators,
+                // which enforce the default limit, so only lower it.
+                max_frame_size_ = std::min<int64_t>(max_frame_size_,
+                        std::max<int64_t>(5, lj::bson::as_int64(
+                                environs_->config()["server/max_frame_size"])));
+            }
+        }
+
+        void Area::prepare()
+        {
+            if (environs_->has_storage())
+            {
+                lj::log::out<lj::Info>("Replaying the write-ahead log.");
+                environs_->storage().recover();
+            }
         }
 
         logjam::Environs& Area::environs() 
@@ -61,6 +92,16 @@ namespace logjam
             return logjam::Context(environs_);
         }
 
+        lj::Executor& Area::executor()
+        {
+            return *executor_;
+        }
+
+        size_t Area::max_frame_size() const
+        {
+            return max_frame_size_;
+        }
+
         //// Lifeguard
 
         Lifeguard::Lifeguard(Area& a) :
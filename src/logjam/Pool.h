@@ -35,6 +35,7 @@
  */
 
 #include "logjam/Environs.h"
+#include "lj/Executor.h"
 #include "lj/Thread.h"
 
 namespace logjam
@@ -45,6 +46,18 @@ namespace logjam
         class Swimmer;
 
         //! Area of the pool.
+        /*!
+         Each area owns a bounded executor for running stage logic. The
+         number of workers is read from \c server/workers, and defaults to
+         one worker per core.
+
+         The largest request a connection will buffer is read from
+         \c server/max_frame_size, in bytes. It can only lower the default
+         of lj::bson::Decoder::k_default_max_frame_size.
+
+         Derived areas must call Area::prepare() before they start
+         accepting connections, so logged documents are recovered first.
+         */
         class Area
         {
         public:
@@ -55,7 +68,7 @@ namespace logjam
             Area& operator=(Area&& rhs) = default;
             virtual ~Area() = default;
 
-            virtual void prepare() = 0;
+            virtual void prepare();
             virtual void open() = 0;
             virtual void close() = 0;
             virtual void cleanup() = 0;
@@ -63,8 +76,12 @@ namespace logjam
             virtual logjam::Environs& environs();
             virtual const logjam::Environs& environs() const;
             virtual logjam::Context spawn_context();
+            virtual lj::Executor& executor();
+            virtual size_t max_frame_size() const;
         private:
             std::shared_ptr<logjam::Environs> environs_;
+            std::shared_ptr<lj::Executor> executor_;
+            size_t max_frame_size_;
         }; // class logjam::pool::Area
 
         //! Lifeguard assigned to areas of the pool.
@@ -34,6 +34,7 @@
  */
 
 #include "logjam/Stage.h"
+#include <cstring>
 
 namespace logjam
 {
@@ -44,6 +45,19 @@ namespace logjam
         return lj::log::format<lj::Debug>(real_fmt) << name();
     }
 
+    bool Stage::ready(const char* data,
+            size_t sz,
+            lj::bson::Decoder& decoder) const
+    {
+        return 0 < decoder.scan(reinterpret_cast<const uint8_t*>(data), sz);
+    }
+
+    bool Stage::ready(const char* data, size_t sz) const
+    {
+        lj::bson::Decoder decoder;
+        return ready(data, sz, decoder);
+    }
+
     std::unique_ptr<Stage> safe_execute_stage(std::unique_ptr<Stage>& stg,
             pool::Swimmer& swmr)
     {
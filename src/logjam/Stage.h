@@ -36,6 +36,7 @@
 
 #include "logjam/Pool.h"
 #include "lj/Bson.h"
+#include "lj/Bson_decoder.h"
 #include "lj/Log.h"
 #include <memory>
 #include <string>
@@ -67,6 +68,34 @@ namespace logjam
         virtual std::unique_ptr<Stage> logic(pool::Swimmer& swmr) const = 0;
         virtual std::string name() const = 0;
         virtual std::unique_ptr<Stage> clone() const = 0;
+
+        //! Check if enough input is buffered for logic() to complete.
+        /*!
+         Event driven pools read from the network without blocking, and only
+         call logic() once the stage reports that it can finish without
+         waiting on more bytes. The default implementation expects one
+         complete BSON document, checked incrementally by the connection's
+         decoder.
+         \param data The buffered, unread input.
+         \param sz The number of buffered bytes.
+         \param decoder The connection's frame decoder. Reset by the pool
+         after every call to logic().
+         \return True if logic() can run, false if more input is needed.
+         \throws lj::Exception if the buffered input can never be valid,
+         for example an oversized frame.
+         */
+        virtual bool ready(const char* data,
+                size_t sz,
+                lj::bson::Decoder& decoder) const;
+
+        //! Check if enough input is buffered for logic() to complete.
+        /*!
+         Uses a fresh decoder with the default maximum frame size.
+         \param data The buffered, unread input.
+         \param sz The number of buffered bytes.
+         \return True if logic() can run, false if more input is needed.
+         */
+        bool ready(const char* data, size_t sz) const;
     protected:
         virtual lj::log::Logger& log(const std::string& fmt) const;
     }; // class logjam::Stage
@@ -0,0 +1,109 @@
+/*!
+ \file logjam/storage/Bloom.cpp
+ \brief Logjam bloom filter implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Bloom.h"
+
+#include <algorithm>
+
+namespace
+{
+    // ln(2) * bits per key, rounded down.
+    const uint32_t k_default_probes = 6;
+
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        const size_t Bloom::k_bits_per_key;
+
+        Bloom::Bloom(size_t keys) :
+                bits_((std::max<size_t>(keys, 1) * k_bits_per_key + 7) / 8, 0),
+                probes_(k_default_probes)
+        {
+        }
+
+        Bloom::Bloom(const uint8_t* bits,
+                size_t sz,
+                uint32_t probes) :
+                bits_(bits, bits + sz),
+                probes_(probes)
+        {
+        }
+
+        void Bloom::add(uint64_t key)
+        {
+            // Double hashing: probe h1 + i * h2 for each i.
+            const uint64_t count = bits_.size() * 8;
+            uint64_t h = mix(key);
+            const uint64_t delta = (h >> 33) | 1;
+            for (uint32_t h2 = 0; h2 < probes_; ++h2)
+            {
+                uint64_t bit = h % count;
+                bits_[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+                h += delta;
+            }
+        }
+
+        bool Bloom::may_contain(uint64_t key) const
+        {
+            if (bits_.empty())
+            {
+                return true;
+            }
+            const uint64_t count = bits_.size() * 8;
+            uint64_t h = mix(key);
+            const uint64_t delta = (h >> 33) | 1;
+            for (uint32_t h2 = 0; h2 < probes_; ++h2)
+            {
+                uint64_t bit = h % count;
+                if (0 == (bits_[bit / 8] & (1 << (bit % 8))))
+                {
+                    return false;
+                }
+                h += delta;
+            }
+            return true;
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
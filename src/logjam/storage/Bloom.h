@@ -0,0 +1,116 @@
+#pragma once
+/*!
+ \file logjam/storage/Bloom.h
+ \brief Logjam bloom filter definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdint>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Bloom filter over document keys.
+
+         Sized for an expected number of keys at a fixed number of bits
+         per key, which gives roughly a 1% false positive rate. The bit
+         array can be written out with the data it describes and loaded
+         again without rebuilding.
+         \since 1.0
+         */
+        class Bloom
+        {
+        public:
+            //! Bits allocated per expected key.
+            static const size_t k_bits_per_key = 10;
+
+            /*!
+             \brief Create an empty filter.
+             \param keys The expected number of keys.
+             */
+            explicit Bloom(size_t keys);
+
+            /*!
+             \brief Load a filter written by #data().
+             \param bits The bit array.
+             \param sz The number of bytes in \c bits.
+             \param probes The number of probes used to build it.
+             */
+            Bloom(const uint8_t* bits,
+                    size_t sz,
+                    uint32_t probes);
+
+            //! Default copy constructor.
+            Bloom(const Bloom& orig) = default;
+
+            //! Default move constructor.
+            Bloom(Bloom&& orig) = default;
+
+            //! Default copy assignment operator.
+            Bloom& operator=(const Bloom& orig) = default;
+
+            //! Default move assignment operator.
+            Bloom& operator=(Bloom&& orig) = default;
+
+            //! Destructor.
+            ~Bloom() = default;
+
+            //! Add a key.
+            void add(uint64_t key);
+
+            /*!
+             \brief Test if a key may have been added.
+             \return False only if the key was never added.
+             */
+            bool may_contain(uint64_t key) const;
+
+            //! Get the bit array.
+            inline const std::vector<uint8_t>& data() const
+            {
+                return bits_;
+            }
+
+            //! Get the number of probes per key.
+            inline uint32_t probes() const
+            {
+                return probes_;
+            }
+
+        private:
+            std::vector<uint8_t> bits_;
+            uint32_t probes_;
+        }; // class logjam::storage::Bloom
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,603 @@
+/*!
+ \file logjam/storage/Btree.cpp
+ \brief Logjam paged B+tree implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Btree.h"
+#include "lj/Exception.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const uint64_t k_magic = 0x3165657274426a6cULL; // "ljBtree1"
+    const uint32_t k_version = 1;
+    const uint32_t k_leaf = 1;
+    const uint32_t k_inner = 2;
+    const size_t k_header_size = 64;
+    const size_t k_initial_pages = 16;
+
+    // Inner nodes are never more than a handful of levels deep; the
+    // smallest possible fan-out still addresses 2^32 pages in 6 levels.
+    const uint32_t k_max_depth = 32;
+
+    bool key_less(const logjam::storage::Btree::Key& a,
+            const logjam::storage::Btree::Key& b)
+    {
+        return logjam::storage::compare(a, b) < 0;
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        namespace
+        {
+            const size_t k_leaf_capacity =
+                    (Btree::k_page_size - k_header_size) / sizeof(Btree::Key);
+            const size_t k_inner_capacity =
+                    (Btree::k_page_size - k_header_size - sizeof(uint32_t)) /
+                    (sizeof(Btree::Key) + sizeof(uint32_t));
+            const size_t k_tag_capacity = Btree::k_page_size - 48;
+        }; // namespace logjam::storage::(anonymous)
+
+        struct Btree::Meta
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t page_size;
+            uint32_t root;
+            uint32_t pages;
+            uint64_t size;
+            uint32_t clean;
+            uint32_t tag_size;
+            uint8_t reserved[8];
+            char tag[k_tag_capacity];
+        };
+
+        // Entries start on a cache line boundary, and a page is exactly
+        // one file page so it can be mapped straight from disk.
+        struct alignas(64) Btree::Page
+        {
+            struct Inner
+            {
+                Key keys[k_inner_capacity];
+                uint32_t children[k_inner_capacity + 1];
+            };
+
+            uint32_t kind;
+            uint32_t count;
+            uint32_t next;
+            uint8_t reserved[k_header_size - 3 * sizeof(uint32_t)];
+            union
+            {
+                Key leaf[k_leaf_capacity];
+                Inner inner;
+            };
+        };
+
+        const size_t Btree::k_page_size;
+        const size_t Btree::k_key_size;
+
+        int compare(const Btree::Key& a,
+                const Btree::Key& b)
+        {
+            int cmp = memcmp(a.bytes, b.bytes, Btree::k_key_size);
+            if (0 != cmp)
+            {
+                return cmp;
+            }
+            return (a.record < b.record) ? -1 : ((a.record > b.record) ? 1 : 0);
+        }
+
+        Btree::Btree(const std::string& path,
+                const std::string& tag,
+                Buffer_pool* pool) :
+                path_(path),
+                tag_(tag),
+                fd_(-1),
+                map_(nullptr),
+                pages_(0),
+                valid_(false),
+                pool_(pool),
+                file_(0)
+        {
+            static_assert(sizeof(Key) == 32, "Tree entries must be 32 bytes.");
+            static_assert(sizeof(Meta) == k_page_size, "Tree meta must fill a page.");
+            static_assert(sizeof(Page) == k_page_size, "Tree nodes must fill a page.");
+
+            if (tag_.size() > k_tag_capacity)
+            {
+                throw LJ__Exception(std::string("Tree tag is too long for ") +
+                        path_);
+            }
+
+            fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0)
+            {
+                throw LJ__Exception(std::string("Unable to open tree ") +
+                        path_ + ": " + strerror(errno));
+            }
+
+            struct stat st;
+            if (fstat(fd_, &st) < 0)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw LJ__Exception(std::string("Unable to stat tree ") +
+                        path_ + ": " + strerror(err));
+            }
+
+            size_t existing = st.st_size / k_page_size;
+            try
+            {
+                map(std::max(existing, k_initial_pages));
+            }
+            catch (...)
+            {
+                ::close(fd_);
+                throw;
+            }
+
+            // Anything that was not closed cleanly by the same tag is
+            // discarded; the owner rebuilds it from the source records.
+            const Meta* m = meta();
+            valid_ = existing >= 2 &&
+                    k_magic == m->magic &&
+                    k_version == m->version &&
+                    k_page_size == m->page_size &&
+                    1 == m->clean &&
+                    m->pages <= existing &&
+                    tag_.size() == m->tag_size &&
+                    0 == memcmp(tag_.data(), m->tag, tag_.size());
+            if (!valid_)
+            {
+                reset();
+            }
+
+            if (pool_)
+            {
+                file_ = pool_->attach(map_, pages_ * k_page_size, fd_);
+            }
+        }
+
+        Btree::~Btree()
+        {
+            if (pool_)
+            {
+                pool_->detach(file_);
+            }
+            if (map_)
+            {
+                try
+                {
+                    sync();
+                }
+                catch (lj::Exception&)
+                {
+                    // The tree stays marked dirty and is rebuilt on open.
+                }
+                munmap(map_, pages_ * k_page_size);
+            }
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+            }
+        }
+
+        uint64_t Btree::size() const
+        {
+            return meta()->size;
+        }
+
+        bool Btree::insert(const Key& key)
+        {
+            uint32_t parents[k_max_depth];
+            uint32_t depth;
+            Buffer_pool::Pin held;
+            uint32_t number = find_leaf(key, parents, &depth, held);
+            Page* leaf = page(number);
+            Key* pos = std::lower_bound(leaf->leaf,
+                    leaf->leaf + leaf->count,
+                    key,
+                    key_less);
+            size_t indx = pos - leaf->leaf;
+            if (indx < leaf->count && 0 == compare(*pos, key))
+            {
+                return false;
+            }
+
+            dirty();
+            if (leaf->count < k_leaf_capacity)
+            {
+                memmove(pos + 1, pos, (leaf->count - indx) * sizeof(Key));
+                *pos = key;
+                ++leaf->count;
+            }
+            else
+            {
+                // Allocating may remap the file, so the page pointers are
+                // fetched again afterwards.
+                uint32_t right_number = allocate(k_leaf);
+                leaf = page(number);
+                Page* right = page(right_number);
+
+                const size_t half = k_leaf_capacity / 2;
+                memcpy(right->leaf,
+                        leaf->leaf + half,
+                        (k_leaf_capacity - half) * sizeof(Key));
+                right->count = k_leaf_capacity - half;
+                leaf->count = half;
+                right->next = leaf->next;
+                leaf->next = right_number;
+
+                Page* target = leaf;
+                if (indx > half)
+                {
+                    target = right;
+                    indx -= half;
+                }
+                memmove(target->leaf + indx + 1,
+                        target->leaf + indx,
+                        (target->count - indx) * sizeof(Key));
+                target->leaf[indx] = key;
+                ++target->count;
+
+                Key separator = right->leaf[0];
+                insert_parent(parents, depth, separator, right_number);
+            }
+            ++meta()->size;
+            return true;
+        }
+
+        bool Btree::erase(const Key& key)
+        {
+            uint32_t parents[k_max_depth];
+            uint32_t depth;
+            Buffer_pool::Pin held;
+            Page* leaf = page(find_leaf(key, parents, &depth, held));
+            Key* pos = std::lower_bound(leaf->leaf,
+                    leaf->leaf + leaf->count,
+                    key,
+                    key_less);
+            size_t indx = pos - leaf->leaf;
+            if (indx >= leaf->count || 0 != compare(*pos, key))
+            {
+                return false;
+            }
+
+            // Leaves are allowed to run empty. The separators above
+            // still bound the leaf, so searches remain correct.
+            dirty();
+            memmove(pos, pos + 1, (leaf->count - indx - 1) * sizeof(Key));
+            --leaf->count;
+            --meta()->size;
+            return true;
+        }
+
+        size_t Btree::scan(const Key& first,
+                const Key& last,
+                const Scan_function& fn) const
+        {
+            if (0 < compare(first, last))
+            {
+                return 0;
+            }
+
+            uint32_t parents[k_max_depth];
+            uint32_t depth;
+            Buffer_pool::Pin held;
+            uint32_t number = find_leaf(first, parents, &depth, held);
+            const Page* leaf = page(number);
+            size_t indx = std::lower_bound(leaf->leaf,
+                    leaf->leaf + leaf->count,
+                    first,
+                    key_less) - leaf->leaf;
+
+            size_t visited = 0;
+            while (true)
+            {
+                for (; indx < leaf->count; ++indx)
+                {
+                    if (0 < compare(leaf->leaf[indx], last))
+                    {
+                        return visited;
+                    }
+                    ++visited;
+                    if (!fn(leaf->leaf[indx]))
+                    {
+                        return visited;
+                    }
+                }
+                if (0 == leaf->next)
+                {
+                    return visited;
+                }
+                number = leaf->next;
+                held = pin(number);
+                leaf = page(number);
+                indx = 0;
+            }
+        }
+
+        void Btree::clear()
+        {
+            dirty();
+            reset();
+        }
+
+        void Btree::sync()
+        {
+            if (msync(map_, pages_ * k_page_size, MS_SYNC) < 0)
+            {
+                throw LJ__Exception(std::string("Unable to sync tree ") +
+                        path_ + ": " + strerror(errno));
+            }
+
+            // The clean mark is only written once every page is on disk.
+            if (!meta()->clean)
+            {
+                meta()->clean = 1;
+                if (msync(map_, k_page_size, MS_SYNC) < 0)
+                {
+                    throw LJ__Exception(std::string("Unable to sync tree ") +
+                            path_ + ": " + strerror(errno));
+                }
+            }
+        }
+
+        Btree::Meta* Btree::meta() const
+        {
+            return reinterpret_cast<Meta*>(map_);
+        }
+
+        Btree::Page* Btree::page(uint32_t number) const
+        {
+            return reinterpret_cast<Page*>(map_ + number * k_page_size);
+        }
+
+        Buffer_pool::Pin Btree::pin(uint32_t number) const
+        {
+            return pool_ ?
+                    pool_->pin(file_, number * k_page_size, k_page_size) :
+                    Buffer_pool::Pin();
+        }
+
+        uint32_t Btree::allocate(uint32_t kind)
+        {
+            if (meta()->pages == pages_)
+            {
+                map(pages_ * 2);
+            }
+            uint32_t number = meta()->pages++;
+            Page* p = page(number);
+            memset(p, 0, k_page_size);
+            p->kind = kind;
+            return number;
+        }
+
+        void Btree::map(size_t pages)
+        {
+            if (ftruncate(fd_, pages * k_page_size) < 0)
+            {
+                throw LJ__Exception(std::string("Unable to size tree ") +
+                        path_ + ": " + strerror(errno));
+            }
+
+            // The pool must forget the old mapping before it goes away, or
+            // an eviction could advise whatever is mapped there next.
+            bool remap = nullptr != map_;
+            if (remap)
+            {
+                if (pool_)
+                {
+                    pool_->reattach(file_, nullptr, 0);
+                }
+                munmap(map_, pages_ * k_page_size);
+                map_ = nullptr;
+            }
+
+            void* ptr = mmap(nullptr,
+                    pages * k_page_size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    fd_,
+                    0);
+            if (MAP_FAILED == ptr)
+            {
+                if (pool_ && remap)
+                {
+                    pool_->detach(file_);
+                    pool_ = nullptr;
+                }
+                throw LJ__Exception(std::string("Unable to map tree ") +
+                        path_ + ": " + strerror(errno));
+            }
+            map_ = static_cast<uint8_t*>(ptr);
+            pages_ = pages;
+            if (pool_ && remap)
+            {
+                pool_->reattach(file_, map_, pages_ * k_page_size);
+            }
+        }
+
+        void Btree::reset()
+        {
+            Meta* m = meta();
+            memset(m, 0, k_page_size);
+            m->magic = k_magic;
+            m->version = k_version;
+            m->page_size = k_page_size;
+            m->root = 1;
+            m->pages = 2;
+            m->size = 0;
+            m->clean = 0;
+            m->tag_size = tag_.size();
+            memcpy(m->tag, tag_.data(), tag_.size());
+
+            Page* root = page(1);
+            memset(root, 0, k_page_size);
+            root->kind = k_leaf;
+        }
+
+        void Btree::dirty()
+        {
+            // The dirty mark must reach the disk before any modified page
+            // does, otherwise a crash could leave a clean-looking tree
+            // with half of an update in it.
+            if (meta()->clean)
+            {
+                meta()->clean = 0;
+                if (msync(map_, k_page_size, MS_SYNC) < 0)
+                {
+                    throw LJ__Exception(std::string("Unable to sync tree ") +
+                            path_ + ": " + strerror(errno));
+                }
+            }
+        }
+
+        uint32_t Btree::find_leaf(const Key& key,
+                uint32_t* parents,
+                uint32_t* depth,
+                Buffer_pool::Pin& held) const
+        {
+            *depth = 0;
+            uint32_t number = meta()->root;
+            held = pin(number);
+            const Page* p = page(number);
+            while (k_inner == p->kind)
+            {
+                if (k_max_depth == *depth)
+                {
+                    throw LJ__Exception(std::string("Tree is too deep: ") +
+                            path_);
+                }
+                parents[(*depth)++] = number;
+
+                // Separators are the first key of their right child, so
+                // equal keys go right.
+                size_t indx = std::upper_bound(p->inner.keys,
+                        p->inner.keys + p->count,
+                        key,
+                        key_less) - p->inner.keys;
+                number = p->inner.children[indx];
+                held = pin(number);
+                p = page(number);
+            }
+            return number;
+        }
+
+        void Btree::insert_parent(uint32_t* parents,
+                uint32_t depth,
+                const Key& separator,
+                uint32_t right)
+        {
+            Key promote = separator;
+            while (0 < depth)
+            {
+                uint32_t number = parents[--depth];
+                Page* p = page(number);
+                size_t indx = std::upper_bound(p->inner.keys,
+                        p->inner.keys + p->count,
+                        promote,
+                        key_less) - p->inner.keys;
+
+                if (p->count < k_inner_capacity)
+                {
+                    memmove(p->inner.keys + indx + 1,
+                            p->inner.keys + indx,
+                            (p->count - indx) * sizeof(Key));
+                    memmove(p->inner.children + indx + 2,
+                            p->inner.children + indx + 1,
+                            (p->count - indx) * sizeof(uint32_t));
+                    p->inner.keys[indx] = promote;
+                    p->inner.children[indx + 1] = right;
+                    ++p->count;
+                    return;
+                }
+
+                // Split a full inner node around its middle key, which
+                // moves up to the next level.
+                Key keys[k_inner_capacity + 1];
+                uint32_t children[k_inner_capacity + 2];
+                memcpy(keys, p->inner.keys, indx * sizeof(Key));
+                keys[indx] = promote;
+                memcpy(keys + indx + 1,
+                        p->inner.keys + indx,
+                        (k_inner_capacity - indx) * sizeof(Key));
+                memcpy(children, p->inner.children, (indx + 1) * sizeof(uint32_t));
+                children[indx + 1] = right;
+                memcpy(children + indx + 2,
+                        p->inner.children + indx + 1,
+                        (k_inner_capacity - indx) * sizeof(uint32_t));
+
+                uint32_t sibling_number = allocate(k_inner);
+                p = page(number);
+                Page* sibling = page(sibling_number);
+
+                const size_t total = k_inner_capacity + 1;
+                const size_t mid = total / 2;
+                memcpy(p->inner.keys, keys, mid * sizeof(Key));
+                memcpy(p->inner.children, children, (mid + 1) * sizeof(uint32_t));
+                p->count = mid;
+                memcpy(sibling->inner.keys,
+                        keys + mid + 1,
+                        (total - mid - 1) * sizeof(Key));
+                memcpy(sibling->inner.children,
+                        children + mid + 1,
+                        (total - mid) * sizeof(uint32_t));
+                sibling->count = total - mid - 1;
+
+                promote = keys[mid];
+                right = sibling_number;
+            }
+
+            // The root itself was split.
+            uint32_t old_root = meta()->root;
+            uint32_t root_number = allocate(k_inner);
+            Page* root = page(root_number);
+            root->count = 1;
+            root->inner.keys[0] = promote;
+            root->inner.children[0] = old_root;
+            root->inner.children[1] = right;
+            meta()->root = root_number;
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
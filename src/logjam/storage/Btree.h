@@ -0,0 +1,215 @@
+#pragma once
+/*!
+ \file logjam/storage/Btree.h
+ \brief Logjam paged B+tree definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Buffer_pool.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Persistent B+tree of fixed-size keys.
+
+         The tree lives in a single file of 4KB pages that is mapped into
+         memory. Page 0 holds the tree metadata; every other page is a
+         leaf or an inner node. Pages are aligned to the cache line and
+         hold fixed-size entries, so searches are binary searches over
+         contiguous memory and range scans walk the linked leaves.
+
+         Erased entries are removed from their leaf, but pages are never
+         merged or released. A tree that was not closed cleanly, or that
+         was created for a different tag, is emptied when it is opened and
+         must be rebuilt by the owner; see #valid().
+
+         Reads pin the pages they visit in the buffer pool, if the tree
+         was opened with one.
+
+         The tree is not synchronized. Callers must serialize access.
+         \since 1.0
+         */
+        class Btree
+        {
+        public:
+            //! Size of a tree page in bytes.
+            static const size_t k_page_size = 4096;
+
+            //! Number of key bytes stored in each entry.
+            static const size_t k_key_size = 24;
+
+            /*!
+             \brief Tree entry.
+
+             Entries are ordered by the key bytes, compared with memcmp,
+             and then by the record identifier. The same key bytes can be
+             stored for many records.
+             */
+            struct Key
+            {
+                uint8_t bytes[k_key_size]; //!< Order-preserving key bytes.
+                uint64_t record; //!< Identifier of the indexed record.
+            };
+
+            /*!
+             \brief Function called for each entry in a range.
+             \return False to stop the scan.
+             */
+            typedef std::function<bool(const Key&)> Scan_function;
+
+            /*!
+             \brief Open or create a tree.
+             \param path The path of the tree file.
+             \param tag Description of the tree contents. The tree is
+             emptied if it was written with a different tag.
+             \param pool The page cache, or nullptr to leave the mapping
+             to the kernel.
+             \throws lj::Exception If the file cannot be opened or mapped.
+             */
+            Btree(const std::string& path,
+                    const std::string& tag,
+                    Buffer_pool* pool = nullptr);
+
+            //! Deleted copy constructor.
+            Btree(const Btree& orig) = delete;
+
+            //! Deleted move constructor.
+            Btree(Btree&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Btree& operator=(const Btree& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Btree& operator=(Btree&& orig) = delete;
+
+            //! Destructor. Syncs the tree and marks it clean.
+            ~Btree();
+
+            //! Get the path of the tree file.
+            inline const std::string& path() const
+            {
+                return path_;
+            }
+
+            /*!
+             \brief Test if the existing contents were kept when opened.
+
+             False means the file was new, was not closed cleanly, or was
+             written with a different tag, and the tree is empty.
+             */
+            inline bool valid() const
+            {
+                return valid_;
+            }
+
+            //! Get the number of entries in the tree.
+            uint64_t size() const;
+
+            /*!
+             \brief Insert an entry.
+             \param key The entry to insert.
+             \return False if the entry already exists.
+             \throws lj::Exception If the file cannot be grown.
+             */
+            bool insert(const Key& key);
+
+            /*!
+             \brief Erase an entry.
+             \param key The entry to erase.
+             \return False if the entry was not found.
+             */
+            bool erase(const Key& key);
+
+            /*!
+             \brief Visit the entries between two keys in order.
+             \param first The smallest entry to visit.
+             \param last The largest entry to visit.
+             \param fn Function called for each entry.
+             \return The number of entries visited.
+             */
+            size_t scan(const Key& first,
+                    const Key& last,
+                    const Scan_function& fn) const;
+
+            //! Remove every entry.
+            void clear();
+
+            /*!
+             \brief Flush the tree to disk and mark it clean.
+             \throws lj::Exception If the file cannot be synced.
+             */
+            void sync();
+
+        private:
+            struct Meta;
+            struct Page;
+
+            Meta* meta() const;
+            Page* page(uint32_t number) const;
+            Buffer_pool::Pin pin(uint32_t number) const;
+            uint32_t allocate(uint32_t kind);
+            void map(size_t pages);
+            void reset();
+            void dirty();
+            uint32_t find_leaf(const Key& key,
+                    uint32_t* parents,
+                    uint32_t* depth,
+                    Buffer_pool::Pin& held) const;
+            void insert_parent(uint32_t* parents,
+                    uint32_t depth,
+                    const Key& separator,
+                    uint32_t right);
+
+            std::string path_;
+            std::string tag_;
+            int fd_;
+            uint8_t* map_;
+            size_t pages_;
+            bool valid_;
+            Buffer_pool* pool_;
+            uint32_t file_;
+        }; // class logjam::storage::Btree
+
+        /*!
+         \brief Compare two tree entries.
+         \return Negative, zero or positive like memcmp.
+         */
+        int compare(const Btree::Key& a,
+                const Btree::Key& b);
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,338 @@
+/*!
+ \file logjam/storage/Buffer_pool.cpp
+ \brief Logjam storage page cache implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Buffer_pool.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace
+{
+    const int k_file_shift = 40;
+    const uint64_t k_index_mask = (1ULL << k_file_shift) - 1;
+
+    inline uint64_t page_key(uint32_t file,
+            size_t indx)
+    {
+        return (static_cast<uint64_t>(file) << k_file_shift) | indx;
+    }
+
+    inline uint32_t page_file(uint64_t page)
+    {
+        return static_cast<uint32_t>(page >> k_file_shift);
+    }
+
+    inline size_t page_index(uint64_t page)
+    {
+        return static_cast<size_t>(page & k_index_mask);
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        const size_t Buffer_pool::k_page_size;
+        const size_t Buffer_pool::k_default_size = 128 * 1024 * 1024;
+
+        Buffer_pool::Pin::Pin() :
+                pool_(nullptr),
+                file_(0),
+                first_(0),
+                last_(0)
+        {
+        }
+
+        Buffer_pool::Pin::Pin(Buffer_pool* pool,
+                uint32_t file,
+                size_t first,
+                size_t last) :
+                pool_(pool),
+                file_(file),
+                first_(first),
+                last_(last)
+        {
+        }
+
+        Buffer_pool::Pin::Pin(Pin&& orig) :
+                pool_(orig.pool_),
+                file_(orig.file_),
+                first_(orig.first_),
+                last_(orig.last_)
+        {
+            orig.pool_ = nullptr;
+        }
+
+        Buffer_pool::Pin& Buffer_pool::Pin::operator=(Pin&& orig)
+        {
+            if (this != &orig)
+            {
+                release();
+                pool_ = orig.pool_;
+                file_ = orig.file_;
+                first_ = orig.first_;
+                last_ = orig.last_;
+                orig.pool_ = nullptr;
+            }
+            return *this;
+        }
+
+        Buffer_pool::Pin::~Pin()
+        {
+            release();
+        }
+
+        void Buffer_pool::Pin::release()
+        {
+            if (pool_)
+            {
+                pool_->unpin(file_, first_, last_);
+                pool_ = nullptr;
+            }
+        }
+
+        Buffer_pool::Buffer_pool(size_t budget) :
+                capacity_(std::max<size_t>(1, budget / k_page_size)),
+                frames_(),
+                free_(),
+                table_(),
+                files_(),
+                hand_(0),
+                pin_hits_(0),
+                pin_misses_(0),
+                evictions_(0),
+                overflows_(0),
+                mutex_()
+        {
+            frames_.reserve(capacity_);
+            table_.reserve(capacity_);
+        }
+
+        uint32_t Buffer_pool::attach(uint8_t* base,
+                size_t length,
+                int fd)
+        {
+            // Identifiers are never reused, so a pin that outlives its
+            // file cannot unpin pages of another file.
+            std::lock_guard<std::mutex> lock(mutex_);
+            files_.push_back(File{base, length, fd, true});
+            return static_cast<uint32_t>(files_.size() - 1);
+        }
+
+        void Buffer_pool::reattach(uint32_t file,
+                uint8_t* base,
+                size_t length)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            forget(file);
+            files_[file].base = base;
+            files_[file].length = length;
+        }
+
+        void Buffer_pool::detach(uint32_t file)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            forget(file);
+            files_[file].attached = false;
+        }
+
+        Buffer_pool::Pin Buffer_pool::pin(uint32_t file,
+                size_t offset,
+                size_t sz)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (0 == sz ||
+                    files_.size() <= file ||
+                    !files_[file].attached ||
+                    files_[file].length <= offset)
+            {
+                return Pin();
+            }
+
+            size_t end = std::min(offset + sz, files_[file].length);
+            size_t first = offset / k_page_size;
+            size_t last = (end - 1) / k_page_size;
+            for (size_t indx = first; indx <= last; ++indx)
+            {
+                uint64_t page = page_key(file, indx);
+                size_t slot;
+                auto iter = table_.find(page);
+                if (table_.end() == iter)
+                {
+                    ++pin_misses_;
+                    slot = load(page);
+                }
+                else
+                {
+                    ++pin_hits_;
+                    slot = iter->second;
+                }
+                Frame& frame = frames_[slot];
+                frame.referenced = true;
+                ++frame.pins;
+            }
+            return Pin(this, file, first, last);
+        }
+
+        Buffer_pool::Stats Buffer_pool::stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return Stats{pin_hits_,
+                    pin_misses_,
+                    evictions_,
+                    overflows_,
+                    table_.size(),
+                    capacity_};
+        }
+
+        void Buffer_pool::unpin(uint32_t file,
+                size_t first,
+                size_t last)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t indx = first; indx <= last; ++indx)
+            {
+                // Pages of a remapped or detached file are already gone.
+                auto iter = table_.find(page_key(file, indx));
+                if (table_.end() != iter && 0 < frames_[iter->second].pins)
+                {
+                    --frames_[iter->second].pins;
+                }
+            }
+        }
+
+        size_t Buffer_pool::load(uint64_t page)
+        {
+            while (table_.size() >= capacity_ && evict())
+            {
+            }
+            if (table_.size() >= capacity_)
+            {
+                ++overflows_;
+            }
+
+            size_t slot;
+            if (free_.empty())
+            {
+                slot = frames_.size();
+                frames_.push_back(Frame());
+            }
+            else
+            {
+                slot = free_.back();
+                free_.pop_back();
+            }
+            frames_[slot] = Frame{page, 0, true, true};
+            table_.emplace(page, slot);
+
+            // Start reading the page ahead of the access.
+            const File& f = files_[page_file(page)];
+            size_t offset = page_index(page) * k_page_size;
+            madvise(f.base + offset,
+                    std::min(k_page_size, f.length - offset),
+                    MADV_WILLNEED);
+            return slot;
+        }
+
+        bool Buffer_pool::evict()
+        {
+            const size_t count = frames_.size();
+            for (size_t step = 0; step < 2 * count; ++step)
+            {
+                if (hand_ >= count)
+                {
+                    hand_ = 0;
+                }
+                size_t slot = hand_++;
+                Frame& frame = frames_[slot];
+                if (!frame.used || 0 < frame.pins)
+                {
+                    continue;
+                }
+                if (frame.referenced)
+                {
+                    // Second chance.
+                    frame.referenced = false;
+                    continue;
+                }
+
+                drop(frame.page);
+                table_.erase(frame.page);
+                frame.used = false;
+                free_.push_back(slot);
+                ++evictions_;
+                return true;
+            }
+            return false;
+        }
+
+        void Buffer_pool::drop(uint64_t page)
+        {
+            const File& f = files_[page_file(page)];
+            size_t offset = page_index(page) * k_page_size;
+            if (!f.attached || offset >= f.length)
+            {
+                return;
+            }
+
+            // Unmap the pages from the process and, where supported, ask
+            // the kernel to drop its cached copy. Dirty pages stay cached
+            // until they are written back, so no data is lost.
+            size_t length = std::min(k_page_size, f.length - offset);
+            madvise(f.base + offset, length, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+            if (0 <= f.fd)
+            {
+                posix_fadvise(f.fd, offset, length, POSIX_FADV_DONTNEED);
+            }
+#endif
+        }
+
+        void Buffer_pool::forget(uint32_t file)
+        {
+            for (size_t slot = 0; slot < frames_.size(); ++slot)
+            {
+                Frame& frame = frames_[slot];
+                if (frame.used && page_file(frame.page) == file)
+                {
+                    table_.erase(frame.page);
+                    frame.used = false;
+                    free_.push_back(slot);
+                }
+            }
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
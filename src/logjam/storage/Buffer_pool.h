@@ -0,0 +1,250 @@
+#pragma once
+/*!
+ \file logjam/storage/Buffer_pool.h
+ \brief Logjam storage page cache definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Advisory page cache for mapped storage files.
+
+         Segments and index trees are mapped into memory, so a read is a
+         pointer dereference rather than a system call and a copy. The
+         pool owns no page frames; the kernel decides what is resident.
+         The pool only tracks the pages that reads have pinned and gives
+         the kernel hints about them. Files are divided into fixed-size
+         pages, and every read pins the pages it touches. A page is
+         tracked from its first pin until it is dropped. When more pages
+         are tracked than the budget allows, a CLOCK sweep picks an
+         unpinned page that has not been used since the last sweep, and
+         the kernel is advised to drop it.
+
+         The budget and the counters therefore describe pins and hints,
+         not residency: a tracked page may already have been reclaimed by
+         the kernel, and an untracked page may still be cached.
+
+         Dropping a page never invalidates a pointer: touching it again
+         faults it back in from the file. Pins therefore protect hot pages
+         from eviction, not correctness. Only shared, file-backed mappings
+         may be attached; dropping an anonymous mapping would lose its
+         contents.
+
+         If every tracked page is pinned when a new page is needed, the
+         budget is exceeded rather than blocking the read.
+         \since 1.0
+         */
+        class Buffer_pool
+        {
+        public:
+            //! Size of a cache page in bytes.
+            static const size_t k_page_size = 64 * 1024;
+
+            //! Default advisory budget in bytes.
+            static const size_t k_default_size;
+
+            //! Pin and hint counters. None of them measure residency.
+            struct Stats
+            {
+                uint64_t pin_hits; //!< Page pins that found the page tracked.
+                uint64_t pin_misses; //!< Page pins that started tracking the page.
+                uint64_t evictions; //!< Pages the kernel was advised to drop.
+                uint64_t overflows; //!< Pins that exceeded the budget.
+                size_t tracked; //!< Pages currently tracked.
+                size_t capacity; //!< Tracked pages allowed by the budget.
+            };
+
+            /*!
+             \brief Pages pinned by a read.
+
+             The pages are unpinned when the pin is destroyed or released.
+             Pins can be moved but not copied.
+             */
+            class Pin
+            {
+            public:
+                //! Create a pin that holds nothing.
+                Pin();
+
+                //! Deleted copy constructor.
+                Pin(const Pin& orig) = delete;
+
+                //! Move constructor.
+                Pin(Pin&& orig);
+
+                //! Deleted copy assignment operator.
+                Pin& operator=(const Pin& orig) = delete;
+
+                //! Move assignment operator.
+                Pin& operator=(Pin&& orig);
+
+                //! Destructor. Unpins the pages.
+                ~Pin();
+
+                //! Test if the pin holds any pages.
+                inline explicit operator bool() const
+                {
+                    return nullptr != pool_;
+                }
+
+                //! Unpin the pages now.
+                void release();
+
+            private:
+                friend class Buffer_pool;
+
+                Pin(Buffer_pool* pool,
+                        uint32_t file,
+                        size_t first,
+                        size_t last);
+
+                Buffer_pool* pool_;
+                uint32_t file_;
+                size_t first_;
+                size_t last_;
+            }; // class logjam::storage::Buffer_pool::Pin
+
+            /*!
+             \brief Create a pool.
+             \param budget The advisory budget in bytes, the most memory worth
+             of pages to track. At least one page is always allowed.
+             */
+            explicit Buffer_pool(size_t budget = k_default_size);
+
+            //! Deleted copy constructor.
+            Buffer_pool(const Buffer_pool& orig) = delete;
+
+            //! Deleted move constructor.
+            Buffer_pool(Buffer_pool&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Buffer_pool& operator=(const Buffer_pool& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Buffer_pool& operator=(Buffer_pool&& orig) = delete;
+
+            //! Destructor.
+            ~Buffer_pool() = default;
+
+            /*!
+             \brief Start caching a mapped file.
+             \param base The start of the shared mapping.
+             \param length The length of the mapping.
+             \param fd The mapped file descriptor.
+             \return The file identifier used for pins.
+             */
+            uint32_t attach(uint8_t* base,
+                    size_t length,
+                    int fd);
+
+            /*!
+             \brief Replace the mapping of an attached file.
+
+             Called after a file is remapped. Tracked pages of the old
+             mapping are forgotten.
+             \param file The file identifier.
+             \param base The start of the new mapping.
+             \param length The length of the new mapping.
+             */
+            void reattach(uint32_t file,
+                    uint8_t* base,
+                    size_t length);
+
+            /*!
+             \brief Stop caching a file.
+
+             Must be called before the file is unmapped.
+             \param file The file identifier.
+             */
+            void detach(uint32_t file);
+
+            /*!
+             \brief Pin the pages holding a byte range of a file.
+             \param file The file identifier.
+             \param offset The first byte of the range.
+             \param sz The number of bytes in the range.
+             \return The pin, which holds nothing for an empty range.
+             */
+            Pin pin(uint32_t file,
+                    size_t offset,
+                    size_t sz);
+
+            //! Get a snapshot of the pin and hint counters.
+            Stats stats() const;
+
+        private:
+            struct Frame
+            {
+                uint64_t page;
+                uint32_t pins;
+                bool referenced;
+                bool used;
+            };
+
+            struct File
+            {
+                uint8_t* base;
+                size_t length;
+                int fd;
+                bool attached;
+            };
+
+            void unpin(uint32_t file,
+                    size_t first,
+                    size_t last);
+            size_t load(uint64_t page);
+            bool evict();
+            void drop(uint64_t page);
+            void forget(uint32_t file);
+
+            size_t capacity_;
+            std::vector<Frame> frames_;
+            std::vector<size_t> free_;
+            std::unordered_map<uint64_t, size_t> table_;
+            std::vector<File> files_;
+            size_t hand_;
+            uint64_t pin_hits_;
+            uint64_t pin_misses_;
+            uint64_t evictions_;
+            uint64_t overflows_;
+            mutable std::mutex mutex_;
+        }; // class logjam::storage::Buffer_pool
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,435 @@
+/*!
+ \file logjam/storage/Index.cpp
+ \brief Logjam secondary document index implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Index.h"
+#include "lj/Exception.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    // Type classes, in sort order. Zero marks a type that is not indexed.
+    const uint8_t k_class_null = 0x10;
+    const uint8_t k_class_number = 0x20;
+    const uint8_t k_class_string = 0x30;
+    const uint8_t k_class_binary = 0x40;
+    const uint8_t k_class_boolean = 0x50;
+    const uint8_t k_class_datetime = 0x60;
+
+    const uint64_t k_sign_bit = 0x8000000000000000ULL;
+
+    uint8_t type_class(const lj::bson::Type t)
+    {
+        switch (t)
+        {
+            case lj::bson::Type::k_null:
+                return k_class_null;
+            case lj::bson::Type::k_int32:
+            case lj::bson::Type::k_int64:
+            case lj::bson::Type::k_timestamp:
+            case lj::bson::Type::k_double:
+                return k_class_number;
+            case lj::bson::Type::k_string:
+                return k_class_string;
+            case lj::bson::Type::k_binary:
+                return k_class_binary;
+            case lj::bson::Type::k_boolean:
+                return k_class_boolean;
+            case lj::bson::Type::k_datetime:
+                return k_class_datetime;
+            default:
+                return 0;
+        }
+    }
+
+    int64_t integer_value(const lj::bson::Type t,
+            const uint8_t* v)
+    {
+        if (lj::bson::Type::k_int32 == t)
+        {
+            int32_t i;
+            memcpy(&i, v, sizeof(int32_t));
+            return i;
+        }
+        int64_t i;
+        memcpy(&i, v, sizeof(int64_t));
+        return i;
+    }
+
+    double number_value(const lj::bson::Type t,
+            const uint8_t* v)
+    {
+        if (lj::bson::Type::k_double == t)
+        {
+            double d;
+            memcpy(&d, v, sizeof(double));
+            return d;
+        }
+        else if (lj::bson::Type::k_timestamp == t)
+        {
+            uint64_t u;
+            memcpy(&u, v, sizeof(uint64_t));
+            return static_cast<double>(u);
+        }
+        return static_cast<double>(integer_value(t, v));
+    }
+
+    // Write a big-endian integer so memcmp orders it.
+    void put_ordered(uint8_t* out,
+            uint64_t val)
+    {
+        for (int h = 7; h >= 0; --h)
+        {
+            out[h] = static_cast<uint8_t>(val);
+            val >>= 8;
+        }
+    }
+
+    uint64_t ordered_double(double d)
+    {
+        // Negative zero would otherwise sort before positive zero.
+        if (0.0 == d)
+        {
+            d = 0.0;
+        }
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(double));
+        return (bits & k_sign_bit) ? ~bits : (bits | k_sign_bit);
+    }
+
+    // Strings and binary values share the byte layout of a length
+    // followed by the data; strings count their terminator.
+    int compare_bytes(const uint8_t* a,
+            size_t a_sz,
+            const uint8_t* b,
+            size_t b_sz)
+    {
+        int cmp = memcmp(a, b, std::min(a_sz, b_sz));
+        if (0 != cmp)
+        {
+            return cmp;
+        }
+        return (a_sz < b_sz) ? -1 : ((a_sz > b_sz) ? 1 : 0);
+    }
+
+    template <typename T>
+    int three_way(const T& a,
+            const T& b)
+    {
+        return (a < b) ? -1 : ((b < a) ? 1 : 0);
+    }
+
+    size_t value_length(const uint8_t* v)
+    {
+        int32_t sz;
+        memcpy(&sz, v, sizeof(int32_t));
+        return sz < 0 ? 0 : static_cast<size_t>(sz);
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        Index::Index(const std::string& name,
+                const std::string& field,
+                const std::string& file,
+                Buffer_pool* pool) :
+                name_(name),
+                field_(field),
+                path_("./" + field),
+                tree_(file, field, pool)
+        {
+        }
+
+        bool Index::encode(const lj::bson::Type t,
+                const uint8_t* v,
+                Btree::Key& key)
+        {
+            uint8_t cls = type_class(t);
+            if (0 == cls)
+            {
+                return false;
+            }
+
+            memset(key.bytes, 0, Btree::k_key_size);
+            key.bytes[0] = cls;
+            uint8_t* out = key.bytes + 1;
+            const size_t room = Btree::k_key_size - 1;
+            switch (cls)
+            {
+                case k_class_number:
+                    put_ordered(out, ordered_double(number_value(t, v)));
+                    break;
+                case k_class_string:
+                {
+                    size_t sz = value_length(v);
+                    sz = (0 < sz) ? sz - 1 : 0;
+                    memcpy(out, v + 4, std::min(sz, room));
+                    break;
+                }
+                case k_class_binary:
+                    out[0] = v[4];
+                    memcpy(out + 1, v + 5, std::min(value_length(v), room - 1));
+                    break;
+                case k_class_boolean:
+                    out[0] = v[0] ? 1 : 0;
+                    break;
+                case k_class_datetime:
+                    put_ordered(out, static_cast<uint64_t>(integer_value(t, v)) ^ k_sign_bit);
+                    break;
+                default:
+                    break;
+            }
+            return true;
+        }
+
+        int Index::compare(const lj::bson::Type ta,
+                const uint8_t* a,
+                const lj::bson::Type tb,
+                const uint8_t* b)
+        {
+            uint8_t ca = type_class(ta);
+            uint8_t cb = type_class(tb);
+            if (ca != cb)
+            {
+                return three_way(ca, cb);
+            }
+
+            switch (ca)
+            {
+                case k_class_number:
+                    if (lj::bson::Type::k_double != ta &&
+                            lj::bson::Type::k_double != tb)
+                    {
+                        return three_way(integer_value(ta, a),
+                                integer_value(tb, b));
+                    }
+                    return three_way(number_value(ta, a),
+                            number_value(tb, b));
+                case k_class_string:
+                    return compare_bytes(a + 4,
+                            value_length(a),
+                            b + 4,
+                            value_length(b));
+                case k_class_binary:
+                    if (a[4] != b[4])
+                    {
+                        return three_way(a[4], b[4]);
+                    }
+                    return compare_bytes(a + 5,
+                            value_length(a),
+                            b + 5,
+                            value_length(b));
+                case k_class_boolean:
+                    return three_way(a[0] ? 1 : 0, b[0] ? 1 : 0);
+                case k_class_datetime:
+                    return three_way(integer_value(ta, a),
+                            integer_value(tb, b));
+                default:
+                    return 0;
+            }
+        }
+
+        void Index::add(const uint8_t* doc,
+                uint64_t key)
+        {
+            Btree::Key k;
+            if (entry(doc, key, k))
+            {
+                tree_.insert(k);
+            }
+        }
+
+        void Index::remove(const uint8_t* doc,
+                uint64_t key)
+        {
+            Btree::Key k;
+            if (entry(doc, key, k))
+            {
+                tree_.erase(k);
+            }
+        }
+
+        void Index::remove(const uint8_t* doc,
+                uint64_t key,
+                const std::vector<const uint8_t*>& retained)
+        {
+            Btree::Key k;
+            if (!entry(doc, key, k))
+            {
+                return;
+            }
+            for (const uint8_t* other : retained)
+            {
+                Btree::Key kept;
+                if (entry(other, key, kept) &&
+                        0 == logjam::storage::compare(k, kept))
+                {
+                    return;
+                }
+            }
+            tree_.erase(k);
+        }
+
+        void Index::update(const uint8_t* old_doc,
+                const uint8_t* new_doc,
+                uint64_t key)
+        {
+            Btree::Key old_key;
+            Btree::Key new_key;
+            bool had = entry(old_doc, key, old_key);
+            bool has = entry(new_doc, key, new_key);
+            if (had && has && 0 == logjam::storage::compare(old_key, new_key))
+            {
+                return;
+            }
+            if (had)
+            {
+                tree_.erase(old_key);
+            }
+            if (has)
+            {
+                tree_.insert(new_key);
+            }
+        }
+
+        size_t Index::entries(const lj::bson::Node* lower,
+                const lj::bson::Node* upper,
+                std::vector<Btree::Key>& out) const
+        {
+            Btree::Key first;
+            Btree::Key last;
+            bounds(lower, upper, first, last);
+            return tree_.scan(first, last, [&out](const Btree::Key& k) -> bool {
+                out.push_back(k);
+                return true;
+            });
+        }
+
+        bool Index::matches(const Btree::Key& found,
+                const uint8_t* doc,
+                const lj::bson::Node* lower,
+                const lj::bson::Node* upper) const
+        {
+            // The entry may belong to another version of the document.
+            Btree::Key k;
+            if (!entry(doc, found.record, k) ||
+                    0 != logjam::storage::compare(k, found))
+            {
+                return false;
+            }
+
+            // Only entries that encode the same as a bound can be
+            // outside of the range.
+            Btree::Key first;
+            Btree::Key last;
+            bounds(lower, upper, first, last);
+            bool at_lower = lower &&
+                    0 == memcmp(k.bytes, first.bytes, Btree::k_key_size);
+            bool at_upper = upper &&
+                    0 == memcmp(k.bytes, last.bytes, Btree::k_key_size);
+            if (at_lower || at_upper)
+            {
+                lj::bson::View v(lj::bson::View(doc).path(path_));
+                if (at_lower && 0 > compare(v.type(), v.data(), lower->type(), lower->to_value()))
+                {
+                    return false;
+                }
+                if (at_upper && 0 < compare(v.type(), v.data(), upper->type(), upper->to_value()))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void Index::clear()
+        {
+            tree_.clear();
+        }
+
+        void Index::sync()
+        {
+            tree_.sync();
+        }
+
+        bool Index::entry(const uint8_t* doc,
+                uint64_t key,
+                Btree::Key& out) const
+        {
+            lj::bson::View v;
+            try
+            {
+                v = lj::bson::View(doc).path(path_);
+            }
+            catch (lj::bson::Bson_type_exception&)
+            {
+                // The path runs through a value.
+                return false;
+            }
+            if (!v || !encode(v.type(), v.data(), out))
+            {
+                return false;
+            }
+            out.record = key;
+            return true;
+        }
+
+        void Index::bounds(const lj::bson::Node* lower,
+                const lj::bson::Node* upper,
+                Btree::Key& first,
+                Btree::Key& last) const
+        {
+            memset(first.bytes, 0x00, Btree::k_key_size);
+            first.record = 0;
+            memset(last.bytes, 0xff, Btree::k_key_size);
+            last.record = UINT64_MAX;
+            for (auto bound : {std::make_pair(lower, &first), std::make_pair(upper, &last)})
+            {
+                if (bound.first &&
+                        (lj::bson::type_is_nested(bound.first->type()) ||
+                        !encode(bound.first->type(), bound.first->to_value(), *bound.second)))
+                {
+                    throw LJ__Exception(std::string("Unable to scan index ") +
+                            name_ + " with a bound of type " +
+                            lj::bson::type_string(bound.first->type()));
+                }
+            }
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
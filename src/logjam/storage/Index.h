@@ -0,0 +1,256 @@
+#pragma once
+/*!
+ \file logjam/storage/Index.h
+ \brief Logjam secondary document index definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Btree.h"
+#include "lj/Bson.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Secondary index over one field of stored documents.
+
+         The field is a path inside the document payload (the \c "."
+         child). Each indexed document contributes one tree entry made of
+         the encoded field value and the document key. Documents without
+         the field, or with a value that cannot be ordered (documents,
+         arrays and the more exotic bson types), are not indexed.
+
+         Values of different types sort by type first: null, numbers,
+         strings, binary, booleans and then datetimes. Numbers of
+         different types compare by value. Long strings and binary
+         values are truncated in the tree, so entries that match a range
+         bound after encoding are compared against the document.
+
+         Superseded versions of a document may keep their entries while
+         a snapshot can still see them, so a range scan is done in two
+         steps: #entries() collects the entries in the range, and
+         #matches() keeps only the entry of the version being read.
+
+         The index is not synchronized; the owning collection serializes
+         access.
+         \since 1.0
+         */
+        class Index
+        {
+        public:
+            /*!
+             \brief Function called for each document in a range.
+             \return False to stop the scan.
+             */
+            typedef std::function<bool(const uint8_t*)> Scan_function;
+
+            /*!
+             \brief Open or create an index.
+             \param name The name of the index.
+             \param field The path of the indexed field in the payload.
+             \param file The path of the tree file.
+             \param pool The page cache for tree reads, or nullptr.
+             \throws lj::Exception If the tree cannot be opened.
+             */
+            Index(const std::string& name,
+                    const std::string& field,
+                    const std::string& file,
+                    Buffer_pool* pool = nullptr);
+
+            //! Deleted copy constructor.
+            Index(const Index& orig) = delete;
+
+            //! Deleted move constructor.
+            Index(Index&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Index& operator=(const Index& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Index& operator=(Index&& orig) = delete;
+
+            //! Destructor.
+            ~Index() = default;
+
+            //! Get the name of the index.
+            inline const std::string& name() const
+            {
+                return name_;
+            }
+
+            //! Get the path of the indexed field.
+            inline const std::string& field() const
+            {
+                return field_;
+            }
+
+            /*!
+             \brief Test if the stored entries were kept when opened.
+
+             An invalid index is empty and must be rebuilt with #add().
+             */
+            inline bool valid() const
+            {
+                return tree_.valid();
+            }
+
+            //! Get the number of indexed documents.
+            inline uint64_t size() const
+            {
+                return tree_.size();
+            }
+
+            /*!
+             \brief Encode a value into order-preserving key bytes.
+             \param t The type of the value.
+             \param v The value bytes.
+             \param key The entry to fill. The record is not changed.
+             \return False if values of this type are not indexed.
+             */
+            static bool encode(const lj::bson::Type t,
+                    const uint8_t* v,
+                    Btree::Key& key);
+
+            /*!
+             \brief Compare two indexable values.
+             \param ta The type of the first value.
+             \param a The first value bytes.
+             \param tb The type of the second value.
+             \param b The second value bytes.
+             \return Negative, zero or positive like memcmp.
+             */
+            static int compare(const lj::bson::Type ta,
+                    const uint8_t* a,
+                    const lj::bson::Type tb,
+                    const uint8_t* b);
+
+            /*!
+             \brief Add a document to the index.
+             \param doc The document bytes.
+             \param key The document key.
+             */
+            void add(const uint8_t* doc,
+                    uint64_t key);
+
+            /*!
+             \brief Remove a document from the index.
+             \param doc The document bytes that were indexed.
+             \param key The document key.
+             */
+            void remove(const uint8_t* doc,
+                    uint64_t key);
+
+            /*!
+             \brief Remove a superseded version unless another version shares its entry.
+             \param doc The document bytes that were indexed.
+             \param key The document key.
+             \param retained The versions of the document still indexed.
+             */
+            void remove(const uint8_t* doc,
+                    uint64_t key,
+                    const std::vector<const uint8_t*>& retained);
+
+            /*!
+             \brief Replace the indexed version of a document.
+
+             Nothing is written if the field encodes the same way in both
+             versions.
+             \param old_doc The previously indexed document bytes.
+             \param new_doc The new document bytes.
+             \param key The document key.
+             */
+            void update(const uint8_t* old_doc,
+                    const uint8_t* new_doc,
+                    uint64_t key);
+
+            /*!
+             \brief Collect the entries with a field value in a range.
+
+             Entries are returned in field order, and by key for equal
+             values. Both bounds are inclusive, but entries that encode
+             the same as a bound may still be outside of the range, and
+             one document may have entries for several versions.
+             \param lower The smallest value, or nullptr for no lower bound.
+             \param upper The largest value, or nullptr for no upper bound.
+             \param out Receives the entries.
+             \return The number of entries collected.
+             \throws lj::Exception If a bound cannot be indexed.
+             */
+            size_t entries(const lj::bson::Node* lower,
+                    const lj::bson::Node* upper,
+                    std::vector<Btree::Key>& out) const;
+
+            /*!
+             \brief Test if an entry belongs to a document version in a range.
+
+             Only reads the document, so it may be called without
+             serializing with writers.
+             \param found An entry returned by #entries().
+             \param doc The version of the document being read.
+             \param lower The lower bound passed to #entries().
+             \param upper The upper bound passed to #entries().
+             \return True if \c doc produced the entry and its field is in
+             the range.
+             */
+            bool matches(const Btree::Key& found,
+                    const uint8_t* doc,
+                    const lj::bson::Node* lower,
+                    const lj::bson::Node* upper) const;
+
+            //! Remove every entry.
+            void clear();
+
+            //! Flush the index to disk.
+            void sync();
+
+        private:
+            bool entry(const uint8_t* doc,
+                    uint64_t key,
+                    Btree::Key& out) const;
+            void bounds(const lj::bson::Node* lower,
+                    const lj::bson::Node* upper,
+                    Btree::Key& first,
+                    Btree::Key& last) const;
+
+            std::string name_;
+            std::string field_;
+            lj::bson::Path path_;
+            Btree tree_;
+        }; // class logjam::storage::Index
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,690 @@
+/*!
+ \file logjam/storage/Lsm.cpp
+ \brief Logjam log-structured merge-tree collection implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Lsm.h"
+#include "lj/Exception.h"
+#include "lj/Log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const char k_manifest_name[] = "MANIFEST";
+    const char k_run_suffix[] = ".run";
+
+    // Runs are cut at this multiple of the memtable size, and level 1
+    // may hold this multiple of the memtable size.
+    const size_t k_run_factor = 2;
+    const size_t k_level1_factor = 10;
+    const size_t k_level_ratio = 10;
+
+    uint64_t total_size(const std::vector<std::shared_ptr<logjam::storage::Run>>& runs)
+    {
+        uint64_t total = 0;
+        for (const auto& run : runs)
+        {
+            total += run->size();
+        }
+        return total;
+    }
+
+    size_t bson_size(const uint8_t* bytes)
+    {
+        int32_t sz;
+        memcpy(&sz, bytes, sizeof(int32_t));
+        return sz;
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        const size_t Lsm_collection::k_default_memtable_size = 4 * 1024 * 1024;
+        const size_t Lsm_collection::k_levels;
+        const size_t Lsm_collection::k_level0_compaction_runs;
+        const size_t Lsm_collection::k_level0_stall_runs;
+
+        Lsm_collection::Lsm_collection(const std::string& name,
+                const std::string& directory,
+                Wal* wal,
+                Buffer_pool* pool,
+                size_t memtable_size) :
+                name_(name),
+                directory_(directory),
+                wal_(wal),
+                pool_(pool),
+                memtable_size_(std::max<size_t>(memtable_size, 1)),
+                mutex_(),
+                work_cv_(),
+                stall_cv_(),
+                memtable_(new Memtable()),
+                immutable_(),
+                levels_(),
+                cursors_(k_levels, 0),
+                next_run_(0),
+                running_(true),
+                stats_(),
+                flush_mutex_(),
+                install_mutex_(),
+                compactor_()
+        {
+            if (mkdir(directory_.c_str(), 0755) < 0 && EEXIST != errno)
+            {
+                throw LJ__Exception(std::string("Unable to create directory ") +
+                        directory_ + ": " + strerror(errno));
+            }
+
+            // Open the runs listed in the manifest, in level order.
+            std::shared_ptr<Level_list> levels(new Level_list(k_levels));
+            std::set<std::string> listed;
+            FILE* manifest = fopen((directory_ + "/" + k_manifest_name).c_str(), "r");
+            if (manifest)
+            {
+                unsigned level;
+                char file[64];
+                while (2 == fscanf(manifest, "%u %63s", &level, file))
+                {
+                    if (k_levels <= level)
+                    {
+                        fclose(manifest);
+                        throw LJ__Exception(std::string("Damaged manifest in ") +
+                                directory_);
+                    }
+                    listed.insert(file);
+                    (*levels)[level].emplace_back(new Run(directory_ + "/" + file, pool_));
+                }
+                fclose(manifest);
+            }
+
+            // Remove runs that were written but never installed, and
+            // never reuse a run number.
+            DIR* dir = opendir(directory_.c_str());
+            if (!dir)
+            {
+                throw LJ__Exception(std::string("Unable to read directory ") +
+                        directory_ + ": " + strerror(errno));
+            }
+            for (struct dirent* entry = readdir(dir);
+                    entry;
+                    entry = readdir(dir))
+            {
+                unsigned long long number;
+                char suffix[8];
+                if (2 == sscanf(entry->d_name, "%llu%7s", &number, suffix) &&
+                        0 == strncmp(suffix, k_run_suffix, strlen(k_run_suffix)))
+                {
+                    next_run_ = std::max<uint64_t>(next_run_, number + 1);
+                    if (listed.end() == listed.find(entry->d_name))
+                    {
+                        unlink((directory_ + "/" + entry->d_name).c_str());
+                    }
+                }
+            }
+            closedir(dir);
+            levels_ = levels;
+
+            size_t runs = 0;
+            for (const auto& level : *levels_)
+            {
+                runs += level.size();
+            }
+            lj::log::format<lj::Info>("Opened LSM collection %s with %d runs.")
+                    << name_
+                    << runs
+                    << lj::log::end;
+
+            compactor_.reset(new lj::Thread());
+            compactor_->run([this]() { compact_loop(); }, []() {});
+        }
+
+        Lsm_collection::~Lsm_collection()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_ = false;
+                work_cv_.notify_all();
+            }
+            compactor_->join();
+
+            try
+            {
+                sync();
+            }
+            catch (lj::Exception& ex)
+            {
+                lj::log::format<lj::Error>("Unable to flush LSM collection %s: %s")
+                        << name_
+                        << ex
+                        << lj::log::end;
+            }
+        }
+
+        uint64_t Lsm_collection::store(const lj::Document& doc)
+        {
+            size_t sz;
+            std::unique_ptr<uint8_t[]> bytes(doc.root().to_binary(&sz));
+            uint64_t key = doc.key();
+
+            // Logging and inserting under the same lock means a sync
+            // covers every logged record.
+            std::unique_lock<std::mutex> lock(mutex_);
+            uint64_t lsn = wal_ ? wal_->append(name_, bytes.get(), sz) : 0;
+            insert(lock, key, bytes.get(), sz);
+            return lsn;
+        }
+
+        bool Lsm_collection::restore(const uint8_t* bytes)
+        {
+            lj::bson::Node doc(lj::bson::Type::k_document, bytes);
+            uint64_t key = lj::bson::as_uint64(doc["_/key"]);
+            lj::Uuid id = lj::bson::as_uuid(doc["_/id"]);
+
+            std::unique_ptr<lj::bson::Node> current(fetch(key));
+            const lj::bson::Node* current_id = current ? current->path("_/id") : nullptr;
+            if (current_id && id == lj::bson::as_uuid(*current_id))
+            {
+                return false;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            insert(lock, key, bytes, doc.size());
+            return true;
+        }
+
+        lj::bson::Node* Lsm_collection::fetch(const uint64_t key) const
+        {
+            std::shared_ptr<const Level_list> levels;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                const uint8_t* ptr = memtable_->get(key);
+                if (!ptr && immutable_)
+                {
+                    ptr = immutable_->get(key);
+                }
+                if (ptr)
+                {
+                    return new lj::bson::Node(lj::bson::Type::k_document, ptr);
+                }
+                levels = levels_;
+            }
+
+            // The snapshot keeps the runs open even if a compaction
+            // replaces them while they are searched.
+            Buffer_pool::Pin held;
+            const auto& level0 = levels->front();
+            for (auto iter = level0.rbegin(); level0.rend() != iter; ++iter)
+            {
+                const uint8_t* ptr = (*iter)->find(key, held);
+                if (ptr)
+                {
+                    return new lj::bson::Node(lj::bson::Type::k_document, ptr);
+                }
+            }
+            for (size_t level = 1; level < levels->size(); ++level)
+            {
+                const auto& runs = (*levels)[level];
+                auto iter = std::lower_bound(runs.begin(),
+                        runs.end(),
+                        key,
+                        [](const std::shared_ptr<Run>& run, uint64_t k) {
+                            return run->max_key() < k;
+                        });
+                if (runs.end() == iter)
+                {
+                    continue;
+                }
+                const uint8_t* ptr = (*iter)->find(key, held);
+                if (ptr)
+                {
+                    return new lj::bson::Node(lj::bson::Type::k_document, ptr);
+                }
+            }
+            return nullptr;
+        }
+
+        void Lsm_collection::sync()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (immutable_)
+            {
+                lock.unlock();
+                flush_immutable();
+                lock.lock();
+            }
+            if (0 < memtable_->size())
+            {
+                immutable_ = memtable_;
+                memtable_.reset(new Memtable());
+            }
+            lock.unlock();
+            flush_immutable();
+        }
+
+        Lsm_collection::Stats Lsm_collection::stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Stats result(stats_);
+            result.memtable_bytes = memtable_->bytes() +
+                    (immutable_ ? immutable_->bytes() : 0);
+            for (const auto& level : *levels_)
+            {
+                result.runs.push_back(level.size());
+                result.level_bytes.push_back(total_size(level));
+            }
+            return result;
+        }
+
+        void Lsm_collection::insert(std::unique_lock<std::mutex>& lock,
+                uint64_t key,
+                const uint8_t* bytes,
+                size_t sz)
+        {
+            // Wait for the background thread if the memtable cannot be
+            // switched or level 0 is backed up.
+            if ((immutable_ && memtable_->bytes() >= memtable_size_) ||
+                    levels_->front().size() >= k_level0_stall_runs)
+            {
+                auto start = std::chrono::steady_clock::now();
+                work_cv_.notify_one();
+                stall_cv_.wait(lock, [this]() {
+                    return !running_ ||
+                            ((!immutable_ || memtable_->bytes() < memtable_size_) &&
+                                    levels_->front().size() < k_level0_stall_runs);
+                });
+                ++stats_.stalls;
+                stats_.stall_micros += std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+            }
+
+            memtable_->put(key, bytes, sz);
+            stats_.user_bytes += sz;
+
+            if (!immutable_ && memtable_->bytes() >= memtable_size_)
+            {
+                immutable_ = memtable_;
+                memtable_.reset(new Memtable());
+                work_cv_.notify_one();
+            }
+        }
+
+        void Lsm_collection::compact_loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (running_)
+            {
+                try
+                {
+                    int level = pick_level(*levels_);
+                    if (immutable_)
+                    {
+                        lock.unlock();
+                        flush_immutable();
+                        lock.lock();
+                    }
+                    else if (0 <= level)
+                    {
+                        lock.unlock();
+                        compact(level);
+                        lock.lock();
+                    }
+                    else
+                    {
+                        work_cv_.wait(lock);
+                    }
+                }
+                catch (lj::Exception& ex)
+                {
+                    if (!lock.owns_lock())
+                    {
+                        lock.lock();
+                    }
+                    lj::log::format<lj::Error>("Background work failed for LSM collection %s: %s")
+                            << name_
+                            << ex
+                            << lj::log::end;
+                    work_cv_.wait_for(lock, std::chrono::seconds(1));
+                }
+            }
+        }
+
+        void Lsm_collection::flush_immutable()
+        {
+            std::lock_guard<std::mutex> flushing(flush_mutex_);
+            std::shared_ptr<const Memtable> table;
+            uint64_t number = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                table = immutable_;
+                if (!table)
+                {
+                    return;
+                }
+                number = next_run_++;
+            }
+
+            size_t written = 0;
+            std::shared_ptr<Run> run;
+            if (0 < table->size())
+            {
+                Run::Writer writer(run_path(number));
+                table->each([&writer](uint64_t key, const uint8_t* bytes, size_t sz) {
+                    writer.add(key, bytes, sz);
+                });
+                written = writer.finish();
+                run.reset(new Run(run_path(number), pool_));
+            }
+
+            // Newer runs go at the end of level 0.
+            std::lock_guard<std::mutex> installing(install_mutex_);
+            std::shared_ptr<Level_list> levels;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                levels.reset(new Level_list(*levels_));
+            }
+            if (run)
+            {
+                levels->front().push_back(run);
+                write_manifest(*levels);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            levels_ = levels;
+            immutable_.reset();
+            stats_.flush_bytes += written;
+            ++stats_.flushes;
+            stall_cv_.notify_all();
+            work_cv_.notify_one();
+        }
+
+        int Lsm_collection::pick_level(const Level_list& levels) const
+        {
+            if (levels.front().size() >= k_level0_compaction_runs)
+            {
+                return 0;
+            }
+            for (size_t level = 1; level + 1 < levels.size(); ++level)
+            {
+                if (total_size(levels[level]) > level_limit(level))
+                {
+                    return level;
+                }
+            }
+            return -1;
+        }
+
+        void Lsm_collection::compact(int level)
+        {
+            std::shared_ptr<const Level_list> current;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                current = levels_;
+            }
+
+            // Inputs are ordered newest first, so the first input holding
+            // a key has its latest version.
+            std::vector<std::shared_ptr<Run>> inputs;
+            const auto& runs = (*current)[level];
+            if (0 == level)
+            {
+                inputs.assign(runs.rbegin(), runs.rend());
+            }
+            else
+            {
+                // Pick the runs round robin by key so every part of the
+                // key space is pushed down in turn.
+                auto iter = std::find_if(runs.begin(),
+                        runs.end(),
+                        [this, level](const std::shared_ptr<Run>& run) {
+                            return run->min_key() >= cursors_[level];
+                        });
+                inputs.push_back(runs.end() == iter ? runs.front() : *iter);
+                cursors_[level] = inputs.front()->max_key() + 1;
+            }
+
+            uint64_t first = inputs.front()->min_key();
+            uint64_t last = inputs.front()->max_key();
+            for (const auto& run : inputs)
+            {
+                first = std::min(first, run->min_key());
+                last = std::max(last, run->max_key());
+            }
+            size_t moved = inputs.size();
+            for (const auto& run : (*current)[level + 1])
+            {
+                if (run->overlaps(first, last))
+                {
+                    inputs.push_back(run);
+                }
+            }
+
+            // A single run with nothing to merge against is moved down
+            // without being rewritten.
+            std::vector<std::shared_ptr<Run>> outputs;
+            size_t written = 0;
+            bool trivial = (1 == inputs.size());
+            if (trivial)
+            {
+                outputs = inputs;
+            }
+            else
+            {
+                written = merge(inputs, outputs);
+            }
+
+            std::lock_guard<std::mutex> installing(install_mutex_);
+            std::shared_ptr<Level_list> levels;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                levels.reset(new Level_list(*levels_));
+            }
+            for (size_t h = 0; h < inputs.size(); ++h)
+            {
+                auto& from = (*levels)[h < moved ? level : level + 1];
+                from.erase(std::remove(from.begin(), from.end(), inputs[h]), from.end());
+            }
+            auto& into = (*levels)[level + 1];
+            into.insert(into.end(), outputs.begin(), outputs.end());
+            std::sort(into.begin(),
+                    into.end(),
+                    [](const std::shared_ptr<Run>& a, const std::shared_ptr<Run>& b) {
+                        return a->min_key() < b->min_key();
+                    });
+            write_manifest(*levels);
+
+            // The replaced files go away once no reader holds them.
+            if (!trivial)
+            {
+                for (const auto& run : inputs)
+                {
+                    run->obsolete();
+                }
+            }
+
+            lj::log::format<lj::Debug>("Compacted %d runs from level %d of %s into %d runs.")
+                    << inputs.size()
+                    << level
+                    << name_
+                    << outputs.size()
+                    << lj::log::end;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            levels_ = levels;
+            stats_.compaction_bytes += written;
+            ++stats_.compactions;
+            stall_cv_.notify_all();
+        }
+
+        size_t Lsm_collection::merge(const std::vector<std::shared_ptr<Run>>& inputs,
+                std::vector<std::shared_ptr<Run>>& outputs)
+        {
+            const size_t run_size = memtable_size_ * k_run_factor;
+            std::vector<size_t> positions(inputs.size(), 0);
+            std::unique_ptr<Run::Writer> writer;
+            std::string path;
+            size_t written = 0;
+
+            try
+            {
+                while (true)
+                {
+                    // Find the smallest key left and the newest input with it.
+                    size_t winner = inputs.size();
+                    uint64_t key = 0;
+                    for (size_t h = 0; h < inputs.size(); ++h)
+                    {
+                        if (positions[h] < inputs[h]->count() &&
+                                (inputs.size() == winner || inputs[h]->key(positions[h]) < key))
+                        {
+                            winner = h;
+                            key = inputs[h]->key(positions[h]);
+                        }
+                    }
+                    if (inputs.size() == winner)
+                    {
+                        break;
+                    }
+
+                    Buffer_pool::Pin held;
+                    const uint8_t* bytes = inputs[winner]->at(positions[winner], held);
+                    for (size_t h = 0; h < inputs.size(); ++h)
+                    {
+                        if (positions[h] < inputs[h]->count() &&
+                                inputs[h]->key(positions[h]) == key)
+                        {
+                            ++positions[h];
+                        }
+                    }
+
+                    if (!writer)
+                    {
+                        uint64_t number;
+                        {
+                            std::lock_guard<std::mutex> lock(mutex_);
+                            number = next_run_++;
+                        }
+                        path = run_path(number);
+                        writer.reset(new Run::Writer(path));
+                    }
+                    writer->add(key, bytes, bson_size(bytes));
+                    if (writer->size() >= run_size)
+                    {
+                        written += writer->finish();
+                        writer.reset();
+                        outputs.emplace_back(new Run(path, pool_));
+                    }
+                }
+                if (writer)
+                {
+                    written += writer->finish();
+                    writer.reset();
+                    outputs.emplace_back(new Run(path, pool_));
+                }
+            }
+            catch (...)
+            {
+                for (const auto& run : outputs)
+                {
+                    run->obsolete();
+                }
+                outputs.clear();
+                throw;
+            }
+            return written;
+        }
+
+        void Lsm_collection::write_manifest(const Level_list& levels) const
+        {
+            std::string path(directory_ + "/" + k_manifest_name);
+            std::string temp_path(path + ".tmp");
+            std::string contents;
+            for (size_t level = 0; level < levels.size(); ++level)
+            {
+                for (const auto& run : levels[level])
+                {
+                    contents += std::to_string(level) + " " +
+                            run->path().substr(directory_.size() + 1) + "\n";
+                }
+            }
+
+            int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                throw LJ__Exception(std::string("Unable to create manifest ") +
+                        temp_path + ": " + strerror(errno));
+            }
+            bool ok = static_cast<ssize_t>(contents.size()) ==
+                    ::write(fd, contents.data(), contents.size()) &&
+                    0 == fsync(fd);
+            int err = errno;
+            ::close(fd);
+            if (!ok || rename(temp_path.c_str(), path.c_str()) < 0)
+            {
+                err = ok ? errno : err;
+                unlink(temp_path.c_str());
+                throw LJ__Exception(std::string("Unable to write manifest ") +
+                        path + ": " + strerror(err));
+            }
+        }
+
+        std::string Lsm_collection::run_path(uint64_t number) const
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "/%08llu%s",
+                    static_cast<unsigned long long>(number),
+                    k_run_suffix);
+            return directory_ + buffer;
+        }
+
+        uint64_t Lsm_collection::level_limit(size_t level) const
+        {
+            uint64_t limit = memtable_size_ * k_level1_factor;
+            for (size_t h = 1; h < level; ++h)
+            {
+                limit *= k_level_ratio;
+            }
+            return limit;
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,259 @@
+#pragma once
+/*!
+ \file logjam/storage/Lsm.h
+ \brief Logjam log-structured merge-tree collection definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Buffer_pool.h"
+#include "logjam/storage/Memtable.h"
+#include "logjam/storage/Run.h"
+#include "logjam/storage/Wal.h"
+#include "lj/Bson.h"
+#include "lj/Document.h"
+#include "lj/Thread.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Write-optimized collection of documents.
+
+         Only the latest version of each document key is kept. Documents
+         are logged and then inserted into an in-memory skiplist. Once the
+         memtable fills it becomes immutable and a background thread
+         writes it to a new sorted run in level 0. Level 0 runs may
+         overlap; every other level holds non-overlapping runs and is
+         allowed ten times the bytes of the level above it. A background
+         thread merges level 0 into level 1, and any level that outgrows
+         its budget into the next one, keeping the newest version of each
+         key.
+
+         Writers stall when the background thread falls behind: when a
+         full memtable is waiting for the previous one to be flushed, or
+         when level 0 holds too many runs. The number of stalls, the time
+         spent stalled and the bytes written by flushes and compactions
+         are reported by #stats().
+
+         The runs in each level are listed in a \c MANIFEST file that is
+         replaced atomically, so a crash during a flush or compaction
+         leaves either the old or the new set of runs.
+         \since 1.0
+         */
+        class Lsm_collection
+        {
+        public:
+            //! Counters describing the work done by the collection.
+            struct Stats
+            {
+                //! Document bytes stored by callers.
+                uint64_t user_bytes;
+
+                //! Run bytes written by memtable flushes.
+                uint64_t flush_bytes;
+
+                //! Run bytes written by compactions.
+                uint64_t compaction_bytes;
+
+                //! Number of memtable flushes.
+                uint64_t flushes;
+
+                //! Number of compactions, including trivial moves.
+                uint64_t compactions;
+
+                //! Number of writes that had to wait for the background thread.
+                uint64_t stalls;
+
+                //! Total time writers spent stalled, in microseconds.
+                uint64_t stall_micros;
+
+                //! Document bytes held in memory.
+                uint64_t memtable_bytes;
+
+                //! Number of runs in each level.
+                std::vector<uint64_t> runs;
+
+                //! Number of run bytes in each level.
+                std::vector<uint64_t> level_bytes;
+
+                //! Get the run bytes written per stored byte, ignoring the log.
+                inline double write_amplification() const
+                {
+                    return 0 == user_bytes ? 0.0 :
+                            static_cast<double>(flush_bytes + compaction_bytes) / user_bytes;
+                }
+            };
+
+            //! Default memtable size.
+            static const size_t k_default_memtable_size;
+
+            //! Number of levels, including level 0.
+            static const size_t k_levels = 7;
+
+            //! Number of level 0 runs that triggers a compaction.
+            static const size_t k_level0_compaction_runs = 4;
+
+            //! Number of level 0 runs that stalls writers.
+            static const size_t k_level0_stall_runs = 8;
+
+            /*!
+             \brief Open or create a collection.
+
+             Runs are cut at twice the memtable size and level 1 may hold
+             ten times the memtable size.
+             \param name The name of the collection.
+             \param directory The directory holding the run files.
+             \param wal The write-ahead log, or nullptr to skip logging.
+             \param pool The page cache, or nullptr to skip caching.
+             \param memtable_size The memtable size that triggers a flush.
+             \throws lj::Exception If the runs cannot be opened.
+             */
+            Lsm_collection(const std::string& name,
+                    const std::string& directory,
+                    Wal* wal,
+                    Buffer_pool* pool = nullptr,
+                    size_t memtable_size = k_default_memtable_size);
+
+            //! Deleted copy constructor.
+            Lsm_collection(const Lsm_collection& orig) = delete;
+
+            //! Deleted move constructor.
+            Lsm_collection(Lsm_collection&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Lsm_collection& operator=(const Lsm_collection& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Lsm_collection& operator=(Lsm_collection&& orig) = delete;
+
+            //! Destructor. Stops the background thread and flushes the memtable.
+            ~Lsm_collection();
+
+            //! Get the name of the collection.
+            inline const std::string& name() const
+            {
+                return name_;
+            }
+
+            /*!
+             \brief Store a document version, replacing any previous one.
+             \param doc The document to store.
+             \return The log sequence number, or 0 if there is no log.
+             \throws lj::Exception If the document cannot be logged.
+             \sa Collection::store(const lj::Document&)
+             */
+            uint64_t store(const lj::Document& doc);
+
+            /*!
+             \brief Add a logged document image during recovery.
+
+             A record matching the current version of its key is ignored,
+             so replaying the same record twice is harmless.
+             \param bytes The bson document bytes.
+             \return True if the version was added.
+             */
+            bool restore(const uint8_t* bytes);
+
+            /*!
+             \brief Fetch the current document version.
+
+             Runs may be replaced by a compaction at any time, so the
+             result is a lj::bson::Type::k_document node copied out of
+             the memtable or run. The caller is responsible for releasing
+             the pointer.
+             \param key The document key.
+             \return The document node, or nullptr if not found.
+             */
+            lj::bson::Node* fetch(const uint64_t key) const;
+
+            /*!
+             \brief Flush the memtable to a run.
+
+             Every version stored before the call is in a synced run when
+             the call returns.
+             \throws lj::Exception If the run cannot be written.
+             */
+            void sync();
+
+            //! Get a snapshot of the collection counters.
+            Stats stats() const;
+
+        private:
+            typedef std::vector<std::vector<std::shared_ptr<Run>>> Level_list;
+
+            void insert(std::unique_lock<std::mutex>& lock,
+                    uint64_t key,
+                    const uint8_t* bytes,
+                    size_t sz);
+            void compact_loop();
+            void flush_immutable();
+            int pick_level(const Level_list& levels) const;
+            void compact(int level);
+            size_t merge(const std::vector<std::shared_ptr<Run>>& inputs,
+                    std::vector<std::shared_ptr<Run>>& outputs);
+            void write_manifest(const Level_list& levels) const;
+            std::string run_path(uint64_t number) const;
+            uint64_t level_limit(size_t level) const;
+
+            std::string name_;
+            std::string directory_;
+            Wal* wal_;
+            Buffer_pool* pool_;
+            size_t memtable_size_;
+
+            mutable std::mutex mutex_;
+            std::condition_variable work_cv_;
+            std::condition_variable stall_cv_;
+            std::shared_ptr<Memtable> memtable_;
+            std::shared_ptr<const Memtable> immutable_;
+            std::shared_ptr<const Level_list> levels_;
+            std::vector<uint64_t> cursors_;
+            uint64_t next_run_;
+            bool running_;
+            Stats stats_;
+
+            // Serializes flushes with each other, and manifest updates
+            // with each other.
+            std::mutex flush_mutex_;
+            std::mutex install_mutex_;
+            std::unique_ptr<lj::Thread> compactor_;
+        }; // class logjam::storage::Lsm_collection
+    }; // namespace logjam::storage
+}; // namespace logjam
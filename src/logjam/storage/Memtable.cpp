@@ -0,0 +1,142 @@
+/*!
+ \file logjam/storage/Memtable.cpp
+ \brief Logjam skiplist memtable implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Memtable.h"
+
+namespace logjam
+{
+    namespace storage
+    {
+        const size_t Memtable::k_max_height;
+
+        Memtable::Memtable() :
+                head_(),
+                height_(1),
+                size_(0),
+                bytes_(0),
+                random_()
+        {
+            head_.key = 0;
+            head_.next.assign(k_max_height, nullptr);
+        }
+
+        Memtable::~Memtable()
+        {
+            Node* node = head_.next[0];
+            while (node)
+            {
+                Node* nxt = node->next[0];
+                delete node;
+                node = nxt;
+            }
+        }
+
+        void Memtable::put(uint64_t key,
+                const uint8_t* bytes,
+                size_t sz)
+        {
+            // Find the last node before the key on every level.
+            Node* prev[k_max_height];
+            Node* node = &head_;
+            for (size_t h = height_; h-- > 0;)
+            {
+                while (node->next[h] && node->next[h]->key < key)
+                {
+                    node = node->next[h];
+                }
+                prev[h] = node;
+            }
+
+            Node* found = node->next[0];
+            if (found && found->key == key)
+            {
+                bytes_ = bytes_ - found->value.size() + sz;
+                found->value.assign(bytes, bytes + sz);
+                return;
+            }
+
+            size_t height = random_height();
+            for (; height_ < height; ++height_)
+            {
+                prev[height_] = &head_;
+            }
+
+            node = new Node();
+            node->key = key;
+            node->value.assign(bytes, bytes + sz);
+            node->next.resize(height);
+            for (size_t h = 0; h < height; ++h)
+            {
+                node->next[h] = prev[h]->next[h];
+                prev[h]->next[h] = node;
+            }
+            ++size_;
+            bytes_ += sz;
+        }
+
+        const uint8_t* Memtable::get(uint64_t key) const
+        {
+            const Node* node = &head_;
+            for (size_t h = height_; h-- > 0;)
+            {
+                while (node->next[h] && node->next[h]->key < key)
+                {
+                    node = node->next[h];
+                }
+            }
+            node = node->next[0];
+            return (node && node->key == key) ? node->value.data() : nullptr;
+        }
+
+        void Memtable::each(const Entry_function& fn) const
+        {
+            for (const Node* node = head_.next[0]; node; node = node->next[0])
+            {
+                fn(node->key, node->value.data(), node->value.size());
+            }
+        }
+
+        size_t Memtable::random_height()
+        {
+            // Each level holds a quarter of the nodes of the one below.
+            size_t height = 1;
+            while (height < k_max_height && 0 == (random_() & 3))
+            {
+                ++height;
+            }
+            return height;
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
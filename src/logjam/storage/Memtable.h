@@ -0,0 +1,136 @@
+#pragma once
+/*!
+ \file logjam/storage/Memtable.h
+ \brief Logjam skiplist memtable definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Sorted in-memory table of document versions.
+
+         A skiplist keyed by document key holding a copy of the bson bytes
+         of the latest version stored for each key. Storing a key again
+         replaces the previous bytes. Iteration visits the keys in
+         ascending order, which is the order sorted runs are written in.
+
+         The table is not synchronized. The owner must serialize writers
+         with each other and with readers; once a table stops accepting
+         writes it may be read from any number of threads.
+         \since 1.0
+         */
+        class Memtable
+        {
+        public:
+            //! Function invoked for each entry by #each().
+            typedef std::function<void(uint64_t, const uint8_t*, size_t)> Entry_function;
+
+            //! Maximum number of levels in the skiplist.
+            static const size_t k_max_height = 12;
+
+            //! Create an empty table.
+            Memtable();
+
+            //! Deleted copy constructor.
+            Memtable(const Memtable& orig) = delete;
+
+            //! Deleted move constructor.
+            Memtable(Memtable&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Memtable& operator=(const Memtable& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Memtable& operator=(Memtable&& orig) = delete;
+
+            //! Destructor.
+            ~Memtable();
+
+            /*!
+             \brief Store the bytes of a document version.
+             \param key The document key.
+             \param bytes The bson document bytes.
+             \param sz The number of bytes in \c bytes.
+             */
+            void put(uint64_t key,
+                    const uint8_t* bytes,
+                    size_t sz);
+
+            /*!
+             \brief Get the bytes stored for a key.
+             \param key The document key.
+             \return Pointer to the bytes, or nullptr if not found. The
+             pointer is valid until the key is stored again.
+             */
+            const uint8_t* get(uint64_t key) const;
+
+            //! Visit every entry in key order.
+            void each(const Entry_function& fn) const;
+
+            //! Get the number of distinct keys.
+            inline size_t size() const
+            {
+                return size_;
+            }
+
+            //! Get the number of document bytes held.
+            inline size_t bytes() const
+            {
+                return bytes_;
+            }
+
+        private:
+            struct Node
+            {
+                uint64_t key;
+                std::vector<uint8_t> value;
+                std::vector<Node*> next;
+            };
+
+            size_t random_height();
+
+            Node head_;
+            size_t height_;
+            size_t size_;
+            size_t bytes_;
+            std::minstd_rand random_;
+        }; // class logjam::storage::Memtable
+    }; // namespace logjam::storage
+}; // namespace logjam
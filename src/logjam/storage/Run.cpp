@@ -0,0 +1,342 @@
+/*!
+ \file logjam/storage/Run.cpp
+ \brief Logjam immutable sorted run implementation.
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/storage/Run.h"
+#include "lj/Exception.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const uint64_t k_run_magic = 0x4e55524d414a4c4cULL; // "LLJAMRUN"
+    const uint32_t k_run_version = 1;
+    const size_t k_write_buffer_size = 1024 * 1024;
+
+    // Fixed size trailer at the end of every run file.
+    struct Footer
+    {
+        uint64_t count;
+        uint64_t index_offset;
+        uint64_t bloom_offset;
+        uint64_t bloom_size;
+        uint64_t min_key;
+        uint64_t max_key;
+        uint32_t probes;
+        uint32_t version;
+        uint64_t magic;
+    };
+
+    // Dense index entry, one per key.
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t offset;
+    };
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        Run::Writer::Writer(const std::string& path) :
+                path_(path),
+                temp_path_(path + ".tmp"),
+                fd_(-1),
+                offset_(0),
+                buffer_(),
+                keys_(),
+                offsets_()
+        {
+            fd_ = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0)
+            {
+                throw LJ__Exception(std::string("Unable to create run ") +
+                        temp_path_ + ": " + strerror(errno));
+            }
+            buffer_.reserve(k_write_buffer_size);
+        }
+
+        Run::Writer::~Writer()
+        {
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+                unlink(temp_path_.c_str());
+            }
+        }
+
+        void Run::Writer::add(uint64_t key,
+                const uint8_t* bytes,
+                size_t sz)
+        {
+            if (!keys_.empty() && key <= keys_.back())
+            {
+                throw LJ__Exception(std::string("Key out of order in run ") +
+                        path_);
+            }
+            keys_.push_back(key);
+            offsets_.push_back(offset_);
+            write(bytes, sz);
+        }
+
+        size_t Run::Writer::finish()
+        {
+            // Align the index so entries can be read in place.
+            const uint8_t zeros[sizeof(Entry)] = {};
+            write(zeros, (sizeof(uint64_t) - offset_ % sizeof(uint64_t)) % sizeof(uint64_t));
+
+            Footer footer = {};
+            footer.count = keys_.size();
+            footer.index_offset = offset_;
+            for (size_t h = 0; h < keys_.size(); ++h)
+            {
+                Entry entry = {keys_[h], offsets_[h]};
+                write(&entry, sizeof(entry));
+            }
+
+            Bloom bloom(keys_.size());
+            for (uint64_t key : keys_)
+            {
+                bloom.add(key);
+            }
+            footer.bloom_offset = offset_;
+            footer.bloom_size = bloom.data().size();
+            footer.probes = bloom.probes();
+            write(bloom.data().data(), bloom.data().size());
+            write(zeros, (sizeof(uint64_t) - offset_ % sizeof(uint64_t)) % sizeof(uint64_t));
+
+            footer.min_key = keys_.empty() ? 0 : keys_.front();
+            footer.max_key = keys_.empty() ? 0 : keys_.back();
+            footer.version = k_run_version;
+            footer.magic = k_run_magic;
+            write(&footer, sizeof(footer));
+            drain();
+
+            if (fsync(fd_) < 0)
+            {
+                throw LJ__Exception(std::string("Unable to sync run ") +
+                        temp_path_ + ": " + strerror(errno));
+            }
+            ::close(fd_);
+            fd_ = -1;
+            if (rename(temp_path_.c_str(), path_.c_str()) < 0)
+            {
+                int err = errno;
+                unlink(temp_path_.c_str());
+                throw LJ__Exception(std::string("Unable to install run ") +
+                        path_ + ": " + strerror(err));
+            }
+            return offset_;
+        }
+
+        void Run::Writer::write(const void* data,
+                size_t sz)
+        {
+            const uint8_t* ptr = static_cast<const uint8_t*>(data);
+            buffer_.insert(buffer_.end(), ptr, ptr + sz);
+            offset_ += sz;
+            if (buffer_.size() >= k_write_buffer_size)
+            {
+                drain();
+            }
+        }
+
+        void Run::Writer::drain()
+        {
+            size_t done = 0;
+            while (done < buffer_.size())
+            {
+                ssize_t rc = ::write(fd_, buffer_.data() + done, buffer_.size() - done);
+                if (rc < 0)
+                {
+                    if (EINTR == errno)
+                    {
+                        continue;
+                    }
+                    throw LJ__Exception(std::string("Unable to write run ") +
+                            temp_path_ + ": " + strerror(errno));
+                }
+                done += rc;
+            }
+            buffer_.clear();
+        }
+
+        Run::Run(const std::string& path,
+                Buffer_pool* pool) :
+                path_(path),
+                fd_(-1),
+                map_(nullptr),
+                size_(0),
+                count_(0),
+                min_key_(0),
+                max_key_(0),
+                index_(nullptr),
+                bloom_(nullptr, 0, 0),
+                pool_(pool),
+                file_(0),
+                obsolete_(false)
+        {
+            fd_ = ::open(path_.c_str(), O_RDONLY);
+            if (fd_ < 0)
+            {
+                throw LJ__Exception(std::string("Unable to open run ") +
+                        path_ + ": " + strerror(errno));
+            }
+
+            struct stat st;
+            if (fstat(fd_, &st) < 0)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw LJ__Exception(std::string("Unable to stat run ") +
+                        path_ + ": " + strerror(err));
+            }
+            size_ = st.st_size;
+            if (size_ < sizeof(Footer))
+            {
+                ::close(fd_);
+                throw LJ__Exception(std::string("Truncated run ") + path_);
+            }
+
+            void* ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (MAP_FAILED == ptr)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw LJ__Exception(std::string("Unable to map run ") +
+                        path_ + ": " + strerror(err));
+            }
+            map_ = static_cast<uint8_t*>(ptr);
+
+            Footer footer;
+            memcpy(&footer, map_ + size_ - sizeof(Footer), sizeof(Footer));
+            if (k_run_magic != footer.magic ||
+                    k_run_version != footer.version ||
+                    footer.index_offset + footer.count * sizeof(Entry) > footer.bloom_offset ||
+                    footer.bloom_offset + footer.bloom_size > size_ - sizeof(Footer))
+            {
+                munmap(map_, size_);
+                ::close(fd_);
+                throw LJ__Exception(std::string("Damaged run ") + path_);
+            }
+
+            count_ = footer.count;
+            min_key_ = footer.min_key;
+            max_key_ = footer.max_key;
+            index_ = map_ + footer.index_offset;
+            bloom_ = Bloom(map_ + footer.bloom_offset,
+                    footer.bloom_size,
+                    footer.probes);
+
+            if (pool_)
+            {
+                file_ = pool_->attach(map_, size_, fd_);
+            }
+        }
+
+        Run::~Run()
+        {
+            if (pool_)
+            {
+                pool_->detach(file_);
+            }
+            munmap(map_, size_);
+            ::close(fd_);
+            if (obsolete_)
+            {
+                unlink(path_.c_str());
+            }
+        }
+
+        uint64_t Run::key(size_t position) const
+        {
+            Entry entry;
+            memcpy(&entry, index_ + position * sizeof(Entry), sizeof(Entry));
+            return entry.key;
+        }
+
+        const uint8_t* Run::at(size_t position,
+                Buffer_pool::Pin& held) const
+        {
+            Entry entry;
+            memcpy(&entry, index_ + position * sizeof(Entry), sizeof(Entry));
+            const uint8_t* ptr = map_ + entry.offset;
+            if (pool_)
+            {
+                int32_t sz;
+                memcpy(&sz, ptr, sizeof(int32_t));
+                held = pool_->pin(file_, entry.offset, sz);
+            }
+            return ptr;
+        }
+
+        const uint8_t* Run::find(uint64_t key,
+                Buffer_pool::Pin& held) const
+        {
+            if (0 == count_ || key < min_key_ || key > max_key_ ||
+                    !bloom_.may_contain(key))
+            {
+                return nullptr;
+            }
+
+            // Binary search the dense index for the key.
+            size_t first = 0;
+            size_t last = count_;
+            while (first < last)
+            {
+                size_t middle = first + (last - first) / 2;
+                if (this->key(middle) < key)
+                {
+                    first = middle + 1;
+                }
+                else
+                {
+                    last = middle;
+                }
+            }
+            if (first == count_ || this->key(first) != key)
+            {
+                return nullptr;
+            }
+            return at(first, held);
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,251 @@
+#pragma once
+/*!
+ \file logjam/storage/Run.h
+ \brief Logjam immutable sorted run definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Bloom.h"
+#include "logjam/storage/Buffer_pool.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Immutable sorted run of document versions.
+
+         A run file holds one bson document per key, sorted by document
+         key, followed by a dense index of key and offset pairs, a bloom
+         filter over the keys and a fixed size footer. Runs are written
+         once by a Run::Writer and never modified afterwards.
+
+         Lookups consult the bloom filter before searching the index, so
+         a key that is not in the run rarely touches the data pages.
+         \since 1.0
+         */
+        class Run
+        {
+        public:
+            /*!
+             \brief Writer for a new run file.
+
+             The run is written to a temporary file that is synced and
+             renamed into place by #finish(), so a run file either exists
+             complete or not at all.
+             */
+            class Writer
+            {
+            public:
+                /*!
+                 \brief Create the temporary run file.
+                 \param path The path of the finished run.
+                 \throws lj::Exception If the file cannot be created.
+                 */
+                explicit Writer(const std::string& path);
+
+                //! Deleted copy constructor.
+                Writer(const Writer& orig) = delete;
+
+                //! Deleted move constructor.
+                Writer(Writer&& orig) = delete;
+
+                //! Deleted copy assignment operator.
+                Writer& operator=(const Writer& orig) = delete;
+
+                //! Deleted move assignment operator.
+                Writer& operator=(Writer&& orig) = delete;
+
+                //! Destructor. Removes the file if it was not finished.
+                ~Writer();
+
+                /*!
+                 \brief Append a document version.
+
+                 Keys must be added in strictly ascending order.
+                 \param key The document key.
+                 \param bytes The bson document bytes.
+                 \param sz The number of bytes in \c bytes.
+                 \throws lj::Exception If the key is out of order or the
+                 write fails.
+                 */
+                void add(uint64_t key,
+                        const uint8_t* bytes,
+                        size_t sz);
+
+                /*!
+                 \brief Write the index, filter and footer and install the file.
+                 \return The size of the run file in bytes.
+                 \throws lj::Exception If the file cannot be written.
+                 */
+                size_t finish();
+
+                //! Get the number of document bytes added so far.
+                inline size_t size() const
+                {
+                    return offset_;
+                }
+
+                //! Get the number of keys added so far.
+                inline size_t count() const
+                {
+                    return keys_.size();
+                }
+
+            private:
+                void write(const void* data,
+                        size_t sz);
+                void drain();
+
+                std::string path_;
+                std::string temp_path_;
+                int fd_;
+                size_t offset_;
+                std::vector<uint8_t> buffer_;
+                std::vector<uint64_t> keys_;
+                std::vector<uint64_t> offsets_;
+            }; // class logjam::storage::Run::Writer
+
+            /*!
+             \brief Open a finished run file.
+             \param path The path of the run file.
+             \param pool The page cache, or nullptr to skip caching.
+             \throws lj::Exception If the file cannot be mapped or is not
+             a complete run.
+             */
+            Run(const std::string& path,
+                    Buffer_pool* pool = nullptr);
+
+            //! Deleted copy constructor.
+            Run(const Run& orig) = delete;
+
+            //! Deleted move constructor.
+            Run(Run&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Run& operator=(const Run& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Run& operator=(Run&& orig) = delete;
+
+            //! Destructor. Removes the file if the run is obsolete.
+            ~Run();
+
+            //! Get the path of the run file.
+            inline const std::string& path() const
+            {
+                return path_;
+            }
+
+            //! Get the size of the run file in bytes.
+            inline size_t size() const
+            {
+                return size_;
+            }
+
+            //! Get the number of keys in the run.
+            inline size_t count() const
+            {
+                return count_;
+            }
+
+            //! Get the smallest key in the run.
+            inline uint64_t min_key() const
+            {
+                return min_key_;
+            }
+
+            //! Get the largest key in the run.
+            inline uint64_t max_key() const
+            {
+                return max_key_;
+            }
+
+            //! Get the key at a position in the run.
+            uint64_t key(size_t position) const;
+
+            /*!
+             \brief Get the bson bytes at a position in the run.
+             \param position The position, less than #count().
+             \param held Receives the pin on the document pages.
+             \return Pointer into the mapping.
+             */
+            const uint8_t* at(size_t position,
+                    Buffer_pool::Pin& held) const;
+
+            /*!
+             \brief Find the bson bytes stored for a key.
+             \param key The document key.
+             \param held Receives the pin on the document pages.
+             \return Pointer into the mapping, or nullptr if not found.
+             */
+            const uint8_t* find(uint64_t key,
+                    Buffer_pool::Pin& held) const;
+
+            //! Test if the key range of the run overlaps a range.
+            inline bool overlaps(uint64_t first,
+                    uint64_t last) const
+            {
+                return min_key_ <= last && first <= max_key_;
+            }
+
+            /*!
+             \brief Mark the run as replaced.
+
+             The file is removed once the run is destroyed, which happens
+             when the last reader lets go of it.
+             */
+            inline void obsolete()
+            {
+                obsolete_ = true;
+            }
+
+        private:
+            std::string path_;
+            int fd_;
+            uint8_t* map_;
+            size_t size_;
+            size_t count_;
+            uint64_t min_key_;
+            uint64_t max_key_;
+            const uint8_t* index_;
+            Bloom bloom_;
+            Buffer_pool* pool_;
+            uint32_t file_;
+            bool obsolete_;
+        }; // class logjam::storage::Run
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,218 @@
+/*!
+ \file logjam/storage/Segment.cpp
+ \brief Logjam append-only segment file implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Segment.h"
+#include "lj/Exception.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t k_bson_minimum_size = 5;
+
+    // Find the end of the record starting at offset. A record is only
+    // valid if it fits, starts with an element (unless it is empty) and
+    // carries the bson document terminator. Anything else is the zero
+    // filled tail or a torn write, and offset is returned.
+    size_t record_end(const uint8_t* map,
+            size_t limit,
+            size_t offset)
+    {
+        if (limit - offset < k_bson_minimum_size)
+        {
+            return offset;
+        }
+
+        int32_t sz;
+        memcpy(&sz, map + offset, sizeof(int32_t));
+        if (sz < static_cast<int32_t>(k_bson_minimum_size) ||
+                static_cast<size_t>(sz) > limit - offset ||
+                map[offset + sz - 1] != 0 ||
+                (0 == map[offset + sizeof(int32_t)]) != (k_bson_minimum_size == static_cast<size_t>(sz)))
+        {
+            return offset;
+        }
+        return offset + sz;
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        const size_t Segment::k_default_capacity = 64 * 1024 * 1024;
+
+        Segment::Segment(const std::string& path,
+                size_t capacity,
+                Buffer_pool* pool) :
+                path_(path),
+                fd_(-1),
+                map_(nullptr),
+                capacity_(capacity),
+                size_(0),
+                pool_(pool),
+                file_(0)
+        {
+            fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0)
+            {
+                throw LJ__Exception(std::string("Unable to open segment ") +
+                        path_ + ": " + strerror(errno));
+            }
+
+            struct stat st;
+            if (fstat(fd_, &st) < 0)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw LJ__Exception(std::string("Unable to stat segment ") +
+                        path_ + ": " + strerror(err));
+            }
+
+            if (static_cast<size_t>(st.st_size) > capacity_)
+            {
+                capacity_ = st.st_size;
+            }
+            else if (static_cast<size_t>(st.st_size) < capacity_ &&
+                    ftruncate(fd_, capacity_) < 0)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw LJ__Exception(std::string("Unable to size segment ") +
+                        path_ + ": " + strerror(err));
+            }
+
+            void* ptr = mmap(nullptr,
+                    capacity_,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    fd_,
+                    0);
+            if (MAP_FAILED == ptr)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw LJ__Exception(std::string("Unable to map segment ") +
+                        path_ + ": " + strerror(err));
+            }
+            map_ = static_cast<uint8_t*>(ptr);
+
+            // Walk the existing records to find the end of the log.
+            size_t offset = 0;
+            while (offset < capacity_)
+            {
+                size_t nxt = record_end(map_, capacity_, offset);
+                if (nxt == offset)
+                {
+                    break;
+                }
+                offset = nxt;
+            }
+            size_ = offset;
+
+            if (pool_)
+            {
+                file_ = pool_->attach(map_, capacity_, fd_);
+            }
+        }
+
+        Segment::~Segment()
+        {
+            if (pool_)
+            {
+                pool_->detach(file_);
+            }
+            if (map_)
+            {
+                msync(map_, size_, MS_SYNC);
+                munmap(map_, capacity_);
+            }
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+            }
+        }
+
+        size_t Segment::append(const uint8_t* data,
+                size_t sz)
+        {
+            if (!fits(sz))
+            {
+                throw LJ__Exception(std::string("Record does not fit in segment ") +
+                        path_);
+            }
+
+            size_t offset = size_;
+            memcpy(map_ + offset, data, sz);
+            size_ += sz;
+            return offset;
+        }
+
+        size_t Segment::next(size_t offset) const
+        {
+            if (offset >= size_)
+            {
+                return size_;
+            }
+            return record_end(map_, size_, offset);
+        }
+
+        Buffer_pool::Pin Segment::pin(size_t offset) const
+        {
+            if (!pool_ || offset >= size_)
+            {
+                return Buffer_pool::Pin();
+            }
+
+            int32_t sz;
+            memcpy(&sz, map_ + offset, sizeof(int32_t));
+            return pool_->pin(file_, offset, static_cast<size_t>(sz));
+        }
+
+        void Segment::sync()
+        {
+            if (msync(map_, size_, MS_SYNC) < 0)
+            {
+                throw LJ__Exception(std::string("Unable to sync segment ") +
+                        path_ + ": " + strerror(errno));
+            }
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,175 @@
+#pragma once
+/*!
+ \file logjam/storage/Segment.h
+ \brief Logjam append-only segment file definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Buffer_pool.h"
+
+#include <cstdint>
+#include <string>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Append-only file of serialized bson documents.
+
+         A segment is a fixed capacity file that is mapped into memory
+         once when it is opened. Documents are appended back to back
+         without any additional framing; the bson length prefix is
+         enough to walk the records. The unused tail of the file is zero
+         filled, which is how the end of the log is found when an
+         existing segment is reopened.
+
+         Because the mapping is never moved, pointers returned by
+         #at(size_t) remain valid for the life of the segment. Reads that
+         go through #pin(size_t) are tracked by the buffer pool.
+         \since 1.0
+         */
+        class Segment
+        {
+        public:
+            //! Capacity used for new segments.
+            static const size_t k_default_capacity;
+
+            /*!
+             \brief Open or create a segment.
+
+             Existing files are scanned to find the end of the log. A
+             partially written record at the end of the file is ignored
+             and will be overwritten by the next append.
+             \param path The path of the segment file.
+             \param capacity The minimum capacity of the segment.
+             \param pool The page cache, or nullptr to leave the mapping
+             to the kernel.
+             \throws lj::Exception If the file cannot be opened or mapped.
+             */
+            Segment(const std::string& path,
+                    size_t capacity,
+                    Buffer_pool* pool = nullptr);
+
+            //! Deleted copy constructor.
+            Segment(const Segment& orig) = delete;
+
+            //! Deleted move constructor.
+            Segment(Segment&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Segment& operator=(const Segment& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Segment& operator=(Segment&& orig) = delete;
+
+            //! Destructor.
+            ~Segment();
+
+            //! Get the path of the segment file.
+            inline const std::string& path() const
+            {
+                return path_;
+            }
+
+            //! Get the number of bytes used in the segment.
+            inline size_t size() const
+            {
+                return size_;
+            }
+
+            //! Get the total number of bytes available in the segment.
+            inline size_t capacity() const
+            {
+                return capacity_;
+            }
+
+            /*!
+             \brief Test if a record will fit in the remaining space.
+             \param sz The size of the record.
+             \return True if the record can be appended.
+             */
+            inline bool fits(size_t sz) const
+            {
+                return capacity_ - size_ >= sz;
+            }
+
+            /*!
+             \brief Append a serialized bson document.
+             \param data The bson document bytes.
+             \param sz The number of bytes in \c data.
+             \return The offset of the record in the segment.
+             \throws lj::Exception If the record does not fit.
+             */
+            size_t append(const uint8_t* data,
+                    size_t sz);
+
+            /*!
+             \brief Get the record stored at an offset.
+
+             The returned pointer refers directly to the mapped file.
+             \param offset The offset returned by #append.
+             \return Pointer to the bson document bytes.
+             */
+            inline const uint8_t* at(size_t offset) const
+            {
+                return map_ + offset;
+            }
+
+            /*!
+             \brief Get the offset of the record following \c offset.
+             \param offset The offset of an existing record.
+             \return The next offset, equal to #size() at the end.
+             */
+            size_t next(size_t offset) const;
+
+            /*!
+             \brief Pin the pages of a record in the buffer pool.
+             \param offset The offset of an existing record.
+             \return The pin, which holds nothing without a pool.
+             */
+            Buffer_pool::Pin pin(size_t offset) const;
+
+            //! Flush appended records to disk.
+            void sync();
+
+        private:
+            std::string path_;
+            int fd_;
+            uint8_t* map_;
+            size_t capacity_;
+            size_t size_;
+            Buffer_pool* pool_;
+            uint32_t file_;
+        }; // class logjam::storage::Segment
+    }; // namespace logjam::storage
+}; // namespace logjam
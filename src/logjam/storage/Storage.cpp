@@ -0,0 +1,1019 @@
+/*!
+ \file logjam/storage/Storage.cpp
+ \brief Logjam log-structured document storage implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Storage.h"
+#include "lj/Exception.h"
+#include "lj/Log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    void make_directory(const std::string& path)
+    {
+        if (mkdir(path.c_str(), 0755) < 0 && EEXIST != errno)
+        {
+            throw LJ__Exception(std::string("Unable to create directory ") +
+                    path + ": " + strerror(errno));
+        }
+    }
+
+    // The pin is released when the last copy of the view goes away.
+    lj::bson::View pinned_view(const uint8_t* ptr,
+            const std::shared_ptr<logjam::storage::Buffer_pool::Pin>& held)
+    {
+        if (!ptr)
+        {
+            return lj::bson::View();
+        }
+        return lj::bson::View(std::shared_ptr<const uint8_t>(ptr,
+                [held](const uint8_t*) {}));
+    }
+
+    // Copy each version held by a record, without its siblings.
+    void split(const lj::bson::Node& record,
+            std::vector<std::unique_ptr<lj::bson::Node>>& out)
+    {
+        out.emplace_back(new lj::bson::Node(record));
+        out.back()->set_child(lj::Document::k_path_siblings, nullptr);
+        if (record.exists(lj::Document::k_path_siblings))
+        {
+            for (const lj::bson::Node* sibling : record.nav(lj::Document::k_path_siblings).to_vector())
+            {
+                out.emplace_back(new lj::bson::Node(*sibling));
+                out.back()->set_child(lj::Document::k_path_siblings, nullptr);
+            }
+        }
+    }
+
+    int64_t updates(const lj::bson::Node& version)
+    {
+        int64_t total = 0;
+        const lj::bson::Node& clock = version.nav(lj::Document::k_path_vclock);
+        for (auto iter = clock.begin(); clock.end() != iter; ++iter)
+        {
+            total += lj::bson::as_int64(*iter);
+        }
+        return total;
+    }
+
+    // Order concurrent versions the same way on every server: most
+    // updates first, then by data, then by clock.
+    bool precedes(const std::unique_ptr<lj::bson::Node>& left,
+            const std::unique_ptr<lj::bson::Node>& right)
+    {
+        int64_t l = updates(*left);
+        int64_t r = updates(*right);
+        if (l != r)
+        {
+            return l > r;
+        }
+        uint8_t left_hash[lj::bson::k_content_hash_size];
+        uint8_t right_hash[lj::bson::k_content_hash_size];
+        lj::bson::content_hash(left->nav(lj::Document::k_path_data), left_hash);
+        lj::bson::content_hash(right->nav(lj::Document::k_path_data), right_hash);
+        int cmp = memcmp(left_hash, right_hash, sizeof(left_hash));
+        if (0 != cmp)
+        {
+            return cmp > 0;
+        }
+        return lj::bson::as_json_string(left->nav(lj::Document::k_path_vclock)) >
+                lj::bson::as_json_string(right->nav(lj::Document::k_path_vclock));
+    }
+
+    bool valid_name(const std::string& name)
+    {
+        if (name.empty())
+        {
+            return false;
+        }
+        for (char c : name)
+        {
+            if (!isalnum(static_cast<unsigned char>(c)) && '_' != c && '-' != c)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        Collection::Snapshot::Snapshot() :
+                collection_(nullptr),
+                sequence_(0)
+        {
+        }
+
+        Collection::Snapshot::Snapshot(const Collection* collection,
+                uint64_t sequence) :
+                collection_(collection),
+                sequence_(sequence)
+        {
+        }
+
+        Collection::Snapshot::Snapshot(Snapshot&& orig) :
+                collection_(orig.collection_),
+                sequence_(orig.sequence_)
+        {
+            orig.collection_ = nullptr;
+        }
+
+        Collection::Snapshot& Collection::Snapshot::operator=(Snapshot&& orig)
+        {
+            if (this != &orig)
+            {
+                release();
+                collection_ = orig.collection_;
+                sequence_ = orig.sequence_;
+                orig.collection_ = nullptr;
+            }
+            return *this;
+        }
+
+        Collection::Snapshot::~Snapshot()
+        {
+            release();
+        }
+
+        void Collection::Snapshot::release()
+        {
+            if (collection_)
+            {
+                collection_->release(sequence_);
+                collection_ = nullptr;
+            }
+        }
+
+        Collection::Collection(const std::string& name,
+                const std::string& directory,
+                size_t capacity,
+                Wal* wal,
+                Buffer_pool* pool) :
+                name_(name),
+                directory_(directory),
+                capacity_(capacity),
+                wal_(wal),
+                pool_(pool),
+                indexes_(),
+                segments_(),
+                keys_(),
+                versioned_(),
+                ids_(),
+                sequence_(0),
+                snapshots_(),
+                released_(false),
+                mutex_()
+        {
+            make_directory(directory_);
+
+            // Reopen the existing segments in order and rebuild the
+            // indexes from their contents.
+            for (size_t number = 0;
+                    0 == access(segment_path(number).c_str(), F_OK);
+                    ++number)
+            {
+                segments_.emplace_back(new Segment(segment_path(number),
+                        capacity_,
+                        pool_));
+                const Segment& seg = *segments_.back();
+                for (size_t offset = 0;
+                        offset < seg.size();
+                        offset = seg.next(offset))
+                {
+                    lj::bson::Node doc(lj::bson::Type::k_document,
+                            seg.at(offset));
+                    const lj::bson::Node* key = doc.path("_/key");
+                    const lj::bson::Node* id = doc.path("_/id");
+                    if (!key || !id)
+                    {
+                        lj::log::format<lj::Warning>("Skipping record without keys at %s:%d.")
+                                << seg.path()
+                                << offset
+                                << lj::log::end;
+                        continue;
+                    }
+                    index(Location{number, offset},
+                            lj::bson::as_uint64(*key),
+                            lj::bson::as_uuid(*id));
+                    trim(lj::bson::as_uint64(*key));
+                }
+            }
+
+            lj::log::format<lj::Info>("Opened collection %s with %d segments and %d keys.")
+                    << name_
+                    << segments_.size()
+                    << keys_.size()
+                    << lj::log::end;
+        }
+
+        uint64_t Collection::store(const lj::Document& doc)
+        {
+            size_t sz;
+            std::unique_ptr<uint8_t[]> bytes(doc.root().to_binary(&sz));
+            uint64_t key = doc.key();
+            lj::Uuid id = doc.id();
+
+            // The log append and the segment append happen under the same
+            // lock, so syncing the collection covers every logged record.
+            std::lock_guard<std::mutex> lock(mutex_);
+            uint64_t lsn = wal_ ? wal_->append(name_, bytes.get(), sz) : 0;
+            append(bytes.get(), sz, key, id);
+            return lsn;
+        }
+
+        bool Collection::restore(const uint8_t* bytes)
+        {
+            lj::bson::Node doc(lj::bson::Type::k_document, bytes);
+            uint64_t key = lj::bson::as_uint64(doc["_/key"]);
+            lj::Uuid id = lj::bson::as_uuid(doc["_/id"]);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ids_.end() != ids_.find(id))
+            {
+                return false;
+            }
+            append(bytes, doc.size(), key, id);
+            return true;
+        }
+
+        Collection::Reconciled Collection::reconcile(const lj::bson::Node& doc,
+                uint64_t& lsn)
+        {
+            lsn = 0;
+            const uint64_t key = lj::bson::as_uint64(doc.nav(lj::Document::k_path_key));
+            std::vector<std::unique_ptr<lj::bson::Node>> incoming;
+            split(doc, incoming);
+
+            // The current versions are read and replaced under one lock so
+            // a concurrent store cannot slip in between.
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<std::unique_ptr<lj::bson::Node>> versions;
+            std::unique_ptr<lj::bson::Node> current;
+            const Location* loc = visible(key, UINT64_MAX);
+            if (loc)
+            {
+                current.reset(new lj::bson::Node(lj::bson::Type::k_document,
+                        resolve(*loc)));
+                split(*current, versions);
+            }
+
+            // The kept versions never descend from one another, so an
+            // incoming version is either known or replaces the ones it
+            // descends from.
+            bool changed = false;
+            for (auto& version : incoming)
+            {
+                const lj::bson::Node& clock = version->nav(lj::Document::k_path_vclock);
+                bool known = false;
+                for (auto iter = versions.begin(); versions.end() != iter;)
+                {
+                    lj::Document::Order order = lj::Document::compare(clock,
+                            (*iter)->nav(lj::Document::k_path_vclock));
+                    if (lj::Document::Order::k_before == order ||
+                            lj::Document::Order::k_equal == order)
+                    {
+                        known = true;
+                        break;
+                    }
+                    else if (lj::Document::Order::k_after == order)
+                    {
+                        iter = versions.erase(iter);
+                    }
+                    else
+                    {
+                        ++iter;
+                    }
+                }
+                if (!known)
+                {
+                    versions.push_back(std::move(version));
+                    changed = true;
+                }
+            }
+            if (!changed)
+            {
+                return Reconciled::k_stale;
+            }
+
+            std::sort(versions.begin(), versions.end(), precedes);
+
+            // A merged record is identified by its key and the versions it
+            // holds, so every replica gives the same merge the same id and
+            // two merges of one key never share an id.
+            std::string merged;
+            for (int shift = 56; 0 <= shift; shift -= 8)
+            {
+                merged.push_back(static_cast<char>((key >> shift) & 0xff));
+            }
+            for (const auto& version : versions)
+            {
+                size_t sz;
+                const lj::Uuid id(lj::bson::as_uuid(version->nav(lj::Document::k_path_id)));
+                const uint8_t* bytes = id.data(&sz);
+                merged.append(reinterpret_cast<const char*>(bytes), sz);
+            }
+
+            std::unique_ptr<lj::bson::Node> record(std::move(versions.front()));
+            if (1 < versions.size())
+            {
+                record->set_child(lj::Document::k_path_siblings,
+                        new lj::bson::Node(lj::bson::Type::k_array, nullptr));
+                for (size_t h = 1; h < versions.size(); ++h)
+                {
+                    record->push_child(lj::Document::k_path_siblings,
+                            versions[h].release());
+                }
+
+                // The merged record is a new version of the key.
+                record->set_child(lj::Document::k_path_parent, current ?
+                        new lj::bson::Node(current->nav(lj::Document::k_path_id)) :
+                        lj::bson::new_null());
+                record->set_child(lj::Document::k_path_id,
+                        lj::bson::new_uuid(lj::Uuid(lj::Uuid::k_nil, merged)));
+            }
+
+            size_t sz;
+            std::unique_ptr<uint8_t[]> bytes(record->to_binary(&sz));
+            lsn = wal_ ? wal_->append(name_, bytes.get(), sz) : 0;
+            append(bytes.get(),
+                    sz,
+                    key,
+                    lj::bson::as_uuid(record->nav(lj::Document::k_path_id)));
+            return (1 < versions.size()) ?
+                    Reconciled::k_conflict :
+                    Reconciled::k_applied;
+        }
+
+        uint64_t Collection::changes(uint64_t since,
+                size_t limit,
+                size_t max_bytes,
+                const Change_function& fn) const
+        {
+            // The documents are visited without the lock; the pointers stay
+            // valid because records are never rewritten.
+            std::vector<std::pair<uint64_t, const uint8_t*>> found;
+            {
+                Buffer_pool::Pin held;
+                std::lock_guard<std::mutex> lock(mutex_);
+                size_t bytes = 0;
+                for (auto iter = changes_.upper_bound(since);
+                        changes_.end() != iter && found.size() < limit;
+                        ++iter)
+                {
+                    const Version& version = keys_.find(iter->second)->second.back();
+                    const uint8_t* doc = resolve(version.location, held);
+                    bytes += lj::bson::type_value_size(lj::bson::Type::k_document, doc);
+                    if (bytes > max_bytes && !found.empty())
+                    {
+                        break;
+                    }
+                    found.emplace_back(iter->first, doc);
+                }
+            }
+
+            for (const auto& change : found)
+            {
+                fn(change.second);
+            }
+            return found.empty() ? since : found.back().first;
+        }
+
+        const uint8_t* Collection::read(const uint64_t key) const
+        {
+            return read(key, Snapshot());
+        }
+
+        const uint8_t* Collection::read(const uint64_t key,
+                const Snapshot& snapshot) const
+        {
+            // The pin only records the access; the pointer outlives it.
+            Buffer_pool::Pin held;
+            uint64_t sequence = sequence_of(snapshot);
+            std::lock_guard<std::mutex> lock(mutex_);
+            const Location* loc = visible(key, sequence);
+            return loc ? resolve(*loc, held) : nullptr;
+        }
+
+        const uint8_t* Collection::read(const lj::Uuid& id) const
+        {
+            Buffer_pool::Pin held;
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto iter = ids_.find(id);
+            return (ids_.end() == iter) ? nullptr : resolve(iter->second, held);
+        }
+
+        lj::bson::Node* Collection::fetch(const uint64_t key) const
+        {
+            return fetch(key, Snapshot());
+        }
+
+        lj::bson::Node* Collection::fetch(const uint64_t key,
+                const Snapshot& snapshot) const
+        {
+            Buffer_pool::Pin held;
+            const uint8_t* ptr = nullptr;
+            uint64_t sequence = sequence_of(snapshot);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                const Location* loc = visible(key, sequence);
+                if (loc)
+                {
+                    ptr = resolve(*loc, held);
+                }
+            }
+            return ptr ?
+                    new lj::bson::Node(lj::bson::Type::k_binary_document, ptr) :
+                    nullptr;
+        }
+
+        lj::bson::Node* Collection::fetch(const lj::Uuid& id) const
+        {
+            Buffer_pool::Pin held;
+            const uint8_t* ptr = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto iter = ids_.find(id);
+                if (ids_.end() != iter)
+                {
+                    ptr = resolve(iter->second, held);
+                }
+            }
+            return ptr ?
+                    new lj::bson::Node(lj::bson::Type::k_binary_document, ptr) :
+                    nullptr;
+        }
+
+        lj::bson::View Collection::view(const uint64_t key) const
+        {
+            return view(key, Snapshot());
+        }
+
+        lj::bson::View Collection::view(const uint64_t key,
+                const Snapshot& snapshot) const
+        {
+            std::shared_ptr<Buffer_pool::Pin> held(new Buffer_pool::Pin());
+            const uint8_t* ptr = nullptr;
+            uint64_t sequence = sequence_of(snapshot);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                const Location* loc = visible(key, sequence);
+                if (loc)
+                {
+                    ptr = resolve(*loc, *held);
+                }
+            }
+            return pinned_view(ptr, held);
+        }
+
+        lj::bson::View Collection::view(const lj::Uuid& id) const
+        {
+            std::shared_ptr<Buffer_pool::Pin> held(new Buffer_pool::Pin());
+            const uint8_t* ptr = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto iter = ids_.find(id);
+                if (ids_.end() != iter)
+                {
+                    ptr = resolve(iter->second, *held);
+                }
+            }
+            return pinned_view(ptr, held);
+        }
+
+        size_t Collection::size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return keys_.size();
+        }
+
+        size_t Collection::retained() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t count = 0;
+            for (uint64_t key : versioned_)
+            {
+                count += keys_.find(key)->second.size() - 1;
+            }
+            return count;
+        }
+
+        Collection::Snapshot Collection::snapshot() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            snapshots_.insert(sequence_);
+            return Snapshot(this, sequence_);
+        }
+
+        void Collection::add_index(const std::string& name,
+                const std::string& field)
+        {
+            if (!valid_name(name))
+            {
+                throw LJ__Exception(std::string("Invalid index name: ") +
+                        name);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (indexes_.end() != indexes_.find(name))
+            {
+                throw LJ__Exception(std::string("Index already exists: ") +
+                        name);
+            }
+
+            std::unique_ptr<Index> idx(new Index(name,
+                    field,
+                    directory_ + "/" + name + ".idx",
+                    pool_));
+            if (!idx->valid())
+            {
+                // Versions still visible to a snapshot are indexed too.
+                for (const auto& chain : keys_)
+                {
+                    for (const Version& version : chain.second)
+                    {
+                        idx->add(resolve(version.location), chain.first);
+                    }
+                }
+                lj::log::format<lj::Info>("Rebuilt index %s on %s/%s with %d entries.")
+                        << name
+                        << name_
+                        << field
+                        << idx->size()
+                        << lj::log::end;
+            }
+            indexes_.emplace(name, std::move(idx));
+        }
+
+        bool Collection::has_index(const std::string& name) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return indexes_.end() != indexes_.find(name);
+        }
+
+        size_t Collection::scan(const std::string& name,
+                const lj::bson::Node* lower,
+                const lj::bson::Node* upper,
+                const Index::Scan_function& fn) const
+        {
+            Snapshot snap(snapshot());
+            return scan(name, lower, upper, fn, snap);
+        }
+
+        size_t Collection::scan(const std::string& name,
+                const lj::bson::Node* lower,
+                const lj::bson::Node* upper,
+                const Index::Scan_function& fn,
+                const Snapshot& snapshot) const
+        {
+            uint64_t sequence = sequence_of(snapshot);
+
+            // Only collecting the entries needs the lock. Entries of
+            // versions the snapshot cannot see are dropped by matches().
+            const Index* idx = nullptr;
+            std::vector<Btree::Key> found;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto iter = indexes_.find(name);
+                if (indexes_.end() == iter)
+                {
+                    throw LJ__Exception(std::string("Unknown index ") +
+                            name + " on collection " + name_);
+                }
+                idx = iter->second.get();
+                idx->entries(lower, upper, found);
+            }
+
+            size_t visited = 0;
+            for (const Btree::Key& k : found)
+            {
+                // Each document stays pinned while it is passed to fn.
+                Buffer_pool::Pin held;
+                const uint8_t* doc = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    const Location* loc = visible(k.record, sequence);
+                    if (loc)
+                    {
+                        doc = resolve(*loc, held);
+                    }
+                }
+                if (!doc || !idx->matches(k, doc, lower, upper))
+                {
+                    continue;
+                }
+                ++visited;
+                if (!fn(doc))
+                {
+                    break;
+                }
+            }
+            return visited;
+        }
+
+        void Collection::sync()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& seg : segments_)
+            {
+                seg->sync();
+            }
+            for (auto& idx : indexes_)
+            {
+                idx.second->sync();
+            }
+        }
+
+        void Collection::append(const uint8_t* bytes,
+                size_t sz,
+                const uint64_t key,
+                const lj::Uuid& id)
+        {
+            if (segments_.empty() || !segments_.back()->fits(sz))
+            {
+                size_t number = segments_.size();
+                segments_.emplace_back(new Segment(segment_path(number),
+                        std::max(capacity_, sz),
+                        pool_));
+            }
+            size_t number = segments_.size() - 1;
+            size_t offset = segments_.back()->append(bytes, sz);
+
+            // Index the new version, then drop whatever versions of the
+            // key no snapshot can see any more.
+            collect();
+            index(Location{number, offset}, key, id);
+            const uint8_t* current = segments_.back()->at(offset);
+            for (auto& idx : indexes_)
+            {
+                idx.second->add(current, key);
+            }
+            trim(key);
+        }
+
+        void Collection::index(const Location& loc,
+                const uint64_t key,
+                const lj::Uuid& id)
+        {
+            // Later versions are chained after earlier ones by key, and
+            // every version remains reachable by id.
+            std::vector<Version>& chain = keys_[key];
+            if (!chain.empty())
+            {
+                changes_.erase(chain.back().sequence);
+            }
+            chain.push_back(Version{++sequence_, loc});
+            changes_[sequence_] = key;
+            ids_[id] = loc;
+        }
+
+        void Collection::trim(const uint64_t key)
+        {
+            auto iter = keys_.find(key);
+            std::vector<Version>& chain = iter->second;
+
+            // An older version is needed while a snapshot was taken after
+            // it was written but before the next version replaced it.
+            std::vector<Version> kept;
+            std::vector<Version> dropped;
+            for (size_t h = 0; h + 1 < chain.size(); ++h)
+            {
+                auto reader = snapshots_.lower_bound(chain[h].sequence);
+                if (snapshots_.end() != reader && *reader < chain[h + 1].sequence)
+                {
+                    kept.push_back(chain[h]);
+                }
+                else
+                {
+                    dropped.push_back(chain[h]);
+                }
+            }
+            if (dropped.empty())
+            {
+                if (1 < chain.size())
+                {
+                    versioned_.insert(key);
+                }
+                return;
+            }
+            kept.push_back(chain.back());
+            chain.swap(kept);
+
+            if (!indexes_.empty())
+            {
+                std::vector<const uint8_t*> retained;
+                for (const Version& version : chain)
+                {
+                    retained.push_back(resolve(version.location));
+                }
+                for (const Version& version : dropped)
+                {
+                    const uint8_t* doc = resolve(version.location);
+                    for (auto& idx : indexes_)
+                    {
+                        idx.second->remove(doc, key, retained);
+                    }
+                }
+            }
+
+            if (1 < chain.size())
+            {
+                versioned_.insert(key);
+            }
+            else
+            {
+                versioned_.erase(key);
+            }
+        }
+
+        void Collection::collect()
+        {
+            // Snapshots are released without the writer's help, so the
+            // chains they pinned are trimmed by the next append.
+            if (!released_)
+            {
+                return;
+            }
+            released_ = false;
+            std::vector<uint64_t> keys(versioned_.begin(), versioned_.end());
+            for (uint64_t key : keys)
+            {
+                trim(key);
+            }
+        }
+
+        void Collection::release(uint64_t sequence) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            snapshots_.erase(snapshots_.find(sequence));
+            released_ = true;
+        }
+
+        uint64_t Collection::sequence_of(const Snapshot& snapshot) const
+        {
+            if (!snapshot)
+            {
+                return UINT64_MAX;
+            }
+            if (this != snapshot.collection_)
+            {
+                throw LJ__Exception(std::string("Snapshot does not belong to collection ") +
+                        name_);
+            }
+            return snapshot.sequence_;
+        }
+
+        const Collection::Location* Collection::visible(const uint64_t key,
+                uint64_t sequence) const
+        {
+            auto iter = keys_.find(key);
+            if (keys_.end() == iter)
+            {
+                return nullptr;
+            }
+            const std::vector<Version>& chain = iter->second;
+            for (auto version = chain.rbegin(); chain.rend() != version; ++version)
+            {
+                if (version->sequence <= sequence)
+                {
+                    return &version->location;
+                }
+            }
+            return nullptr;
+        }
+
+        const uint8_t* Collection::resolve(const Location& loc) const
+        {
+            return segments_[loc.segment]->at(loc.offset);
+        }
+
+        const uint8_t* Collection::resolve(const Location& loc,
+                Buffer_pool::Pin& held) const
+        {
+            held = segments_[loc.segment]->pin(loc.offset);
+            return segments_[loc.segment]->at(loc.offset);
+        }
+
+        std::string Collection::segment_path(size_t number) const
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "/%08llu.seg",
+                    static_cast<unsigned long long>(number));
+            return directory_ + buffer;
+        }
+
+        Storage::Storage(const std::string& directory,
+                std::chrono::milliseconds flush_interval,
+                size_t batch_size,
+                size_t capacity,
+                size_t cache_size) :
+                directory_(directory),
+                capacity_(capacity),
+                pool_(new Buffer_pool(cache_size)),
+                collections_(),
+                lsm_collections_(),
+                mutex_(),
+                wal_()
+        {
+            make_directory(directory_);
+            wal_.reset(new Wal(directory_ + "/wal",
+                    flush_interval,
+                    batch_size,
+                    [this]() { sync(); }));
+        }
+
+        Collection& Storage::collection(const std::string& name)
+        {
+            if (!valid_name(name))
+            {
+                throw LJ__Exception(std::string("Invalid collection name: ") +
+                        name);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (lsm_collections_.end() != lsm_collections_.find(name))
+            {
+                throw LJ__Exception(std::string("Collection is an LSM collection: ") +
+                        name);
+            }
+            auto iter = collections_.find(name);
+            if (collections_.end() == iter)
+            {
+                iter = collections_.emplace(name,
+                        std::unique_ptr<Collection>(new Collection(name,
+                                directory_ + "/" + name,
+                                capacity_,
+                                wal_.get(),
+                                pool_.get()))).first;
+            }
+            return *iter->second;
+        }
+
+        Lsm_collection& Storage::lsm(const std::string& name)
+        {
+            if (!valid_name(name))
+            {
+                throw LJ__Exception(std::string("Invalid collection name: ") +
+                        name);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (collections_.end() != collections_.find(name))
+            {
+                throw LJ__Exception(std::string("Collection is not an LSM collection: ") +
+                        name);
+            }
+            auto iter = lsm_collections_.find(name);
+            if (lsm_collections_.end() == iter)
+            {
+                iter = lsm_collections_.emplace(name,
+                        std::unique_ptr<Lsm_collection>(new Lsm_collection(name,
+                                directory_ + "/" + name,
+                                wal_.get(),
+                                pool_.get()))).first;
+            }
+            return *iter->second;
+        }
+
+        bool Storage::is_lsm(const std::string& name) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return lsm_collections_.end() != lsm_collections_.find(name);
+        }
+
+        std::vector<std::string> Storage::names() const
+        {
+            std::set<std::string> found;
+            DIR* dir = opendir(directory_.c_str());
+            if (dir)
+            {
+                for (struct dirent* entry = readdir(dir);
+                        entry;
+                        entry = readdir(dir))
+                {
+                    std::string name(entry->d_name);
+                    std::string first(directory_ + "/" + name + "/00000000.seg");
+                    if (valid_name(name) && 0 == access(first.c_str(), F_OK))
+                    {
+                        found.insert(name);
+                    }
+                }
+                closedir(dir);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& coll : collections_)
+            {
+                found.insert(coll.first);
+            }
+            for (const auto& coll : lsm_collections_)
+            {
+                found.erase(coll.first);
+            }
+            return std::vector<std::string>(found.begin(), found.end());
+        }
+
+        void Storage::wait(uint64_t lsn)
+        {
+            if (0 < lsn)
+            {
+                wal_->wait(lsn);
+            }
+        }
+
+        size_t Storage::recover()
+        {
+            size_t count = 0;
+            wal_->replay([this, &count](const std::string& name,
+                    const uint8_t* bytes) {
+                bool added = is_lsm(name) ?
+                        lsm(name).restore(bytes) :
+                        collection(name).restore(bytes);
+                if (added)
+                {
+                    ++count;
+                }
+            });
+
+            // The recovered records are only in the segments and memtables
+            // now, so they must be synced before the old log files are
+            // removed.
+            sync();
+            wal_->checkpoint();
+
+            lj::log::format<lj::Info>("Recovered %d document versions from the log.")
+                    << count
+                    << lj::log::end;
+            return count;
+        }
+
+        void Storage::sync()
+        {
+            // Collections are never removed, so they can be synced without
+            // holding the lock that guards opening new ones.
+            std::vector<Collection*> colls;
+            std::vector<Lsm_collection*> lsm_colls;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto& coll : collections_)
+                {
+                    colls.push_back(coll.second.get());
+                }
+                for (auto& coll : lsm_collections_)
+                {
+                    lsm_colls.push_back(coll.second.get());
+                }
+            }
+            for (Collection* coll : colls)
+            {
+                coll->sync();
+            }
+            for (Lsm_collection* coll : lsm_colls)
+            {
+                coll->sync();
+            }
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,592 @@
+#pragma once
+/*!
+ \file logjam/storage/Storage.h
+ \brief Logjam log-structured document storage definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Buffer_pool.h"
+#include "logjam/storage/Index.h"
+#include "logjam/storage/Lsm.h"
+#include "logjam/storage/Segment.h"
+#include "logjam/storage/Wal.h"
+#include "lj/Bson.h"
+#include "lj/Document.h"
+#include "lj/Uuid.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Log-structured collection of documents.
+
+         Every stored document version is appended to the newest segment
+         in the collection directory. The location of each version is
+         tracked in memory by document id, and each document key keeps a
+         chain of the versions that a reader may still see. The indexes
+         are rebuilt by scanning the segments when the collection is
+         opened.
+
+         Every appended version is given the next sequence number. A
+         Snapshot remembers the sequence number it was taken at, and
+         reads through it see the newest version of each key at or below
+         that number, whatever is written afterwards. Versions that no
+         open snapshot can see are dropped from the chains by the next
+         writer; their bytes stay in the segments and remain readable
+         by document id.
+
+         Records are never rewritten, so pointers returned by the read
+         methods remain valid for as long as the collection is open.
+
+         Secondary indexes on payload fields are kept in B+tree files
+         next to the segments and are updated as each version is
+         appended. An index that was not closed cleanly is rebuilt from
+         the segments when it is added.
+
+         Document and index reads pin the pages they touch in the
+         buffer pool, if the collection has one.
+         \since 1.0
+         */
+        class Collection
+        {
+        public:
+            //! Outcome of reconciling a replicated document.
+            enum class Reconciled
+            {
+                k_stale, //!< Every incoming version was already known.
+                k_applied, //!< The incoming version replaced the current one.
+                k_conflict //!< Concurrent versions are kept as siblings.
+            };
+
+            //! Function invoked with the bytes of each changed document.
+            typedef std::function<void(const uint8_t*)> Change_function;
+
+            /*!
+             \brief Consistent view of the collection at a point in time.
+
+             The versions visible to a snapshot are kept until it is
+             released or destroyed. An empty snapshot reads the latest
+             versions. Snapshots can be moved but not copied, and must
+             not outlive their collection.
+             */
+            class Snapshot
+            {
+            public:
+                //! Create a snapshot that reads the latest versions.
+                Snapshot();
+
+                //! Deleted copy constructor.
+                Snapshot(const Snapshot& orig) = delete;
+
+                //! Move constructor.
+                Snapshot(Snapshot&& orig);
+
+                //! Deleted copy assignment operator.
+                Snapshot& operator=(const Snapshot& orig) = delete;
+
+                //! Move assignment operator.
+                Snapshot& operator=(Snapshot&& orig);
+
+                //! Destructor. Releases the snapshot.
+                ~Snapshot();
+
+                //! Test if the snapshot holds a point in time.
+                inline explicit operator bool() const
+                {
+                    return nullptr != collection_;
+                }
+
+                //! Get the sequence number the snapshot reads at.
+                inline uint64_t sequence() const
+                {
+                    return sequence_;
+                }
+
+                //! Let go of the versions held by the snapshot now.
+                void release();
+
+            private:
+                friend class Collection;
+
+                Snapshot(const Collection* collection,
+                        uint64_t sequence);
+
+                const Collection* collection_;
+                uint64_t sequence_;
+            }; // class logjam::storage::Collection::Snapshot
+
+            /*!
+             \brief Open or create a collection.
+             \param name The name of the collection.
+             \param directory The directory holding the segment files.
+             \param capacity The capacity of new segments.
+             \param wal The write-ahead log, or nullptr to skip logging.
+             \param pool The page cache, or nullptr to skip caching.
+             \throws lj::Exception If the segments cannot be opened.
+             */
+            Collection(const std::string& name,
+                    const std::string& directory,
+                    size_t capacity,
+                    Wal* wal,
+                    Buffer_pool* pool = nullptr);
+
+            //! Deleted copy constructor.
+            Collection(const Collection& orig) = delete;
+
+            //! Deleted move constructor.
+            Collection(Collection&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Collection& operator=(const Collection& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Collection& operator=(Collection&& orig) = delete;
+
+            //! Destructor.
+            ~Collection() = default;
+
+            //! Get the name of the collection.
+            inline const std::string& name() const
+            {
+                return name_;
+            }
+
+            /*!
+             \brief Append a document version to the collection.
+
+             The document image is written to the log before it is added
+             to the segment. It is not durable until the returned log
+             sequence number has been passed to Storage::wait().
+             \param doc The document to store.
+             \return The log sequence number, or 0 if there is no log.
+             \throws lj::Exception If the document cannot be written.
+             */
+            uint64_t store(const lj::Document& doc);
+
+            /*!
+             \brief Add a logged document image during recovery.
+
+             Versions that are already in a segment are ignored, so
+             replaying the same record twice is harmless.
+             \param bytes The bson document bytes.
+             \return True if the version was added.
+             */
+            bool restore(const uint8_t* bytes);
+
+            /*!
+             \brief Merge a document replicated from another server.
+
+             Versions are compared by vector clock. An incoming version
+             that the current version descends from is ignored, one that
+             descends from the current version replaces it, and concurrent
+             versions are kept together: the one with the most updates
+             stays the document and the rest are stored under its
+             "_/siblings" element with a new id. Siblings carried by the
+             incoming document are merged the same way, so every server
+             settles on the same set of versions whatever order the
+             updates arrive in.
+             \param doc The replicated document.
+             \param lsn Set to the log sequence number of the stored
+             version, or 0 if nothing was stored.
+             \return The outcome.
+             \throws lj::Exception If the document cannot be written.
+             \sa lj::Document::compare()
+             */
+            Reconciled reconcile(const lj::bson::Node& doc,
+                    uint64_t& lsn);
+
+            /*!
+             \brief Visit documents changed since a sequence number.
+
+             Each key is visited once, with its current version, in the
+             order the keys were last written. Passing the returned
+             sequence number to the next call continues after the last
+             visited document.
+             \param since Sequence number of the last change already seen.
+             \param limit The most documents to visit.
+             \param max_bytes The most document bytes to visit. The first
+             document is always visited, even if it is larger.
+             \param fn Function invoked with the bytes of each document.
+             \return The sequence number of the last visited document, or
+             \c since if nothing changed.
+             */
+            uint64_t changes(uint64_t since,
+                    size_t limit,
+                    size_t max_bytes,
+                    const Change_function& fn) const;
+
+            /*!
+             \brief Get the bson bytes of the current document version.
+             \param key The document key.
+             \return Pointer into the segment, or nullptr if not found.
+             */
+            const uint8_t* read(const uint64_t key) const;
+
+            /*!
+             \brief Get the bson bytes of a document as of a snapshot.
+             \param key The document key.
+             \param snapshot The snapshot to read at.
+             \return Pointer into the segment, or nullptr if the key did
+             not exist when the snapshot was taken.
+             \throws lj::Exception If the snapshot belongs to another
+             collection.
+             */
+            const uint8_t* read(const uint64_t key,
+                    const Snapshot& snapshot) const;
+
+            /*!
+             \brief Get the bson bytes of a specific document version.
+             \param id The document id.
+             \return Pointer into the segment, or nullptr if not found.
+             */
+            const uint8_t* read(const lj::Uuid& id) const;
+
+            /*!
+             \brief Fetch the current document version.
+
+             The result is a lj::bson::Type::k_binary_document node built
+             straight from the segment bytes. The caller is responsible
+             for releasing the pointer.
+             \param key The document key.
+             \return The document node, or nullptr if not found.
+             */
+            lj::bson::Node* fetch(const uint64_t key) const;
+
+            /*!
+             \brief Fetch a document as of a snapshot.
+             \param key The document key.
+             \param snapshot The snapshot to read at.
+             \return The document node, or nullptr if not found.
+             \throws lj::Exception If the snapshot belongs to another
+             collection.
+             \sa fetch(const uint64_t) const
+             */
+            lj::bson::Node* fetch(const uint64_t key,
+                    const Snapshot& snapshot) const;
+
+            /*!
+             \brief Fetch a specific document version.
+             \param id The document id.
+             \return The document node, or nullptr if not found.
+             \sa fetch(const uint64_t) const
+             */
+            lj::bson::Node* fetch(const lj::Uuid& id) const;
+
+            /*!
+             \brief View the current document version in place.
+
+             No bytes are copied; the view reads straight from the
+             segment mapping and stays valid as long as the collection.
+             The document stays pinned in the buffer pool until the last
+             copy of the view is destroyed.
+             \param key The document key.
+             \return The document view, or an empty view if not found.
+             */
+            lj::bson::View view(const uint64_t key) const;
+
+            /*!
+             \brief View a document as of a snapshot.
+             \param key The document key.
+             \param snapshot The snapshot to read at.
+             \return The document view, or an empty view if not found.
+             \throws lj::Exception If the snapshot belongs to another
+             collection.
+             \sa view(const uint64_t) const
+             */
+            lj::bson::View view(const uint64_t key,
+                    const Snapshot& snapshot) const;
+
+            /*!
+             \brief View a specific document version in place.
+             \param id The document id.
+             \return The document view, or an empty view if not found.
+             \sa view(const uint64_t) const
+             */
+            lj::bson::View view(const lj::Uuid& id) const;
+
+            //! Get the number of distinct document keys.
+            size_t size() const;
+
+            //! Get the number of superseded versions kept for snapshots.
+            size_t retained() const;
+
+            /*!
+             \brief Take a snapshot of the current versions.
+             \return The snapshot.
+             */
+            Snapshot snapshot() const;
+
+            /*!
+             \brief Add a secondary index on a payload field.
+
+             The index is stored in \c name.idx in the collection
+             directory. Existing documents are indexed if the file is new,
+             was not closed cleanly or was built for a different field.
+             \param name The name of the index.
+             \param field The path of the field inside the payload.
+             \throws lj::Exception If the name is invalid or already used,
+             or if the index cannot be opened.
+             */
+            void add_index(const std::string& name,
+                    const std::string& field);
+
+            //! Test if an index exists.
+            bool has_index(const std::string& name) const;
+
+            /*!
+             \brief Visit the current documents with a field in a range.
+
+             Documents are visited in field order with the bytes of the
+             version current when the scan started. The scan reads from
+             its own snapshot, so writers are not blocked while \c fn
+             runs and \c fn may call back into the collection.
+             \param name The name of the index.
+             \param lower The smallest value, or nullptr for no lower bound.
+             \param upper The largest value, or nullptr for no upper bound.
+             \param fn Function called for each document.
+             \return The number of documents visited.
+             \throws lj::Exception If the index does not exist or a bound
+             cannot be indexed.
+             */
+            size_t scan(const std::string& name,
+                    const lj::bson::Node* lower,
+                    const lj::bson::Node* upper,
+                    const Index::Scan_function& fn) const;
+
+            /*!
+             \brief Visit the documents with a field in a range as of a snapshot.
+             \param name The name of the index.
+             \param lower The smallest value, or nullptr for no lower bound.
+             \param upper The largest value, or nullptr for no upper bound.
+             \param fn Function called for each document.
+             \param snapshot The snapshot to read at.
+             \return The number of documents visited.
+             \throws lj::Exception If the index does not exist, a bound
+             cannot be indexed or the snapshot belongs to another
+             collection.
+             \sa scan(const std::string&, const lj::bson::Node*, const lj::bson::Node*, const Index::Scan_function&) const
+             */
+            size_t scan(const std::string& name,
+                    const lj::bson::Node* lower,
+                    const lj::bson::Node* upper,
+                    const Index::Scan_function& fn,
+                    const Snapshot& snapshot) const;
+
+            //! Flush all segments and indexes to disk.
+            void sync();
+
+        private:
+            struct Location
+            {
+                size_t segment;
+                size_t offset;
+            };
+
+            struct Version
+            {
+                uint64_t sequence;
+                Location location;
+            };
+
+            void append(const uint8_t* bytes,
+                    size_t sz,
+                    const uint64_t key,
+                    const lj::Uuid& id);
+            void index(const Location& loc,
+                    const uint64_t key,
+                    const lj::Uuid& id);
+            void trim(const uint64_t key);
+            void collect();
+            void release(uint64_t sequence) const;
+            uint64_t sequence_of(const Snapshot& snapshot) const;
+            const Location* visible(const uint64_t key,
+                    uint64_t sequence) const;
+            const uint8_t* resolve(const Location& loc) const;
+            const uint8_t* resolve(const Location& loc,
+                    Buffer_pool::Pin& held) const;
+            std::string segment_path(size_t number) const;
+
+            std::string name_;
+            std::string directory_;
+            size_t capacity_;
+            Wal* wal_;
+            Buffer_pool* pool_;
+            // Indexes are destroyed after the segments so they are only
+            // marked clean once the segments are flushed.
+            std::map<std::string, std::unique_ptr<Index>> indexes_;
+            std::vector<std::unique_ptr<Segment>> segments_;
+            // Versions of each key oldest first; only the last one is
+            // current. Keys with more than one version are in versioned_.
+            std::map<uint64_t, std::vector<Version>> keys_;
+            std::set<uint64_t> versioned_;
+            // Key of each current version by its sequence number.
+            std::map<uint64_t, uint64_t> changes_;
+            std::map<lj::Uuid, Location> ids_;
+            uint64_t sequence_;
+            mutable std::multiset<uint64_t> snapshots_;
+            mutable bool released_;
+            mutable std::mutex mutex_;
+        }; // class logjam::storage::Collection
+
+        /*!
+         \brief Directory of document collections.
+
+         Collections are opened on first use and stay open until the
+         storage object is destroyed. Every stored document is written to
+         a shared write-ahead log kept in the \c wal sub-directory.
+
+         A collection name is either a log-structured Collection or a
+         write-optimized Lsm_collection, depending on which accessor
+         opened it first.
+         \since 1.0
+         */
+        class Storage
+        {
+        public:
+            /*!
+             \brief Open or create a storage directory.
+             \param directory The storage directory.
+             \param flush_interval Maximum time a log record waits for a batch.
+             \param batch_size Number of log records that force a flush.
+             \param capacity The capacity of new segments.
+             \param cache_size The advisory budget of the buffer pool.
+             \throws lj::Exception If the directory cannot be created.
+             */
+            explicit Storage(const std::string& directory,
+                    std::chrono::milliseconds flush_interval = Wal::k_default_flush_interval,
+                    size_t batch_size = Wal::k_default_batch_size,
+                    size_t capacity = Segment::k_default_capacity,
+                    size_t cache_size = Buffer_pool::k_default_size);
+
+            //! Deleted copy constructor.
+            Storage(const Storage& orig) = delete;
+
+            //! Deleted move constructor.
+            Storage(Storage&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Storage& operator=(const Storage& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Storage& operator=(Storage&& orig) = delete;
+
+            //! Destructor.
+            ~Storage() = default;
+
+            //! Get the storage directory.
+            inline const std::string& directory() const
+            {
+                return directory_;
+            }
+
+            //! Get the buffer pool shared by all collections.
+            inline const Buffer_pool& pool() const
+            {
+                return *pool_;
+            }
+
+            /*!
+             \brief Get a collection, opening it if necessary.
+
+             Collection names are limited to letters, digits, underscore
+             and dash so they can be used as directory names.
+             \param name The name of the collection.
+             \return The collection.
+             \throws lj::Exception If the name is invalid or the
+             collection cannot be opened.
+             */
+            Collection& collection(const std::string& name);
+
+            /*!
+             \brief Get an LSM collection, opening it if necessary.
+
+             LSM collections must be opened before #recover() so their
+             logged records are routed to them.
+             \param name The name of the collection.
+             \return The collection.
+             \throws lj::Exception If the name is invalid or already used
+             by a regular collection, or if the collection cannot be
+             opened.
+             \sa collection(const std::string&)
+             */
+            Lsm_collection& lsm(const std::string& name);
+
+            //! Test if a name belongs to an open LSM collection.
+            bool is_lsm(const std::string& name) const;
+
+            /*!
+             \brief Get the names of the regular collections.
+
+             Collections that hold documents on disk are listed whether or
+             not they have been opened yet.
+             \return The collection names in order.
+             */
+            std::vector<std::string> names() const;
+
+            /*!
+             \brief Block until a stored document is durable.
+             \param lsn The log sequence number returned by Collection::store.
+             \throws lj::Exception If the log failed.
+             */
+            void wait(uint64_t lsn);
+
+            /*!
+             \brief Replay the write-ahead log into the collections.
+
+             Called once at startup, before any documents are stored.
+             \return The number of document versions recovered.
+             */
+            size_t recover();
+
+            //! Flush all open collections to disk.
+            void sync();
+
+        private:
+            std::string directory_;
+            size_t capacity_;
+            std::unique_ptr<Buffer_pool> pool_;
+            std::map<std::string, std::unique_ptr<Collection>> collections_;
+            std::map<std::string, std::unique_ptr<Lsm_collection>> lsm_collections_;
+            mutable std::mutex mutex_;
+            std::unique_ptr<Wal> wal_;
+        }; // class logjam::storage::Storage
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,498 @@
+/*!
+ \file logjam/storage/Wal.cpp
+ \brief Logjam write-ahead log implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Wal.h"
+#include "lj/Exception.h"
+#include "lj/Log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Each record is framed by the payload size and a checksum of the
+    // payload. The payload is the collection name, prefixed by its
+    // length, followed by the bson document.
+    const size_t k_frame_header_size = 2 * sizeof(uint32_t);
+    const char k_log_suffix[] = ".wal";
+
+    uint32_t checksum(const uint8_t* data,
+            size_t sz)
+    {
+        // FNV-1a.
+        uint32_t hash = 2166136261u;
+        for (const uint8_t* end = data + sz; data < end; ++data)
+        {
+            hash ^= *data;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    bool read_file(const std::string& path,
+            std::vector<uint8_t>& contents)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        uint8_t buffer[64 * 1024];
+        ssize_t rc;
+        while ((rc = ::read(fd, buffer, sizeof(buffer))) != 0)
+        {
+            if (rc < 0)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                ::close(fd);
+                return false;
+            }
+            contents.insert(contents.end(), buffer, buffer + rc);
+        }
+        ::close(fd);
+        return true;
+    }
+
+    void write_fully(int fd,
+            const uint8_t* data,
+            size_t sz)
+    {
+        while (sz > 0)
+        {
+            ssize_t rc = ::write(fd, data, sz);
+            if (rc < 0)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                throw LJ__Exception(std::string("Unable to write log: ") +
+                        strerror(errno));
+            }
+            data += rc;
+            sz -= rc;
+        }
+    }
+
+    void sync_fully(int fd)
+    {
+#ifdef __APPLE__
+        // fsync on darwin does not flush the drive cache.
+        if (fcntl(fd, F_FULLFSYNC) == 0)
+        {
+            return;
+        }
+#endif
+        if (fsync(fd) < 0)
+        {
+            throw LJ__Exception(std::string("Unable to sync log: ") +
+                    strerror(errno));
+        }
+    }
+}; // namespace (anonymous)
+
+namespace logjam
+{
+    namespace storage
+    {
+        const std::chrono::milliseconds Wal::k_default_flush_interval(2);
+        const size_t Wal::k_default_batch_size = 128;
+        const size_t Wal::k_checkpoint_size = 64 * 1024 * 1024;
+
+        Wal::Wal(const std::string& directory,
+                std::chrono::milliseconds flush_interval,
+                size_t batch_size,
+                Checkpoint_function checkpoint) :
+                directory_(directory),
+                flush_interval_(flush_interval),
+                batch_size_(std::max<size_t>(1, batch_size)),
+                checkpoint_(checkpoint),
+                existing_(),
+                current_(0),
+                fd_(-1),
+                written_(0),
+                mutex_(),
+                writer_cv_(),
+                checkpoint_cv_(),
+                durable_cv_(),
+                pending_(),
+                pending_count_(0),
+                next_lsn_(1),
+                durable_(0),
+                running_(true),
+                failed_(false),
+                recovered_(false),
+                checkpoint_pending_(false),
+                writer_(),
+                checkpointer_()
+        {
+            if (mkdir(directory_.c_str(), 0755) < 0 && EEXIST != errno)
+            {
+                throw LJ__Exception(std::string("Unable to create directory ") +
+                        directory_ + ": " + strerror(errno));
+            }
+
+            // Find the existing log files so they can be replayed.
+            DIR* dir = opendir(directory_.c_str());
+            if (!dir)
+            {
+                throw LJ__Exception(std::string("Unable to read directory ") +
+                        directory_ + ": " + strerror(errno));
+            }
+            for (struct dirent* entry = readdir(dir);
+                    entry;
+                    entry = readdir(dir))
+            {
+                unsigned long long number;
+                char suffix[8];
+                if (2 == sscanf(entry->d_name, "%llu%7s", &number, suffix) &&
+                        0 == strcmp(suffix, k_log_suffix))
+                {
+                    existing_.push_back(number);
+                }
+            }
+            closedir(dir);
+            std::sort(existing_.begin(), existing_.end());
+
+            // New records always go into a new file.
+            open_log(existing_.empty() ? 0 : existing_.back() + 1);
+
+            writer_.reset(new lj::Thread());
+            writer_->run([this]() { write_loop(); }, []() {});
+            checkpointer_.reset(new lj::Thread());
+            checkpointer_->run([this]() { checkpoint_loop(); }, []() {});
+        }
+
+        Wal::~Wal()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_ = false;
+            }
+            writer_cv_.notify_all();
+            checkpoint_cv_.notify_all();
+            writer_->join();
+            checkpointer_->join();
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+            }
+        }
+
+        uint64_t Wal::append(const std::string& collection,
+                const uint8_t* doc,
+                size_t sz)
+        {
+            if (collection.size() > 255)
+            {
+                throw LJ__Exception("Collection name is too long for the log.");
+            }
+
+            // Build the frame before taking the lock.
+            uint32_t payload_size = 1 + collection.size() + sz;
+            std::vector<uint8_t> frame(k_frame_header_size + payload_size);
+            uint8_t* payload = frame.data() + k_frame_header_size;
+            payload[0] = static_cast<uint8_t>(collection.size());
+            memcpy(payload + 1, collection.data(), collection.size());
+            memcpy(payload + 1 + collection.size(), doc, sz);
+            uint32_t sum = checksum(payload, payload_size);
+            memcpy(frame.data(), &payload_size, sizeof(uint32_t));
+            memcpy(frame.data() + sizeof(uint32_t), &sum, sizeof(uint32_t));
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (failed_ || !running_)
+            {
+                throw LJ__Exception("The log is not accepting records.");
+            }
+            pending_.insert(pending_.end(), frame.begin(), frame.end());
+            if (1 == ++pending_count_ || batch_size_ <= pending_count_)
+            {
+                writer_cv_.notify_one();
+            }
+            return next_lsn_++;
+        }
+
+        void Wal::wait(uint64_t lsn)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            durable_cv_.wait(lock, [this, lsn]() {
+                return durable_ >= lsn || failed_;
+            });
+            if (durable_ < lsn)
+            {
+                throw LJ__Exception("The log failed before the record was synced.");
+            }
+        }
+
+        uint64_t Wal::durable() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return durable_;
+        }
+
+        size_t Wal::replay(Replay_function func) const
+        {
+            size_t count = 0;
+            for (uint64_t number : existing_)
+            {
+                std::vector<uint8_t> contents;
+                if (!read_file(log_path(number), contents))
+                {
+                    throw LJ__Exception(std::string("Unable to read log ") +
+                            log_path(number) + ": " + strerror(errno));
+                }
+
+                size_t offset = 0;
+                while (contents.size() - offset >= k_frame_header_size)
+                {
+                    uint32_t payload_size;
+                    uint32_t sum;
+                    memcpy(&payload_size, contents.data() + offset, sizeof(uint32_t));
+                    memcpy(&sum, contents.data() + offset + sizeof(uint32_t), sizeof(uint32_t));
+                    const uint8_t* payload = contents.data() + offset + k_frame_header_size;
+                    if (payload_size > contents.size() - offset - k_frame_header_size ||
+                            payload_size < 1 ||
+                            sum != checksum(payload, payload_size))
+                    {
+                        lj::log::format<lj::Warning>("Log %s is damaged at %d. Ignoring the rest of the file.")
+                                << log_path(number)
+                                << offset
+                                << lj::log::end;
+                        break;
+                    }
+
+                    std::string collection(reinterpret_cast<const char*>(payload + 1),
+                            payload[0]);
+                    func(collection, payload + 1 + payload[0]);
+                    offset += k_frame_header_size + payload_size;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        void Wal::checkpoint()
+        {
+            std::vector<uint64_t> old;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                old.swap(existing_);
+                recovered_ = true;
+            }
+            remove_logs(old);
+        }
+
+        void Wal::write_loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                writer_cv_.wait(lock, [this]() {
+                    return !running_ || 0 < pending_count_;
+                });
+                if (0 == pending_count_)
+                {
+                    break;
+                }
+
+                // Give concurrent writers a chance to join the batch.
+                writer_cv_.wait_for(lock, flush_interval_, [this]() {
+                    return !running_ || batch_size_ <= pending_count_;
+                });
+
+                std::vector<uint8_t> batch;
+                batch.swap(pending_);
+                pending_count_ = 0;
+                uint64_t lsn = next_lsn_ - 1;
+                lock.unlock();
+
+                bool ok = true;
+                try
+                {
+                    write_fully(fd_, batch.data(), batch.size());
+                    sync_fully(fd_);
+                    written_ += batch.size();
+                }
+                catch (lj::Exception& ex)
+                {
+                    lj::log::format<lj::Critical>("Write-ahead log failed: %s")
+                            << ex
+                            << lj::log::end;
+                    ok = false;
+                }
+
+                lock.lock();
+                if (ok)
+                {
+                    durable_ = lsn;
+                }
+                else
+                {
+                    failed_ = true;
+                }
+                durable_cv_.notify_all();
+                if (failed_)
+                {
+                    break;
+                }
+
+                if (recovered_ && written_ >= k_checkpoint_size)
+                {
+                    lock.unlock();
+                    try
+                    {
+                        rotate();
+                    }
+                    catch (lj::Exception& ex)
+                    {
+                        lj::log::format<lj::Error>("Unable to rotate the log: %s")
+                                << ex
+                                << lj::log::end;
+                    }
+                    lock.lock();
+                }
+            }
+        }
+
+        void Wal::checkpoint_loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                checkpoint_cv_.wait(lock, [this]() {
+                    return !running_ || checkpoint_pending_;
+                });
+                if (!running_)
+                {
+                    // Files left behind are replayed on the next start.
+                    break;
+                }
+
+                // Only files closed before the sync starts are covered by
+                // it. Files the writer closes meanwhile wait for the next
+                // pass.
+                checkpoint_pending_ = false;
+                std::vector<uint64_t> old;
+                old.swap(existing_);
+                lock.unlock();
+
+                try
+                {
+                    checkpoint_();
+                    remove_logs(old);
+                }
+                catch (lj::Exception& ex)
+                {
+                    lj::log::format<lj::Error>("Checkpoint failed: %s")
+                            << ex
+                            << lj::log::end;
+                    lock.lock();
+                    existing_.insert(existing_.begin(), old.begin(), old.end());
+                    continue;
+                }
+                lock.lock();
+            }
+        }
+
+        void Wal::open_log(uint64_t number)
+        {
+            std::string path(log_path(number));
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0)
+            {
+                throw LJ__Exception(std::string("Unable to open log ") +
+                        path + ": " + strerror(errno));
+            }
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+            }
+            fd_ = fd;
+            current_ = number;
+            written_ = 0;
+        }
+
+        void Wal::rotate()
+        {
+            // Only the writer thread touches the current file, so it can
+            // be switched without holding the lock.
+            uint64_t previous = current_;
+            open_log(current_ + 1);
+
+            // Every record in the previous file has been handed to the
+            // segments. The checkpoint thread makes them durable and drops
+            // the file while the writer carries on with the new one.
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                existing_.push_back(previous);
+                checkpoint_pending_ = true;
+            }
+            checkpoint_cv_.notify_one();
+        }
+
+        void Wal::remove_logs(const std::vector<uint64_t>& numbers)
+        {
+            for (uint64_t number : numbers)
+            {
+                if (unlink(log_path(number).c_str()) < 0 && ENOENT != errno)
+                {
+                    lj::log::format<lj::Error>("Unable to remove log %s: %s")
+                            << log_path(number)
+                            << strerror(errno)
+                            << lj::log::end;
+                }
+            }
+        }
+
+        std::string Wal::log_path(uint64_t number) const
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "/%08llu%s",
+                    static_cast<unsigned long long>(number),
+                    k_log_suffix);
+            return directory_ + buffer;
+        }
+    }; // namespace logjam::storage
+}; // namespace logjam
@@ -0,0 +1,200 @@
+#pragma once
+/*!
+ \file logjam/storage/Wal.h
+ \brief Logjam write-ahead log definition.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lj/Thread.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace logjam
+{
+    namespace storage
+    {
+        /*!
+         \brief Write-ahead log with group commit.
+
+         Document images are appended to an in-memory batch and assigned a
+         log sequence number. A single writer thread writes the batch to
+         the current log file and syncs it. Callers that need durability
+         wait on the sequence number they were given, so concurrent
+         writers share a single fsync.
+
+         The writer flushes as soon as \c batch_size records are pending,
+         or once the oldest pending record has waited \c flush_interval.
+
+         Log files are numbered and never reused. When the current file
+         grows past #k_checkpoint_size the writer starts a new file and
+         carries on with it. A separate checkpoint thread runs the
+         checkpoint function to sync the segments and then removes the
+         files that were closed before the sync started, so group commits
+         never wait on a checkpoint.
+         \since 1.0
+         */
+        class Wal
+        {
+        public:
+            //! Function invoked for every record during replay.
+            typedef std::function<void(const std::string&, const uint8_t*)> Replay_function;
+
+            //! Function invoked to make all applied records durable.
+            typedef std::function<void()> Checkpoint_function;
+
+            //! Default time a record may wait for its batch to fill.
+            static const std::chrono::milliseconds k_default_flush_interval;
+
+            //! Default number of records that force a flush.
+            static const size_t k_default_batch_size;
+
+            //! Log file size that triggers a checkpoint.
+            static const size_t k_checkpoint_size;
+
+            /*!
+             \brief Open the log directory and start the writer.
+
+             Existing log files are left alone until #checkpoint() is
+             called, so they can be replayed first.
+             \param directory The directory holding the log files.
+             \param flush_interval Maximum time a record waits for a batch.
+             \param batch_size Number of records that force a flush.
+             \param checkpoint Function that syncs the applied records.
+             \throws lj::Exception If the log cannot be opened.
+             */
+            Wal(const std::string& directory,
+                    std::chrono::milliseconds flush_interval,
+                    size_t batch_size,
+                    Checkpoint_function checkpoint);
+
+            //! Deleted copy constructor.
+            Wal(const Wal& orig) = delete;
+
+            //! Deleted move constructor.
+            Wal(Wal&& orig) = delete;
+
+            //! Deleted copy assignment operator.
+            Wal& operator=(const Wal& orig) = delete;
+
+            //! Deleted move assignment operator.
+            Wal& operator=(Wal&& orig) = delete;
+
+            //! Destructor. Flushes the pending batch and stops the writer.
+            ~Wal();
+
+            /*!
+             \brief Append a document image to the log.
+
+             The record is not durable until #wait(uint64_t) returns for
+             the returned sequence number.
+             \param collection The collection the document belongs to.
+             \param doc The bson document bytes.
+             \param sz The number of bytes in \c doc.
+             \return The log sequence number of the record.
+             \throws lj::Exception If the log has failed.
+             */
+            uint64_t append(const std::string& collection,
+                    const uint8_t* doc,
+                    size_t sz);
+
+            /*!
+             \brief Block until a record has been synced to disk.
+             \param lsn The log sequence number returned by #append.
+             \throws lj::Exception If the log failed before the record
+             was synced.
+             */
+            void wait(uint64_t lsn);
+
+            //! Get the highest log sequence number synced to disk.
+            uint64_t durable() const;
+
+            /*!
+             \brief Replay the log files that existed when the log opened.
+
+             Replay stops at the first damaged record in each file, which
+             is where a crash interrupted the last write.
+             \param func Function invoked for each record.
+             \return The number of records replayed.
+             */
+            size_t replay(Replay_function func) const;
+
+            /*!
+             \brief Remove log files that are no longer needed.
+
+             Must only be called once every record in the older files has
+             been applied and synced. Automatic checkpoints are disabled
+             until the first call, so records are never discarded before
+             they are replayed.
+             */
+            void checkpoint();
+
+        private:
+            void write_loop();
+            void checkpoint_loop();
+            void open_log(uint64_t number);
+            void rotate();
+            void remove_logs(const std::vector<uint64_t>& numbers);
+            std::string log_path(uint64_t number) const;
+
+            std::string directory_;
+            std::chrono::milliseconds flush_interval_;
+            size_t batch_size_;
+            Checkpoint_function checkpoint_;
+            std::vector<uint64_t> existing_;
+            uint64_t current_;
+            int fd_;
+            size_t written_;
+
+            mutable std::mutex mutex_;
+            std::condition_variable writer_cv_;
+            std::condition_variable checkpoint_cv_;
+            mutable std::condition_variable durable_cv_;
+            std::vector<uint8_t> pending_;
+            size_t pending_count_;
+            uint64_t next_lsn_;
+            uint64_t durable_;
+            bool running_;
+            bool failed_;
+            bool recovered_;
+            bool checkpoint_pending_;
+            std::unique_ptr<lj::Thread> writer_;
+            std::unique_ptr<lj::Thread> checkpointer_;
+        }; // class logjam::storage::Wal
+    }; // namespace logjam::storage
+}; // namespace logjam
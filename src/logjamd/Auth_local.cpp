@@ -40,13 +40,14 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 
 namespace
 {
-    const std::string k_login_field("login");
-    const std::string k_password_field("password");
-    const std::string k_id_field("id");
-    const std::string k_salt_field("salt");
+    const lj::bson::Path k_login_field("login");
+    const lj::bson::Path k_password_field("password");
+    const lj::bson::Path k_id_field("id");
+    const lj::bson::Path k_salt_field("salt");
 
     const std::string k_password_hash_name("bcrypt");
 
@@ -76,8 +77,9 @@ namespace logjamd
     lj::Uuid Auth_method_password_hash::authenticate(const lj::bson::Node& data) const
     {
         const std::string login(lj::bson::as_string(data[k_login_field]));
-        auto iter = credentials_by_login_.find(login);
-        if (iter == credentials_by_login_.end())
+        std::unique_ptr<lj::bson::Node> login_key(lj::bson::new_string(login));
+        lj::bson::Node* const* found = credentials_by_login_.find(*login_key);
+        if (!found)
         {
             // Deal with unknown login.
             lj::log::format<lj::Debug>("auth_local: User not found for %s.")
@@ -85,7 +87,7 @@ namespace logjamd
                     << lj::log::end;
             throw logjam::User_not_found_exception(login);
         }
-        const lj::bson::Node* stored_credential = (*iter).second;
+        const lj::bson::Node* stored_credential = *found;
 
         // Prepare scrypt inputs
         lj::log::format<lj::Debug>("auth_local: Calculating derived key.");
@@ -205,7 +207,7 @@ namespace logjamd
                     << old_login
                     << target
                     << lj::log::end;
-            credentials_by_login_.erase(old_login);
+            credentials_by_login_.erase(stored_credential->nav(k_login_field));
         }
 
         // In theory, the user cannot log in during this point. There is no entry in the
@@ -229,7 +231,8 @@ namespace logjamd
         stored_credential->set_child(k_salt_field,
                 salt_node);
 
-        credentials_by_login_[new_login] = stored_credential;
+        credentials_by_login_.insert(stored_credential->nav(k_login_field),
+                stored_credential);
     }
 
     std::string Auth_method_password_hash::name() const
@@ -35,6 +35,7 @@
  */
 
 #include "logjam/User.h"
+#include "lj/Bson_index.h"
 
 namespace logjamd
 {
@@ -55,7 +56,7 @@ namespace logjamd
                 const lj::bson::Node& data);
         virtual std::string name() const;
     private:
-        std::map<std::string, lj::bson::Node*> credentials_by_login_;
+        lj::bson::Hash_index<lj::bson::Node*> credentials_by_login_;
         std::map<lj::Uuid, lj::bson::Node*> credentials_by_id_;
     };
 };
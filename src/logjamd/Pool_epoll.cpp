@@ -0,0 +1,636 @@
+/*!
+ \file logjamd/Pool_epoll.cpp
+ \brief Logjam server epoll reactor pool implementation.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjamd/Pool_epoll.h"
+#include "logjamd/Stage_pre.h"
+#include "logjam/Network_address_info.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+}
+
+namespace
+{
+    const size_t k_read_size = 8192;
+    const int k_max_events = 64;
+    const int k_listen_backlog = 128;
+
+    void make_non_blocking(int fd)
+    {
+        int flags = ::fcntl(fd, F_GETFL, 0);
+        if (0 > flags || 0 > ::fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+        {
+            throw LJ__Exception(strerror(errno));
+        }
+    }
+}; // namespace (anonymous)
+
+namespace logjamd
+{
+    namespace pool
+    {
+        //// Swimmer_epoll
+
+        Swimmer_epoll::Swimmer_epoll(logjam::pool::Lifeguard& lg,
+                logjam::Context&& ctx,
+                int sockfd) :
+                logjam::pool::Swimmer(lg, std::move(ctx)),
+                is_running_(true),
+                hung_up_(false),
+                client_socket_(sockfd),
+                stage_(new logjamd::Stage_pre()),
+                decoder_(lg.area().max_frame_size()),
+                buffer_(k_read_size),
+                stream_(&buffer_)
+        {
+            make_non_blocking(sockfd);
+        }
+
+        void Swimmer_epoll::run()
+        {
+            while (ready())
+            {
+                try
+                {
+                    decoder_.reset();
+                    stage_ = safe_execute_stage(stage_, *this);
+                    io().flush();
+                }
+                catch (const lj::Exception& ex)
+                {
+                    stage_.reset();
+                    lj::log::format<lj::Error>("Encountered %s LJ Exception.")
+                            << ex
+                            << lj::log::end;
+                }
+                catch (const std::exception& ex)
+                {
+                    stage_.reset();
+                    lj::log::format<lj::Critical>("Encountered %s std Exception.")
+                            << ex
+                            << lj::log::end;
+                }
+                catch (...)
+                {
+                    stage_.reset();
+                    lj::log::out<lj::Alert>("Encountered an unexpected Exception.");
+                }
+
+                // The buffer reports end of file instead of blocking, so
+                // reset the stream state for the next stage.
+                io().clear();
+            }
+
+            if (nullptr == stage_)
+            {
+                is_running_.store(false);
+            }
+            buffer_.compact_input();
+        }
+
+        bool Swimmer_epoll::ready()
+        {
+            if (!is_running_.load() || nullptr == stage_)
+            {
+                return false;
+            }
+
+            try
+            {
+                return stage_->ready(buffer_.input_data(),
+                        buffer_.input_size(),
+                        decoder_);
+            }
+            catch (const lj::Exception& ex)
+            {
+                lj::log::format<lj::Warning>("Rejected request: %s")
+                        << ex
+                        << lj::log::end;
+            }
+            stage_.reset();
+            is_running_.store(false);
+            return false;
+        }
+
+        void Swimmer_epoll::stop()
+        {
+            is_running_.store(false);
+        }
+
+        void Swimmer_epoll::cleanup()
+        {
+            lj::log::format<lj::Debug>("Swimmer %p cleaned up.")
+                    << this
+                    << lj::log::end;
+            lifeguard().remove(this);
+            delete this;
+        }
+
+        std::iostream& Swimmer_epoll::io()
+        {
+            return stream_;
+        }
+
+        bool Swimmer_epoll::fill()
+        {
+            while (true)
+            {
+                char* ptr = buffer_.prepare_input(k_read_size);
+                ssize_t rc = ::recv(socket(), ptr, k_read_size, 0);
+                if (0 < rc)
+                {
+                    buffer_.commit_input(rc);
+                }
+                else if (0 == rc)
+                {
+                    // Peer closed the connection.
+                    return false;
+                }
+                else if (EINTR != errno)
+                {
+                    return EAGAIN == errno || EWOULDBLOCK == errno;
+                }
+            }
+        }
+
+        bool Swimmer_epoll::drain()
+        {
+            while (has_output())
+            {
+                ssize_t rc = ::send(socket(),
+                        buffer_.output_data(),
+                        buffer_.output_size(),
+                        MSG_NOSIGNAL);
+                if (0 <= rc)
+                {
+                    buffer_.consume_output(rc);
+                }
+                else if (EINTR != errno)
+                {
+                    return EAGAIN == errno || EWOULDBLOCK == errno;
+                }
+            }
+            return true;
+        }
+
+        bool Swimmer_epoll::has_output() const
+        {
+            return 0 < buffer_.output_size();
+        }
+
+        void Swimmer_epoll::hang_up()
+        {
+            hung_up_ = true;
+        }
+
+        bool Swimmer_epoll::hung_up() const
+        {
+            return hung_up_;
+        }
+
+        bool Swimmer_epoll::is_running() const
+        {
+            return is_running_.load();
+        }
+
+        int Swimmer_epoll::socket() const
+        {
+            return client_socket_.socket();
+        }
+
+        //// Lifeguard_epoll
+
+        Lifeguard_epoll::Lifeguard_epoll(logjam::pool::Area& a) :
+                logjam::pool::Lifeguard(a),
+                is_running_(false),
+                epollfd_(::epoll_create1(0)),
+                eventfd_(::eventfd(0, EFD_NONBLOCK)),
+                pending_mutex_(),
+                pending_(),
+                returning_(),
+                responsibilities_()
+        {
+            if (0 > epollfd_ || 0 > eventfd_)
+            {
+                throw LJ__Exception(strerror(errno));
+            }
+
+            // The wake up event is the only one without a swimmer.
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = nullptr;
+            if (0 > ::epoll_ctl(epollfd_, EPOLL_CTL_ADD, eventfd_, &ev))
+            {
+                throw LJ__Exception(strerror(errno));
+            }
+        }
+
+        Lifeguard_epoll::~Lifeguard_epoll()
+        {
+            for (Swimmer_map::value_type& p : responsibilities_)
+            {
+                delete p.first;
+            }
+            for (Swimmer_epoll* s : pending_)
+            {
+                delete s;
+            }
+            ::close(eventfd_);
+            ::close(epollfd_);
+        }
+
+        void Lifeguard_epoll::remove(logjam::pool::Swimmer* s)
+        {
+            Swimmer_epoll* swimmer = static_cast<Swimmer_epoll*>(s);
+            Swimmer_map::iterator iter(responsibilities_.find(swimmer));
+            if (responsibilities_.end() != iter)
+            {
+                interest(swimmer, 0);
+                iter->first->stop();
+                responsibilities_.erase(iter);
+            }
+        }
+
+        void Lifeguard_epoll::watch(logjam::pool::Swimmer* s)
+        {
+            Swimmer_epoll* swimmer = dynamic_cast<Swimmer_epoll*>(s);
+            if (nullptr == swimmer)
+            {
+                throw LJ__Exception("Epoll lifeguards only watch epoll swimmers.");
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                pending_.push_back(swimmer);
+            }
+            wake();
+        }
+
+        void Lifeguard_epoll::run()
+        {
+            is_running_.store(true);
+            struct epoll_event events[k_max_events];
+            while (is_running_.load())
+            {
+                int count = ::epoll_wait(epollfd_, events, k_max_events, -1);
+                if (0 > count)
+                {
+                    if (EINTR == errno)
+                    {
+                        continue;
+                    }
+                    throw LJ__Exception(strerror(errno));
+                }
+
+                for (int h = 0; h < count; ++h)
+                {
+                    if (nullptr == events[h].data.ptr)
+                    {
+                        uint64_t ignored;
+                        while (0 < ::read(eventfd_, &ignored, sizeof(ignored)))
+                        {
+                        }
+                        adopt();
+                    }
+                    else
+                    {
+                        service(static_cast<Swimmer_epoll*>(events[h].data.ptr),
+                                events[h].events);
+                    }
+                }
+            }
+        }
+
+        void Lifeguard_epoll::stop()
+        {
+            is_running_.store(false);
+            wake();
+        }
+
+        void Lifeguard_epoll::cleanup()
+        {
+        }
+
+        void Lifeguard_epoll::wake()
+        {
+            uint64_t one = 1;
+            if (0 > ::write(eventfd_, &one, sizeof(one)) && EAGAIN != errno)
+            {
+                lj::log::format<lj::Error>("Unable to wake lifeguard %p: %s")
+                        .end(this, strerror(errno));
+            }
+        }
+
+        void Lifeguard_epoll::finished(Swimmer_epoll* s)
+        {
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                returning_.push_back(s);
+            }
+            wake();
+        }
+
+        void Lifeguard_epoll::adopt()
+        {
+            std::list<Swimmer_epoll*> adopted;
+            std::list<Swimmer_epoll*> returned;
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                adopted.swap(pending_);
+                returned.swap(returning_);
+            }
+
+            for (Swimmer_epoll* s : adopted)
+            {
+                responsibilities_[s] = 0;
+                interest(s, EPOLLIN | EPOLLRDHUP);
+                if (0 == responsibilities_[s])
+                {
+                    responsibilities_.erase(s);
+                    delete s;
+                }
+            }
+
+            for (Swimmer_epoll* s : returned)
+            {
+                // Pipelined requests may already be buffered.
+                if (s->ready())
+                {
+                    dispatch(s);
+                }
+                else
+                {
+                    settle(s);
+                }
+            }
+        }
+
+        void Lifeguard_epoll::service(Swimmer_epoll* s, uint32_t events)
+        {
+            if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                if (!s->fill())
+                {
+                    s->hang_up();
+                }
+            }
+
+            if (s->ready())
+            {
+                dispatch(s);
+            }
+            else
+            {
+                settle(s);
+            }
+        }
+
+        void Lifeguard_epoll::dispatch(Swimmer_epoll* s)
+        {
+            // Stop watching until the executor hands the swimmer back.
+            interest(s, 0);
+            Lifeguard_epoll* lg = this;
+            area().executor().submit([lg, s]() {
+                s->run();
+                lg->finished(s);
+            });
+        }
+
+        void Lifeguard_epoll::settle(Swimmer_epoll* s)
+        {
+            // Close once the peer is gone, or once the swimmer is done
+            // and everything has been written.
+            bool open = s->drain() && !s->hung_up();
+            if (!open || (!s->is_running() && !s->has_output()))
+            {
+                s->cleanup();
+                return;
+            }
+
+            uint32_t wanted = EPOLLIN | EPOLLRDHUP;
+            if (s->has_output())
+            {
+                wanted |= EPOLLOUT;
+            }
+            interest(s, wanted);
+        }
+
+        void Lifeguard_epoll::interest(Swimmer_epoll* s, uint32_t events)
+        {
+            uint32_t& current = responsibilities_[s];
+            if (current == events)
+            {
+                return;
+            }
+
+            int op = EPOLL_CTL_MOD;
+            if (0 == current)
+            {
+                op = EPOLL_CTL_ADD;
+            }
+            else if (0 == events)
+            {
+                op = EPOLL_CTL_DEL;
+            }
+
+            struct epoll_event ev;
+            ev.events = events;
+            ev.data.ptr = s;
+            if (0 > ::epoll_ctl(epollfd_, op, s->socket(), &ev))
+            {
+                lj::log::format<lj::Error>("Unable to watch fh %d: %s")
+                        .end(s->socket(), strerror(errno));
+                return;
+            }
+            current = events;
+        }
+
+        //// Area_epoll
+
+        Area_epoll::Area_epoll(logjam::Environs&& env) :
+                logjam::pool::Area(std::move(env)),
+                is_running_(false),
+                listen_socket_(),
+                lifeguards_(),
+                lifeguard_threads_()
+        {
+        }
+
+        Area_epoll::~Area_epoll()
+        {
+            // Swimmers still on the executor reference the lifeguards.
+            executor().shutdown();
+            for (std::unique_ptr<Lifeguard_epoll>& lg : lifeguards_)
+            {
+                lg->stop();
+            }
+            for (std::unique_ptr<lj::Thread>& t : lifeguard_threads_)
+            {
+                t->join();
+            }
+        }
+
+        void Area_epoll::prepare()
+        {
+            logjam::pool::Area::prepare();
+
+            // Figure out where we should be listening.
+            std::string listen_on(lj::bson::as_string(
+                    environs().config()["server/listen"]));
+            lj::log::format<lj::Info>("Attempting to listen on \"%s\".")
+                    << listen_on
+                    << lj::log::end;
+
+            logjam::Network_address_info info(listen_on,
+                    AI_PASSIVE,
+                    AF_UNSPEC,
+                    SOCK_STREAM,
+                    0);
+            if (!info.next())
+            {
+                // we didn't get any address information back, so abort!
+                throw LJ__Exception(info.error());
+            }
+            listen_socket_ = logjam::socket_for_listening(info.current(),
+                    k_listen_backlog);
+
+            // Figure out how many reactors to run.
+            int64_t reactors = 0;
+            if (environs().config().exists("server/reactors"))
+            {
+                reactors = lj::bson::as_int64(
+                        environs().config()["server/reactors"]);
+            }
+            if (1 > reactors)
+            {
+                reactors = std::max(1u, std::thread::hardware_concurrency());
+            }
+
+            for (int64_t h = 0; h < reactors; ++h)
+            {
+                lifeguards_.emplace_back(new Lifeguard_epoll(*this));
+            }
+            lj::log::format<lj::Info>("Prepared %d epoll reactors.")
+                    .end(reactors);
+        }
+
+        void Area_epoll::open()
+        {
+            assert(listen_socket_.is_open());
+            assert(!lifeguards_.empty());
+
+            for (std::unique_ptr<Lifeguard_epoll>& lg : lifeguards_)
+            {
+                lifeguard_threads_.emplace_back(new lj::Thread());
+                lifeguard_threads_.back()->run(lg.get());
+            }
+
+            is_running_.store(true);
+            size_t next_lifeguard = 0;
+            while (is_running_.load())
+            {
+                // Accept a connection.
+                struct sockaddr_storage remote_addr;
+                socklen_t remote_addr_size = sizeof(struct sockaddr_storage);
+                int sockfd = ::accept(listen_socket_.socket(),
+                        (struct sockaddr *)&remote_addr,
+                        &remote_addr_size);
+                if (0 > sockfd)
+                {
+                    if (!is_running_.load() || EINTR == errno
+                            || ECONNABORTED == errno)
+                    {
+                        continue;
+                    }
+                    // I had problems accepting that client.
+                    throw LJ__Exception(strerror(errno));
+                }
+
+                // Spread the swimmers across the reactors.
+                Lifeguard_epoll& lg = *lifeguards_[next_lifeguard];
+                next_lifeguard = (next_lifeguard + 1) % lifeguards_.size();
+
+                Swimmer_epoll* new_swimmer = new Swimmer_epoll(lg,
+                        spawn_context(),
+                        sockfd);
+
+                // Collect all the admin stuff we need for this connection.
+                std::string remote_ip = logjam::Network_address_info::as_string(
+                        (struct sockaddr*)&remote_addr);
+                new_swimmer->context().node().set_child("client/address",
+                        lj::bson::new_string(remote_ip));
+
+                // Hand the swimmer to the reactor thread.
+                lg.watch(new_swimmer);
+
+                lj::log::format<lj::Info>("Accepted a connection from %s on fh %d.")
+                        << remote_ip
+                        << sockfd
+                        << lj::log::end;
+            }
+        }
+
+        void Area_epoll::close()
+        {
+            is_running_.store(false);
+            ::shutdown(listen_socket_.socket(), SHUT_RDWR);
+            for (std::unique_ptr<Lifeguard_epoll>& lg : lifeguards_)
+            {
+                lg->stop();
+            }
+        }
+
+        void Area_epoll::cleanup()
+        {
+            for (std::unique_ptr<lj::Thread>& t : lifeguard_threads_)
+            {
+                t->join();
+            }
+            lifeguard_threads_.clear();
+            executor().shutdown();
+            listen_socket_.close();
+        }
+    }; // namespace logjamd::pool
+}; // namespace logjamd
@@ -0,0 +1,194 @@
+#pragma once
+/*!
+ \file logjamd/Pool_epoll.h
+ \brief Logjam server epoll reactor pool header.
+ \author Jason Watson
+ 
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "logjam/Network_socket.h"
+#include "logjam/Pool.h"
+#include "logjam/Stage.h"
+#include "lj/Streambuf_buffer.h"
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace logjamd
+{
+    namespace pool
+    {
+        //! Event driven swimmer. Non-blocking socket.
+        /*!
+         The swimmer never reads from the socket while a stage is running.
+         The reactor fills the swimmer input buffer as data arrives, and
+         once the current stage reports the buffered input is sufficient,
+         the swimmer is handed to the area executor to run its stages.
+         */
+        class Swimmer_epoll : public logjam::pool::Swimmer
+        {
+        public:
+            Swimmer_epoll(logjam::pool::Lifeguard& lg,
+                    logjam::Context&& ctx,
+                    int sockfd);
+            Swimmer_epoll(const Swimmer_epoll& o) = delete;
+            Swimmer_epoll(Swimmer_epoll&& o) = delete;
+            Swimmer_epoll& operator=(const Swimmer_epoll&& rhs) = delete;
+            Swimmer_epoll& operator=(Swimmer_epoll&& rhs) = delete;
+            virtual ~Swimmer_epoll() = default;
+
+            //! Execute stages until one needs more input.
+            virtual void run() override;
+
+            //! Test if the current stage can run with the buffered input.
+            /*!
+             Malformed or oversized input stops the swimmer.
+             */
+            virtual bool ready();
+            virtual void stop() override;
+            virtual void cleanup() override;
+            virtual std::iostream& io() override;
+
+            //! Read everything currently available on the socket.
+            /*!
+             \return False if the peer closed the connection or the read
+             failed, true otherwise.
+             */
+            virtual bool fill();
+
+            //! Write as much buffered output as the socket accepts.
+            /*!
+             \return False if the write failed, true otherwise.
+             */
+            virtual bool drain();
+
+            //! Test if output is waiting to be written.
+            virtual bool has_output() const;
+
+            //! Mark the connection as closed by the peer.
+            virtual void hang_up();
+
+            //! Test if the peer closed the connection.
+            virtual bool hung_up() const;
+
+            //! Test if the swimmer expects more input.
+            virtual bool is_running() const;
+
+            //! Get the socket descriptor.
+            virtual int socket() const;
+        private:
+            std::atomic<bool> is_running_;
+            bool hung_up_;
+            logjam::Network_socket client_socket_;
+            std::unique_ptr<logjam::Stage> stage_;
+            lj::bson::Decoder decoder_;
+            lj::Streambuf_buffer buffer_;
+            std::iostream stream_;
+        }; // class logjamd::pool::Swimmer_epoll
+
+        //! Event driven lifeguard. One epoll reactor.
+        /*!
+         Each lifeguard owns an epoll descriptor and runs in its own thread.
+         Swimmers are handed over through watch(), and handed back by the
+         executor through finished(). Both can be called from any thread.
+         All other methods are only called from the reactor thread.
+
+         While a swimmer runs on the executor, its socket is removed from
+         the epoll set so the reactor does not touch its buffers.
+         */
+        class Lifeguard_epoll : public logjam::pool::Lifeguard
+        {
+        public:
+            explicit Lifeguard_epoll(logjam::pool::Area& a);
+            Lifeguard_epoll(const Lifeguard_epoll& o) = delete;
+            Lifeguard_epoll(Lifeguard_epoll&& o) = delete;
+            Lifeguard_epoll& operator=(const Lifeguard_epoll& rhs) = delete;
+            Lifeguard_epoll& operator=(Lifeguard_epoll&& rhs) = delete;
+            virtual ~Lifeguard_epoll();
+
+            virtual void remove(logjam::pool::Swimmer* s) override;
+            virtual void watch(logjam::pool::Swimmer* s) override;
+            virtual void run() override;
+            virtual void stop();
+            virtual void cleanup() override;
+
+            //! Return a swimmer after its stages ran on the executor.
+            virtual void finished(Swimmer_epoll* s);
+        private:
+            void wake();
+            void adopt();
+            void service(Swimmer_epoll* s, uint32_t events);
+            void dispatch(Swimmer_epoll* s);
+            void settle(Swimmer_epoll* s);
+            void interest(Swimmer_epoll* s, uint32_t events);
+
+            std::atomic<bool> is_running_;
+            int epollfd_;
+            int eventfd_;
+            std::mutex pending_mutex_;
+            std::list<Swimmer_epoll*> pending_;
+            std::list<Swimmer_epoll*> returning_;
+            typedef std::map<Swimmer_epoll*, uint32_t> Swimmer_map;
+            Swimmer_map responsibilities_;
+        }; // class logjamd::pool::Lifeguard_epoll
+
+        //! Event driven area. Socket listener with epoll reactors.
+        /*!
+         Accepts connections on the calling thread, and hands them to a
+         fixed number of reactor threads. The number of reactors is read
+         from \c server/reactors, and defaults to the number of cores.
+         */
+        class Area_epoll : public logjam::pool::Area
+        {
+        public:
+            explicit Area_epoll(logjam::Environs&& env);
+            Area_epoll(const Area_epoll& o) = delete;
+            Area_epoll(Area_epoll&& o) = delete;
+            Area_epoll& operator=(const Area_epoll& rhs) = delete;
+            Area_epoll& operator=(Area_epoll&& rhs) = delete;
+            virtual ~Area_epoll();
+
+            virtual void prepare() override;
+            virtual void open() override;
+            virtual void close() override;
+            virtual void cleanup() override;
+        private:
+            std::atomic<bool> is_running_;
+            logjam::Network_socket listen_socket_;
+            std::vector<std::unique_ptr<Lifeguard_epoll> > lifeguards_;
+            std::vector<std::unique_ptr<lj::Thread> > lifeguard_threads_;
+        }; // class logjamd::pool::Area_epoll
+    }; // namespace logjamd::pool
+}; // namespace logjamd
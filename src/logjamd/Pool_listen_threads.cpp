@@ -37,8 +37,15 @@
 #include "logjamd/Server.h"
 #include "logjamd/Stage_pre.h"
 #include "logjam/Network_address_info.h"
+#include <cerrno>
 #include <memory>
 
+namespace
+{
+    const size_t k_read_size = 8192;
+    const int k_listen_backlog = 128;
+}; // namespace (anonymous)
+
 namespace logjamd
 {
     namespace pool
@@ -50,7 +57,10 @@ namespace logjamd
                 int sockfd) :
                 logjam::pool::Swimmer(lg, std::move(ctx)),
                 is_running_(false),
-                client_connection_(sockfd)
+                client_socket_(sockfd),
+                decoder_(lg.area().max_frame_size()),
+                buffer_(),
+                stream_(&buffer_)
         {
         }
 
@@ -62,10 +72,40 @@ namespace logjamd
 
             while (is_running_.load() && nullptr != stage)
             {
+                // Read on this thread until the stage can run without
+                // blocking a worker.
                 try
                 {
-                    stage = safe_execute_stage(stage, *this);
-                    io().flush();
+                    while (!stage->ready(buffer_.input_data(),
+                            buffer_.input_size(),
+                            decoder_))
+                    {
+                        if (!fill())
+                        {
+                            stage.reset();
+                            break;
+                        }
+                    }
+                }
+                catch (const lj::Exception& ex)
+                {
+                    stage.reset();
+                    lj::log::format<lj::Warning>("Rejected request: %s")
+                            << ex
+                            << lj::log::end;
+                }
+                if (nullptr == stage)
+                {
+                    break;
+                }
+                decoder_.reset();
+
+                try
+                {
+                    lifeguard().area().executor().execute([this, &stage]() {
+                        stage = safe_execute_stage(stage, *this);
+                        io().flush();
+                    });
                 }
                 catch (const lj::Exception& ex)
                 {
@@ -86,6 +126,15 @@ namespace logjamd
                     stage.reset();
                     lj::log::out<lj::Alert>("Encountered an unexpected Exception.");
                 }
+
+                // The buffer reports end of file instead of blocking, so
+                // reset the stream state for the next stage.
+                io().clear();
+                buffer_.compact_input();
+                if (!drain())
+                {
+                    stage.reset();
+                }
             }
 
             is_running_.store(false);
@@ -108,7 +157,46 @@ namespace logjamd
 
         std::iostream& Swimmer_listener::io()
         {
-            return client_connection_.stream();
+            return stream_;
+        }
+
+        bool Swimmer_listener::fill()
+        {
+            while (true)
+            {
+                char* ptr = buffer_.prepare_input(k_read_size);
+                ssize_t rc = ::recv(client_socket_.socket(), ptr, k_read_size, 0);
+                if (0 < rc)
+                {
+                    buffer_.commit_input(rc);
+                    return true;
+                }
+                else if (0 == rc || EINTR != errno)
+                {
+                    // Peer closed the connection, or the read failed.
+                    return false;
+                }
+            }
+        }
+
+        bool Swimmer_listener::drain()
+        {
+            while (0 < buffer_.output_size())
+            {
+                ssize_t rc = ::send(client_socket_.socket(),
+                        buffer_.output_data(),
+                        buffer_.output_size(),
+                        0);
+                if (0 <= rc)
+                {
+                    buffer_.consume_output(rc);
+                }
+                else if (EINTR != errno)
+                {
+                    return false;
+                }
+            }
+            return true;
         }
 
         //// Lifeguard_listener
@@ -210,6 +298,8 @@ namespace logjamd
 
         void Area_listener::prepare()
         {
+            logjam::pool::Area::prepare();
+
             // Figure out where we should be listening.
             std::string listen_on(lj::bson::as_string(
                     environs().config()["server/listen"]));
@@ -228,32 +318,9 @@ namespace logjamd
                 throw LJ__Exception(info.error());
             }
 
-            // Now create my socket descriptor for listening.
-            int sockfd = ::socket(info.current().ai_family,
-                    info.current().ai_socktype,
-                    info.current().ai_protocol);
-            if (0 > sockfd)
-            {
-                // Did not get a socket descriptor.
-                throw LJ__Exception(strerror(errno));
-            }
-
-            int rc = ::bind(sockfd,
-                    info.current().ai_addr,
-                    info.current().ai_addrlen);
-            if (0 > rc)
-            {
-                // Did not get a socket descriptor.
-                throw LJ__Exception(strerror(errno));
-            }
-
-            rc = ::listen(sockfd, 5);
-            if (0 > rc)
-            {
-                // did not bind the listener to a port.
-                throw LJ__Exception(strerror(errno));
-            }
-
+            // The lifeguard connection takes ownership of the descriptor.
+            int sockfd = logjam::socket_for_listening(info.current(),
+                    k_listen_backlog).release();
             lifeguard_.reset(new Lifeguard_listener(*this, sockfd));
         }
 
@@ -35,7 +35,10 @@
  */
 
 #include "logjam/Network_connection.h"
+#include "logjam/Network_socket.h"
 #include "logjam/Pool.h"
+#include "lj/Bson_decoder.h"
+#include "lj/Streambuf_buffer.h"
 #include <atomic>
 #include <map>
 
@@ -44,6 +47,12 @@ namespace logjamd
     namespace pool
     {
         //! Thread-per connection swimmer. Socket listener
+        /*!
+         The connection thread only performs the network IO. Once enough
+         input is buffered for the current stage, the stage logic is
+         executed on the area executor, so the number of stages running at
+         once is bounded by the number of workers.
+         */
         class Swimmer_listener : public logjam::pool::Swimmer
         {
         public:
@@ -61,8 +70,14 @@ namespace logjamd
             virtual void cleanup() override;
             virtual std::iostream& io() override;
         private:
+            bool fill();
+            bool drain();
+
             std::atomic<bool> is_running_;
-            logjam::Network_connection client_connection_;
+            logjam::Network_socket client_socket_;
+            lj::bson::Decoder decoder_;
+            lj::Streambuf_buffer buffer_;
+            std::iostream stream_;
         }; // class logjamd::pool::Swimmer_listener
 
         //! Thread-per connection lifeguard. Socket listener
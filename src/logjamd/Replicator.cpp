@@ -0,0 +1,337 @@
+/*!
+ \file Replicator.cpp
+ \brief Logjam server outbound peer replication implementation.
+ \author Jason Watson
+
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjamd/Replicator.h"
+#include "logjamd/Stage_replicate.h"
+#include "logjam/Client_socket.h"
+#include "lj/Bson.h"
+#include "lj/Exception.h"
+#include "lj/Log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    const std::string k_peer_mode("peer");
+    const std::string k_positions_suffix(".replication");
+
+    // Collection and position covered by a batch in flight.
+    struct Batch
+    {
+        std::string collection;
+        uint64_t sequence;
+    };
+}; // namespace (anonymous)
+
+namespace logjamd
+{
+    const size_t Replicator::k_batch_size = 128;
+    const size_t Replicator::k_batch_overhead = 4096;
+    const size_t Replicator::k_window = 8;
+    const std::chrono::milliseconds Replicator::k_poll_interval(50);
+    const std::chrono::milliseconds Replicator::k_retry_interval(1000);
+    const std::chrono::milliseconds Replicator::k_save_interval(1000);
+
+    Replicator::Replicator(logjam::storage::Storage& storage,
+            const lj::Uuid& server,
+            const std::string& secret,
+            const std::vector<std::string>& peers,
+            size_t max_frame_size) :
+            storage_(storage),
+            server_(server),
+            secret_(secret),
+            max_frame_size_(max_frame_size),
+            mutex_(),
+            stop_cv_(),
+            running_(true),
+            threads_()
+    {
+        for (const std::string& peer : peers)
+        {
+            threads_.emplace_back(new lj::Thread());
+            threads_.back()->run([this, peer]() { run(peer); }, []() {});
+        }
+    }
+
+    Replicator::~Replicator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        stop_cv_.notify_all();
+        for (auto& thread : threads_)
+        {
+            thread->join();
+        }
+    }
+
+    void Replicator::run(const std::string& peer)
+    {
+        // Positions survive reconnects and restarts, so only batches that
+        // were not acknowledged, or not saved yet, are sent again.
+        std::map<std::string, uint64_t> acked(load_positions(peer));
+        std::map<std::string, uint64_t> saved(acked);
+        while (running())
+        {
+            try
+            {
+                // The connection is not encrypted, so the secret is only
+                // used to answer the peer's challenge.
+                lj::bson::Node accepted;
+                std::unique_ptr<std::iostream> io(
+                        logjam::client::create_plain_connection(peer, k_peer_mode, accepted));
+                if (!accepted.exists("challenge"))
+                {
+                    throw LJ__Exception("Peer did not send a challenge.");
+                }
+
+                lj::bson::Node hello;
+                hello.set_child("server", lj::bson::new_uuid(server_));
+                hello.set_child("proof", lj::bson::new_string(Stage_replicate::proof(secret_,
+                        lj::bson::as_string(accepted["challenge"]),
+                        server_)));
+                (*io) << hello;
+                io->flush();
+
+                lj::bson::Node response;
+                (*io) >> response;
+                if (!io->good() || !logjam::client::is_success(response))
+                {
+                    throw LJ__Exception(std::string("Handshake refused: ") +
+                            logjam::client::message(response));
+                }
+
+                lj::log::format<lj::Info>("Replicating to %s.").end(peer);
+                stream(peer, *io, acked);
+            }
+            catch (lj::Exception& ex)
+            {
+                lj::log::format<lj::Warning>("Replication to %s failed: %s")
+                        << peer
+                        << ex
+                        << lj::log::end;
+            }
+            if (saved != acked)
+            {
+                save_positions(peer, acked);
+                saved = acked;
+            }
+            pause(k_retry_interval);
+        }
+    }
+
+    void Replicator::stream(const std::string& peer,
+            std::iostream& io,
+            std::map<std::string, uint64_t>& acked)
+    {
+        // Leave room for the batch fields and array keys, so a full batch
+        // still fits in a frame.
+        const size_t budget = max_frame_size_ -
+                std::min(k_batch_overhead, max_frame_size_ / 2);
+
+        std::map<std::string, uint64_t> sent(acked);
+        std::deque<Batch> outstanding;
+        uint64_t number = 0;
+        auto saved = std::chrono::steady_clock::now();
+        while (running())
+        {
+            // Fill the window before waiting on the peer. Whole documents
+            // are sent; the peer needs every version to merge them.
+            for (const std::string& name : storage_.names())
+            {
+                logjam::storage::Collection& coll = storage_.collection(name);
+                while (outstanding.size() < k_window)
+                {
+                    lj::bson::Node batch;
+                    batch.set_child("documents",
+                            new lj::bson::Node(lj::bson::Type::k_array, nullptr));
+                    size_t count = 0;
+                    uint64_t& position = sent[name];
+                    uint64_t last = coll.changes(position,
+                            k_batch_size,
+                            budget,
+                            [&batch, &count, &peer, &name, budget](const uint8_t* bytes) {
+                                lj::bson::View doc(bytes);
+                                if (doc.size() > budget)
+                                {
+                                    lj::log::format<lj::Error>("Document %llu in %s is too large to replicate to %s: %llu bytes.")
+                                            << lj::bson::as_uint64(doc["_/key"])
+                                            << name
+                                            << peer
+                                            << doc.size()
+                                            << lj::log::end;
+                                    return;
+                                }
+                                batch.push_child("documents",
+                                        new lj::bson::Node(lj::bson::Type::k_document, bytes));
+                                ++count;
+                            });
+                    if (last == position)
+                    {
+                        break;
+                    }
+                    position = last;
+                    if (0 == count)
+                    {
+                        // Everything in it was skipped.
+                        continue;
+                    }
+
+                    batch.set_child("batch", lj::bson::new_uint64(++number));
+                    batch.set_child("collection", lj::bson::new_string(name));
+                    io << batch;
+                    outstanding.push_back(Batch{name, last});
+                }
+            }
+            io.flush();
+
+            if (outstanding.empty())
+            {
+                pause(k_poll_interval);
+                continue;
+            }
+
+            // Batches are acknowledged in the order they were sent.
+            lj::bson::Node ack;
+            io >> ack;
+            if (!io.good())
+            {
+                throw LJ__Exception("Connection lost.");
+            }
+            if (!logjam::client::is_success(ack))
+            {
+                throw LJ__Exception(std::string("Batch rejected: ") +
+                        logjam::client::message(ack));
+            }
+            acked[outstanding.front().collection] = outstanding.front().sequence;
+            outstanding.pop_front();
+
+            lj::log::format<lj::Debug>("%s acknowledged batch %llu: %llu applied, %llu conflicts, %llu stale.")
+                    << peer
+                    << lj::bson::as_uint64(ack["batch"])
+                    << lj::bson::as_uint64(ack["applied"])
+                    << lj::bson::as_uint64(ack["conflicts"])
+                    << lj::bson::as_uint64(ack["stale"])
+                    << lj::log::end;
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - saved >= k_save_interval)
+            {
+                save_positions(peer, acked);
+                saved = now;
+            }
+        }
+    }
+
+    bool Replicator::running() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return running_;
+    }
+
+    void Replicator::pause(std::chrono::milliseconds interval)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_cv_.wait_for(lock, interval, [this]() { return !running_; });
+    }
+
+    std::string Replicator::positions_path(const std::string& peer) const
+    {
+        // Collection names never contain a dot, so this cannot clash
+        // with a collection directory.
+        return storage_.directory() + "/" + peer + k_positions_suffix;
+    }
+
+    std::map<std::string, uint64_t> Replicator::load_positions(const std::string& peer) const
+    {
+        // Positions are sequence numbers in the local collections, which
+        // are rebuilt the same way every time storage is opened.
+        std::map<std::string, uint64_t> acked;
+        FILE* file = fopen(positions_path(peer).c_str(), "r");
+        if (file)
+        {
+            unsigned long long position;
+            char name[256];
+            while (2 == fscanf(file, "%llu %255s", &position, name))
+            {
+                acked[name] = position;
+            }
+            fclose(file);
+        }
+        return acked;
+    }
+
+    void Replicator::save_positions(const std::string& peer,
+            const std::map<std::string, uint64_t>& acked) const
+    {
+        // A lost or stale file only means documents are sent again, and
+        // the peer drops the ones it already has.
+        std::string path(positions_path(peer));
+        std::string temp_path(path + ".tmp");
+        std::string contents;
+        for (const auto& position : acked)
+        {
+            contents += std::to_string(position.second) + " " +
+                    position.first + "\n";
+        }
+
+        int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 &&
+                static_cast<ssize_t>(contents.size()) ==
+                ::write(fd, contents.data(), contents.size()) &&
+                0 == fsync(fd);
+        int err = errno;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        if (!ok || rename(temp_path.c_str(), path.c_str()) < 0)
+        {
+            err = ok ? errno : err;
+            unlink(temp_path.c_str());
+            lj::log::format<lj::Warning>("Unable to save replication positions for %s: %s")
+                    << peer
+                    << strerror(err)
+                    << lj::log::end;
+        }
+    }
+}; // namespace logjamd
@@ -0,0 +1,162 @@
+#pragma once
+/*!
+ \file Replicator.h
+ \brief Logjam server outbound peer replication definition.
+ \author Jason Watson
+
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/storage/Storage.h"
+#include "lj/Thread.h"
+#include "lj/Uuid.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace logjamd
+{
+    /*!
+     \brief Ships document changes to the cluster peers.
+
+     Every server in a cluster accepts writes. Each peer listed in
+     \c server/cluster gets a thread that connects in \c peer mode and
+     streams the documents changed since the last batch the peer
+     acknowledged, read from logjam::storage::Collection::changes. Up to
+     #k_window batches are written before waiting for the oldest
+     acknowledgement, so the link is never idle on a round trip.
+
+     Batches hold whole documents, not deltas. The receiver merges by
+     vector clock and keeps sibling versions on conflict, which needs
+     every version in full; a diff only applies to the exact version it
+     was made against, and the peer may not have it. Batches are also
+     kept below the frame size. A document too large to send on its own
+     is logged and skipped.
+
+     The receiving Stage_replicate merges each document by vector clock
+     and stores anything new, which puts it in the receiver's own change
+     stream. Updates therefore also reach servers that are only
+     connected through other peers, and echoes are dropped as stale.
+     Every server ends up with every document, so reads can be served
+     by any of them.
+
+     When a connection fails, the thread reconnects after
+     #k_retry_interval and resends everything after the last
+     acknowledged batch. The acknowledged positions are saved in the
+     storage directory, at most every #k_save_interval and when the
+     thread stops, so a restarted server only resends what changed
+     since the last save.
+
+     Peer connections are not encrypted yet. The shared secret never
+     crosses the network; it only answers the peer's challenge. The
+     documents do cross it in the clear, so logjamd refuses to replicate
+     unless \c server/replication/plaintext is set to true.
+     \since 1.0
+     \sa logjamd::Stage_replicate
+     */
+    class Replicator
+    {
+    public:
+        //! Most documents sent in one batch.
+        static const size_t k_batch_size;
+
+        //! Room left in each batch frame for everything but documents.
+        static const size_t k_batch_overhead;
+
+        //! Most batches sent before waiting for an acknowledgement.
+        static const size_t k_window;
+
+        //! Time to wait for changes when there are none.
+        static const std::chrono::milliseconds k_poll_interval;
+
+        //! Time to wait before reconnecting to a failed peer.
+        static const std::chrono::milliseconds k_retry_interval;
+
+        //! Least time between saves of the acknowledged positions.
+        static const std::chrono::milliseconds k_save_interval;
+
+        /*!
+         \brief Start replicating to the peers.
+         \param storage The storage to replicate.
+         \param server The id of this server.
+         \param secret The secret shared by the cluster.
+         \param peers The \c "hostname@port" of each peer.
+         \param max_frame_size The largest frame a peer accepts.
+         */
+        Replicator(logjam::storage::Storage& storage,
+                const lj::Uuid& server,
+                const std::string& secret,
+                const std::vector<std::string>& peers,
+                size_t max_frame_size);
+
+        //! Deleted copy constructor.
+        Replicator(const Replicator& orig) = delete;
+
+        //! Deleted move constructor.
+        Replicator(Replicator&& orig) = delete;
+
+        //! Deleted copy assignment operator.
+        Replicator& operator=(const Replicator& orig) = delete;
+
+        //! Deleted move assignment operator.
+        Replicator& operator=(Replicator&& orig) = delete;
+
+        //! Destructor. Stops and joins the peer threads.
+        ~Replicator();
+
+    private:
+        void run(const std::string& peer);
+        void stream(const std::string& peer,
+                std::iostream& io,
+                std::map<std::string, uint64_t>& acked);
+        bool running() const;
+        void pause(std::chrono::milliseconds interval);
+        std::string positions_path(const std::string& peer) const;
+        std::map<std::string, uint64_t> load_positions(const std::string& peer) const;
+        void save_positions(const std::string& peer,
+                const std::map<std::string, uint64_t>& acked) const;
+
+        logjam::storage::Storage& storage_;
+        lj::Uuid server_;
+        std::string secret_;
+        size_t max_frame_size_;
+        mutable std::mutex mutex_;
+        std::condition_variable stop_cv_;
+        bool running_;
+        std::vector<std::unique_ptr<lj::Thread>> threads_;
+    }; // class logjamd::Replicator
+}; // namespace logjamd
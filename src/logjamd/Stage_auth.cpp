@@ -40,6 +40,7 @@
 #include "logjamd/constants.h"
 #include "logjam/User.h"
 #include "lj/Bson.h"
+#include "lj/Bson_schema.h"
 #include "lj/Log.h"
 #include "lj/Uuid.h"
 
@@ -55,6 +56,21 @@ namespace
     const std::string k_succeeded_auth_method("Authentication succeeded");
     const std::string k_keys_ignored("Authentication succeeded, but ignoring keys on an insecure connection.");
     const std::string k_keys_warning("Authentication succeeded, setting up keys on an insecure channel.");
+    const lj::bson::Path k_path_attempts("auth/attempts");
+    const lj::bson::Path k_path_success("success");
+
+    struct Auth_request
+    {
+        std::string method;
+        std::string provider;
+        lj::bson::View data;
+    };
+
+    const lj::bson::Schema<Auth_request,
+            lj::bson::Field<Auth_request, std::string, &Auth_request::method>,
+            lj::bson::Field<Auth_request, std::string, &Auth_request::provider>,
+            lj::bson::Field<Auth_request, lj::bson::View, &Auth_request::data> >
+            k_auth_request_schema("method", "provider", "data");
 };
 
 namespace logjamd
@@ -63,7 +79,7 @@ namespace logjamd
     {
         // abort if we have attempted to auth too many times.
         lj::bson::Node& attempts =
-                swmr.context().node().nav("auth/attempts");
+                swmr.context().node().nav(k_path_attempts);
         lj::bson::increment(attempts, 1);
         if (k_max_auth_attempts <= lj::bson::as_int64(attempts))
         {
@@ -72,15 +88,25 @@ namespace logjamd
             return std::unique_ptr<Stage>(nullptr);
         }
 
-        // Get the input data.
-        lj::bson::Node n;
+        // Get the input data. The request is only read, so it is viewed
+        // rather than parsed into a Node.
+        lj::bson::View n;
         swmr.io() >> n;
-        std::string method_name(lj::bson::as_string(n["method"]));
-        std::string provider_name(lj::bson::as_string(n["provider"]));
+        Auth_request request;
+        try
+        {
+            k_auth_request_schema.decode(n, request);
+        }
+        catch (lj::bson::Bson_type_exception& ex)
+        {
+            log("Malformed authentication request: %s").end(ex);
+        }
+        const std::string& method_name = request.method;
+        const std::string& provider_name = request.provider;
 
         // prepare the response
         lj::bson::Node response(response::new_empty(*this));
-        response.set_child("success", lj::bson::new_boolean(false));
+        response.set_child(k_path_success, lj::bson::new_boolean(false));
 
         log("Looking up method %s in provider %s.")
                 << method_name
@@ -94,7 +120,8 @@ namespace logjamd
                     auth_repo.provider(provider_name);
             logjam::Authentication_method& method =
                     provider.method(method_name);
-            lj::Uuid user_id(method.authenticate(n["data"]));
+            lj::Uuid user_id(method.authenticate(request.data ?
+                    request.data.to_node() : lj::bson::Node()));
 
             logjam::User_repository& user_repo =
                     swmr.context().environs().user_repository();
@@ -103,7 +130,7 @@ namespace logjamd
                     << user.name()
                     << lj::log::end;
 
-            response.set_child("success", lj::bson::new_boolean(true));
+            response.set_child(k_path_success, lj::bson::new_boolean(true));
             response.set_child("message", lj::bson::new_string(k_succeeded_auth_method));
             
             // update the ctx object for the right user.
@@ -134,7 +161,7 @@ namespace logjamd
 
         // selet the next stage.
         std::unique_ptr<Stage> next_stage;
-        if (lj::bson::as_boolean(response["success"]))
+        if (lj::bson::as_boolean(response[k_path_success]))
         {
             // TODO impersonation
 
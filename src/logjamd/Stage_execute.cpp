@@ -37,10 +37,15 @@
 #include "logjamd/Command_language.h"
 #include "logjamd/Response.h"
 #include "lua/Command_language_lua.h"
+#include "logjam/storage/Storage.h"
+#include "lj/Arena.h"
 #include "lj/Bson.h"
+#include "lj/Executor.h"
 #include "lj/Log.h"
 #include "lj/Stopclock.h"
+#include "lj/Wiper.h"
 #include <iostream>
+#include <memory>
 
 namespace
 {
@@ -56,8 +61,20 @@ namespace logjamd
         log("Executing command.").end();
         lj::Stopclock timer;
 
+        // The request and response trees are allocated from one arena and
+        // released together at the end of the request. The command runs
+        // outside the scope, so anything it adds to long lived trees
+        // (the context node, storage indexes) is allocated on the heap.
+        lj::Arena arena;
         lj::bson::Node request;
-        swmr.io() >> request;
+        lj::bson::Node response;
+        {
+            lj::Arena::Scope arena_scope(arena);
+            swmr.io() >> request;
+            response = response::new_empty(*this);
+            response.set_child("output",
+                    new lj::bson::Node(lj::bson::Type::k_array, NULL));
+        }
 
         // The command language should be swapped out for different langauges.
         // Lua is the only supported language right now.
@@ -66,12 +83,34 @@ namespace logjamd
 
         log("Using %s for the command language.").end(cmd_lang->name());
 
-        lj::bson::Node response(response::new_empty(*this));
-        response.set_child("output",
-                new lj::bson::Node(lj::bson::Type::k_array, NULL));
         bool result = cmd_lang->perform(swmr, request, response);
+
+        // Documents stored by the command must be on disk before the
+        // response is sent.
+        uint64_t lsn = swmr.context().lsn();
+        if (0 < lsn)
+        {
+            try
+            {
+                swmr.context().environs().storage().wait(lsn);
+            }
+            catch (lj::Exception& ex)
+            {
+                log("Unable to make stored documents durable: %s").end(ex);
+                response.set_child("message",
+                        lj::bson::new_string(ex.str()));
+                response.set_child("success",
+                        lj::bson::new_boolean(false));
+            }
+        }
         response.set_child("elapsed", lj::bson::new_uint64(timer.elapsed()));
-        swmr.io() << response;
+
+        // Large responses are serialized across the pool's workers.
+        size_t response_size;
+        std::unique_ptr<uint8_t[], lj::Wiper<uint8_t[]> > response_bytes(
+                response.to_binary(&response_size, swmr.lifeguard().area().executor()));
+        response_bytes.get_deleter().set_count(response_size);
+        swmr.io() << lj::bson::View(response_bytes.get());
 
         // Setup the return object.
         std::unique_ptr<Stage> next_stage(nullptr);
@@ -41,8 +41,10 @@
 #include "lj/Streambuf_pipe.h"
 
 #include <cassert>
+#include <cstring>
 #include <map>
 #include <iostream>
+#include <strings.h>
 
 namespace
 {
@@ -52,6 +54,8 @@ namespace
     const std::string REQUIRE_AUTH_PREFIX("~/");
     const std::string HEADER_LINE_ENDING("\r\n");
     const std::string HEADER_CONTENT_LENGTH("Content-Length: ");
+    const std::string HEADER_NAME_CONTENT_LENGTH("Content-Length");
+    const std::string HEADER_ETAG("ETag: ");
     const std::string HEADERS_AUTH_REQUIRED("HTTP/1.0 401 Unauthorized\r\nServer: Logjamd\r\nContent-Type: application/json; charset=\"UTF-8\"\r\nWWW-Authenticate: Basic realm=\"Secure Command Execution\"\r\n");
     const std::string HEADERS_FORBIDDEN("HTTP/1.0 403 Forbidden\r\nServer: Logjamd\r\nContent-Type: application/json; charset=\"UTF-8\"\r\n");
     const std::string HEADERS_SERVER_ERROR("HTTP/1.0 500 Internal Server Error\r\nServer: Logjamd\r\nContent-Type: application/json; charset=\"UTF-8\"\r\n");
@@ -89,6 +93,78 @@ namespace
         return result;
     }
     
+    //! Parse a Content-Length value. Only digits are accepted, surrounded
+    //! by optional whitespace, and the length may not exceed limit.
+    bool parse_content_length(const char* begin,
+            const char* end,
+            size_t limit,
+            size_t& length)
+    {
+        while (begin != end && (' ' == *begin || '\t' == *begin))
+        {
+            ++begin;
+        }
+        while (begin != end && (' ' == end[-1] || '\t' == end[-1] || '\r' == end[-1]))
+        {
+            --end;
+        }
+        if (begin == end)
+        {
+            return false;
+        }
+
+        size_t value = 0;
+        for (; begin != end; ++begin)
+        {
+            if (*begin < '0' || *begin > '9')
+            {
+                return false;
+            }
+            value = value * 10 + (*begin - '0');
+            if (value > limit)
+            {
+                return false;
+            }
+        }
+        length = value;
+        return true;
+    }
+
+    //! Find the Content-Length in a raw header block. Repeated headers must
+    //! agree. A missing header is a length of zero.
+    bool find_content_length(const char* headers,
+            size_t sz,
+            size_t limit,
+            size_t& length)
+    {
+        const size_t name_size = HEADER_NAME_CONTENT_LENGTH.size();
+        bool found = false;
+        length = 0;
+        size_t line = 0;
+        while (line < sz)
+        {
+            const char* nl = static_cast<const char*>(memchr(headers + line, '\n', sz - line));
+            const size_t line_end = nl ? nl - headers : sz;
+            if (line_end - line > name_size &&
+                    ':' == headers[line + name_size] &&
+                    0 == strncasecmp(headers + line, HEADER_NAME_CONTENT_LENGTH.c_str(), name_size))
+            {
+                size_t value;
+                if (!parse_content_length(headers + line + name_size + 1,
+                        headers + line_end,
+                        limit,
+                        value) || (found && value != length))
+                {
+                    return false;
+                }
+                length = value;
+                found = true;
+            }
+            line = line_end + 1;
+        }
+        return true;
+    }
+
     void header_to_key_value(const std::string& header,
             std::string& key,
             std::string& value)
@@ -142,6 +218,7 @@ namespace
                 uri_(),
                 http_version_major_(1),
                 http_version_minor_(0),
+                content_length_(0),
                 body_(nullptr)
         {
             if (m.compare("post") == 0)
@@ -202,15 +279,34 @@ namespace
         {
             http_version_minor_ = minor;
         }
-        int64_t content_length() const
+        size_t content_length() const
+        {
+            return content_length_;
+        }
+        //! Read the Content-Length header, which may not exceed limit.
+        //! Repeated headers must agree.
+        void read_content_length(size_t limit)
         {
-            int64_t length = 0;
-            auto iter = headers.find("Content-Length");
-            if (headers.end() != iter)
+            bool found = false;
+            content_length_ = 0;
+            for (auto& header : headers)
             {
-                length = atol(iter->second.c_str());
+                if (0 != strcasecmp(header.first.c_str(), HEADER_NAME_CONTENT_LENGTH.c_str()))
+                {
+                    continue;
+                }
+                size_t value;
+                if (!parse_content_length(header.second.data(),
+                        header.second.data() + header.second.size(),
+                        limit,
+                        value) || (found && value != content_length_))
+                {
+                    throw lj::Exception("Http Server",
+                            "Invalid Content-Length header.");
+                }
+                content_length_ = value;
+                found = true;
             }
-            return length;
         }
         const uint8_t* body() const
         {
@@ -228,6 +324,7 @@ namespace
         std::string uri_;
         int http_version_major_;
         int http_version_minor_;
+        size_t content_length_;
         uint8_t* body_;
     };
     
@@ -374,15 +471,18 @@ namespace
         lj::log::out<lj::Debug>("Done processing headers");
     }
     
-    void process_body_lines(Http_request& state, std::iostream& input_stream)
+    void process_body_lines(Http_request& state,
+            std::iostream& input_stream,
+            size_t max_frame_size)
     {
-        int64_t content_length = state.content_length();
+        state.read_content_length(max_frame_size);
+        size_t content_length = state.content_length();
         if (content_length > 0)
         {
             // Request says there should be some content in the body.
             // Read that content out and store it.
             uint8_t* buffer = new uint8_t[content_length];
-            int64_t indx = 0;
+            size_t indx = 0;
             while (indx < content_length)
             {
                 // Read the body bytes.
@@ -453,7 +553,9 @@ namespace logjamd
             ctx.data(req);
             process_first_line(*req, http_ios);
             process_header_lines(*req, http_ios);
-            process_body_lines(*req, http_ios);
+            process_body_lines(*req,
+                    http_ios,
+                    swmr.lifeguard().area().max_frame_size());
             req->real_stage.reset(new Stage_auth());
         }
         catch (const lj::Exception& ex)
@@ -633,7 +735,16 @@ namespace logjamd
 
             // This should be updated to deal with exceptions, etc.
             std::string body(lj::bson::as_json_string(response));
+
+            // The elapsed time differs on every run, so the ETag only
+            // covers the rest of the response.
+            lj::bson::Node stable(response);
+            stable.set_child("elapsed", nullptr);
+            uint8_t etag[lj::bson::k_content_hash_size];
+            lj::bson::content_hash(stable, etag);
             http_ios << HEADERS_SUCCESS
+                    << HEADER_ETAG << '"' << lj::base64_encode(etag, sizeof(etag)) << '"'
+                    << HEADER_LINE_ENDING
                     << HEADER_CONTENT_LENGTH << body.size()
                     << HEADER_LINE_ENDING << HEADER_LINE_ENDING
                     << body;
@@ -666,5 +777,70 @@ namespace logjamd
     {
         return std::unique_ptr<logjam::Stage>(new Stage_http_adapt(*this));
     }
-};
 
+    bool Stage_http_adapt::ready(const char* data,
+            size_t sz,
+            lj::bson::Decoder& decoder) const
+    {
+        // The frame size is known once the headers have been read.
+        if (0 < decoder.frame_size())
+        {
+            return sz >= decoder.frame_size();
+        }
+
+        // The headers end with an empty line, with or without the CR.
+        // Scanning resumes at the first line ending that could not be
+        // checked on the previous call.
+        size_t headers_end = 0;
+        size_t pos = decoder.position();
+        while (pos < sz)
+        {
+            const char* nl = static_cast<const char*>(memchr(data + pos, '\n', sz - pos));
+            if (!nl)
+            {
+                pos = sz;
+                break;
+            }
+            pos = nl - data;
+            if (pos + 1 == sz || ('\r' == data[pos + 1] && pos + 2 == sz))
+            {
+                break;
+            }
+            if ('\n' == data[pos + 1])
+            {
+                headers_end = pos + 2;
+                break;
+            }
+            if ('\r' == data[pos + 1] && '\n' == data[pos + 2])
+            {
+                headers_end = pos + 3;
+                break;
+            }
+            ++pos;
+        }
+
+        const size_t limit = decoder.max_frame_size();
+        if (0 == headers_end)
+        {
+            if (sz > limit)
+            {
+                throw LJ__Exception("HTTP headers exceed the maximum frame size.");
+            }
+            decoder.track(pos, 0);
+            return false;
+        }
+        if (headers_end > limit)
+        {
+            throw LJ__Exception("HTTP headers exceed the maximum frame size.");
+        }
+
+        // Wait for the body as well.
+        size_t content_length;
+        if (!find_content_length(data, headers_end, limit - headers_end, content_length))
+        {
+            throw LJ__Exception("Invalid or oversized Content-Length header.");
+        }
+        decoder.track(headers_end, headers_end + content_length);
+        return sz >= headers_end + content_length;
+    }
+};
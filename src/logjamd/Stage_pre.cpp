@@ -37,6 +37,7 @@
 #include "logjamd/Response.h"
 #include "logjamd/Stage_auth.h"
 #include "logjamd/Stage_http_adapt.h"
+#include "logjamd/Stage_replicate.h"
 #include "logjamd/constants.h"
 #include "logjam/User.h"
 
@@ -52,6 +53,8 @@ namespace
     const std::string k_tls_mode("+tls\n");
     const std::string k_peer_mode("peer\n");
     const std::string k_error_unknown_mode("Unknown mode: ");
+    const std::string k_error_no_replication("Replication is not enabled.");
+    const std::string k_error_no_plaintext("Replication over plain connections is not enabled.");
 };
 
 namespace logjamd
@@ -95,6 +98,31 @@ namespace logjamd
                     lj::bson::new_string("post"));
             return std::unique_ptr<logjam::Stage>(new Stage_http_adapt());
         }
+        else if (k_peer_mode.compare(buffer) == 0)
+        {
+            // Peers prove they know the shared secret, so the mode is
+            // refused when none is configured. Peer connections are not
+            // encrypted, so the mode also needs an explicit opt in.
+            const lj::bson::Node& config = swmr.context().environs().config();
+            if (!config.exists("server/replication/secret"))
+            {
+                log("Peer mode requested without a replication secret.").end();
+                swmr.io() << response::new_error(*this, k_error_no_replication);
+                return nullptr;
+            }
+            if (!Stage_replicate::plaintext_allowed(config))
+            {
+                log("Peer mode requested without server/replication/plaintext.").end();
+                swmr.io() << response::new_error(*this, k_error_no_plaintext);
+                return nullptr;
+            }
+            log("Using peer mode.").end();
+            lj::bson::Node response(response::new_empty(*this));
+            response.set_child("challenge", lj::bson::new_string(
+                    Stage_replicate::new_challenge(swmr)));
+            swmr.io() << response;
+            return std::unique_ptr<logjam::Stage>(new Stage_replicate());
+        }
         else
         {
             std::string mode(buffer, 4);
@@ -114,4 +142,25 @@ namespace logjamd
     {
         return std::unique_ptr<Stage>(new Stage_pre(*this));
     }
+
+    bool Stage_pre::ready(const char* data,
+            size_t sz,
+            lj::bson::Decoder& decoder) const
+    {
+        if (sz < k_http_post_mode.size())
+        {
+            return false;
+        }
+
+        // Post mode also consumes the slash after the mode.
+        std::locale loc;
+        for (size_t h = 0; h < k_http_post_mode.size(); ++h)
+        {
+            if (std::tolower(data[h], loc) != k_http_post_mode[h])
+            {
+                return true;
+            }
+        }
+        return sz > k_http_post_mode.size();
+    }
 };
@@ -60,6 +60,10 @@ namespace logjamd
                 logjam::pool::Swimmer& swmr) const override;
         virtual std::string name() const override;
         virtual std::unique_ptr<logjam::Stage> clone() const override;
+        virtual bool ready(const char* data,
+                size_t sz,
+                lj::bson::Decoder& decoder) const override;
+        using logjam::Stage::ready;
     };
 };
 
@@ -0,0 +1,226 @@
+/*!
+ \file Stage_replicate.cpp
+ \brief Logjam server peer replication stage implementation.
+ \author Jason Watson
+
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjamd/Stage_replicate.h"
+#include "logjamd/Response.h"
+#include "logjam/storage/Storage.h"
+#include "lj/Base64.h"
+#include "lj/Bson.h"
+#include "lj/Log.h"
+#include "lj/Stopclock.h"
+#include "nettle/hmac.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+namespace
+{
+    const lj::bson::Path k_path_peer("replication/peer");
+    const lj::bson::Path k_path_challenge("replication/challenge");
+    const size_t k_challenge_size = 32;
+    const std::string k_error_no_storage("Replication requires storage.");
+    const std::string k_error_bad_secret("Replication handshake failed.");
+
+    // Compare every byte so the time taken does not reveal the secret.
+    bool same_secret(const std::string& left, const std::string& right)
+    {
+        if (left.size() != right.size())
+        {
+            return false;
+        }
+        unsigned char diff = 0;
+        for (size_t h = 0; h < left.size(); ++h)
+        {
+            diff |= left[h] ^ right[h];
+        }
+        return 0 == diff;
+    }
+}; // namespace (anonymous)
+
+namespace logjamd
+{
+    std::unique_ptr<logjam::Stage> Stage_replicate::logic(
+            logjam::pool::Swimmer& swmr) const
+    {
+        lj::bson::Node request;
+        swmr.io() >> request;
+
+        logjam::Environs& env = swmr.context().environs();
+        if (!swmr.context().node().exists(k_path_peer))
+        {
+            // Stage_pre only enters this stage with a secret configured and
+            // a challenge issued. A challenge is only good for one attempt.
+            const std::string secret(lj::bson::as_string(
+                    env.config().nav("server/replication/secret")));
+            std::string challenge;
+            if (swmr.context().node().exists(k_path_challenge))
+            {
+                challenge = lj::bson::as_string(swmr.context().node()[k_path_challenge]);
+                swmr.context().node().set_child(k_path_challenge, nullptr);
+            }
+            if (challenge.empty() || !request.exists("proof") || !request.exists("server") ||
+                    !same_secret(lj::bson::as_string(request["proof"]),
+                            proof(secret, challenge, lj::bson::as_uuid(request["server"]))))
+            {
+                log("Rejected a peer handshake.").end();
+                swmr.io() << response::new_error(*this, k_error_bad_secret);
+                return nullptr;
+            }
+            if (!env.has_storage())
+            {
+                swmr.io() << response::new_error(*this, k_error_no_storage);
+                return nullptr;
+            }
+
+            std::string peer(lj::bson::as_uuid(request["server"]));
+            log("Accepted replication from %s.").end(peer);
+            swmr.context().node().set_child(k_path_peer, lj::bson::new_string(peer));
+            swmr.io() << response::new_empty(*this);
+            return clone();
+        }
+
+        lj::Stopclock timer;
+        lj::bson::Node response(response::new_empty(*this));
+        response.set_child("batch", new lj::bson::Node(request["batch"]));
+        try
+        {
+            logjam::storage::Storage& storage = env.storage();
+            std::string name(lj::bson::as_string(request["collection"]));
+            logjam::storage::Collection& coll = storage.collection(name);
+
+            uint64_t applied = 0;
+            uint64_t conflicts = 0;
+            uint64_t stale = 0;
+            uint64_t lsn = 0;
+            for (const lj::bson::Node* doc : request["documents"].to_vector())
+            {
+                uint64_t stored;
+                switch (coll.reconcile(*doc, stored))
+                {
+                    case logjam::storage::Collection::Reconciled::k_applied:
+                        ++applied;
+                        break;
+                    case logjam::storage::Collection::Reconciled::k_conflict:
+                        ++conflicts;
+                        break;
+                    default:
+                        ++stale;
+                        break;
+                }
+                lsn = std::max(lsn, stored);
+            }
+
+            // The peer moves past the batch once it is acknowledged, so
+            // the stored versions must be on disk first.
+            storage.wait(lsn);
+            response.set_child("applied", lj::bson::new_uint64(applied));
+            response.set_child("conflicts", lj::bson::new_uint64(conflicts));
+            response.set_child("stale", lj::bson::new_uint64(stale));
+            log("Applied batch from %s to %s: %llu applied, %llu conflicts, %llu stale in %llu ns.")
+                    << lj::bson::as_string(swmr.context().node()[k_path_peer])
+                    << name
+                    << applied
+                    << conflicts
+                    << stale
+                    << timer.elapsed()
+                    << lj::log::end;
+        }
+        catch (lj::Exception& ex)
+        {
+            log("Unable to apply batch: %s").end(ex);
+            response.set_child("message", lj::bson::new_string(ex.str()));
+            response.set_child("success", lj::bson::new_boolean(false));
+        }
+        swmr.io() << response;
+
+        // A failed batch ends the stream; the peer reconnects and resends
+        // everything after its last acknowledged batch.
+        if (!lj::bson::as_boolean(response["success"]))
+        {
+            return nullptr;
+        }
+        return clone();
+    }
+
+    std::string Stage_replicate::name() const
+    {
+        return std::string("Replication");
+    }
+
+    std::unique_ptr<logjam::Stage> Stage_replicate::clone() const
+    {
+        return std::unique_ptr<logjam::Stage>(new Stage_replicate(*this));
+    }
+
+    std::string Stage_replicate::new_challenge(logjam::pool::Swimmer& swmr)
+    {
+        uint8_t bytes[k_challenge_size];
+        std::fstream rnd("/dev/urandom", std::ios_base::in);
+        rnd.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+        if (!rnd)
+        {
+            throw LJ__Exception("Unable to read random bytes for the peer challenge.");
+        }
+        std::string challenge(lj::base64_encode(bytes, sizeof(bytes)));
+        swmr.context().node().set_child(k_path_challenge,
+                lj::bson::new_string(challenge));
+        return challenge;
+    }
+
+    std::string Stage_replicate::proof(const std::string& secret,
+            const std::string& challenge,
+            const lj::Uuid& server)
+    {
+        size_t server_sz;
+        const uint8_t* server_bytes = server.data(&server_sz);
+
+        struct hmac_sha256_ctx ctx;
+        hmac_sha256_set_key(&ctx, secret.size(),
+                reinterpret_cast<const uint8_t*>(secret.data()));
+        hmac_sha256_update(&ctx, challenge.size(),
+                reinterpret_cast<const uint8_t*>(challenge.data()));
+        hmac_sha256_update(&ctx, server_sz, server_bytes);
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        hmac_sha256_digest(&ctx, sizeof(digest), digest);
+        return lj::base64_encode(digest, sizeof(digest));
+    }
+
+    bool Stage_replicate::plaintext_allowed(const lj::bson::Node& config)
+    {
+        return config.exists("server/replication/plaintext") &&
+                lj::bson::as_boolean(config.nav("server/replication/plaintext"));
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+/*!
+ \file Stage_replicate.h
+ \brief Logjam server peer replication stage definition.
+ \author Jason Watson
+
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "logjam/Stage.h"
+#include "lj/Bson.h"
+#include "lj/Uuid.h"
+
+#include <string>
+
+namespace logjamd
+{
+    //! Replication stream from a cluster peer.
+    /*!
+     Entered from the \c peer mode, whose response carries a random
+     \c challenge. The first request is the handshake, proving the peer
+     knows \c server/replication/secret without sending it:
+     \code
+     { "server": <peer server id>, "proof": "<proof(secret, challenge, server)>" }
+     \endcode
+     Every later request is a batch of changed documents for one
+     collection:
+     \code
+     { "batch": 1, "collection": "users", "documents": [ ... ] }
+     \endcode
+     Each document is merged with logjam::storage::Collection::reconcile,
+     and the batch is acknowledged once the stored versions are durable.
+     The peer may send several batches before reading the first
+     acknowledgement; batches are applied and acknowledged in order.
+
+     Peer connections do not negotiate TLS yet, so documents cross the
+     network in the clear. Peer mode is refused unless
+     \c server/replication/plaintext is set to true, which should only
+     be done when the links between servers are otherwise protected.
+     \since 1.0
+     \sa logjamd::Replicator
+     */
+    class Stage_replicate : public logjam::Stage
+    {
+    public:
+        Stage_replicate() = default;
+        Stage_replicate(const Stage_replicate& o) = default;
+        Stage_replicate(Stage_replicate&& o) = default;
+        Stage_replicate& operator=(const Stage_replicate& rhs) = default;
+        Stage_replicate& operator=(Stage_replicate&& rhs) = default;
+        virtual ~Stage_replicate() = default;
+        virtual std::unique_ptr<logjam::Stage> logic(
+                logjam::pool::Swimmer& swmr) const override;
+        virtual std::string name() const override;
+        virtual std::unique_ptr<logjam::Stage> clone() const override;
+
+        /*!
+         \brief Issue a handshake challenge for a connection.
+
+         The challenge is kept in the connection context until the
+         handshake uses it.
+         \param swmr The connection entering peer mode.
+         \return Random bytes, base64 encoded.
+         */
+        static std::string new_challenge(logjam::pool::Swimmer& swmr);
+
+        /*!
+         \brief Answer a handshake challenge.
+
+         HMAC-SHA256 keyed with the secret over the challenge and the id
+         of the answering server.
+         \param secret The secret shared by the cluster.
+         \param challenge The challenge from new_challenge().
+         \param server The id of the answering server.
+         \return The proof, base64 encoded.
+         */
+        static std::string proof(const std::string& secret,
+                const std::string& challenge,
+                const lj::Uuid& server);
+
+        /*!
+         \brief Test if replication may use plain connections.
+         \param config The server configuration.
+         \return True if \c server/replication/plaintext is true.
+         */
+        static bool plaintext_allowed(const lj::bson::Node& config);
+    };
+};
@@ -35,16 +35,23 @@
 
 #include "lj/Args.h"
 #include "logjamd/Auth_local.h"
+#include "logjamd/Pool_epoll.h"
 #include "logjamd/Pool_listen_threads.h"
+#include "logjamd/Replicator.h"
+#include "logjamd/Stage_replicate.h"
 #include "logjamd/constants.h"
 #include "logjam/User.h"
+#include "logjam/storage/Storage.h"
 
+#include <algorithm>
+#include <chrono>
 #include <csignal>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 static void setup_credentials(
         logjam::Authentication_method& method,
@@ -128,13 +135,129 @@ int main(int argc, char* const argv[]) {
             logjamd::k_user_password_http);
 
     // Run the server.
-    logjam::Environs environs(std::move(*config), &user_repo, &auth_repo);
-    logjamd::pool::Area_listener inbound(std::move(environs));
+    std::string pool_type("threads");
+    if (config->exists("server/pool"))
+    {
+        pool_type = lj::bson::as_string(config->nav("server/pool"));
+    }
+    std::unique_ptr<logjam::storage::Storage> storage;
+    if (config->exists("server/storage/path"))
+    {
+        std::string storage_path(lj::bson::as_string(config->nav("server/storage/path")));
+        lj::log::format<lj::Info>("Opening storage in %s.").end(storage_path);
+        try
+        {
+            int64_t flush_interval = logjam::storage::Wal::k_default_flush_interval.count();
+            if (config->exists("server/storage/wal/flush_interval_ms"))
+            {
+                flush_interval = lj::bson::as_int64(config->nav("server/storage/wal/flush_interval_ms"));
+            }
+            int64_t batch_size = logjam::storage::Wal::k_default_batch_size;
+            if (config->exists("server/storage/wal/batch_size"))
+            {
+                batch_size = lj::bson::as_int64(config->nav("server/storage/wal/batch_size"));
+            }
+            int64_t cache_mb = logjam::storage::Buffer_pool::k_default_size / (1024 * 1024);
+            if (config->exists("server/storage/cache_mb"))
+            {
+                cache_mb = lj::bson::as_int64(config->nav("server/storage/cache_mb"));
+            }
+            storage.reset(new logjam::storage::Storage(storage_path,
+                    std::chrono::milliseconds(std::max<int64_t>(0, flush_interval)),
+                    std::max<int64_t>(1, batch_size),
+                    logjam::storage::Segment::k_default_capacity,
+                    std::max<int64_t>(1, cache_mb) * 1024 * 1024));
+
+            // Write-heavy collections are declared as
+            // server/storage/lsm = ["<collection>", ...], and must be
+            // opened before the log is replayed.
+            if (config->exists("server/storage/lsm"))
+            {
+                for (const lj::bson::Node* name : config->nav("server/storage/lsm").to_vector())
+                {
+                    storage->lsm(lj::bson::as_string(*name));
+                }
+            }
+
+            // Secondary indexes are declared per collection as
+            // server/storage/indexes/<collection>/<index> = "<field path>".
+            if (config->exists("server/storage/indexes"))
+            {
+                const lj::bson::Node& indexes = config->nav("server/storage/indexes");
+                for (auto coll = indexes.begin(); indexes.end() != coll; ++coll)
+                {
+                    for (auto idx = coll->begin(); coll->end() != idx; ++idx)
+                    {
+                        storage->collection(coll.key()).add_index(idx.key(),
+                                lj::bson::as_string(idx.value()));
+                    }
+                }
+            }
+        }
+        catch (lj::Exception& ex)
+        {
+            lj::log::format<lj::Critical>("Failure: %s").end(ex);
+            return 1;
+        }
+    }
+    logjam::Environs environs(std::move(*config),
+            &user_repo,
+            &auth_repo,
+            storage.get());
+    std::unique_ptr<logjam::pool::Area> inbound;
+    if (pool_type.compare("epoll") == 0)
+    {
+        lj::log::out<lj::Info>("Using the epoll reactor pool.");
+        inbound.reset(new logjamd::pool::Area_epoll(std::move(environs)));
+    }
+    else
+    {
+        lj::log::out<lj::Info>("Using the thread-per-connection pool.");
+        inbound.reset(new logjamd::pool::Area_listener(std::move(environs)));
+    }
 
+    // The replicator is stopped before the pool and storage go away.
+    std::unique_ptr<logjamd::Replicator> replicator;
     try
     {
-        inbound.prepare();
-        inbound.open();
+        inbound->prepare();
+
+        // Cluster peers are declared as server/cluster = ["host@port", ...].
+        // Replication starts once the log has been recovered.
+        const lj::bson::Node& cfg = inbound->environs().config();
+        std::vector<std::string> peers;
+        if (cfg.exists("server/cluster"))
+        {
+            for (const lj::bson::Node* peer : cfg.nav("server/cluster").to_vector())
+            {
+                peers.push_back(lj::bson::as_string(*peer));
+            }
+        }
+        if (!peers.empty())
+        {
+            if (!storage)
+            {
+                throw lj::Exception("logjamd", "Replication requires server/storage.");
+            }
+            if (!cfg.exists("server/id") || !cfg.exists("server/replication/secret"))
+            {
+                throw lj::Exception("logjamd", "Replication requires server/id and server/replication/secret.");
+            }
+            if (!logjamd::Stage_replicate::plaintext_allowed(cfg))
+            {
+                // TODO replace this with +tls once peer mode supports it.
+                throw lj::Exception("logjamd", "Peer connections are not encrypted. Set server/replication/plaintext to true only if the links between servers are otherwise protected.");
+            }
+            lj::log::out<lj::Warning>("Replicating over unencrypted peer connections.");
+            lj::log::format<lj::Info>("Replicating to %d peers.").end(peers.size());
+            replicator.reset(new logjamd::Replicator(*storage,
+                    lj::bson::as_uuid(cfg.nav("server/id")),
+                    lj::bson::as_string(cfg.nav("server/replication/secret")),
+                    peers,
+                    inbound->max_frame_size()));
+        }
+
+        inbound->open();
     }
     catch (lj::Exception& ex)
     {
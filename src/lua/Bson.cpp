@@ -55,6 +55,10 @@ namespace lua
         ,LUNAR_METHOD(Bson, set_int32)
         ,LUNAR_METHOD(Bson, set_int64)
         ,LUNAR_METHOD(Bson, set_uuid)
+        ,LUNAR_METHOD(Bson, set_datetime)
+        ,LUNAR_METHOD(Bson, set_timestamp)
+        ,LUNAR_METHOD(Bson, set_regex)
+        ,LUNAR_METHOD(Bson, set_javascript)
         ,LUNAR_METHOD(Bson, as_string)
         ,LUNAR_METHOD(Bson, as_nil)
         ,LUNAR_METHOD(Bson, as_table)
@@ -67,7 +71,8 @@ namespace lua
     };
 
     Bson::Bson(lua_State* L) :
-            node_(new lj::bson::Node())
+            root_(new lj::bson::Node()),
+            path_()
     {
         int top = lua_gettop(L);
         if (top == 1)
@@ -79,7 +84,7 @@ namespace lua
                     // Try to read an existing bson object from the user
                     // data.
                     Bson* orig = Lunar<lua::Bson>::check(L, 1);
-                    node_->copy_from(orig->node());
+                    root_->copy_from(orig->cnode());
                 }
                 else
                 {
@@ -88,7 +93,7 @@ namespace lua
                     lua_pop(L, 1);
                     std::unique_ptr<lj::bson::Node> n(
                             lj::bson::parse_json(tmp));
-                    node_->copy_from(*n);
+                    root_->copy_from(*n);
                 }
             }
             catch (lj::Exception& ex)
@@ -100,14 +105,26 @@ namespace lua
     }
 
     Bson::Bson(const lj::bson::Node& val) :
-            node_(new lj::bson::Node(val))
+            root_(new lj::bson::Node(val)),
+            path_()
     {
     }
 
     Bson::Bson(std::shared_ptr<lj::bson::Node>& root,
             const std::string& path) : 
-            node_(root, root->path(path))
+            root_(root),
+            path_(path)
     {
+        // Create the path now, like the original navigation did.
+        node();
+    }
+
+    Bson::Bson(std::shared_ptr<lj::bson::Node>& root,
+            const lj::bson::Path& path) :
+            root_(root),
+            path_(path)
+    {
+        node();
     }
 
     Bson::~Bson()
@@ -116,19 +133,26 @@ namespace lua
 
     lj::bson::Node& Bson::node()
     {
-        return *node_;
+        return root_->nav(path_);
+    }
+
+    const lj::bson::Node& Bson::cnode() const
+    {
+        const lj::bson::Node* n =
+                static_cast<const lj::bson::Node&>(*root_).path(path_);
+        return n ? *n : const_cast<Bson*>(this)->node();
     }
 
     int Bson::type(lua_State* L)
     {
-        std::string tmp(lj::bson::type_string(node_->type()));
+        std::string tmp(lj::bson::type_string(cnode().type()));
         lua_pushstring(L, tmp.c_str());
         return 1;
     }
 
     int Bson::nullify(lua_State* L)
     {
-        node_->nullify();
+        node().nullify();
         return 0;
     }
 
@@ -138,7 +162,13 @@ namespace lua
         lua_pop(L, 1);
         try
         {
-            Lunar<lua::Bson>::push(L, new Bson(node_, tmp), true);
+            lj::bson::Path child(path_);
+            const lj::bson::Path relative(tmp);
+            for (auto iter = relative.begin(); relative.end() != iter; ++iter)
+            {
+                child.push_back(*iter);
+            }
+            Lunar<lua::Bson>::push(L, new Bson(root_, child), true);
         }
         catch (lj::Exception& ex)
         {
@@ -157,11 +187,11 @@ namespace lua
             {
                 std::string tmp(lua::as_string(L, -1));
                 lua_pop(L, 1);
-                Lunar<lua::Bson>::push(L, new Bson(node_->nav(tmp)), true);
+                Lunar<lua::Bson>::push(L, new Bson(node().nav(tmp)), true);
             }
             else
             {
-                Lunar<lua::Bson>::push(L, new Bson(*node_), true);
+                Lunar<lua::Bson>::push(L, new Bson(cnode()), true);
             }
         }
         catch (lj::Exception& ex)
@@ -182,13 +212,13 @@ namespace lua
                 std::string tmp(lua::as_string(L, -1));
                 lua_pop(L, 1);
                 Lunar<lua::Bson_ro>::push(L,
-                        new Bson_ro(node_->nav(tmp)),
+                        new Bson_ro(node().nav(tmp)),
                         true);
             }
             else
             {
                 Lunar<lua::Bson_ro>::push(L,
-                        new Bson_ro(*node_),
+                        new Bson_ro(cnode()),
                         true);
             }
         }
@@ -205,7 +235,7 @@ namespace lua
         std::string tmp(lua::as_string(L, -1));
         try
         {
-            node_->set_child(tmp, lj::bson::new_null());
+            node().set_child(tmp, lj::bson::new_null());
         }
         catch (lj::Exception& ex)
         {
@@ -224,12 +254,12 @@ namespace lua
             if (top == 2)
             {
                 Bson* val = Lunar<Bson>::check(L, 2);
-                node_->set_child(tmp,
-                        new lj::bson::Node(val->node()));
+                node().set_child(tmp,
+                        new lj::bson::Node(val->cnode()));
             }
             else
             {
-                node_->set_child(tmp, new lj::bson::Node());
+                node().set_child(tmp, new lj::bson::Node());
             }
         }
         catch (lj::Exception& ex)
@@ -250,12 +280,12 @@ namespace lua
             if (top == 2)
             {
                 Bson* val = Lunar<Bson>::check(L, 2);
-                node_->set_child(tmp,
-                        new lj::bson::Node(val->node()));
+                node().set_child(tmp,
+                        new lj::bson::Node(val->cnode()));
             }
             else
             {
-                node_->set_child(tmp, lj::bson::new_array());
+                node().set_child(tmp, lj::bson::new_array());
             }
         }
         catch (lj::Exception& ex)
@@ -272,7 +302,7 @@ namespace lua
         std::string tmp(lua::as_string(L, -2));
         try
         {
-            node_->set_child(tmp,
+            node().set_child(tmp,
                     lj::bson::new_boolean(lua_toboolean(L, -1)));
         }
         catch (lj::Exception& ex)
@@ -288,7 +318,7 @@ namespace lua
         std::string tmp(lua::as_string(L, -2));
         try
         {
-            node_->set_child(tmp,
+            node().set_child(tmp,
                     lj::bson::new_string(lua::as_string(L, -1)));
         }
         catch (lj::Exception& ex)
@@ -304,7 +334,7 @@ namespace lua
         std::string tmp(lua::as_string(L, -2));
         try
         {
-            node_->set_child(tmp,
+            node().set_child(tmp,
                     lj::bson::new_int32(lua_tointeger(L, -1)));
         }
         catch (lj::Exception& ex)
@@ -320,7 +350,7 @@ namespace lua
         std::string tmp(lua::as_string(L, -2));
         try
         {
-            node_->set_child(tmp,
+            node().set_child(tmp,
                     lj::bson::new_int64(lua_tointeger(L, -1)));
         }
         catch (lj::Exception& ex)
@@ -337,7 +367,7 @@ namespace lua
         try
         {
             Uuid* val = Lunar<Uuid>::check(L, -1);
-            node_->set_child(tmp,
+            node().set_child(tmp,
                     lj::bson::new_uuid(val->id()));
         }
         catch (lj::Exception& ex)
@@ -348,9 +378,74 @@ namespace lua
         return 0;
     }
 
+    int Bson::set_datetime(lua_State* L)
+    {
+        std::string tmp(lua::as_string(L, -2));
+        try
+        {
+            node().set_child(tmp,
+                    lj::bson::new_datetime(lua_tointeger(L, -1)));
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+        return 0;
+    }
+
+    int Bson::set_timestamp(lua_State* L)
+    {
+        std::string tmp(lua::as_string(L, -2));
+        try
+        {
+            node().set_child(tmp,
+                    lj::bson::new_timestamp(lua_tointeger(L, -1)));
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+        return 0;
+    }
+
+    int Bson::set_regex(lua_State* L)
+    {
+        std::string tmp(lua::as_string(L, -3));
+        try
+        {
+            node().set_child(tmp,
+                    lj::bson::new_regex(lua::as_string(L, -2),
+                            lua::as_string(L, -1)));
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+        return 0;
+    }
+
+    int Bson::set_javascript(lua_State* L)
+    {
+        std::string tmp(lua::as_string(L, -2));
+        try
+        {
+            node().set_child(tmp,
+                    lj::bson::new_javascript(lua::as_string(L, -1)));
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+        return 0;
+    }
+
     int Bson::as_string(lua_State* L)
     {
-        std::string tmp(lj::bson::as_string(*node_));
+        std::string tmp(lj::bson::as_string(cnode()));
         lua_pushstring(L, tmp.c_str());
         return 1;
     }
@@ -363,27 +458,25 @@ namespace lua
 
     int Bson::as_table(lua_State* L)
     {
-        if (lj::bson::Type::k_document == node_->type())
+        const lj::bson::Node& n = cnode();
+        if (lj::bson::Type::k_document == n.type())
         {
-            std::map<std::string, lj::bson::Node*> tmp =
-                    node_->to_map();
-            lua_createtable(L, 0, tmp.size());
+            lua_createtable(L, 0, n.count());
             int table = lua_gettop(L);
-            for (auto iter = tmp.begin();
-                    tmp.end() != iter;
+            for (auto iter = n.begin();
+                    n.end() != iter;
                     ++iter)
             {
-                lua_pushstring(L, (*iter).first.c_str());
+                lua_pushstring(L, iter.key().c_str());
                 Lunar<Bson_ro>::push(L,
-                        new Bson_ro(*((*iter).second)),
+                        new Bson_ro(*iter),
                         true);
                 lua_rawset(L, table);
             }
         }
-        else if (lj::bson::Type::k_array == node_->type())
+        else if (lj::bson::Type::k_array == n.type())
         {
-            std::vector<lj::bson::Node*> tmp = 
-                    node_->to_vector();
+            const lj::bson::Node::Array& tmp = n.to_vector();
             lua_createtable(L, tmp.size(), 0);
             int table = lua_gettop(L);
             int i = 1;
@@ -406,21 +499,21 @@ namespace lua
 
     int Bson::as_number(lua_State* L)
     {
-        int64_t tmp = lj::bson::as_int64(*node_);
+        int64_t tmp = lj::bson::as_int64(cnode());
         lua_pushinteger(L, tmp);
         return 1;
     }
 
     int Bson::as_boolean(lua_State* L)
     {
-        bool tmp = lj::bson::as_boolean(*node_);
+        bool tmp = lj::bson::as_boolean(cnode());
         lua_pushboolean(L, tmp);
         return 1;
     }
 
     int Bson::__tostring(lua_State* L)
     {
-        std::string tmp(lj::bson::as_json_string(*node_));
+        std::string tmp(lj::bson::as_json_string(cnode()));
         lua_pushstring(L, tmp.c_str());
         return 1;
     }
@@ -432,7 +525,7 @@ namespace lua
 
     int Bson::as_uuid(lua_State* L)
     {
-        Lunar<Uuid>::push(L, new Uuid(lj::bson::as_uuid(*node_)), true);
+        Lunar<Uuid>::push(L, new Uuid(lj::bson::as_uuid(cnode())), true);
         return 1;
     }
 
@@ -468,11 +561,10 @@ namespace lua
 
     int Bson_ro::path(lua_State* L)
     {
-        const lj::bson::Node& cnode(node());
         std::string tmp(lua::as_string(L, -1));
         try
         {
-            Lunar<lua::Bson_ro>::push(L, new Bson_ro(cnode.nav(tmp)), true);
+            Lunar<lua::Bson_ro>::push(L, new Bson_ro(cnode().nav(tmp)), true);
         }
         catch (lj::Exception& ex)
         {
@@ -487,15 +579,14 @@ namespace lua
         int top = lua_gettop(L);
         try
         {
-            const lj::bson::Node& cnode(node());
             if (top == 1)
             {
                 std::string tmp(lua::as_string(L, -1));
-                Lunar<lua::Bson_ro>::push(L, new Bson_ro(cnode.nav(tmp)), true);
+                Lunar<lua::Bson_ro>::push(L, new Bson_ro(cnode().nav(tmp)), true);
             }
             else
             {
-                Lunar<lua::Bson_ro>::push(L, new Bson_ro(cnode), true);
+                Lunar<lua::Bson_ro>::push(L, new Bson_ro(cnode()), true);
             }
         }
         catch (lj::Exception& ex)
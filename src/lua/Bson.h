@@ -47,7 +47,8 @@ namespace lua
     class Bson
     {
     private:
-        std::shared_ptr<lj::bson::Node> node_; //!< Pointer to the real Bson node.
+        std::shared_ptr<lj::bson::Node> root_; //!< The root of the real Bson node.
+        lj::bson::Path path_; //!< Path from the root to the real Bson node.
     public:
         static const char LUNAR_CLASS_NAME[]; //!< Table name for Lua.
         static Lunar<Bson>::RegType LUNAR_METHODS[]; //!< Array of methods to register in Lua.
@@ -79,12 +80,19 @@ namespace lua
          will cascade and release all the memory associated with the children,
          this constructor pins memory management on the root. while all the
          methods will be performed against the provided path.
+         \par
+         The path is followed from the root on every call, so changes
+         to copies of the root never leak into this object.
          \param root The root of the Bson node.
          \param path The path this node represents from the root.
          */
         Bson(std::shared_ptr<lj::bson::Node>& root,
                 const std::string& path);
 
+        //! Pre-parsed version of the root and path constructor.
+        Bson(std::shared_ptr<lj::bson::Node>& root,
+                const lj::bson::Path& path);
+
         //! Destructor.
         virtual ~Bson();
 
@@ -96,6 +104,15 @@ namespace lua
          */
         lj::bson::Node& node();
 
+        //! Get the underlying lj::bson::Node for reading.
+        /*!
+         \par
+         Unlike node(), this does not unshare the node from copies of
+         the root.
+         \return A reference to the underlying node.
+         */
+        const lj::bson::Node& cnode() const;
+
         //! Get the bson type of the node.
         /*!
          \par Lua Parameters
@@ -131,6 +148,10 @@ namespace lua
         int set_int32(lua_State* L);
         int set_int64(lua_State* L);
         int set_uuid(lua_State* L);
+        int set_datetime(lua_State* L);
+        int set_timestamp(lua_State* L);
+        int set_regex(lua_State* L);
+        int set_javascript(lua_State* L);
         int as_string(lua_State* L);
         int as_nil(lua_State* L);
         int as_table(lua_State* L);
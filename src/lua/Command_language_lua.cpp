@@ -37,7 +37,14 @@
 #include "lua/Bson.h"
 #include "lua/Document.h"
 #include "lua/Uuid.h"
+#include "logjam/storage/Storage.h"
+#include "lj/Exception.h"
 #include "lua.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
 #include <sstream>
 
 namespace
@@ -119,6 +126,249 @@ namespace
         return 0;
     }
 
+    int storage_store(lua_State* L)
+    {
+        logjam::pool::Swimmer* swmr = static_cast<logjam::pool::Swimmer*>(
+                lua_touserdata(L, lua_upvalueindex(1)));
+
+        std::string name(lua::as_string(L, 1));
+        lua::Document* doc = lua::Lunar<lua::Document>::check(L, 2);
+        try
+        {
+            // Remember the log position so the response waits for it.
+            logjam::Context& ctx = swmr->context();
+            logjam::storage::Storage& storage = ctx.environs().storage();
+            if (storage.is_lsm(name))
+            {
+                ctx.lsn(storage.lsm(name).store(doc->document()));
+            }
+            else
+            {
+                ctx.lsn(storage.collection(name).store(doc->document()));
+            }
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+        return 0;
+    }
+
+    // Lua numbers are doubles, so keys past 2^53 must be passed as
+    // decimal strings. Numbers that may have been rounded are rejected
+    // rather than fetching a neighbouring record.
+    uint64_t storage_key(lua_State* L, int offset)
+    {
+        if (LUA_TSTRING == lua_type(L, offset))
+        {
+            std::string str(lua::as_string(L, offset));
+            char* end = nullptr;
+            errno = 0;
+            unsigned long long key = strtoull(str.c_str(), &end, 10);
+            if (str.empty() || !isdigit(static_cast<unsigned char>(str[0])) ||
+                    '\0' != *end || ERANGE == errno)
+            {
+                throw LJ__Exception(std::string("Invalid document key: ") + str);
+            }
+            return key;
+        }
+
+        lua_Number num = lua_tonumber(L, offset);
+        if (num < 0 || num >= 9007199254740992.0 || num != std::floor(num))
+        {
+            throw LJ__Exception(std::string("Document key cannot be represented exactly, pass it as a string: ") +
+                    lua::as_string(L, offset));
+        }
+        return static_cast<uint64_t>(num);
+    }
+
+    int storage_fetch(lua_State* L)
+    {
+        logjam::pool::Swimmer* swmr = static_cast<logjam::pool::Swimmer*>(
+                lua_touserdata(L, lua_upvalueindex(1)));
+
+        std::string name(lua::as_string(L, 1));
+        const uint8_t* bytes = nullptr;
+        try
+        {
+            logjam::storage::Storage& storage = swmr->context().environs().storage();
+            if (storage.is_lsm(name))
+            {
+                // LSM collections only keep the latest version by key.
+                lj::bson::Node* found = storage.lsm(name).fetch(
+                        storage_key(L, 2));
+                if (!found)
+                {
+                    lua_pushnil(L);
+                    return 1;
+                }
+                lj::Document* doc = new lj::Document(found, true);
+                lua::Lunar<lua::Document>::push(L, new lua::Document(doc, true), true);
+                return 1;
+            }
+
+            logjam::storage::Collection& coll = storage.collection(name);
+            if (LUA_TNUMBER == lua_type(L, 2) || LUA_TSTRING == lua_type(L, 2))
+            {
+                bytes = coll.read(storage_key(L, 2));
+            }
+            else
+            {
+                bytes = coll.read(lua::Lunar<lua::Uuid>::check(L, 2)->id());
+            }
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+
+        if (!bytes)
+        {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        // The bytes point straight into the segment, so the document is
+        // parsed from the mapped file without an intermediate copy.
+        lj::Document* doc = new lj::Document(
+                new lj::bson::Node(lj::bson::Type::k_document, bytes),
+                true);
+        lua::Lunar<lua::Document>::push(L, new lua::Document(doc, true), true);
+        return 1;
+    }
+
+    lj::bson::Node* scan_bound(lua_State* L, int offset)
+    {
+        switch (lua_type(L, offset))
+        {
+            case LUA_TNONE:
+            case LUA_TNIL:
+                return nullptr;
+            case LUA_TBOOLEAN:
+                return lj::bson::new_boolean(lua_toboolean(L, offset));
+            case LUA_TNUMBER:
+            {
+                double d = lua_tonumber(L, offset);
+                return new lj::bson::Node(lj::bson::Type::k_double,
+                        reinterpret_cast<const uint8_t*>(&d));
+            }
+            case LUA_TSTRING:
+                return lj::bson::new_string(lua::as_string(L, offset));
+            default:
+                return new lj::bson::Node(
+                        lua::Lunar<lua::Bson>::check(L, offset)->cnode());
+        }
+    }
+
+    int storage_scan(lua_State* L)
+    {
+        logjam::pool::Swimmer* swmr = static_cast<logjam::pool::Swimmer*>(
+                lua_touserdata(L, lua_upvalueindex(1)));
+
+        std::string name(lua::as_string(L, 1));
+        std::string index(lua::as_string(L, 2));
+        std::unique_ptr<lj::bson::Node> lower(scan_bound(L, 3));
+        std::unique_ptr<lj::bson::Node> upper(scan_bound(L, 4));
+        lua_Integer limit = luaL_optinteger(L, 5, 0);
+
+        lua_newtable(L); // results
+        int count = 0;
+        try
+        {
+            logjam::storage::Collection& coll =
+                    swmr->context().environs().storage().collection(name);
+            coll.scan(index,
+                    lower.get(),
+                    upper.get(),
+                    [L, limit, &count](const uint8_t* bytes) -> bool {
+                        lj::Document* doc = new lj::Document(
+                                new lj::bson::Node(lj::bson::Type::k_document, bytes),
+                                true);
+                        lua::Lunar<lua::Document>::push(L,
+                                new lua::Document(doc, true),
+                                true); // results doc
+                        lua_rawseti(L, -2, ++count); // results
+                        return 0 >= limit || count < limit;
+                    });
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+        return 1;
+    }
+
+    int storage_cache_stats(lua_State* L)
+    {
+        logjam::pool::Swimmer* swmr = static_cast<logjam::pool::Swimmer*>(
+                lua_touserdata(L, lua_upvalueindex(1)));
+
+        logjam::storage::Buffer_pool::Stats stats = {};
+        try
+        {
+            stats = swmr->context().environs().storage().pool().stats();
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+
+        lj::bson::Node result;
+        result.set_child("pin_hits", lj::bson::new_uint64(stats.pin_hits));
+        result.set_child("pin_misses", lj::bson::new_uint64(stats.pin_misses));
+        result.set_child("evictions", lj::bson::new_uint64(stats.evictions));
+        result.set_child("overflows", lj::bson::new_uint64(stats.overflows));
+        result.set_child("tracked_pages", lj::bson::new_uint64(stats.tracked));
+        result.set_child("capacity_pages", lj::bson::new_uint64(stats.capacity));
+        result.set_child("page_size", lj::bson::new_uint64(logjam::storage::Buffer_pool::k_page_size));
+        lua::Lunar<lua::Bson>::push(L, new lua::Bson(result), true);
+        return 1;
+    }
+
+    int storage_lsm_stats(lua_State* L)
+    {
+        logjam::pool::Swimmer* swmr = static_cast<logjam::pool::Swimmer*>(
+                lua_touserdata(L, lua_upvalueindex(1)));
+
+        std::string name(lua::as_string(L, 1));
+        logjam::storage::Lsm_collection::Stats stats = {};
+        try
+        {
+            stats = swmr->context().environs().storage().lsm(name).stats();
+        }
+        catch (lj::Exception& ex)
+        {
+            lua_pushstring(L, ex.str().c_str());
+            lua_error(L);
+        }
+
+        double amplification = stats.write_amplification();
+        lj::bson::Node result;
+        result.set_child("user_bytes", lj::bson::new_uint64(stats.user_bytes));
+        result.set_child("flush_bytes", lj::bson::new_uint64(stats.flush_bytes));
+        result.set_child("compaction_bytes", lj::bson::new_uint64(stats.compaction_bytes));
+        result.set_child("write_amplification", new lj::bson::Node(lj::bson::Type::k_double,
+                reinterpret_cast<const uint8_t*>(&amplification)));
+        result.set_child("flushes", lj::bson::new_uint64(stats.flushes));
+        result.set_child("compactions", lj::bson::new_uint64(stats.compactions));
+        result.set_child("stalls", lj::bson::new_uint64(stats.stalls));
+        result.set_child("stall_micros", lj::bson::new_uint64(stats.stall_micros));
+        result.set_child("memtable_bytes", lj::bson::new_uint64(stats.memtable_bytes));
+        result.set_child("runs", lj::bson::new_array());
+        result.set_child("level_bytes", lj::bson::new_array());
+        for (size_t level = 0; level < stats.runs.size(); ++level)
+        {
+            result.push_child("runs", lj::bson::new_uint64(stats.runs[level]));
+            result.push_child("level_bytes", lj::bson::new_uint64(stats.level_bytes[level]));
+        }
+        lua::Lunar<lua::Bson>::push(L, new lua::Bson(result), true);
+        return 1;
+    }
+
     lua_State* setup_lua(lj::bson::Node& request)
     {
         lua_State* L = luaL_newstate();
@@ -161,6 +411,33 @@ namespace lua
         Lunar<Bson>::push(L, new Bson(swmr.context().node()), true); // context
         lua_setglobal(L, "CTXDATA"); // empty
 
+        // Document changes are recorded in the vector clock under the
+        // configured server id.
+        const lj::bson::Node& config = swmr.context().environs().config();
+        if (config.exists("server/id"))
+        {
+            std::string server(lj::bson::as_uuid(config.nav("server/id")));
+            lua_pushstring(L, server.c_str()); // server
+            lua_setfield(L, LUA_REGISTRYINDEX, Document::k_registry_server); // empty
+        }
+
+        // Document storage functions.
+        lua_pushlightuserdata(L, &swmr); // swmr
+        lua_pushvalue(L, -1); // swmr swmr
+        lua_pushvalue(L, -1); // swmr swmr swmr
+        lua_pushvalue(L, -1); // swmr swmr swmr swmr
+        lua_pushvalue(L, -1); // swmr swmr swmr swmr swmr
+        lua_pushcclosure(L, &storage_store, 1); // swmr swmr swmr swmr func
+        lua_setglobal(L, "store"); // swmr swmr swmr swmr
+        lua_pushcclosure(L, &storage_fetch, 1); // swmr swmr swmr func
+        lua_setglobal(L, "fetch"); // swmr swmr swmr
+        lua_pushcclosure(L, &storage_scan, 1); // swmr swmr func
+        lua_setglobal(L, "scan"); // swmr swmr
+        lua_pushcclosure(L, &storage_cache_stats, 1); // swmr func
+        lua_setglobal(L, "cache_stats"); // swmr
+        lua_pushcclosure(L, &storage_lsm_stats, 1); // func
+        lua_setglobal(L, "lsm_stats"); // empty
+
         // Setup the repsonse wrapper where necessary.
         std::unique_ptr<Bson> response_wrapper(new Bson(response));
         Lunar<Bson>::push(L, response_wrapper.get(), false); // rw
@@ -38,9 +38,25 @@
 #include "lua/Uuid.h"
 #include "lj/Wiper.h"
 
+namespace
+{
+    // Modifications are recorded in the vector clock under the id of the
+    // server running the command.
+    lj::Uuid server_id(lua_State* L)
+    {
+        lua_getfield(L, LUA_REGISTRYINDEX, lua::Document::k_registry_server);
+        lj::Uuid server(lua_isstring(L, -1) ?
+                lj::Uuid(std::string(lua_tostring(L, -1))) :
+                lj::Uuid::k_nil);
+        lua_pop(L, 1);
+        return server;
+    }
+}; // namespace (anonymous)
+
 namespace lua
 {
     const char Document::LUNAR_CLASS_NAME[] = "Document";
+    const char Document::k_registry_server[] = "logjam.server";
     Lunar<Document>::RegType Document::LUNAR_METHODS[] = {
         LUNAR_METHOD(Document, parent)
         ,LUNAR_METHOD(Document, vclock)
@@ -49,11 +65,13 @@ namespace lua
         ,LUNAR_METHOD(Document, id)
         ,LUNAR_METHOD(Document, suppress)
         ,LUNAR_METHOD(Document, dirty)
+        ,LUNAR_METHOD(Document, conflicted)
         ,LUNAR_METHOD(Document, get)
         ,LUNAR_METHOD(Document, exists)
         ,LUNAR_METHOD(Document, wash)
         ,LUNAR_METHOD(Document, rekey)
         ,LUNAR_METHOD(Document, branch)
+        ,LUNAR_METHOD(Document, resolve)
         ,LUNAR_METHOD(Document, set)
         ,LUNAR_METHOD(Document, push)
         ,LUNAR_METHOD(Document, increment)
@@ -126,8 +144,7 @@ namespace lua
         }
         else if (1 == top)
         {
-            // XXX Change this to get the server from somewhere.
-            doc_->suppress(lj::Uuid::k_nil, lua_toboolean(L, -1));
+            doc_->suppress(server_id(L), lua_toboolean(L, -1));
             return 0;
         }
         else
@@ -144,6 +161,12 @@ namespace lua
         return 1;
     }
 
+    int Document::conflicted(lua_State* L)
+    {
+        lua_pushboolean(L, doc_->conflicted());
+        return 1;
+    }
+
     int Document::get(lua_State* L)
     {
         int top = lua_gettop(L);
@@ -195,8 +218,7 @@ namespace lua
     int Document::rekey(lua_State* L)
     {
         uint64_t key = lua_tointeger(L, -1);
-        // XXX Change this to get the server from somewhere.
-        doc_->rekey(lj::Uuid::k_nil, key);
+        doc_->rekey(server_id(L), key);
         return 0;
     }
 
@@ -208,13 +230,11 @@ namespace lua
         if (top == 1)
         {
             uint64_t key = lua_tointeger(L, -1);
-            // XXX Change this to get the server from somewhere.
-            dup = doc_->branch(lj::Uuid::k_nil, key);
+            dup = doc_->branch(server_id(L), key);
         }
         else
         {
-            // XXX Change this to get the server from somewhere.
-            dup = doc_->branch(lj::Uuid::k_nil, doc_->key());
+            dup = doc_->branch(server_id(L), doc_->key());
         }
         Lunar<lua::Document>::push(L,
                 new lua::Document(dup, true),
@@ -222,14 +242,19 @@ namespace lua
         return 1;
     }
 
+    int Document::resolve(lua_State* L)
+    {
+        doc_->resolve(server_id(L));
+        return 0;
+    }
+
     int Document::set(lua_State* L)
     {
         std::string tmp(as_string(L, -2));
         Bson* val = Lunar<Bson>::check(L, -1);
         try
         {
-            // XXX Change this to get the server from somewhere.
-            doc_->set(lj::Uuid::k_nil, tmp, new lj::bson::Node(val->node()));
+            doc_->set(server_id(L), tmp, new lj::bson::Node(val->node()));
         }
         catch (lj::Exception& ex)
         {
@@ -245,8 +270,7 @@ namespace lua
         Bson* val = Lunar<Bson>::check(L, -1);
         try
         {
-            // XXX Change this to get the server from somewhere.
-            doc_->push(lj::Uuid::k_nil, tmp, new lj::bson::Node(val->node()));
+            doc_->push(server_id(L), tmp, new lj::bson::Node(val->node()));
         }
         catch (lj::Exception& ex)
         {
@@ -262,8 +286,7 @@ namespace lua
         int amt = lua_tointeger(L, -1);
         try
         {
-            // XXX Change this to get the server from somewhere.
-            doc_->increment(lj::Uuid::k_nil, tmp, amt);
+            doc_->increment(server_id(L), tmp, amt);
         }
         catch (lj::Exception& ex)
         {
@@ -313,8 +336,7 @@ namespace lua
 
         try
         {
-            // XXX Change this to get the server from somewhere.
-            doc_->encrypt(lj::Uuid::k_nil,
+            doc_->encrypt(server_id(L),
                     key_ptr.get(),
                     key_sz,
                     key_name,
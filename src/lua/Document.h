@@ -52,6 +52,7 @@ namespace lua
     public:
         static const char LUNAR_CLASS_NAME[]; //!< Table name for Lua.
         static Lunar<Document>::RegType LUNAR_METHODS[]; //!< Array of methods to register in Lua.
+        static const char k_registry_server[]; //!< Registry field with the id of the modifying server.
 
         //! Create a new lua Document object.
         /*!
@@ -69,6 +70,13 @@ namespace lua
 
         //! Destructor.
         ~Document();
+
+        //! Get the wrapped document.
+        inline lj::Document& document()
+        {
+            return *doc_;
+        }
+
         int parent(lua_State* L);
         int vclock(lua_State* L);
         int version(lua_State* L);
@@ -76,11 +84,13 @@ namespace lua
         int id(lua_State* L);
         int suppress(lua_State* L);
         int dirty(lua_State* L);
+        int conflicted(lua_State* L);
         int get(lua_State* L);
         int exists(lua_State* L);
         int wash(lua_State* L);
         int rekey(lua_State* L);
         int branch(lua_State* L);
+        int resolve(lua_State* L);
         int set(lua_State* L);
         int push(lua_State* L);
         int increment(lua_State* L);
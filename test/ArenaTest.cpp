@@ -0,0 +1,199 @@
+/*!
+ \file test/ArenaTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "lj/Arena.h"
+#include "lj/Bson.h"
+#include "test/ArenaTest_driver.h"
+
+#include <map>
+#include <memory>
+
+void testAllocate()
+{
+    lj::Arena arena(128);
+    TEST_ASSERT(arena.capacity() == 0);
+
+    void* a = arena.allocate(3);
+    void* b = arena.allocate(16);
+    TEST_ASSERT(reinterpret_cast<uintptr_t>(a) % lj::Arena::k_alignment == 0);
+    TEST_ASSERT(reinterpret_cast<uintptr_t>(b) % lj::Arena::k_alignment == 0);
+    TEST_ASSERT(static_cast<uint8_t*>(b) - static_cast<uint8_t*>(a) == lj::Arena::k_alignment);
+    TEST_ASSERT(arena.capacity() == 128);
+
+    // Oversized requests get their own block.
+    arena.allocate(1024);
+    TEST_ASSERT(arena.capacity() == 128 + 1024);
+}
+
+void testRelease()
+{
+    lj::Arena arena(128);
+    uint8_t* a = static_cast<uint8_t*>(arena.allocate(64));
+    memset(a, 0xAA, 64);
+    arena.allocate(256);
+    TEST_ASSERT(arena.size() == 320);
+
+    arena.release();
+    TEST_ASSERT(arena.size() == 0);
+    TEST_ASSERT(arena.capacity() == 128);
+    for (int h = 0; h < 64; ++h)
+    {
+        TEST_ASSERT(a[h] == 0);
+    }
+
+    // The first block is reused.
+    TEST_ASSERT(arena.allocate(8) == a);
+}
+
+void testScope()
+{
+    lj::Arena outer;
+    lj::Arena inner;
+    TEST_ASSERT(lj::Arena::current() == nullptr);
+    {
+        lj::Arena::Scope outer_scope(outer);
+        TEST_ASSERT(lj::Arena::current() == &outer);
+        {
+            lj::Arena::Scope inner_scope(inner);
+            TEST_ASSERT(lj::Arena::current() == &inner);
+        }
+        TEST_ASSERT(lj::Arena::current() == &outer);
+    }
+    TEST_ASSERT(lj::Arena::current() == nullptr);
+}
+
+void testNodeTree()
+{
+    lj::Arena arena;
+    lj::bson::Node* heap = new lj::bson::Node();
+    {
+        lj::Arena::Scope scope(arena);
+        lj::bson::Node tree;
+        for (int h = 0; h < 200; ++h)
+        {
+            tree.set_child(std::string("field") + std::to_string(h),
+                    lj::bson::new_int32(h));
+        }
+        tree.set_child("array", lj::bson::new_array());
+        tree.push_child("array", lj::bson::new_string("value"));
+        TEST_ASSERT(arena.size() > 0);
+        TEST_ASSERT(lj::bson::as_int32(tree["field42"]) == 42);
+
+        // Heap nodes can be destroyed while a scope is active.
+        delete heap;
+    }
+
+    // Arena nodes can be destroyed after the scope ends.
+    size_t used = arena.size();
+    lj::bson::Node* node;
+    {
+        lj::Arena::Scope scope(arena);
+        node = lj::bson::new_string("outlives the scope");
+    }
+    TEST_ASSERT(arena.size() > used);
+    TEST_ASSERT(lj::bson::as_string(*node).compare("outlives the scope") == 0);
+    delete node;
+}
+
+void testMixedTree()
+{
+    lj::bson::Node context;
+    {
+        lj::Arena arena;
+        lj::bson::Node request;
+        {
+            lj::Arena::Scope scope(arena);
+            request.set_child("doc/name", lj::bson::new_string("value"));
+            request.set_child("list", lj::bson::new_array());
+        }
+
+        // Growth and copies made after the scope ends use the heap.
+        size_t used = arena.size();
+        for (int h = 0; h < 100; ++h)
+        {
+            request.push_child("list", lj::bson::new_int32(h));
+        }
+        context.set_child("copy", new lj::bson::Node(request["doc"]));
+        TEST_ASSERT(arena.size() == used);
+        TEST_ASSERT(lj::bson::as_int32(request["list/99"]) == 99);
+    }
+
+    // The copy outlives the arena.
+    TEST_ASSERT(lj::bson::as_string(context["copy/name"]).compare("value") == 0);
+}
+
+void testLazy_expand()
+{
+    lj::bson::Node source;
+    source.set_child("doc/name", lj::bson::new_string("value"));
+    size_t sz;
+    std::unique_ptr<uint8_t[]> bytes(source.to_binary(&sz));
+
+    // A heap document parsed while a request arena is active keeps its
+    // children on the heap.
+    lj::bson::Node heap(lj::bson::Type::k_document, bytes.get());
+    {
+        lj::Arena arena;
+        lj::Arena::Scope scope(arena);
+        TEST_ASSERT(lj::bson::as_string(heap["doc/name"]).compare("value") == 0);
+        TEST_ASSERT(arena.size() == 0);
+    }
+    TEST_ASSERT(lj::bson::as_string(heap["doc/name"]).compare("value") == 0);
+
+    // An arena document parsed in its scope stays in the arena.
+    lj::Arena arena;
+    lj::Arena::Scope scope(arena);
+    lj::bson::Node local(lj::bson::Type::k_document, bytes.get());
+    size_t used = arena.size();
+    TEST_ASSERT(lj::bson::as_string(local["doc/name"]).compare("value") == 0);
+    TEST_ASSERT(arena.size() > used);
+}
+
+void testAllocator()
+{
+    lj::Arena arena;
+    lj::Arena::Scope scope(arena);
+    std::map<int, int, std::less<int>, lj::Arena_allocator<std::pair<const int, int> > > m;
+    for (int h = 0; h < 100; ++h)
+    {
+        m[h] = h * 2;
+    }
+    TEST_ASSERT(m.size() == 100);
+    TEST_ASSERT(m[50] == 100);
+    TEST_ASSERT(arena.size() >= 100 * sizeof(std::pair<const int, int>));
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::ArenaTest", tests);
+}
@@ -0,0 +1,117 @@
+/*!
+ \file test/Blake2bTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "lj/Blake2b.h"
+#include "lj/Exception.h"
+#include <cstdio>
+#include <string>
+#include "test/Blake2bTest_driver.h"
+
+namespace
+{
+    std::string hex(const uint8_t* v, size_t sz)
+    {
+        std::string result;
+        char buffer[3];
+        for (size_t h = 0; h < sz; ++h)
+        {
+            snprintf(buffer, sizeof(buffer), "%02x", v[h]);
+            result.append(buffer);
+        }
+        return result;
+    }
+};
+
+void testDigest()
+{
+    // RFC 7693 appendix A.
+    uint8_t out[lj::Blake2b::k_max_digest_size];
+    lj::Blake2b abc(64);
+    abc.update("abc", 3);
+    abc.finish(out);
+    TEST_ASSERT(hex(out, 64).compare("ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+            "7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923") == 0);
+
+    lj::Blake2b empty;
+    TEST_ASSERT(empty.digest_size() == 32);
+    empty.finish(out);
+    TEST_ASSERT(hex(out, 32).compare("0e5751c026e543b2e8ab2eb06099daa1d1e5df47778f7787faab45cdf12fe3a8") == 0);
+
+    // Exactly one block is compressed as the last block.
+    const uint8_t zeros[128] = {0};
+    lj::Blake2b block;
+    block.update(zeros, 128);
+    block.finish(out);
+    TEST_ASSERT(hex(out, 32).compare("378d0caaaa3855f1b38693c1d6ef004fd118691c95c959d4efa950d6d6fcf7c1") == 0);
+}
+
+void testStreaming()
+{
+    uint8_t data[1000];
+    for (int h = 0; h < 1000; ++h)
+    {
+        data[h] = h % 251;
+    }
+    const std::string expected("b372d0608f720c8c3dd41e9c8eecb10143b41abe520b616607e754bf79c08331");
+
+    // The digest does not depend on how the data is split.
+    const size_t pieces[] = {1, 7, 127, 128, 129, 1000};
+    for (size_t piece : pieces)
+    {
+        lj::Blake2b hasher;
+        for (size_t pos = 0; pos < 1000; pos += piece)
+        {
+            hasher.update(data + pos, (1000 - pos < piece) ? 1000 - pos : piece);
+        }
+        uint8_t out[32];
+        hasher.finish(out);
+        TEST_ASSERT(hex(out, 32).compare(expected) == 0);
+    }
+}
+
+void testDigest_size()
+{
+    try
+    {
+        lj::Blake2b hasher(65);
+        TEST_FAILED("Expected an exception for a large digest.");
+    }
+    catch (lj::Exception& ex)
+    {
+    }
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::Blake2b", tests);
+}
@@ -0,0 +1,212 @@
+/*!
+ \file test/Bson_decoderTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+
+#include "testhelper.h"
+#include "lj/Bson.h"
+#include "lj/Bson_decoder.h"
+#include "lj/Streambuf_buffer.h"
+#include <sstream>
+#include "test/Bson_decoderTest_driver.h"
+
+namespace
+{
+    std::string sample_frame()
+    {
+        lj::bson::Node n;
+        n.set_child("str", lj::bson::new_string("hello"));
+        n.set_child("num", lj::bson::new_int64(42));
+        n.set_child("sub/flag", lj::bson::new_boolean(true));
+        n.set_child("list", lj::bson::new_array());
+        n.push_child("list", lj::bson::new_int32(1));
+        n.push_child("list", lj::bson::new_null());
+        n.set_child("bin", lj::bson::new_uuid(lj::Uuid::k_nil));
+        size_t sz;
+        std::unique_ptr<uint8_t[]> data(n.to_binary(&sz));
+        return std::string(reinterpret_cast<char*>(data.get()), sz);
+    }
+
+    const uint8_t* bytes(const std::string& s)
+    {
+        return reinterpret_cast<const uint8_t*>(s.data());
+    }
+};
+
+void testIncremental()
+{
+    const std::string frame = sample_frame();
+    lj::bson::Decoder decoder;
+    for (size_t sz = 0; sz < frame.size(); ++sz)
+    {
+        TEST_ASSERT(decoder.scan(bytes(frame), sz) == 0);
+    }
+    TEST_ASSERT(decoder.frame_size() == frame.size());
+    TEST_ASSERT(decoder.scan(bytes(frame), frame.size()) == frame.size());
+
+    // A complete frame in one call is the same as many small ones.
+    lj::bson::Decoder whole;
+    TEST_ASSERT(whole.scan(bytes(frame), frame.size()) == frame.size());
+}
+
+void testPipelined()
+{
+    const std::string frame = sample_frame();
+    const std::string input = frame + frame;
+    lj::bson::Decoder decoder;
+    TEST_ASSERT(decoder.scan(bytes(input), input.size()) == frame.size());
+    decoder.reset();
+    TEST_ASSERT(decoder.frame_size() == 0);
+    TEST_ASSERT(decoder.scan(bytes(input) + frame.size(), frame.size()) == frame.size());
+}
+
+void testOversized()
+{
+    const std::string frame = sample_frame();
+    lj::bson::Decoder decoder(frame.size() - 1);
+    try
+    {
+        // Only the length is needed to reject the frame.
+        decoder.scan(bytes(frame), 4);
+        TEST_FAILED("Oversized frame was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+
+    lj::bson::Decoder exact(frame.size());
+    TEST_ASSERT(exact.scan(bytes(frame), frame.size()) == frame.size());
+}
+
+void testMalformed()
+{
+    // Length smaller than an empty document.
+    const uint8_t short_length[] = {0x04, 0x00, 0x00, 0x00};
+    try
+    {
+        lj::bson::Decoder().scan(short_length, sizeof(short_length));
+        TEST_FAILED("Invalid length was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+
+    // String claims more bytes than the document holds.
+    std::string frame = sample_frame();
+    const size_t str_len = frame.find("str") + 4;
+    frame[str_len] = 0x7F;
+    try
+    {
+        lj::bson::Decoder().scan(bytes(frame), frame.size());
+        TEST_FAILED("Overrunning string was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+
+    // Unsupported element type.
+    frame = sample_frame();
+    frame[4] = 0x42;
+    try
+    {
+        lj::bson::Decoder().scan(bytes(frame), frame.size());
+        TEST_FAILED("Unsupported type was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+
+    // Missing terminator.
+    frame = sample_frame();
+    frame[frame.size() - 1] = 0x01;
+    try
+    {
+        lj::bson::Decoder().scan(bytes(frame), frame.size());
+        TEST_FAILED("Missing terminator was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+}
+
+void testTruncated_string()
+{
+    // The frame is incomplete, so the decoder waits instead of failing.
+    const std::string frame = sample_frame();
+    const size_t str_end = frame.find("hello") + 3;
+    lj::bson::Decoder decoder;
+    TEST_ASSERT(decoder.scan(bytes(frame), str_end) == 0);
+    TEST_ASSERT(decoder.scan(bytes(frame), frame.size()) == frame.size());
+}
+
+void testStream_extraction()
+{
+    const std::string frame = sample_frame();
+
+    // Generic streams grow the buffer as bytes arrive.
+    std::stringstream ss(frame);
+    lj::bson::View view;
+    ss >> view;
+    TEST_ASSERT(lj::bson::as_string(view["str"]).compare("hello") == 0);
+    TEST_ASSERT(lj::bson::as_int64(view["num"]) == 42);
+
+    // A truncated stream is an error rather than a partial document.
+    std::stringstream truncated(frame.substr(0, frame.size() - 3));
+    try
+    {
+        truncated >> view;
+        TEST_FAILED("Truncated document was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+
+    // Malformed buffered input is rejected before it is viewed in place.
+    std::string bad = frame;
+    bad[4] = 0x42;
+    lj::Streambuf_buffer buffer;
+    std::iostream io(&buffer);
+    io.write(bad.data(), bad.size());
+    try
+    {
+        io >> view;
+        TEST_FAILED("Malformed document was accepted.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::Bson_decoderTest", tests);
+}
@@ -0,0 +1,227 @@
+/*!
+ \file test/Bson_indexTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "lj/Bson.h"
+#include "lj/Bson_index.h"
+#include "lj/Log.h"
+#include "lj/Stopclock.h"
+#include <map>
+#include <memory>
+#include <string>
+#include "test/Bson_indexTest_driver.h"
+
+namespace
+{
+    bool same_hash(const lj::bson::Node& a, const lj::bson::Node& b)
+    {
+        return lj::bson::hash_value(a) == lj::bson::hash_value(b);
+    }
+};
+
+void testEqual_value()
+{
+    std::unique_ptr<lj::bson::Node> i32(lj::bson::new_int32(5));
+    std::unique_ptr<lj::bson::Node> i64(lj::bson::new_int64(5));
+    std::unique_ptr<lj::bson::Node> other(lj::bson::new_int64(6));
+    std::unique_ptr<lj::bson::Node> str(lj::bson::new_string("5"));
+    TEST_ASSERT(lj::bson::equal_value(*i32, *i64));
+    TEST_ASSERT(same_hash(*i32, *i64));
+    TEST_ASSERT(!lj::bson::equal_value(*i64, *other));
+    TEST_ASSERT(!lj::bson::equal_value(*i64, *str));
+
+    // Binary values compare every byte.
+    const uint8_t data_a[4] = {0, 1, 0, 2};
+    const uint8_t data_b[4] = {0, 1, 0, 3};
+    std::unique_ptr<lj::bson::Node> bin_a(lj::bson::new_binary(data_a, 4, lj::bson::Binary_type::k_bin_generic));
+    std::unique_ptr<lj::bson::Node> bin_b(lj::bson::new_binary(data_b, 4, lj::bson::Binary_type::k_bin_generic));
+    std::unique_ptr<lj::bson::Node> bin_c(lj::bson::new_binary(data_a, 4, lj::bson::Binary_type::k_bin_user_defined));
+    TEST_ASSERT(!lj::bson::equal_value(*bin_a, *bin_b));
+    TEST_ASSERT(!lj::bson::equal_value(*bin_a, *bin_c));
+    TEST_ASSERT(lj::bson::equal_value(*bin_a, lj::bson::Node(*bin_a)));
+
+    // Documents compare by content, whatever their field order.
+    const uint8_t unordered[22] = {
+        22, 0, 0, 0,
+        0x10, 'y', 0, 2, 0, 0, 0,
+        0x10, 'x', 0, 3, 0, 0, 0,
+        0x0A, 'z', 0,
+        0};
+    lj::bson::Node built;
+    built.set_child("x", lj::bson::new_int32(3));
+    built.set_child("y", lj::bson::new_int64(2));
+    built.set_child("z", lj::bson::new_null());
+    lj::bson::Node parsed(lj::bson::Type::k_document, unordered);
+    lj::bson::Node binary(lj::bson::Type::k_binary_document, unordered);
+    TEST_ASSERT(lj::bson::equal_value(built, parsed));
+    TEST_ASSERT(lj::bson::equal_value(built, binary));
+    TEST_ASSERT(same_hash(built, parsed));
+    TEST_ASSERT(same_hash(built, binary));
+    built.set_child("z", lj::bson::new_boolean(false));
+    TEST_ASSERT(!lj::bson::equal_value(built, parsed));
+
+    // Nesting is part of the value.
+    lj::bson::Node nested_a(lj::bson::Type::k_array, nullptr);
+    nested_a.push_child("", new lj::bson::Node(lj::bson::Type::k_array, nullptr));
+    nested_a.push_child("0", lj::bson::new_int32(1));
+    nested_a.push_child("", lj::bson::new_int32(2));
+    lj::bson::Node nested_b(lj::bson::Type::k_array, nullptr);
+    nested_b.push_child("", new lj::bson::Node(lj::bson::Type::k_array, nullptr));
+    nested_b.push_child("0", lj::bson::new_int32(1));
+    nested_b.push_child("0", lj::bson::new_int32(2));
+    TEST_ASSERT(!lj::bson::equal_value(nested_a, nested_b));
+    TEST_ASSERT(!same_hash(nested_a, nested_b));
+}
+
+void testHash_index()
+{
+    lj::bson::Hash_index<int> index;
+    TEST_ASSERT(index.empty());
+    for (int h = 0; h < 1000; ++h)
+    {
+        std::unique_ptr<lj::bson::Node> key(lj::bson::new_string(std::to_string(h)));
+        TEST_ASSERT(index.insert(*key, h));
+    }
+    TEST_ASSERT(index.size() == 1000);
+
+    // Replacing keeps the size.
+    std::unique_ptr<lj::bson::Node> five(lj::bson::new_string("5"));
+    TEST_ASSERT(!index.insert(*five, 50));
+    TEST_ASSERT(*index.find(*five) == 50);
+    TEST_ASSERT(index.size() == 1000);
+
+    // Keys are typed.
+    std::unique_ptr<lj::bson::Node> number(lj::bson::new_int32(5));
+    TEST_ASSERT(!index.find(*number));
+
+    // Erase every other key, then check the rest are still found.
+    for (int h = 0; h < 1000; h += 2)
+    {
+        std::unique_ptr<lj::bson::Node> key(lj::bson::new_string(std::to_string(h)));
+        TEST_ASSERT(index.erase(*key));
+        TEST_ASSERT(!index.erase(*key));
+    }
+    TEST_ASSERT(index.size() == 500);
+    for (int h = 0; h < 1000; ++h)
+    {
+        std::unique_ptr<lj::bson::Node> key(lj::bson::new_string(std::to_string(h)));
+        const int* found = index.find(*key);
+        if (h % 2)
+        {
+            TEST_ASSERT(found && *found == ((5 == h) ? 50 : h));
+        }
+        else
+        {
+            TEST_ASSERT(!found);
+        }
+    }
+
+    size_t visited = 0;
+    index.each([&visited](const lj::bson::Node& key, const int& value) {
+        TEST_ASSERT(lj::bson::Type::k_string == key.type());
+        ++visited;
+    });
+    TEST_ASSERT(visited == 500);
+
+    lj::bson::Hash_index<int> moved(std::move(index));
+    TEST_ASSERT(index.empty());
+    TEST_ASSERT(moved.size() == 500);
+    moved.clear();
+    TEST_ASSERT(!moved.find(*five));
+}
+
+void testHash_index_field()
+{
+    // Index records by a field value.
+    std::vector<std::unique_ptr<lj::bson::Node> > records;
+    lj::bson::Hash_index<lj::bson::Node*> by_login;
+    for (int h = 0; h < 100; ++h)
+    {
+        lj::bson::Node* record = new lj::bson::Node();
+        record->set_child("login", lj::bson::new_string("user" + std::to_string(h)));
+        record->set_child("id", lj::bson::new_int32(h));
+        records.emplace_back(record);
+        by_login.insert(record->nav("login"), record);
+    }
+
+    lj::bson::Node request;
+    request.set_child("login", lj::bson::new_string("user42"));
+    lj::bson::Node** found = by_login.find(request["login"]);
+    TEST_ASSERT(found);
+    TEST_ASSERT(lj::bson::as_int32((*found)->nav("id")) == 42);
+}
+
+void testHash_index_benchmark()
+{
+    const int count = 100000;
+    std::vector<std::unique_ptr<lj::bson::Node> > keys;
+    for (int h = 0; h < count; ++h)
+    {
+        keys.emplace_back(lj::bson::new_string("login-" + std::to_string(h * 7919)));
+    }
+
+    std::map<std::string, int> tree;
+    lj::bson::Hash_index<int> index;
+    for (int h = 0; h < count; ++h)
+    {
+        tree[lj::bson::as_string(*keys[h])] = h;
+        index.insert(*keys[h], h);
+    }
+
+    long tree_sum = 0;
+    lj::Stopclock tree_timer;
+    for (int h = 0; h < count; ++h)
+    {
+        tree_sum += tree.find(lj::bson::as_string(*keys[h]))->second;
+    }
+    uint64_t tree_elapsed = tree_timer.elapsed();
+
+    long index_sum = 0;
+    lj::Stopclock index_timer;
+    for (int h = 0; h < count; ++h)
+    {
+        index_sum += *index.find(*keys[h]);
+    }
+    uint64_t index_elapsed = index_timer.elapsed();
+
+    TEST_ASSERT(tree_sum == index_sum);
+    lj::log::format<lj::Info>("Lookups of %d string keys: std::map %d usec, Hash_index %d usec.")
+            << count
+            << tree_elapsed
+            << index_elapsed
+            << lj::log::end;
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::bson::Hash_index", tests);
+}
@@ -0,0 +1,220 @@
+/*!
+ \file test/Bson_schemaTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "lj/Bson.h"
+#include "lj/Bson_schema.h"
+#include "lj/Log.h"
+#include "lj/Stopclock.h"
+#include <memory>
+#include "test/Bson_schemaTest_driver.h"
+
+namespace
+{
+    struct Login
+    {
+        std::string method;
+        std::string provider;
+        int64_t attempts;
+        bool remember;
+        lj::Uuid id;
+        lj::bson::View data;
+    };
+
+    const lj::bson::Schema<Login,
+            lj::bson::Field<Login, std::string, &Login::method>,
+            lj::bson::Field<Login, std::string, &Login::provider>,
+            lj::bson::Field<Login, int64_t, &Login::attempts>,
+            lj::bson::Field<Login, bool, &Login::remember>,
+            lj::bson::Field<Login, lj::Uuid, &Login::id>,
+            lj::bson::Field<Login, lj::bson::View, &Login::data> >
+            k_login_schema("method", "provider", "attempts", "remember", "id", "data");
+
+    struct Credentials
+    {
+        std::string login;
+        std::string password;
+    };
+
+    const lj::bson::Schema<Credentials,
+            lj::bson::Field<Credentials, std::string, &Credentials::login>,
+            lj::bson::Field<Credentials, std::string, &Credentials::password> >
+            k_credentials_schema("login", "password");
+
+    lj::bson::Node* sample_node()
+    {
+        lj::bson::Node* n = new lj::bson::Node();
+        n->set_child("method", lj::bson::new_string("password"));
+        n->set_child("provider", lj::bson::new_string("local"));
+        n->set_child("attempts", lj::bson::new_int32(3));
+        n->set_child("remember", lj::bson::new_boolean(true));
+        n->set_child("id", lj::bson::new_uuid(lj::Uuid("{2ae24c43-8cf9-4590-9d1a-fc5e8583a4bd}")));
+        n->set_child("data/login", lj::bson::new_string("someone"));
+        n->set_child("data/password", lj::bson::new_string("secret"));
+        n->set_child("ignored", lj::bson::new_int64(9));
+        return n;
+    }
+};
+
+void testDecode()
+{
+    std::unique_ptr<lj::bson::Node> n(sample_node());
+    size_t sz;
+    std::unique_ptr<uint8_t[]> bytes(n->to_binary(&sz));
+
+    Login login(k_login_schema.decode(lj::bson::View(bytes.get())));
+    TEST_ASSERT(login.method.compare("password") == 0);
+    TEST_ASSERT(login.provider.compare("local") == 0);
+    TEST_ASSERT(login.attempts == 3);
+    TEST_ASSERT(login.remember);
+    TEST_ASSERT(login.id == lj::Uuid("{2ae24c43-8cf9-4590-9d1a-fc5e8583a4bd}"));
+    TEST_ASSERT(lj::bson::Type::k_document == login.data.type());
+
+    Credentials cred(k_credentials_schema.decode(login.data));
+    TEST_ASSERT(cred.login.compare("someone") == 0);
+    TEST_ASSERT(cred.password.compare("secret") == 0);
+}
+
+void testDecode_missing()
+{
+    lj::bson::Node n;
+    n.set_child("provider", lj::bson::new_string("local"));
+    size_t sz;
+    std::unique_ptr<uint8_t[]> bytes(n.to_binary(&sz));
+
+    Login login(k_login_schema.decode(lj::bson::View(bytes.get())));
+    TEST_ASSERT(login.method.empty());
+    TEST_ASSERT(login.provider.compare("local") == 0);
+    TEST_ASSERT(login.attempts == 0);
+    TEST_ASSERT(!login.data);
+}
+
+void testDecode_bad_type()
+{
+    lj::bson::Node n;
+    n.set_child("method", lj::bson::new_int32(5));
+    size_t sz;
+    std::unique_ptr<uint8_t[]> bytes(n.to_binary(&sz));
+
+    try
+    {
+        k_login_schema.decode(lj::bson::View(bytes.get()));
+    }
+    catch (lj::bson::Bson_type_exception& ex)
+    {
+        TEST_ASSERT(lj::bson::Type::k_int32 == ex.type());
+        return;
+    }
+    TEST_FAILED("Decoding a field of the wrong type did not throw.");
+}
+
+void testEncode()
+{
+    std::unique_ptr<lj::bson::Node> n(sample_node());
+    n->set_child("ignored", nullptr);
+    size_t sz;
+    std::unique_ptr<uint8_t[]> bytes(n->to_binary(&sz));
+    Login login(k_login_schema.decode(lj::bson::View(bytes.get())));
+
+    lj::bson::Node encoded(k_login_schema.to_node(login));
+    TEST_ASSERT(lj::bson::as_string(encoded["method"]).compare("password") == 0);
+    TEST_ASSERT(lj::bson::Type::k_int64 == encoded["attempts"].type());
+    TEST_ASSERT(lj::bson::as_int64(encoded["attempts"]) == 3);
+    TEST_ASSERT(lj::bson::as_uuid(encoded["id"]) == login.id);
+    TEST_ASSERT(lj::bson::as_string(encoded["data/login"]).compare("someone") == 0);
+    TEST_ASSERT(encoded.count() == n->count());
+
+    // Encoding the decoded record gives back the same record.
+    std::string out;
+    k_login_schema.encode(login, out);
+    Login again(k_login_schema.decode(
+            lj::bson::View(reinterpret_cast<const uint8_t*>(out.data()))));
+    TEST_ASSERT(again.method.compare(login.method) == 0);
+    TEST_ASSERT(again.remember == login.remember);
+    TEST_ASSERT(again.id == login.id);
+    TEST_ASSERT(again.data.size() == login.data.size());
+}
+
+void testDecode_benchmark()
+{
+    std::unique_ptr<lj::bson::Node> n(sample_node());
+    size_t sz;
+    std::unique_ptr<uint8_t[]> bytes(n->to_binary(&sz));
+    const lj::bson::View view(bytes.get());
+    const lj::bson::Path k_method("method");
+    const lj::bson::Path k_provider("provider");
+    const lj::bson::Path k_attempts("attempts");
+    const lj::bson::Path k_remember("remember");
+    const lj::bson::Path k_id("id");
+    const lj::bson::Path k_data("data");
+    const int k_rounds = 100000;
+
+    lj::Stopclock path_timer;
+    size_t total = 0;
+    for (int h = 0; k_rounds > h; ++h)
+    {
+        std::string method(lj::bson::as_string(view.path(k_method)));
+        std::string provider(lj::bson::as_string(view.path(k_provider)));
+        total += lj::bson::as_int64(view.path(k_attempts));
+        total += lj::bson::as_boolean(view.path(k_remember)) ? 1 : 0;
+        total += lj::bson::as_uuid(view.path(k_id)) == lj::Uuid::k_nil ? 0 : 1;
+        total += view.path(k_data).size();
+        total += method.size() + provider.size();
+    }
+    const uint64_t path_usec = path_timer.elapsed();
+
+    lj::Stopclock schema_timer;
+    size_t schema_total = 0;
+    Login login;
+    for (int h = 0; k_rounds > h; ++h)
+    {
+        k_login_schema.decode(view, login);
+        schema_total += login.attempts;
+        schema_total += login.remember ? 1 : 0;
+        schema_total += login.id == lj::Uuid::k_nil ? 0 : 1;
+        schema_total += login.data.size();
+        schema_total += login.method.size() + login.provider.size();
+    }
+    const uint64_t schema_usec = schema_timer.elapsed();
+    TEST_ASSERT(total == schema_total);
+
+    lj::log::format<lj::Info>("decode %d records: path %d usec, schema %d usec.")
+            << k_rounds
+            << path_usec
+            << schema_usec
+            << lj::log::end;
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::bson::Schema", tests);
+}
@@ -0,0 +1,158 @@
+/*!
+ \file test/Bson_writerTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "lj/Bson.h"
+#include "lj/Bson_writer.h"
+#include "lj/Log.h"
+#include "lj/Stopclock.h"
+#include <memory>
+#include <sstream>
+#include "test/Bson_writerTest_driver.h"
+
+namespace
+{
+    lj::bson::Node* sample_node()
+    {
+        lj::bson::Node* n = new lj::bson::Node();
+        n->set_child("str", lj::bson::new_string("say \"hi\" \\o/"));
+        n->set_child("num", lj::bson::new_int64(-42));
+        n->set_child("small", lj::bson::new_int32(-7));
+        n->set_child("sub/flag", lj::bson::new_boolean(true));
+        n->set_child("sub/nil", lj::bson::new_null());
+        n->set_child("list", lj::bson::new_array());
+        n->push_child("list", lj::bson::new_int32(1));
+        n->push_child("list", lj::bson::new_string("two"));
+        n->set_child("empty", lj::bson::new_array());
+        n->set_child("id", lj::bson::new_uuid(lj::Uuid("{2ae24c43-8cf9-4590-9d1a-fc5e8583a4bd}")));
+        return n;
+    }
+};
+
+void testPretty()
+{
+    std::unique_ptr<lj::bson::Node> n(sample_node());
+    const std::string expected("{\n\
+  \"empty\":[],\n\
+  \"id\":{\n\
+    \"__bson_note\":3090116147341252871,\n\
+    \"__bson_type\":\"UUID\",\n\
+    \"__bson_value\":\"{2ae24c43-8cf9-4590-9d1a-fc5e8583a4bd}\"\n\
+  },\n\
+  \"list\":[\n\
+    1,\n\
+    \"two\"\n\
+  ],\n\
+  \"num\":-42,\n\
+  \"small\":-7,\n\
+  \"str\":\"say \\\"hi\\\" \\\\o/\",\n\
+  \"sub\":{\n\
+    \"flag\":1,\n\
+    \"nil\":null\n\
+  }\n\
+}");
+
+    std::string out;
+    lj::bson::Json_writer(out).write(*n);
+    TEST_ASSERT(expected.compare(out) == 0);
+    TEST_ASSERT(expected.compare(lj::bson::as_json_string(*n)) == 0);
+
+    // The output can be read back. Numbers and booleans come back as int64.
+    std::unique_ptr<lj::bson::Node> parsed(lj::bson::parse_json(out));
+    TEST_ASSERT(lj::bson::as_string(n->nav("str")).compare(lj::bson::as_string(parsed->nav("str"))) == 0);
+    TEST_ASSERT(lj::bson::as_uuid(n->nav("id")) == lj::bson::as_uuid(parsed->nav("id")));
+    TEST_ASSERT(lj::bson::as_int64(parsed->nav("num")) == -42);
+}
+
+void testCompact()
+{
+    std::unique_ptr<lj::bson::Node> n(sample_node());
+    const std::string expected("{\"empty\":[],\"id\":{\"__bson_note\":3090116147341252871,\"__bson_type\":\"UUID\",\"__bson_value\":\"{2ae24c43-8cf9-4590-9d1a-fc5e8583a4bd}\"},\"list\":[1,\"two\"],\"num\":-42,\"small\":-7,\"str\":\"say \\\"hi\\\" \\\\o/\",\"sub\":{\"flag\":1,\"nil\":null}}");
+
+    std::string out;
+    lj::bson::Json_writer(out, lj::bson::Json_writer::Format::k_compact).write(*n);
+    TEST_ASSERT(expected.compare(out) == 0);
+
+    std::unique_ptr<lj::bson::Node> parsed(lj::bson::parse_json(out));
+    TEST_ASSERT(lj::bson::as_string(n->nav("str")).compare(lj::bson::as_string(parsed->nav("str"))) == 0);
+    TEST_ASSERT(lj::bson::as_uuid(n->nav("id")) == lj::bson::as_uuid(parsed->nav("id")));
+    TEST_ASSERT(lj::bson::as_int64(parsed->nav("num")) == -42);
+}
+
+void testStream()
+{
+    // Large enough to be handed to the stream several times.
+    lj::bson::Node n(lj::bson::Type::k_array, nullptr);
+    for (int h = 0; h < 5000; ++h)
+    {
+        n.push_child("", sample_node());
+    }
+
+    std::ostringstream os;
+    {
+        lj::bson::Json_writer writer(os);
+        writer.write(n);
+        TEST_ASSERT(os.str().size() > 0);
+    }
+    TEST_ASSERT(os.str().compare(lj::bson::as_json_string(n)) == 0);
+}
+
+void testWrite_benchmark()
+{
+    lj::bson::Node n(lj::bson::Type::k_array, nullptr);
+    for (int h = 0; h < 20000; ++h)
+    {
+        n.push_child("", sample_node());
+    }
+
+    lj::Stopclock pretty_timer;
+    std::string pretty;
+    lj::bson::Json_writer(pretty).write(n);
+    const uint64_t pretty_usec = pretty_timer.elapsed();
+
+    lj::Stopclock compact_timer;
+    std::string compact;
+    lj::bson::Json_writer(compact, lj::bson::Json_writer::Format::k_compact).write(n);
+    const uint64_t compact_usec = compact_timer.elapsed();
+
+    TEST_ASSERT(compact.size() < pretty.size());
+    lj::log::format<lj::Info>("Json_writer %d bytes: pretty %d usec, compact %d usec.")
+            << pretty.size()
+            << pretty_usec
+            << compact_usec
+            << lj::log::end;
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::Bson_writerTest", tests);
+}
@@ -115,6 +115,27 @@ void testBranch()
     delete doc2;
 }
 
+void testContent_hash()
+{
+    sample_data data;
+    lj::Document doc(new lj::bson::Node(data.doc), false);
+    doc.rekey(data.server, 100);
+    doc.wash();
+    lj::Document* doc2 = doc.branch(data.server, 200);
+
+    // Branches hold the same data under different metadata.
+    uint8_t a[lj::bson::k_content_hash_size];
+    uint8_t b[lj::bson::k_content_hash_size];
+    doc.content_hash(a);
+    doc2->content_hash(b);
+    TEST_ASSERT(memcmp(a, b, sizeof(a)) == 0);
+
+    doc2->set(data.server, "str", lj::bson::new_string("changed"));
+    doc2->content_hash(b);
+    TEST_ASSERT(memcmp(a, b, sizeof(a)) != 0);
+    delete doc2;
+}
+
 void testSuppress()
 {
     sample_data data;
@@ -128,6 +149,51 @@ void testSuppress()
     TEST_ASSERT(doc.suppress() == false);
 }
 
+void testCompare()
+{
+    sample_data data;
+    const lj::Uuid other(lj::Uuid::k_ns_dns, "example.org", 11);
+    lj::Document doc(new lj::bson::Node(data.doc), false);
+    doc.rekey(data.server, 100);
+    doc.wash();
+    lj::Document copy(new lj::bson::Node(doc.root()), true);
+    TEST_ASSERT(doc.compare(copy) == lj::Document::Order::k_equal);
+
+    doc.set(data.server, "str", lj::bson::new_string("left"));
+    TEST_ASSERT(doc.compare(copy) == lj::Document::Order::k_after);
+    TEST_ASSERT(copy.compare(doc) == lj::Document::Order::k_before);
+
+    copy.set(other, "str", lj::bson::new_string("right"));
+    TEST_ASSERT(doc.compare(copy) == lj::Document::Order::k_concurrent);
+    TEST_ASSERT(copy.compare(doc) == lj::Document::Order::k_concurrent);
+}
+
+void testResolve()
+{
+    sample_data data;
+    const lj::Uuid other(lj::Uuid::k_ns_dns, "example.org", 11);
+    lj::Document doc(new lj::bson::Node(data.doc), false);
+    doc.rekey(data.server, 100);
+    doc.wash();
+    lj::Document sibling(new lj::bson::Node(doc.root()), true);
+    doc.set(data.server, "str", lj::bson::new_string("left"));
+    sibling.set(other, "str", lj::bson::new_string("right"));
+
+    lj::bson::Node* root = new lj::bson::Node(doc.root());
+    root->set_child("_/siblings", new lj::bson::Node(lj::bson::Type::k_array, NULL));
+    root->push_child("_/siblings", new lj::bson::Node(sibling.root()));
+    lj::Document merged(root, true);
+    TEST_ASSERT(merged.conflicted());
+    TEST_ASSERT(merged.compare(sibling) == lj::Document::Order::k_concurrent);
+
+    merged.resolve(data.server);
+    TEST_ASSERT(!merged.conflicted());
+    TEST_ASSERT(!merged.root().exists("_/siblings"));
+    TEST_ASSERT(merged.compare(doc) == lj::Document::Order::k_after);
+    TEST_ASSERT(merged.compare(sibling) == lj::Document::Order::k_after);
+    TEST_ASSERT(lj::bson::as_string(merged.get("str")).compare("left") == 0);
+}
+
 void testVersion()
 {
     sample_data data;
@@ -0,0 +1,141 @@
+/*!
+ \file test/ArgsTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+
+#include "testhelper.h"
+#include "lj/Executor.h"
+#include "test/ExecutorTest_driver.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+void testExecute()
+{
+    lj::Executor executor(2);
+    TEST_ASSERT(executor.workers() == 2);
+
+    int result = 0;
+    executor.execute([&result]() { result = 42; });
+    TEST_ASSERT(result == 42);
+}
+
+void testExecuteException()
+{
+    lj::Executor executor(1);
+    try
+    {
+        executor.execute([]() { throw LJ__Exception("expected"); });
+        TEST_FAILED("The exception should have been rethrown.");
+    }
+    catch (const lj::Exception& ex)
+    {
+        TEST_ASSERT(ex.str().find("expected") != std::string::npos);
+    }
+
+    // The worker survives the exception.
+    bool ran = false;
+    executor.execute([&ran]() { ran = true; });
+    TEST_ASSERT(ran);
+}
+
+void testSubmitMany()
+{
+    std::atomic<int> count(0);
+    {
+        lj::Executor executor(4);
+        for (int h = 0; h < 10000; ++h)
+        {
+            executor.submit([&count]() { ++count; });
+        }
+        // Destructor finishes the queued work.
+    }
+    TEST_ASSERT(count.load() == 10000);
+}
+
+void testNestedSubmit()
+{
+    // Tasks submitted from a worker land on that worker's deque, and idle
+    // workers steal them.
+    std::atomic<int> count(0);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    {
+        lj::Executor executor(4);
+        executor.execute([&]() {
+            for (int h = 0; h < 64; ++h)
+            {
+                executor.submit([&]() {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    threads.insert(std::this_thread::get_id());
+                    ++count;
+                });
+            }
+        });
+    }
+    TEST_ASSERT(count.load() == 64);
+    TEST_ASSERT(threads.size() > 1);
+}
+
+void testNestedExecute()
+{
+    // Waiting on work from inside a worker must not deadlock the pool.
+    lj::Executor executor(1);
+    int result = 0;
+    executor.execute([&]() {
+        executor.execute([&result]() { result = 7; });
+    });
+    TEST_ASSERT(result == 7);
+}
+
+void testSubmitAfterShutdown()
+{
+    lj::Executor executor(1);
+    executor.shutdown();
+    try
+    {
+        executor.submit([]() { });
+        TEST_FAILED("Submit should fail after shutdown.");
+    }
+    catch (const lj::Exception& ex)
+    {
+    }
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::Executor", tests);
+}
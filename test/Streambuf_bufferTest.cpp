@@ -0,0 +1,152 @@
+/*!
+ \file test/ArgsTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+
+#include "testhelper.h"
+#include "lj/Streambuf_buffer.h"
+#include "lj/Bson.h"
+#include "test/Streambuf_bufferTest_driver.h"
+
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+
+void testInput()
+{
+    lj::Streambuf_buffer buffer(4);
+    std::iostream stream(&buffer);
+
+    const std::string expected("Hello World");
+    buffer.append_input(expected.data(), 5);
+    TEST_ASSERT(buffer.input_size() == 5);
+    buffer.append_input(expected.data() + 5, expected.size() - 5);
+    TEST_ASSERT(buffer.input_size() == expected.size());
+
+    char result[6];
+    stream.read(result, 5);
+    result[5] = '\0';
+    TEST_ASSERT(stream.good());
+    TEST_ASSERT(std::string(result).compare("Hello") == 0);
+    TEST_ASSERT(buffer.input_size() == expected.size() - 5);
+    TEST_ASSERT(memcmp(buffer.input_data(), " World", 6) == 0);
+
+    buffer.compact_input();
+    TEST_ASSERT(buffer.input_size() == 6);
+    TEST_ASSERT(memcmp(buffer.input_data(), " World", 6) == 0);
+}
+
+void testInputDoesNotBlock()
+{
+    lj::Streambuf_buffer buffer;
+    std::iostream stream(&buffer);
+
+    buffer.append_input("ab", 2);
+    char result[4];
+    stream.read(result, 4);
+    TEST_ASSERT(stream.eof());
+    TEST_ASSERT(stream.gcount() == 2);
+
+    // More data arrives after the stream is reset.
+    stream.clear();
+    buffer.append_input("cd", 2);
+    stream.read(result, 2);
+    TEST_ASSERT(stream.good());
+    TEST_ASSERT(memcmp(result, "cd", 2) == 0);
+}
+
+void testPrepareInput()
+{
+    lj::Streambuf_buffer buffer(2);
+    std::iostream stream(&buffer);
+
+    buffer.append_input("xy", 2);
+    TEST_ASSERT(stream.get() == 'x');
+
+    // Growing the buffer keeps the read position.
+    char* ptr = buffer.prepare_input(1024);
+    memset(ptr, 'z', 1024);
+    buffer.commit_input(1024);
+    TEST_ASSERT(buffer.input_size() == 1025);
+    TEST_ASSERT(stream.get() == 'y');
+    TEST_ASSERT(stream.get() == 'z');
+}
+
+void testOutput()
+{
+    lj::Streambuf_buffer buffer;
+    std::iostream stream(&buffer);
+
+    stream << "Hello" << ' ' << "World";
+    stream.flush();
+    TEST_ASSERT(buffer.output_size() == 11);
+    TEST_ASSERT(memcmp(buffer.output_data(), "Hello World", 11) == 0);
+
+    buffer.consume_output(6);
+    TEST_ASSERT(buffer.output_size() == 5);
+    TEST_ASSERT(memcmp(buffer.output_data(), "World", 5) == 0);
+
+    buffer.consume_output(5);
+    TEST_ASSERT(buffer.output_size() == 0);
+}
+
+void testBsonRoundTrip()
+{
+    lj::Streambuf_buffer buffer;
+    std::iostream stream(&buffer);
+
+    lj::bson::Node original;
+    original.set_child("hello", lj::bson::new_string("world"));
+    original.set_child("count", lj::bson::new_int64(42));
+    stream << original;
+    stream.flush();
+
+    // Move the written bytes to the input side, one byte at a time.
+    std::string written(buffer.output_data(), buffer.output_size());
+    buffer.consume_output(written.size());
+    for (char c : written)
+    {
+        buffer.append_input(&c, 1);
+    }
+
+    lj::bson::Node result;
+    stream >> result;
+    TEST_ASSERT(lj::bson::as_string(result["hello"]).compare("world") == 0);
+    TEST_ASSERT(lj::bson::as_int64(result["count"]) == 42);
+    TEST_ASSERT(buffer.input_size() == 0);
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("lj::Streambuf_buffer", tests);
+}
@@ -0,0 +1,244 @@
+/*!
+ \file test/logjam/storage/BtreeTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "storagehelper.h"
+#include "logjam/storage/Btree.h"
+#include "lj/Log.h"
+#include "lj/Stopclock.h"
+#include "test/logjam/storage/BtreeTest_driver.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    logjam::storage::Btree::Key make_key(uint32_t value, uint64_t record)
+    {
+        logjam::storage::Btree::Key key;
+        memset(key.bytes, 0, logjam::storage::Btree::k_key_size);
+        for (int h = 3; h >= 0; --h)
+        {
+            key.bytes[h] = static_cast<uint8_t>(value);
+            value >>= 8;
+        }
+        key.record = record;
+        return key;
+    }
+
+    std::vector<uint64_t> collect(const logjam::storage::Btree& tree,
+            const logjam::storage::Btree::Key& first,
+            const logjam::storage::Btree::Key& last)
+    {
+        std::vector<uint64_t> records;
+        tree.scan(first, last, [&records](const logjam::storage::Btree::Key& k) -> bool {
+            records.push_back(k.record);
+            return true;
+        });
+        return records;
+    }
+};
+
+void testInsertScan()
+{
+    std::string dir(make_temp_directory("BtreeTest"));
+    {
+        logjam::storage::Btree tree(dir + "/test.idx", "field");
+        TEST_ASSERT(!tree.valid());
+        TEST_ASSERT(tree.size() == 0);
+
+        // Enough keys to split leaves and inner nodes.
+        std::vector<uint32_t> values;
+        for (uint32_t h = 0; h < 50000; ++h)
+        {
+            values.push_back(h);
+        }
+        std::shuffle(values.begin(), values.end(), std::mt19937(42));
+        for (uint32_t v : values)
+        {
+            TEST_ASSERT(tree.insert(make_key(v, v)));
+        }
+        TEST_ASSERT(!tree.insert(make_key(7, 7)));
+        TEST_ASSERT(tree.size() == 50000);
+
+        std::vector<uint64_t> all(collect(tree,
+                make_key(0, 0),
+                make_key(UINT32_MAX, UINT64_MAX)));
+        TEST_ASSERT(all.size() == 50000);
+        TEST_ASSERT(std::is_sorted(all.begin(), all.end()));
+
+        std::vector<uint64_t> some(collect(tree,
+                make_key(1000, 0),
+                make_key(1999, UINT64_MAX)));
+        TEST_ASSERT(some.size() == 1000);
+        TEST_ASSERT(some.front() == 1000);
+        TEST_ASSERT(some.back() == 1999);
+
+        // Stopping early.
+        size_t visited = tree.scan(make_key(0, 0),
+                make_key(UINT32_MAX, UINT64_MAX),
+                [](const logjam::storage::Btree::Key& k) -> bool {
+                    return k.record < 9;
+                });
+        TEST_ASSERT(visited == 10);
+
+        TEST_ASSERT(collect(tree, make_key(10, 0), make_key(5, 0)).empty());
+    }
+    remove_directory(dir);
+}
+
+void testDuplicateValues()
+{
+    std::string dir(make_temp_directory("BtreeTest"));
+    {
+        logjam::storage::Btree tree(dir + "/test.idx", "field");
+        for (uint64_t record = 0; record < 1000; ++record)
+        {
+            TEST_ASSERT(tree.insert(make_key(record % 3, record)));
+        }
+        std::vector<uint64_t> ones(collect(tree,
+                make_key(1, 0),
+                make_key(1, UINT64_MAX)));
+        TEST_ASSERT(ones.size() == 333);
+        for (uint64_t record : ones)
+        {
+            TEST_ASSERT(record % 3 == 1);
+        }
+        TEST_ASSERT(std::is_sorted(ones.begin(), ones.end()));
+    }
+    remove_directory(dir);
+}
+
+void testErase()
+{
+    std::string dir(make_temp_directory("BtreeTest"));
+    {
+        logjam::storage::Btree tree(dir + "/test.idx", "field");
+        for (uint32_t h = 0; h < 10000; ++h)
+        {
+            tree.insert(make_key(h, h));
+        }
+
+        // Empty whole leaves in the middle of the tree.
+        for (uint32_t h = 2000; h < 8000; ++h)
+        {
+            TEST_ASSERT(tree.erase(make_key(h, h)));
+        }
+        TEST_ASSERT(!tree.erase(make_key(2000, 2000)));
+        TEST_ASSERT(tree.size() == 4000);
+
+        std::vector<uint64_t> all(collect(tree,
+                make_key(0, 0),
+                make_key(UINT32_MAX, UINT64_MAX)));
+        TEST_ASSERT(all.size() == 4000);
+        TEST_ASSERT(all[1999] == 1999);
+        TEST_ASSERT(all[2000] == 8000);
+        TEST_ASSERT(collect(tree, make_key(3000, 0), make_key(4000, 0)).empty());
+
+        // Reinsert into the emptied range.
+        TEST_ASSERT(tree.insert(make_key(5000, 5000)));
+        TEST_ASSERT(collect(tree, make_key(3000, 0), make_key(6000, 0)).size() == 1);
+
+        tree.clear();
+        TEST_ASSERT(tree.size() == 0);
+        TEST_ASSERT(collect(tree, make_key(0, 0), make_key(UINT32_MAX, UINT64_MAX)).empty());
+        TEST_ASSERT(tree.insert(make_key(1, 1)));
+    }
+    remove_directory(dir);
+}
+
+void testReopen()
+{
+    std::string dir(make_temp_directory("BtreeTest"));
+    std::string path(dir + "/test.idx");
+    {
+        logjam::storage::Btree tree(path, "field");
+        for (uint32_t h = 0; h < 5000; ++h)
+        {
+            tree.insert(make_key(h, h));
+        }
+    }
+    {
+        logjam::storage::Btree tree(path, "field");
+        TEST_ASSERT(tree.valid());
+        TEST_ASSERT(tree.size() == 5000);
+        TEST_ASSERT(collect(tree, make_key(100, 0), make_key(199, UINT64_MAX)).size() == 100);
+        tree.insert(make_key(6000, 6000));
+        tree.sync();
+    }
+    {
+        // A different tag discards the contents.
+        logjam::storage::Btree tree(path, "other");
+        TEST_ASSERT(!tree.valid());
+        TEST_ASSERT(tree.size() == 0);
+    }
+    remove_directory(dir);
+}
+
+void testScanBenchmark()
+{
+    std::string dir(make_temp_directory("BtreeTest"));
+    {
+        logjam::storage::Btree tree(dir + "/test.idx", "field");
+        const uint32_t count = 200000;
+        for (uint32_t h = 0; h < count; ++h)
+        {
+            tree.insert(make_key(h, h));
+        }
+
+        lj::Stopclock timer;
+        uint64_t sum = 0;
+        size_t visited = tree.scan(make_key(0, 0),
+                make_key(UINT32_MAX, UINT64_MAX),
+                [&sum](const logjam::storage::Btree::Key& k) -> bool {
+                    sum += k.record;
+                    return true;
+                });
+        uint64_t elapsed = timer.elapsed();
+        TEST_ASSERT(visited == count);
+        TEST_ASSERT(sum == static_cast<uint64_t>(count) * (count - 1) / 2);
+
+        lj::log::format<lj::Info>("Scanned %d entries in %d usec.")
+                << visited
+                << elapsed
+                << lj::log::end;
+    }
+    remove_directory(dir);
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("logjam::storage::Btree", tests);
+}
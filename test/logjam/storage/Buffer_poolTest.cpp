@@ -0,0 +1,218 @@
+/*!
+ \file test/logjam/storage/Buffer_poolTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "storagehelper.h"
+#include "logjam/storage/Buffer_pool.h"
+#include "logjam/storage/Storage.h"
+#include "test/logjam/storage/Buffer_poolTest_driver.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t k_page = logjam::storage::Buffer_pool::k_page_size;
+
+    // A shared file mapping filled with a recognizable pattern.
+    struct Mapped_file
+    {
+        Mapped_file(const std::string& path, size_t pages) :
+                fd(::open(path.c_str(), O_RDWR | O_CREAT, 0644)),
+                length(pages * k_page),
+                base(nullptr)
+        {
+            TEST_ASSERT(0 <= fd);
+            TEST_ASSERT(0 == ftruncate(fd, length));
+            void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            TEST_ASSERT(MAP_FAILED != ptr);
+            base = static_cast<uint8_t*>(ptr);
+            for (size_t h = 0; h < length; ++h)
+            {
+                base[h] = static_cast<uint8_t>(h / k_page + h);
+            }
+        }
+
+        ~Mapped_file()
+        {
+            munmap(base, length);
+            ::close(fd);
+        }
+
+        bool intact() const
+        {
+            for (size_t h = 0; h < length; ++h)
+            {
+                if (base[h] != static_cast<uint8_t>(h / k_page + h))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        int fd;
+        size_t length;
+        uint8_t* base;
+    };
+};
+
+void testHitsAndMisses()
+{
+    std::string dir(make_temp_directory("Buffer_poolTest"));
+    {
+        Mapped_file file(dir + "/data", 8);
+        logjam::storage::Buffer_pool pool(4 * k_page);
+        uint32_t id = pool.attach(file.base, file.length, file.fd);
+
+        pool.pin(id, 0, 10);
+        logjam::storage::Buffer_pool::Stats stats(pool.stats());
+        TEST_ASSERT(stats.pin_misses == 1);
+        TEST_ASSERT(stats.pin_hits == 0);
+        TEST_ASSERT(stats.tracked == 1);
+        TEST_ASSERT(stats.capacity == 4);
+
+        // A range across a page boundary touches both pages.
+        pool.pin(id, k_page - 5, 10);
+        stats = pool.stats();
+        TEST_ASSERT(stats.pin_misses == 2);
+        TEST_ASSERT(stats.pin_hits == 1);
+
+        TEST_ASSERT(!pool.pin(id, 0, 0));
+        TEST_ASSERT(!pool.pin(id, file.length, 10));
+        TEST_ASSERT(pool.stats().pin_misses == 2);
+
+        pool.detach(id);
+        TEST_ASSERT(pool.stats().tracked == 0);
+        TEST_ASSERT(!pool.pin(id, 0, 10));
+    }
+    remove_directory(dir);
+}
+
+void testEviction()
+{
+    std::string dir(make_temp_directory("Buffer_poolTest"));
+    {
+        Mapped_file file(dir + "/data", 16);
+        logjam::storage::Buffer_pool pool(2 * k_page);
+        uint32_t id = pool.attach(file.base, file.length, file.fd);
+
+        for (size_t page = 0; page < 16; ++page)
+        {
+            pool.pin(id, page * k_page, 1);
+        }
+        logjam::storage::Buffer_pool::Stats stats(pool.stats());
+        TEST_ASSERT(stats.pin_misses == 16);
+        TEST_ASSERT(stats.tracked <= 2);
+        TEST_ASSERT(stats.evictions >= 14);
+        TEST_ASSERT(stats.overflows == 0);
+
+        // Dropped pages fault back in from the file.
+        TEST_ASSERT(file.intact());
+        pool.detach(id);
+    }
+    remove_directory(dir);
+}
+
+void testPinnedPagesStay()
+{
+    std::string dir(make_temp_directory("Buffer_poolTest"));
+    {
+        Mapped_file file(dir + "/data", 4);
+        logjam::storage::Buffer_pool pool(k_page);
+        uint32_t id = pool.attach(file.base, file.length, file.fd);
+
+        logjam::storage::Buffer_pool::Pin first(pool.pin(id, 0, 1));
+        TEST_ASSERT(static_cast<bool>(first));
+        {
+            logjam::storage::Buffer_pool::Pin second(pool.pin(id, k_page, 1));
+            logjam::storage::Buffer_pool::Stats stats(pool.stats());
+            TEST_ASSERT(stats.tracked == 2);
+            TEST_ASSERT(stats.overflows == 1);
+            TEST_ASSERT(stats.evictions == 0);
+        }
+
+        // The unpinned page is evicted; the pinned one is still a hit.
+        pool.pin(id, 2 * k_page, 1);
+        pool.pin(id, 0, 1);
+        logjam::storage::Buffer_pool::Stats stats(pool.stats());
+        TEST_ASSERT(stats.pin_hits == 1);
+        TEST_ASSERT(stats.evictions >= 1);
+
+        // Moving a pin keeps a single reference.
+        logjam::storage::Buffer_pool::Pin moved(std::move(first));
+        TEST_ASSERT(!first);
+        TEST_ASSERT(static_cast<bool>(moved));
+        moved.release();
+        TEST_ASSERT(!moved);
+        pool.pin(id, 3 * k_page, 1);
+        TEST_ASSERT(pool.stats().tracked <= 2);
+        TEST_ASSERT(file.intact());
+        pool.detach(id);
+    }
+    remove_directory(dir);
+}
+
+void testStorageReads()
+{
+    std::string dir(make_temp_directory("Buffer_poolTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        lj::Document doc;
+        doc.rekey(lj::Uuid::k_nil, 10);
+        doc.set(lj::Uuid::k_nil, "name", lj::bson::new_string("cached"));
+        coll.store(doc);
+
+        uint64_t before = storage.pool().stats().pin_misses + storage.pool().stats().pin_hits;
+        TEST_ASSERT(coll.read(10) != nullptr);
+        std::unique_ptr<lj::bson::Node> fetched(coll.fetch(10));
+        TEST_ASSERT(fetched.get() != nullptr);
+        {
+            lj::bson::View viewed(coll.view(10));
+            TEST_ASSERT(lj::bson::as_string(viewed["./name"]).compare("cached") == 0);
+        }
+        logjam::storage::Buffer_pool::Stats stats(storage.pool().stats());
+        TEST_ASSERT(stats.pin_misses + stats.pin_hits == before + 3);
+        TEST_ASSERT(stats.pin_hits >= 2);
+    }
+    remove_directory(dir);
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("logjam::storage::Buffer_pool", tests);
+}
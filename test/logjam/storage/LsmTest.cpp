@@ -0,0 +1,271 @@
+/*!
+ \file test/logjam/storage/LsmTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "storagehelper.h"
+#include "logjam/storage/Bloom.h"
+#include "logjam/storage/Lsm.h"
+#include "logjam/storage/Memtable.h"
+#include "logjam/storage/Run.h"
+#include "logjam/storage/Storage.h"
+#include "test/logjam/storage/LsmTest_driver.h"
+
+#include <cstdlib>
+#include <memory>
+#include <unistd.h>
+
+namespace
+{
+    std::string fetch_name(const logjam::storage::Lsm_collection& coll, uint64_t key)
+    {
+        std::unique_ptr<lj::bson::Node> doc(coll.fetch(key));
+        return doc ? lj::bson::as_string((*doc)["./name"]) : std::string();
+    }
+};
+
+void testMemtable()
+{
+    logjam::storage::Memtable table;
+    const uint8_t one[] = {1};
+    const uint8_t two[] = {2, 2};
+    for (uint64_t key = 100; key > 0; --key)
+    {
+        table.put(key * 7 % 101, one, sizeof(one));
+    }
+    TEST_ASSERT(table.size() == 100);
+    TEST_ASSERT(table.bytes() == 100);
+
+    // A second put replaces the value.
+    table.put(7, two, sizeof(two));
+    TEST_ASSERT(table.size() == 100);
+    TEST_ASSERT(table.bytes() == 101);
+    TEST_ASSERT(table.get(7)[0] == 2);
+    TEST_ASSERT(table.get(0) == nullptr);
+
+    uint64_t last = 0;
+    size_t count = 0;
+    table.each([&last, &count](uint64_t key, const uint8_t*, size_t) {
+        TEST_ASSERT(key > last);
+        last = key;
+        ++count;
+    });
+    TEST_ASSERT(count == 100);
+}
+
+void testBloom()
+{
+    logjam::storage::Bloom bloom(1000);
+    for (uint64_t key = 0; key < 1000; ++key)
+    {
+        bloom.add(key * 2);
+    }
+
+    size_t false_positives = 0;
+    for (uint64_t key = 0; key < 1000; ++key)
+    {
+        TEST_ASSERT(bloom.may_contain(key * 2));
+        if (bloom.may_contain(key * 2 + 1))
+        {
+            ++false_positives;
+        }
+    }
+    TEST_ASSERT(false_positives < 50);
+
+    logjam::storage::Bloom loaded(bloom.data().data(),
+            bloom.data().size(),
+            bloom.probes());
+    TEST_ASSERT(loaded.may_contain(500));
+}
+
+void testRun()
+{
+    std::string dir(make_temp_directory("LsmTest"));
+    {
+        std::string path(dir + "/00000000.run");
+        logjam::storage::Run::Writer writer(path);
+        for (uint64_t key = 10; key <= 1000; key += 10)
+        {
+            std::unique_ptr<lj::Document> doc(make_document(key, std::to_string(key)));
+            size_t sz;
+            std::unique_ptr<uint8_t[]> bytes(doc->root().to_binary(&sz));
+            writer.add(key, bytes.get(), sz);
+        }
+        try
+        {
+            writer.add(5, nullptr, 0);
+            TEST_FAILED("Expected an out of order key.");
+        }
+        catch (lj::Exception& ex)
+        {
+        }
+        TEST_ASSERT(writer.finish() > 0);
+        TEST_ASSERT(access((path + ".tmp").c_str(), F_OK) < 0);
+
+        logjam::storage::Run run(path);
+        TEST_ASSERT(run.count() == 100);
+        TEST_ASSERT(run.min_key() == 10);
+        TEST_ASSERT(run.max_key() == 1000);
+        TEST_ASSERT(run.overlaps(1000, 2000));
+        TEST_ASSERT(!run.overlaps(1001, 2000));
+
+        logjam::storage::Buffer_pool::Pin held;
+        const uint8_t* bytes = run.find(500, held);
+        TEST_ASSERT(bytes != nullptr);
+        lj::bson::Node doc(lj::bson::Type::k_document, bytes);
+        TEST_ASSERT(lj::bson::as_string(doc["./name"]).compare("500") == 0);
+        TEST_ASSERT(run.find(505, held) == nullptr);
+        TEST_ASSERT(run.find(0, held) == nullptr);
+
+        run.obsolete();
+    }
+    TEST_ASSERT(access((dir + "/00000000.run").c_str(), F_OK) < 0);
+    remove_directory(dir);
+}
+
+void testStoreFetch()
+{
+    std::string dir(make_temp_directory("LsmTest"));
+    {
+        logjam::storage::Lsm_collection coll("test", dir + "/test", nullptr);
+        std::unique_ptr<lj::Document> doc(make_document(10, "first"));
+        TEST_ASSERT(coll.store(*doc) == 0);
+        TEST_ASSERT(fetch_name(coll, 10).compare("first") == 0);
+        TEST_ASSERT(coll.fetch(11) == nullptr);
+
+        coll.sync();
+        TEST_ASSERT(coll.stats().runs[0] == 1);
+        TEST_ASSERT(fetch_name(coll, 10).compare("first") == 0);
+
+        // The memtable shadows the run.
+        doc->set(lj::Uuid::k_nil, "name", lj::bson::new_string("second"));
+        coll.store(*doc);
+        TEST_ASSERT(fetch_name(coll, 10).compare("second") == 0);
+    }
+    {
+        logjam::storage::Lsm_collection coll("test", dir + "/test", nullptr);
+        TEST_ASSERT(fetch_name(coll, 10).compare("second") == 0);
+    }
+    remove_directory(dir);
+}
+
+void testCompaction()
+{
+    std::string dir(make_temp_directory("LsmTest"));
+    const uint64_t keys = 1000;
+    {
+        // A tiny memtable forces many flushes and compactions.
+        logjam::storage::Lsm_collection coll("test", dir + "/test", nullptr, nullptr, 4096);
+        for (int round = 0; round < 4; ++round)
+        {
+            for (uint64_t key = 0; key < keys; ++key)
+            {
+                uint64_t k = key * 7919 % keys;
+                std::unique_ptr<lj::Document> doc(make_document(k,
+                        std::to_string(round) + ":" + std::to_string(k)));
+                coll.store(*doc);
+            }
+        }
+        coll.sync();
+
+        for (uint64_t key = 0; key < keys; ++key)
+        {
+            TEST_ASSERT(fetch_name(coll, key).compare("3:" + std::to_string(key)) == 0);
+        }
+        TEST_ASSERT(coll.fetch(keys) == nullptr);
+
+        logjam::storage::Lsm_collection::Stats stats(coll.stats());
+        TEST_ASSERT(stats.flushes > 0);
+        TEST_ASSERT(stats.compactions > 0);
+        TEST_ASSERT(stats.write_amplification() > 1.0);
+        TEST_ASSERT(stats.runs.size() == logjam::storage::Lsm_collection::k_levels);
+        TEST_ASSERT(stats.runs[0] < logjam::storage::Lsm_collection::k_level0_stall_runs);
+        lj::log::format<lj::Info>("%d flushes, %d compactions, write amplification %s, %d stalls for %d usec.")
+                << stats.flushes
+                << stats.compactions
+                << std::to_string(stats.write_amplification())
+                << stats.stalls
+                << stats.stall_micros
+                << lj::log::end;
+    }
+    {
+        // The manifest brings back the same runs.
+        logjam::storage::Lsm_collection coll("test", dir + "/test", nullptr, nullptr, 4096);
+        for (uint64_t key = 0; key < keys; key += 97)
+        {
+            TEST_ASSERT(fetch_name(coll, key).compare("3:" + std::to_string(key)) == 0);
+        }
+    }
+    remove_directory(dir);
+}
+
+void testStorageRecover()
+{
+    std::string dir(make_temp_directory("LsmTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Lsm_collection& coll = storage.lsm("events");
+        TEST_ASSERT(storage.is_lsm("events"));
+        TEST_ASSERT(!storage.is_lsm("test"));
+        std::unique_ptr<lj::Document> doc(make_document(10, "logged"));
+        storage.wait(coll.store(*doc));
+
+        try
+        {
+            storage.collection("events");
+            TEST_FAILED("Expected a name conflict.");
+        }
+        catch (lj::Exception& ex)
+        {
+        }
+    }
+
+    // Lose the runs, as if the memtable was never flushed.
+    remove_directory(dir + "/events");
+    {
+        logjam::storage::Storage storage(dir);
+        storage.lsm("events");
+        TEST_ASSERT(storage.recover() == 1);
+        TEST_ASSERT(fetch_name(storage.lsm("events"), 10).compare("logged") == 0);
+    }
+    {
+        logjam::storage::Storage storage(dir);
+        storage.lsm("events");
+        TEST_ASSERT(storage.recover() == 0);
+        TEST_ASSERT(fetch_name(storage.lsm("events"), 10).compare("logged") == 0);
+    }
+    remove_directory(dir);
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("logjam::storage::Lsm", tests);
+}
@@ -0,0 +1,565 @@
+/*!
+ \file test/logjam/storage/StorageTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "storagehelper.h"
+#include "logjam/storage/Storage.h"
+#include "test/logjam/storage/StorageTest_driver.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+void testStoreFetch()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        std::unique_ptr<lj::Document> doc(make_document(10, "first"));
+        coll.store(*doc);
+        TEST_ASSERT(coll.size() == 1);
+
+        std::unique_ptr<lj::bson::Node> found(coll.fetch(10));
+        TEST_ASSERT(found.get() != nullptr);
+        TEST_ASSERT(found->type() == lj::bson::Type::k_binary_document);
+        TEST_ASSERT(found->size() == doc->root().size());
+
+        lj::bson::Node parsed(lj::bson::Type::k_document, coll.read(10));
+        TEST_ASSERT(lj::bson::as_string(parsed["./name"]).compare("first") == 0);
+
+        lj::bson::View viewed(coll.view(10));
+        TEST_ASSERT(viewed.data() == coll.read(10));
+        TEST_ASSERT(lj::bson::as_string(viewed["./name"]).compare("first") == 0);
+        TEST_ASSERT(!coll.view(11));
+
+        std::unique_ptr<lj::bson::Node> by_id(coll.fetch(doc->id()));
+        TEST_ASSERT(by_id.get() != nullptr);
+
+        TEST_ASSERT(coll.fetch(11) == nullptr);
+        TEST_ASSERT(coll.read(lj::Uuid::k_nil) == nullptr);
+    }
+    remove_directory(dir);
+}
+
+void testVersions()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        std::unique_ptr<lj::Document> doc(make_document(10, "first"));
+        coll.store(*doc);
+        doc->wash();
+        lj::Uuid first_id(doc->id());
+
+        doc->set(lj::Uuid::k_nil, "name", lj::bson::new_string("second"));
+        TEST_ASSERT(first_id != doc->id());
+        coll.store(*doc);
+        TEST_ASSERT(coll.size() == 1);
+
+        lj::bson::Node current(lj::bson::Type::k_document, coll.read(10));
+        TEST_ASSERT(lj::bson::as_string(current["./name"]).compare("second") == 0);
+
+        lj::bson::Node old(lj::bson::Type::k_document, coll.read(first_id));
+        TEST_ASSERT(lj::bson::as_string(old["./name"]).compare("first") == 0);
+    }
+    remove_directory(dir);
+}
+
+void testReopen()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    lj::Uuid last_id;
+    {
+        // Small segments force the collection to roll over.
+        logjam::storage::Storage storage(dir,
+                logjam::storage::Wal::k_default_flush_interval,
+                logjam::storage::Wal::k_default_batch_size,
+                512);
+        logjam::storage::Collection& coll = storage.collection("test");
+        for (uint64_t key = 1; key <= 20; ++key)
+        {
+            std::unique_ptr<lj::Document> doc(make_document(key, "value"));
+            coll.store(*doc);
+            last_id = doc->id();
+        }
+        coll.sync();
+    }
+    {
+        logjam::storage::Storage storage(dir,
+                logjam::storage::Wal::k_default_flush_interval,
+                logjam::storage::Wal::k_default_batch_size,
+                512);
+        logjam::storage::Collection& coll = storage.collection("test");
+        TEST_ASSERT(coll.size() == 20);
+        for (uint64_t key = 1; key <= 20; ++key)
+        {
+            lj::bson::Node doc(lj::bson::Type::k_document, coll.read(key));
+            TEST_ASSERT(lj::bson::as_uint64(doc["_/key"]) == key);
+        }
+        TEST_ASSERT(coll.read(last_id) != nullptr);
+
+        std::unique_ptr<lj::Document> doc(make_document(21, "after"));
+        coll.store(*doc);
+        TEST_ASSERT(coll.size() == 21);
+    }
+    remove_directory(dir);
+}
+
+void testRecover()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    lj::Uuid id;
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        std::unique_ptr<lj::Document> doc(make_document(10, "logged"));
+        storage.wait(coll.store(*doc));
+        id = doc->id();
+    }
+
+    // Lose the segments, as if they were never flushed.
+    remove_directory(dir + "/test");
+    {
+        logjam::storage::Storage storage(dir);
+        TEST_ASSERT(storage.recover() == 1);
+        logjam::storage::Collection& coll = storage.collection("test");
+        TEST_ASSERT(coll.size() == 1);
+        lj::bson::Node doc(lj::bson::Type::k_document, coll.read(10));
+        TEST_ASSERT(lj::bson::as_string(doc["./name"]).compare("logged") == 0);
+        TEST_ASSERT(coll.read(id) != nullptr);
+    }
+    {
+        // The recovered versions are in the segments and the log was
+        // checkpointed, so nothing is replayed twice.
+        logjam::storage::Storage storage(dir);
+        TEST_ASSERT(storage.recover() == 0);
+        TEST_ASSERT(storage.collection("test").size() == 1);
+    }
+    remove_directory(dir);
+}
+
+void testTornRecord()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    std::string path(dir + "/segment");
+    size_t used;
+    {
+        logjam::storage::Segment seg(path, 1024);
+        lj::bson::Node node;
+        node.set_child("a", lj::bson::new_string("b"));
+        size_t sz;
+        std::unique_ptr<uint8_t[]> bytes(node.to_binary(&sz));
+        TEST_ASSERT(seg.append(bytes.get(), sz) == 0);
+        TEST_ASSERT(seg.append(bytes.get(), sz) == sz);
+        used = seg.size();
+
+        // Write the length of a record without the body.
+        int32_t partial = 100;
+        seg.append(reinterpret_cast<uint8_t*>(&partial), sizeof(partial));
+        TEST_ASSERT(seg.next(0) == sz);
+    }
+    {
+        logjam::storage::Segment seg(path, 1024);
+        TEST_ASSERT(seg.size() == used);
+        TEST_ASSERT(seg.next(seg.next(0)) == seg.size());
+    }
+    remove_directory(dir);
+}
+
+void testInvalidName()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        try
+        {
+            storage.collection("../escape");
+            TEST_FAILED("Expected an invalid collection name.");
+        }
+        catch (lj::Exception& ex)
+        {
+        }
+    }
+    remove_directory(dir);
+}
+
+namespace
+{
+    lj::Document* make_person(uint64_t key, const std::string& name, int32_t age)
+    {
+        lj::Document* doc = make_document(key, name);
+        doc->set(lj::Uuid::k_nil, "age", lj::bson::new_int32(age));
+        return doc;
+    }
+
+    std::vector<uint64_t> scan_keys(const logjam::storage::Collection& coll,
+            const std::string& index,
+            const lj::bson::Node* lower,
+            const lj::bson::Node* upper)
+    {
+        std::vector<uint64_t> keys;
+        coll.scan(index, lower, upper, [&keys](const uint8_t* bytes) -> bool {
+            keys.push_back(lj::bson::as_uint64(lj::bson::View(bytes)["_/key"]));
+            return true;
+        });
+        return keys;
+    }
+};
+
+void testIndex()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+
+        // Documents stored before the index exists are indexed when it is
+        // added.
+        for (uint64_t key = 1; key <= 50; ++key)
+        {
+            std::unique_ptr<lj::Document> doc(make_person(key, "person", key % 10));
+            coll.store(*doc);
+        }
+        coll.add_index("by_age", "age");
+        coll.add_index("by_name", "name");
+        TEST_ASSERT(coll.has_index("by_age"));
+        TEST_ASSERT(!coll.has_index("by_zip"));
+        try
+        {
+            coll.add_index("by_age", "age");
+            TEST_FAILED("Expected a duplicate index name.");
+        }
+        catch (lj::Exception& ex)
+        {
+        }
+
+        std::unique_ptr<lj::bson::Node> three(lj::bson::new_int64(3));
+        std::unique_ptr<lj::bson::Node> four(lj::bson::new_int32(4));
+        std::vector<uint64_t> keys(scan_keys(coll, "by_age", three.get(), four.get()));
+        TEST_ASSERT(keys.size() == 10);
+        TEST_ASSERT(keys.front() == 3);
+        TEST_ASSERT(keys.back() == 44);
+        TEST_ASSERT(scan_keys(coll, "by_age", nullptr, nullptr).size() == 50);
+        TEST_ASSERT(scan_keys(coll, "by_age", nullptr, three.get()).size() == 20);
+
+        // A new version moves the document within the index.
+        std::unique_ptr<lj::Document> doc(make_person(3, "renamed", 100));
+        coll.store(*doc);
+        TEST_ASSERT(scan_keys(coll, "by_age", three.get(), four.get()).size() == 9);
+        std::unique_ptr<lj::bson::Node> hundred(lj::bson::new_int64(100));
+        keys = scan_keys(coll, "by_age", hundred.get(), nullptr);
+        TEST_ASSERT(keys.size() == 1 && keys.front() == 3);
+
+        // Long strings share a truncated key and are compared in full.
+        std::string prefix(40, 'x');
+        doc.reset(make_person(60, prefix + "a", 1));
+        coll.store(*doc);
+        doc.reset(make_person(61, prefix + "b", 1));
+        coll.store(*doc);
+        std::unique_ptr<lj::bson::Node> bound(lj::bson::new_string(prefix + "b"));
+        keys = scan_keys(coll, "by_name", bound.get(), bound.get());
+        TEST_ASSERT(keys.size() == 1 && keys.front() == 61);
+        std::unique_ptr<lj::bson::Node> renamed(lj::bson::new_string("renamed"));
+        keys = scan_keys(coll, "by_name", renamed.get(), renamed.get());
+        TEST_ASSERT(keys.size() == 1 && keys.front() == 3);
+
+        try
+        {
+            scan_keys(coll, "by_zip", nullptr, nullptr);
+            TEST_FAILED("Expected an unknown index.");
+        }
+        catch (lj::Exception& ex)
+        {
+        }
+    }
+    {
+        // A clean index is reused as-is.
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        coll.add_index("by_age", "age");
+        std::unique_ptr<lj::bson::Node> hundred(lj::bson::new_int64(100));
+        std::vector<uint64_t> keys(scan_keys(coll, "by_age", hundred.get(), nullptr));
+        TEST_ASSERT(keys.size() == 1 && keys.front() == 3);
+
+        // Moving an index to another field rebuilds it.
+        coll.add_index("by_name", "age");
+        TEST_ASSERT(scan_keys(coll, "by_name", hundred.get(), nullptr).size() == 1);
+    }
+    remove_directory(dir);
+}
+
+void testSnapshot()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        std::unique_ptr<lj::Document> doc(make_document(10, "first"));
+        coll.store(*doc);
+
+        logjam::storage::Collection::Snapshot snap(coll.snapshot());
+        TEST_ASSERT(snap);
+        doc->set(lj::Uuid::k_nil, "name", lj::bson::new_string("second"));
+        coll.store(*doc);
+        std::unique_ptr<lj::Document> added(make_document(11, "added"));
+        coll.store(*added);
+
+        // The snapshot keeps reading the versions it started with.
+        lj::bson::Node old(lj::bson::Type::k_document, coll.read(10, snap));
+        TEST_ASSERT(lj::bson::as_string(old["./name"]).compare("first") == 0);
+        TEST_ASSERT(lj::bson::as_string(coll.view(10, snap)["./name"]).compare("first") == 0);
+        TEST_ASSERT(coll.read(11, snap) == nullptr);
+        lj::bson::Node current(lj::bson::Type::k_document, coll.read(10));
+        TEST_ASSERT(lj::bson::as_string(current["./name"]).compare("second") == 0);
+        std::unique_ptr<lj::bson::Node> fetched(coll.fetch(10, snap));
+        TEST_ASSERT(fetched.get() != nullptr && fetched->size() == old.size());
+        TEST_ASSERT(coll.retained() == 1);
+
+        // Released versions are dropped by the next writer.
+        snap.release();
+        TEST_ASSERT(!snap);
+        TEST_ASSERT(coll.retained() == 1);
+        coll.store(*added);
+        TEST_ASSERT(coll.retained() == 0);
+
+        logjam::storage::Collection& other = storage.collection("other");
+        logjam::storage::Collection::Snapshot foreign(other.snapshot());
+        try
+        {
+            coll.read(10, foreign);
+            TEST_FAILED("Expected a foreign snapshot to be rejected.");
+        }
+        catch (lj::Exception& ex)
+        {
+        }
+    }
+    remove_directory(dir);
+}
+
+void testSnapshotScan()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        coll.add_index("by_age", "age");
+        for (uint64_t key = 1; key <= 5; ++key)
+        {
+            std::unique_ptr<lj::Document> doc(make_person(key, "person", key * 10));
+            coll.store(*doc);
+        }
+
+        logjam::storage::Collection::Snapshot snap(coll.snapshot());
+        std::unique_ptr<lj::Document> moved(make_person(1, "moved", 60));
+        coll.store(*moved);
+
+        // Writing from inside the scan does not block, and the scan
+        // still sees the documents as they were.
+        std::vector<uint64_t> keys;
+        coll.scan("by_age", nullptr, nullptr, [&coll, &keys](const uint8_t* bytes) -> bool {
+            uint64_t key = lj::bson::as_uint64(lj::bson::View(bytes)["_/key"]);
+            keys.push_back(key);
+            std::unique_ptr<lj::Document> doc(make_person(key, "updated", 100 + key));
+            coll.store(*doc);
+            return true;
+        }, snap);
+        TEST_ASSERT(keys.size() == 5);
+        for (uint64_t key = 1; key <= 5; ++key)
+        {
+            TEST_ASSERT(keys[key - 1] == key);
+        }
+
+        std::unique_ptr<lj::bson::Node> fifty(lj::bson::new_int64(50));
+        TEST_ASSERT(scan_keys(coll, "by_age", nullptr, fifty.get()).empty());
+        TEST_ASSERT(scan_keys(coll, "by_age", fifty.get(), nullptr).size() == 5);
+    }
+    remove_directory(dir);
+}
+
+void testReconcile()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    lj::Uuid first_id;
+    lj::Uuid second_id;
+    {
+        const lj::Uuid left_server(lj::Uuid::k_ns_dns, "left.example.com", 16);
+        const lj::Uuid right_server(lj::Uuid::k_ns_dns, "right.example.com", 17);
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        uint64_t lsn;
+
+        std::unique_ptr<lj::Document> base(make_document(10, "first"));
+        base->wash();
+        base->set(left_server, "name", lj::bson::new_string("base"));
+        TEST_ASSERT(coll.reconcile(base->root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_applied);
+        TEST_ASSERT(0 < lsn);
+        TEST_ASSERT(coll.reconcile(base->root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_stale);
+        TEST_ASSERT(0 == lsn);
+
+        base->wash();
+        lj::Document left(new lj::bson::Node(base->root()), true);
+        lj::Document right(new lj::bson::Node(base->root()), true);
+        left.set(left_server, "name", lj::bson::new_string("left"));
+        right.set(right_server, "name", lj::bson::new_string("right"));
+        TEST_ASSERT(coll.reconcile(left.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_applied);
+        TEST_ASSERT(coll.reconcile(base->root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_stale);
+        TEST_ASSERT(coll.reconcile(right.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_conflict);
+        TEST_ASSERT(coll.size() == 1);
+
+        lj::Document merged(new lj::bson::Node(lj::bson::Type::k_document,
+                coll.read(10)), true);
+        TEST_ASSERT(merged.conflicted());
+        TEST_ASSERT(merged.root()["_/siblings"].to_vector().size() == 1);
+        TEST_ASSERT(merged.id() != left.id());
+        TEST_ASSERT(merged.id() != right.id());
+        first_id = merged.id();
+        TEST_ASSERT(coll.reconcile(merged.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_stale);
+        TEST_ASSERT(coll.reconcile(right.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_stale);
+
+        // The other order ends with the same document.
+        logjam::storage::Collection& other = storage.collection("other");
+        TEST_ASSERT(other.reconcile(right.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_applied);
+        TEST_ASSERT(other.reconcile(left.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_conflict);
+        lj::bson::Node other_merged(lj::bson::Type::k_document, other.read(10));
+        TEST_ASSERT(lj::bson::as_string(other_merged["./name"]).compare(
+                lj::bson::as_string(merged.get("name"))) == 0);
+        TEST_ASSERT(other.reconcile(merged.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_stale);
+
+        merged.resolve(right_server);
+        TEST_ASSERT(coll.reconcile(merged.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_applied);
+        TEST_ASSERT(other.reconcile(merged.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_applied);
+        lj::Document resolved(new lj::bson::Node(lj::bson::Type::k_document,
+                other.read(10)), true);
+        TEST_ASSERT(!resolved.conflicted());
+        TEST_ASSERT(resolved.id() == merged.id());
+
+        // Both replicas name the first merge the same way, and a second
+        // conflict on the key gets a new id.
+        TEST_ASSERT(lj::bson::as_uuid(other_merged["_/id"]) == first_id);
+        resolved.wash();
+        lj::Document left_again(new lj::bson::Node(resolved.root()), true);
+        lj::Document right_again(new lj::bson::Node(resolved.root()), true);
+        left_again.set(left_server, "name", lj::bson::new_string("left again"));
+        right_again.set(right_server, "name", lj::bson::new_string("right again"));
+        TEST_ASSERT(coll.reconcile(left_again.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_applied);
+        TEST_ASSERT(coll.reconcile(right_again.root(), lsn) ==
+                logjam::storage::Collection::Reconciled::k_conflict);
+        second_id = lj::bson::as_uuid(lj::bson::View(coll.read(10))["_/id"]);
+        TEST_ASSERT(second_id != first_id);
+        const uint8_t* first = coll.read(first_id);
+        TEST_ASSERT(first && lj::bson::as_uuid(lj::bson::View(first)["_/id"]) == first_id);
+    }
+    {
+        // Both merges survive a restart.
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        lj::Document merged(new lj::bson::Node(lj::bson::Type::k_document,
+                coll.read(10)), true);
+        TEST_ASSERT(merged.id() == second_id);
+        TEST_ASSERT(merged.conflicted());
+        const uint8_t* first = coll.read(first_id);
+        TEST_ASSERT(first && lj::bson::View(first).exists("_/siblings"));
+    }
+    remove_directory(dir);
+}
+
+void testChanges()
+{
+    std::string dir(make_temp_directory("StorageTest"));
+    {
+        logjam::storage::Storage storage(dir);
+        logjam::storage::Collection& coll = storage.collection("test");
+        for (uint64_t key = 1; key <= 3; ++key)
+        {
+            std::unique_ptr<lj::Document> doc(make_document(key, "first"));
+            coll.store(*doc);
+        }
+
+        std::vector<uint64_t> keys;
+        auto collect = [&keys](const uint8_t* bytes) {
+            keys.push_back(lj::bson::as_uint64(lj::bson::View(bytes)["_/key"]));
+        };
+        uint64_t since = coll.changes(0, 2, SIZE_MAX, collect);
+        TEST_ASSERT(keys.size() == 2);
+        since = coll.changes(since, 10, SIZE_MAX, collect);
+        TEST_ASSERT(keys.size() == 3);
+        TEST_ASSERT(keys[0] == 1 && keys[1] == 2 && keys[2] == 3);
+        TEST_ASSERT(coll.changes(since, 10, SIZE_MAX, collect) == since);
+        TEST_ASSERT(keys.size() == 3);
+
+        // Only the latest version of a rewritten key is visited.
+        std::unique_ptr<lj::Document> doc(make_document(1, "second"));
+        coll.store(*doc);
+        keys.clear();
+        since = coll.changes(since, 10, SIZE_MAX, collect);
+        TEST_ASSERT(keys.size() == 1 && keys[0] == 1);
+        keys.clear();
+        coll.changes(0, 10, SIZE_MAX, collect);
+        TEST_ASSERT(keys.size() == 3);
+        TEST_ASSERT(keys[0] == 2 && keys[1] == 3 && keys[2] == 1);
+
+        // The byte limit ends the batch early, but never before the first
+        // document.
+        size_t doc_size = lj::bson::View(coll.read(1)).size();
+        keys.clear();
+        since = coll.changes(0, 10, doc_size * 2, collect);
+        TEST_ASSERT(keys.size() == 2);
+        since = coll.changes(since, 10, 1, collect);
+        TEST_ASSERT(keys.size() == 3);
+        TEST_ASSERT(keys[0] == 2 && keys[1] == 3 && keys[2] == 1);
+
+        std::vector<std::string> names(storage.names());
+        TEST_ASSERT(names.size() == 1 && names[0].compare("test") == 0);
+    }
+    remove_directory(dir);
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("logjam::storage::Storage", tests);
+}
@@ -0,0 +1,194 @@
+/*!
+ \file test/logjam/storage/WalTest.cpp
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "storagehelper.h"
+#include "logjam/storage/Wal.h"
+#include "lj/Bson.h"
+#include "test/logjam/storage/WalTest_driver.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    std::vector<uint8_t> make_record(const std::string& value)
+    {
+        lj::bson::Node node;
+        node.set_child("value", lj::bson::new_string(value));
+        size_t sz;
+        std::unique_ptr<uint8_t[]> bytes(node.to_binary(&sz));
+        return std::vector<uint8_t>(bytes.get(), bytes.get() + sz);
+    }
+};
+
+void testGroupCommit()
+{
+    std::string dir(make_temp_directory("WalTest"));
+    {
+        std::atomic<int> checkpoints(0);
+        logjam::storage::Wal wal(dir,
+                std::chrono::milliseconds(5),
+                16,
+                [&checkpoints]() { ++checkpoints; });
+
+        std::vector<uint8_t> record(make_record("value"));
+        std::vector<std::thread> threads;
+        for (int h = 0; h < 8; ++h)
+        {
+            threads.emplace_back([&wal, &record]() {
+                for (int i = 0; i < 50; ++i)
+                {
+                    uint64_t lsn = wal.append("test", record.data(), record.size());
+                    wal.wait(lsn);
+                    TEST_ASSERT(wal.durable() >= lsn);
+                }
+            });
+        }
+        for (std::thread& t : threads)
+        {
+            t.join();
+        }
+        TEST_ASSERT(wal.durable() == 400);
+        TEST_ASSERT(checkpoints == 0);
+    }
+    remove_directory(dir);
+}
+
+void testCheckpointOffWriter()
+{
+    std::string dir(make_temp_directory("WalTest"));
+    {
+        std::atomic<bool> started(false);
+        std::atomic<bool> release(false);
+        logjam::storage::Wal wal(dir,
+                std::chrono::milliseconds(0),
+                1,
+                [&started, &release]() {
+                    started = true;
+                    while (!release)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                });
+        wal.checkpoint();
+
+        // Fill the first file until the writer rotates.
+        std::vector<uint8_t> record(make_record(std::string(1024 * 1024, 'x')));
+        while (!started)
+        {
+            wal.wait(wal.append("test", record.data(), record.size()));
+        }
+
+        // The checkpoint is stuck, but commits still go through.
+        for (int i = 0; i < 4; ++i)
+        {
+            uint64_t lsn = wal.append("test", record.data(), record.size());
+            wal.wait(lsn);
+            TEST_ASSERT(wal.durable() >= lsn);
+        }
+        TEST_ASSERT(0 == access((dir + "/00000000.wal").c_str(), F_OK));
+        TEST_ASSERT(0 == access((dir + "/00000001.wal").c_str(), F_OK));
+
+        release = true;
+        for (int i = 0;
+                i < 1000 && 0 == access((dir + "/00000000.wal").c_str(), F_OK);
+                ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        TEST_ASSERT(0 != access((dir + "/00000000.wal").c_str(), F_OK));
+        TEST_ASSERT(0 == access((dir + "/00000001.wal").c_str(), F_OK));
+    }
+    remove_directory(dir);
+}
+
+void testReplay()
+{
+    std::string dir(make_temp_directory("WalTest"));
+    {
+        logjam::storage::Wal wal(dir,
+                std::chrono::milliseconds(0),
+                1,
+                []() {});
+        std::vector<uint8_t> first(make_record("first"));
+        std::vector<uint8_t> second(make_record("second"));
+        wal.append("one", first.data(), first.size());
+        wal.wait(wal.append("two", second.data(), second.size()));
+    }
+
+    // Simulate a torn write at the end of the log.
+    int fd = ::open((dir + "/00000000.wal").c_str(), O_WRONLY | O_APPEND);
+    TEST_ASSERT(fd >= 0);
+    uint32_t partial[3] = {100, 0, 0};
+    TEST_ASSERT(sizeof(partial) == ::write(fd, partial, sizeof(partial)));
+    ::close(fd);
+
+    {
+        logjam::storage::Wal wal(dir,
+                std::chrono::milliseconds(0),
+                1,
+                []() {});
+        std::vector<std::string> collections;
+        std::vector<std::string> values;
+        size_t count = wal.replay([&collections, &values](const std::string& name,
+                const uint8_t* bytes) {
+            lj::bson::Node node(lj::bson::Type::k_document, bytes);
+            collections.push_back(name);
+            values.push_back(lj::bson::as_string(node["value"]));
+        });
+        TEST_ASSERT(count == 2);
+        TEST_ASSERT(collections[0].compare("one") == 0);
+        TEST_ASSERT(values[0].compare("first") == 0);
+        TEST_ASSERT(collections[1].compare("two") == 0);
+        TEST_ASSERT(values[1].compare("second") == 0);
+
+        wal.checkpoint();
+        TEST_ASSERT(0 != access((dir + "/00000000.wal").c_str(), F_OK));
+    }
+    {
+        logjam::storage::Wal wal(dir,
+                std::chrono::milliseconds(0),
+                1,
+                []() {});
+        TEST_ASSERT(wal.replay([](const std::string&, const uint8_t*) {}) == 0);
+    }
+    remove_directory(dir);
+}
+
+int main(int argc, char** argv)
+{
+    return Test_util::runner("logjam::storage::Wal", tests);
+}
@@ -32,6 +32,8 @@
 
 #include "testhelper.h"
 #include "lj/Bson.h"
+#include "lj/Bson_decoder.h"
+#include "lj/Exception.h"
 #include "logjamd/mock_server.h"
 #include "logjamd/Stage_http_adapt.h"
 #include "logjamd/Stage_pre.h"
@@ -139,6 +141,137 @@ void testHttpPostInsecure()
     TEST_ASSERT(lj::bson::as_boolean(result["success"]));
 }
 
+namespace
+{
+    std::string http_get_etag(const std::string& path)
+    {
+        Mock_env env;
+        env.swimmer->sink() << "get " << path << " HTTP/1.0\r\n";
+        env.swimmer->sink() << "Host: localhost:12345\r\n";
+        env.swimmer->sink() << "\r\n";
+
+        std::unique_ptr<logjam::Stage> next_stage(
+                new logjamd::Stage_pre());
+        next_stage = logjam::safe_execute_stage(next_stage, *(env.swimmer));
+        next_stage = logjam::safe_execute_stage(next_stage, *(env.swimmer));
+
+        std::ostringstream oss;
+        oss << env.swimmer->source().rdbuf();
+        std::string headers(oss.str());
+        headers.erase(headers.find("\r\n\r\n"));
+        const std::string key("ETag: ");
+        size_t start = headers.find(key);
+        if (std::string::npos == start)
+        {
+            return std::string();
+        }
+        start += key.size();
+        return headers.substr(start, headers.find("\r\n", start) - start);
+    }
+};
+
+void testHttpEtag()
+{
+    // Identical requests get the same ETag even though the elapsed time
+    // in the response differs.
+    std::string first(http_get_etag("/print('Hello, world')"));
+    std::string second(http_get_etag("/print('Hello, world')"));
+    std::string other(http_get_etag("/print('Goodbye, world')"));
+    TEST_ASSERT(!first.empty());
+    TEST_ASSERT(0 == first.compare(second));
+    TEST_ASSERT(0 != first.compare(other));
+}
+
+namespace
+{
+    // Feed a request to ready() one byte at a time, the way a slow client
+    // would, and return how many bytes it took.
+    size_t bytes_until_ready(const std::string& request,
+            lj::bson::Decoder& decoder)
+    {
+        logjamd::Stage_http_adapt adapter;
+        for (size_t h = 1; h <= request.size(); ++h)
+        {
+            if (adapter.ready(request.data(), h, decoder))
+            {
+                return h;
+            }
+        }
+        return 0;
+    }
+
+    bool rejected(const std::string& request, size_t max_frame_size)
+    {
+        logjamd::Stage_http_adapt adapter;
+        lj::bson::Decoder decoder(max_frame_size);
+        try
+        {
+            adapter.ready(request.data(), request.size(), decoder);
+        }
+        catch (const lj::Exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+};
+
+void testReady()
+{
+    const std::string headers("put / HTTP/1.0\r\nHost: x\r\ncontent-length:  5\r\n\r\n");
+    const std::string request(headers + "hello");
+    lj::bson::Decoder decoder;
+    TEST_ASSERT(request.size() == bytes_until_ready(request, decoder));
+    TEST_ASSERT(request.size() == decoder.frame_size());
+
+    // A bare newline also ends the headers, and no length means no body.
+    decoder.reset();
+    const std::string bare("get / HTTP/1.0\nHost: x\n\nextra");
+    TEST_ASSERT(bare.find("extra") == bytes_until_ready(bare, decoder));
+
+    // The scan resumes where it stopped instead of starting over.
+    decoder.reset();
+    logjamd::Stage_http_adapt adapter;
+    const std::string partial("get / HTTP/1.0\r\nHost: x\r\n\r");
+    TEST_ASSERT(!adapter.ready(partial.data(), partial.size(), decoder));
+    TEST_ASSERT(partial.size() - 2 == decoder.position());
+    TEST_ASSERT(adapter.ready((partial + "\n").data(), partial.size() + 1, decoder));
+}
+
+void testReadyRejects()
+{
+    const std::string start("put / HTTP/1.0\r\n");
+    TEST_ASSERT(rejected(start + "Content-Length: -5\r\n\r\n", 1024));
+    TEST_ASSERT(rejected(start + "Content-Length: 12abc\r\n\r\n", 1024));
+    TEST_ASSERT(rejected(start + "Content-Length:\r\n\r\n", 1024));
+    TEST_ASSERT(rejected(start + "Content-Length: 99999999999999999999999\r\n\r\n", 1024));
+    TEST_ASSERT(rejected(start + "Content-Length: 1\r\nContent-Length: 2\r\n\r\n", 1024));
+    TEST_ASSERT(rejected(start + "Content-Length: 2000\r\n\r\n", 1024));
+    TEST_ASSERT(rejected(start + "X-Padding: " + std::string(2000, 'x'), 1024));
+
+    // The name only counts at the start of a line.
+    TEST_ASSERT(!rejected(start + "X-Note: Content-Length: -5\r\n\r\n", 1024));
+    TEST_ASSERT(!rejected(start + "Content-Length: 1\r\nContent-Length: 1\r\n\r\n", 1024));
+}
+
+void testHttpPostBadLength()
+{
+    Mock_env env;
+    env.swimmer->sink() << "post / HTTP/1.0\r\n";
+    env.swimmer->sink() << "Content-Length: -1\r\n";
+    env.swimmer->sink() << "\r\n";
+
+    std::unique_ptr<logjam::Stage> next_stage(
+            new logjamd::Stage_pre());
+    next_stage = logjam::safe_execute_stage(next_stage, *(env.swimmer));
+    next_stage = logjam::safe_execute_stage(next_stage, *(env.swimmer));
+    TEST_ASSERT(next_stage == NULL);
+
+    std::ostringstream oss;
+    oss << env.swimmer->source().rdbuf();
+    TEST_ASSERT(0 == oss.str().find("HTTP/1.0 500"));
+}
+
 int main(int argc, char** argv)
 {
     Mock_server_init ctx;
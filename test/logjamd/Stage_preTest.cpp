@@ -91,6 +91,38 @@ void testUnknown()
     TEST_ASSERT(next_stage == NULL);
 }
 
+void testPeerRefused()
+{
+    // Without a replication secret, peer mode is refused.
+    Mock_env env;
+    env.swimmer->sink() << "peer\n";
+
+    // perform the stage.
+    std::unique_ptr<logjam::Stage> next_stage(
+            new logjamd::Stage_pre());
+    next_stage = logjam::safe_execute_stage(next_stage, *(env.swimmer));
+
+    // Test the result.
+    lj::bson::Node response;
+    env.swimmer->source() >> response;
+    TEST_ASSERT(!lj::bson::as_boolean(response["success"]));
+    TEST_ASSERT(next_stage == nullptr);
+}
+
+void testReady()
+{
+    logjamd::Stage_pre stage;
+
+    // Needs the whole mode before it can run.
+    TEST_ASSERT(!stage.ready("bso", 3));
+    TEST_ASSERT(stage.ready("bson\n", 5));
+    TEST_ASSERT(stage.ready("GET /", 5));
+
+    // Post mode consumes the leading slash as well.
+    TEST_ASSERT(!stage.ready("POST ", 5));
+    TEST_ASSERT(stage.ready("POST /", 6));
+}
+
 int main(int argc, char** argv)
 {
     Mock_server_init ctx;
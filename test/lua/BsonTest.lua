@@ -106,3 +106,23 @@ obj4 = Bson_ro:new(obj4)
 ASSERT(tostring(obj4) ~= expected)
 obj5 = Bson:new('{"foo":"testing","bar":100}')
 ASSERT(obj5:as_string() == '{"bar":100, "foo":"testing"}')
+
+-- test the date/time and other bson types
+obj6 = Bson:new()
+obj6:set_datetime("when", 1400000000123)
+obj6:set_timestamp("ts", 42)
+obj6:set_regex("re", "^a.*b$", "i")
+obj6:set_javascript("js", "function() { return 1; }")
+ASSERT(obj6.when:type() == 'datetime')
+ASSERT(obj6.when:as_number() == 1400000000123)
+ASSERT(obj6.when:as_string() == '2014-05-13T16:53:20.123Z')
+ASSERT(obj6.ts:type() == 'timestamp')
+ASSERT(obj6.ts:as_number() == 42)
+ASSERT(obj6.re:type() == 'regex')
+ASSERT(obj6.re:as_string() == '/^a.*b$/i')
+ASSERT(obj6.js:type() == 'javascript')
+ASSERT(obj6.js:as_string() == 'function() { return 1; }')
+obj7 = Bson:new(tostring(obj6))
+ASSERT(obj7.when:type() == 'datetime')
+ASSERT(obj7.re:as_string() == '/^a.*b$/i')
+ASSERT(obj7.js:type() == 'javascript')
@@ -0,0 +1,85 @@
+#pragma once
+/*!
+ \file test/storagehelper.h
+ Copyright (c) 2014, Jason Watson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ * Neither the name of the LogJammin nor the names of its contributors
+ may be used to endorse or promote products derived from this software
+ without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "testhelper.h"
+#include "lj/Bson.h"
+#include "lj/Document.h"
+#include "lj/Uuid.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ftw.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+//! Create an empty directory under /tmp named after the suite.
+inline std::string make_temp_directory(const std::string& suite)
+{
+    std::string pattern("/tmp/" + suite + ".XXXXXX");
+    std::vector<char> buffer(pattern.begin(), pattern.end());
+    buffer.push_back('\0');
+    TEST_ASSERT(nullptr != mkdtemp(buffer.data()));
+    return std::string(buffer.data());
+}
+
+namespace storage_helper
+{
+    inline int remove_entry(const char* path,
+            const struct stat* sb,
+            int type,
+            struct FTW* ftw)
+    {
+        return ::remove(path);
+    }
+}; // namespace storage_helper
+
+//! Remove a directory and everything in it.
+inline void remove_directory(const std::string& path)
+{
+    // Depth first, so directories are empty by the time they are removed.
+    TEST_ASSERT(0 == nftw(path.c_str(),
+            &storage_helper::remove_entry,
+            16,
+            FTW_DEPTH | FTW_PHYS));
+}
+
+//! Create a document with a key and a name field.
+inline lj::Document* make_document(uint64_t key, const std::string& name)
+{
+    lj::Document* doc = new lj::Document();
+    doc->rekey(lj::Uuid::k_nil, key);
+    doc->set(lj::Uuid::k_nil, "name", lj::bson::new_string(name));
+    return doc;
+}